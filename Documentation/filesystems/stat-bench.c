@@ -0,0 +1,216 @@
+/*
+ * stat-bench.c - stat() storm on deep paths, from 1 to N processes
+ *
+ * Builds a chain of nested directories, then has 1, 2, ... N processes
+ * stat() the file at the bottom of it in a loop for a few seconds each
+ * and reports the total and per-process rate.  Every stat() walks all
+ * the components of the path through the dentry cache, so this shows
+ * how well path lookup scales with the number of CPUs:
+ *
+ *	gcc -O2 -o stat-bench stat-bench.c
+ *	./stat-bench [-p procs] [-d depth] [-t seconds] [dir]
+ *
+ * procs defaults to the number of online CPUs, depth to 12 and seconds
+ * to 5.  The directories are made under dir (default /tmp) and removed
+ * again afterwards.  With a single dcache_lock the per-process rate
+ * drops as processes are added; with the lock-free d_lookup() it
+ * should stay roughly flat up to the number of CPUs.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static volatile sig_atomic_t stop;
+
+static void alarm_handler(int sig)
+{
+	stop = 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p procs] [-d depth] [-t seconds] [dir]\n",
+		prog);
+	exit(1);
+}
+
+/* Components of the chain are a short name each, d0/d1/... */
+static char *make_path(const char *dir, int depth, int upto)
+{
+	char *path = malloc(strlen(dir) + depth * 8 + 32);
+	char *p;
+	int i;
+
+	if (path == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	p = path + sprintf(path, "%s/stat-bench.%d", dir, (int)getpid());
+	for (i = 0; i < upto; i++)
+		p += sprintf(p, "/d%d", i);
+	return path;
+}
+
+static void build(const char *dir, int depth)
+{
+	char *path;
+	int i, fd;
+
+	for (i = -1; i < depth; i++) {
+		path = make_path(dir, depth, i + 1);
+		if (mkdir(path, 0755) < 0) {
+			perror(path);
+			exit(1);
+		}
+		free(path);
+	}
+	path = make_path(dir, depth, depth);
+	strcat(path, "/file");
+	fd = creat(path, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+	free(path);
+}
+
+static void destroy(const char *dir, int depth)
+{
+	char *path;
+	int i;
+
+	path = make_path(dir, depth, depth);
+	strcat(path, "/file");
+	unlink(path);
+	free(path);
+	for (i = depth; i >= 0; i--) {
+		path = make_path(dir, depth, i);
+		rmdir(path);
+		free(path);
+	}
+}
+
+/*
+ * Child: stat() until the alarm, then write the count to fd.  It
+ * leaves with _exit() so as not to flush the parent's stdio buffers.
+ */
+static void child(const char *file, int seconds, int fd)
+{
+	struct stat st;
+	unsigned long count = 0;
+
+	signal(SIGALRM, alarm_handler);
+	alarm(seconds);
+	while (!stop) {
+		if (stat(file, &st) < 0) {
+			perror(file);
+			_exit(1);
+		}
+		count++;
+	}
+	if (write(fd, &count, sizeof(count)) != sizeof(count))
+		_exit(1);
+	_exit(0);
+}
+
+/* One round with procs processes; returns the total stat()s per second */
+static double run(const char *file, int procs, int seconds)
+{
+	unsigned long count, total = 0;
+	int fds[2], i, status, failed = 0;
+
+	fflush(stdout);
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(1);
+	}
+	for (i = 0; i < procs; i++) {
+		switch (fork()) {
+		case -1:
+			perror("fork");
+			exit(1);
+		case 0:
+			close(fds[0]);
+			child(file, seconds, fds[1]);
+		}
+	}
+	close(fds[1]);
+	for (i = 0; i < procs; i++) {
+		if (read(fds[0], &count, sizeof(count)) != sizeof(count))
+			break;
+		total += count;
+	}
+	close(fds[0]);
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	if (failed || i < procs) {
+		fprintf(stderr, "a child failed\n");
+		return -1;
+	}
+	return (double)total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "/tmp";
+	int procs = sysconf(_SC_NPROCESSORS_ONLN);
+	int depth = 12, seconds = 5;
+	double rate, base = 0;
+	char *file;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "p:d:t:")) != -1) {
+		switch (opt) {
+		case 'p':
+			procs = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		dir = argv[optind++];
+	if (optind < argc || procs < 1 || depth < 0 || seconds < 1)
+		usage(argv[0]);
+
+	build(dir, depth);
+	file = make_path(dir, depth, depth);
+	strcat(file, "/file");
+
+	printf("%d directories deep, %d s per round\n", depth, seconds);
+	printf("procs      stat/s   per proc  scaling\n");
+	for (n = 1; n <= procs; n++) {
+		rate = run(file, n, seconds);
+		if (rate < 0)
+			break;
+		if (n == 1)
+			base = rate;
+		printf("%5d %11.0f %10.0f %7.2fx\n", n, rate, rate / n,
+		       base > 0 ? rate / base : 0);
+		fflush(stdout);
+	}
+
+	free(file);
+	destroy(dir, depth);
+	return n > procs ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#!/bin/sh
+#
+# htb-bench.sh - per-subscriber HTB shaping benchmark
+#
+# Builds an HTB tree with one leaf class per subscriber address (20000
+# by default) on the loopback device, floods a spread of those
+# addresses, and reports what the tree cost to build and what the
+# traffic cost to classify and dequeue.  Run it once with the u32 hash
+# table setup usually used for this and once with cls_iphash to
+# compare the two:
+#
+#	htb-bench.sh [-c classes] [-f u32|iphash] [-s streams] [-t seconds]
+#		     [-d dev]
+#
+# The subscribers are 10.64.0.0/14, made local so that the traffic
+# loops back through the qdisc of the device; no network namespaces or
+# second machine are needed.  ping -f supplies the packets.  Run it as
+# root on an otherwise idle machine; everything it adds is removed
+# again on exit.
+#
+# -f iphash needs a tc which knows the iphash filter.  With an
+# iproute2 recent enough for "tc -batch" the tree is built in one
+# go, with older ones one tc call per class and filter (slow).
+
+CLASSES=20000
+FILTER=u32
+STREAMS=64
+DURATION=10
+DEV=lo
+
+usage()
+{
+	echo "usage: $0 [-c classes] [-f u32|iphash] [-s streams] [-t seconds] [-d dev]" >&2
+	exit 1
+}
+
+while getopts c:f:s:t:d: opt; do
+	case $opt in
+	c)	CLASSES=$OPTARG ;;
+	f)	FILTER=$OPTARG ;;
+	s)	STREAMS=$OPTARG ;;
+	t)	DURATION=$OPTARG ;;
+	d)	DEV=$OPTARG ;;
+	*)	usage ;;
+	esac
+done
+
+case $FILTER in
+u32|iphash)	;;
+*)		usage ;;
+esac
+
+# Minor class ids 0x10 up must fit in 16 bits
+if [ "$CLASSES" -lt 1 ] || [ "$CLASSES" -gt 65000 ]; then
+	echo "$0: classes must be between 1 and 65000" >&2
+	exit 1
+fi
+
+BATCH=/tmp/htb-bench.$$
+
+cleanup()
+{
+	kill $PINGS 2>/dev/null
+	wait 2>/dev/null
+	tc qdisc del dev $DEV root 2>/dev/null
+	ip route del local 10.64.0.0/14 dev $DEV table local 2>/dev/null
+	rm -f $BATCH
+}
+trap cleanup EXIT INT TERM
+
+# Address and class id of subscriber $1
+addr()
+{
+	echo "10.$((64 + ($1 >> 16))).$((($1 >> 8) & 255)).$(($1 & 255))"
+}
+
+minor()
+{
+	printf "%x" $(($1 + 16))
+}
+
+# Kernel and total jiffies so far, from the cpu line of /proc/stat
+cpu_times()
+{
+	awk '/^cpu / { k = $4 + $7 + $8; t = 0;
+		       for (i = 2; i <= NF; i++) t += $i;
+		       print k, t }' /proc/stat
+}
+
+# Packets through the root qdisc so far
+qdisc_packets()
+{
+	tc -s qdisc show dev $DEV | awk '/Sent/ { print $4; exit }'
+}
+
+tc qdisc del dev $DEV root 2>/dev/null
+ip route add local 10.64.0.0/14 dev $DEV table local || exit 1
+
+# Write the whole tree as tc commands, one per line
+{
+	echo "qdisc add dev $DEV root handle 1: htb default 1"
+	echo "class add dev $DEV parent 1: classid 1:1 htb rate 1000mbit"
+
+	if [ $FILTER = u32 ]; then
+		# 256 buckets on the last octet of the destination
+		echo "filter add dev $DEV parent 1: prio 1 handle 2: protocol ip u32 divisor 256"
+		echo "filter add dev $DEV parent 1: prio 1 protocol ip u32 ht 800:: match ip dst 10.64.0.0/14 hashkey mask 0x000000ff at 16 link 2:"
+	fi
+
+	i=0
+	while [ $i -lt $CLASSES ]; do
+		a=$(addr $i)
+		m=$(minor $i)
+		echo "class add dev $DEV parent 1:1 classid 1:$m htb rate 100kbit ceil 1000mbit"
+		if [ $FILTER = u32 ]; then
+			echo "filter add dev $DEV parent 1: prio 1 protocol ip u32 ht 2:$(printf %x $(($i & 255))): match ip dst $a classid 1:$m"
+		else
+			echo "filter add dev $DEV parent 1: prio 1 protocol ip handle $a iphash classid 1:$m"
+		fi
+		i=$(($i + 1))
+	done
+} > $BATCH
+
+echo "building $CLASSES classes with $FILTER filters on $DEV"
+start=$(date +%s)
+if tc -batch /dev/null 2>/dev/null; then
+	tc -batch $BATCH || exit 1
+else
+	while read cmd; do
+		tc $cmd || exit 1
+	done < $BATCH
+fi
+end=$(date +%s)
+echo "built in $(($end - $start)) s"
+
+# Flood addresses spread evenly over the classes
+PINGS=
+i=0
+while [ $i -lt $STREAMS ]; do
+	ping -f -q -w $DURATION $(addr $(($i * $CLASSES / $STREAMS))) >/dev/null 2>&1 &
+	PINGS="$PINGS $!"
+	i=$(($i + 1))
+done
+
+set -- $(cpu_times)
+k0=$1 t0=$2
+p0=$(qdisc_packets)
+sleep $DURATION
+set -- $(cpu_times)
+k1=$1 t1=$2
+p1=$(qdisc_packets)
+
+echo "$((($p1 - $p0) / $DURATION)) packets/s through the qdisc," \
+     "$((100 * ($k1 - $k0) / ($t1 - $t0)))% of CPU time in the kernel"
@@ -155,6 +155,7 @@ void free_pgd_slow(pgd_t *pgd)
 
 	pte = pte_offset(pmd, 0);
 	pmd_clear(pmd);
+	pgtable_remove_rmap(pte);
 	pte_free(pte);
 	pmd_free(pmd);
 free:
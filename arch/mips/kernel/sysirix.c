@@ -107,7 +107,7 @@ asmlinkage int irix_prctl(struct pt_regs *regs)
 		task = find_task_by_pid(regs->regs[base + 5]);
 		error = -ESRCH;
 		if (error)
-			error = (task->run_list.next != NULL);
+			error = task_on_runqueue(task);
 		read_unlock(&tasklist_lock);
 		/* Can _your_ OS find this out that fast? */
 		break;
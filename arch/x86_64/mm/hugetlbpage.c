@@ -0,0 +1,339 @@
+/*
+ * x86-64 huge TLB page support.
+ *
+ * Huge pages are 2MB pages mapped by a pmd entry with _PAGE_PSE set.
+ * All of them come from a pool that is filled at boot ("hugepages=")
+ * or through /proc/sys/vm/nr_hugepages.
+ *
+ * Pages in the pool are marked reserved, so the generic mm never
+ * frees them: references taken by get_user_pages() and friends are
+ * harmless.  A page handed out by alloc_huge_page() belongs to the
+ * hugetlbfs file it was allocated for until free_huge_page().
+ */
+
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/sysctl.h>
+#include <linux/hugetlb.h>
+#include <linux/rmap.h>
+
+#include <asm/pgalloc.h>
+
+int htlbpage_max;			/* vm.nr_hugepages */
+static long htlbzone_pages;		/* pages in the pool */
+static long htlbpagemem;		/* ... of which are free */
+static LIST_HEAD(htlbpage_freelist);
+static spinlock_t htlbpage_lock = SPIN_LOCK_UNLOCKED;
+static DECLARE_MUTEX(htlbpage_sem);	/* serialises pool resizing */
+
+#define HPAGE_NR_PAGES	(HPAGE_SIZE / PAGE_SIZE)
+
+struct page *alloc_huge_page(void)
+{
+	struct page *page;
+	int i;
+
+	spin_lock(&htlbpage_lock);
+	if (list_empty(&htlbpage_freelist)) {
+		spin_unlock(&htlbpage_lock);
+		return NULL;
+	}
+	page = list_entry(htlbpage_freelist.next, struct page, list);
+	list_del(&page->list);
+	htlbpagemem--;
+	spin_unlock(&htlbpage_lock);
+
+	for (i = 0; i < HPAGE_NR_PAGES; i++)
+		clear_highpage(page + i);
+	return page;
+}
+
+void free_huge_page(struct page *page)
+{
+	spin_lock(&htlbpage_lock);
+	list_add(&page->list, &htlbpage_freelist);
+	htlbpagemem++;
+	spin_unlock(&htlbpage_lock);
+}
+
+int is_hugepage_mem_enough(size_t size)
+{
+	return (size + ~HPAGE_MASK) / HPAGE_SIZE <= htlbpagemem;
+}
+
+static struct page *alloc_fresh_huge_page(void)
+{
+	struct page *page;
+	int i;
+
+	page = alloc_pages(GFP_HIGHUSER, HUGETLB_PAGE_ORDER);
+	if (!page)
+		return NULL;
+	for (i = 0; i < HPAGE_NR_PAGES; i++) {
+		SetPageReserved(page + i);
+		set_page_count(page + i, 1);
+	}
+	return page;
+}
+
+static void release_huge_page(struct page *page)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_NR_PAGES; i++) {
+		ClearPageReserved(page + i);
+		set_page_count(page + i, 0);
+	}
+	set_page_count(page, 1);
+	__free_pages(page, HUGETLB_PAGE_ORDER);
+}
+
+/*
+ * Grow or shrink the pool towards count pages.  Only free pages can be
+ * given back, so the pool may stay larger than asked for.
+ */
+static int set_hugetlb_mem_size(int count)
+{
+	struct page *page;
+
+	down(&htlbpage_sem);
+	while (count > htlbzone_pages) {
+		page = alloc_fresh_huge_page();
+		if (!page)
+			break;
+		spin_lock(&htlbpage_lock);
+		list_add(&page->list, &htlbpage_freelist);
+		htlbpagemem++;
+		htlbzone_pages++;
+		spin_unlock(&htlbpage_lock);
+	}
+	while (count < htlbzone_pages) {
+		spin_lock(&htlbpage_lock);
+		if (list_empty(&htlbpage_freelist)) {
+			spin_unlock(&htlbpage_lock);
+			break;
+		}
+		page = list_entry(htlbpage_freelist.next, struct page, list);
+		list_del(&page->list);
+		htlbpagemem--;
+		htlbzone_pages--;
+		spin_unlock(&htlbpage_lock);
+		release_huge_page(page);
+	}
+	count = htlbzone_pages;
+	up(&htlbpage_sem);
+	return count;
+}
+
+int hugetlb_sysctl_handler(ctl_table *table, int write, struct file *file,
+			   void *buffer, size_t *length)
+{
+	int ret;
+
+	ret = proc_dointvec(table, write, file, buffer, length);
+	if (!ret && write)
+		htlbpage_max = set_hugetlb_mem_size(htlbpage_max);
+	return ret;
+}
+
+static int __init hugetlb_setup(char *s)
+{
+	if (sscanf(s, "%d", &htlbpage_max) <= 0)
+		htlbpage_max = 0;
+	return 1;
+}
+__setup("hugepages=", hugetlb_setup);
+
+static int __init hugetlb_init(void)
+{
+	if (htlbpage_max > 0) {
+		htlbpage_max = set_hugetlb_mem_size(htlbpage_max);
+		printk(KERN_INFO "Total HugeTLB memory allocated, %ld\n",
+		       htlbzone_pages);
+	}
+	return 0;
+}
+__initcall(hugetlb_init);
+
+int hugetlb_report_meminfo(char *buf)
+{
+	return sprintf(buf,
+			"HugePages_Total: %5lu\n"
+			"HugePages_Free:  %5lu\n"
+			"Hugepagesize:    %5lu kB\n",
+			htlbzone_pages,
+			htlbpagemem,
+			HPAGE_SIZE / 1024);
+}
+
+/* A huge page is mapped by the pmd, which has the size of a pte */
+static pte_t *huge_pte_alloc(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd = pgd_offset(mm, addr);
+
+	return (pte_t *) pmd_alloc(mm, pgd, addr);
+}
+
+static pte_t *huge_pte_offset(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd = pgd_offset(mm, addr);
+
+	if (pgd_none(*pgd))
+		return NULL;
+	return (pte_t *) pmd_offset(pgd, addr);
+}
+
+/*
+ * munmap() leaves the page tables of an unmapped range behind unless
+ * they fall into a gap between two vmas, so the pmd a new huge page
+ * goes into may still point to an (empty) page table.
+ */
+static void free_stale_pte_table(pmd_t *pmd)
+{
+	pte_t *pte;
+
+	if (pmd_none(*pmd) || (pmd_val(*pmd) & _PAGE_PSE))
+		return;
+	pte = pte_offset(pmd, 0);
+	pmd_clear(pmd);
+	pgtable_remove_rmap(pte);
+	pte_free(pte);
+}
+
+static void set_huge_pte(struct mm_struct *mm, struct vm_area_struct *vma,
+			 struct page *page, pte_t *ptep)
+{
+	pte_t entry;
+
+	entry = pte_mkyoung(mk_pte(page, vma->vm_page_prot));
+	if (vma->vm_flags & VM_WRITE)
+		entry = pte_mkwrite(pte_mkdirty(entry));
+	entry = __pte(pte_val(entry) | _PAGE_PSE);
+	set_pte(ptep, entry);
+	mm->rss += HPAGE_NR_PAGES;
+}
+
+/*
+ * Map the huge pages backing a new vma, pages[0] going at vm_start.
+ * Called from the hugetlbfs mmap method with the mmap_sem held.
+ */
+int hugetlb_prefault(struct vm_area_struct *vma, struct page **pages)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr;
+	pte_t *ptep;
+	int ret = 0;
+
+	spin_lock(&mm->page_table_lock);
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += HPAGE_SIZE) {
+		ptep = huge_pte_alloc(mm, addr);
+		if (!ptep) {
+			ret = -ENOMEM;
+			break;
+		}
+		free_stale_pte_table((pmd_t *) ptep);
+		if (pte_none(*ptep))
+			set_huge_pte(mm, vma, *pages, ptep);
+		pages++;
+	}
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/* Called by fork with dst->page_table_lock held */
+int copy_hugetlb_page_range(struct mm_struct *dst, struct mm_struct *src,
+			    struct vm_area_struct *vma)
+{
+	pte_t *src_pte, *dst_pte;
+	unsigned long addr;
+
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += HPAGE_SIZE) {
+		dst_pte = huge_pte_alloc(dst, addr);
+		if (!dst_pte)
+			return -ENOMEM;
+		spin_lock(&src->page_table_lock);
+		src_pte = huge_pte_offset(src, addr);
+		if (src_pte && !pte_none(*src_pte)) {
+			set_pte(dst_pte, *src_pte);
+			dst->rss += HPAGE_NR_PAGES;
+		}
+		spin_unlock(&src->page_table_lock);
+	}
+	return 0;
+}
+
+/*
+ * get_user_pages() for a hugetlb vma.  Returns the updated page count,
+ * or -EFAULT if the very first page has been truncated away.
+ */
+int follow_hugetlb_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			struct page **pages, struct vm_area_struct **vmas,
+			unsigned long *st, int *length, int i)
+{
+	unsigned long start = *st;
+	int len = *length;
+	struct page *page;
+	pte_t *ptep;
+
+	spin_lock(&mm->page_table_lock);
+	while (len && start < vma->vm_end) {
+		ptep = huge_pte_offset(mm, start);
+		if (!ptep || pte_none(*ptep)) {
+			len = 0;
+			if (!i)
+				i = -EFAULT;
+			break;
+		}
+		if (pages) {
+			page = pte_page(*ptep) +
+			       ((start & ~HPAGE_MASK) >> PAGE_SHIFT);
+			page_cache_get(page);
+			pages[i] = page;
+		}
+		if (vmas)
+			vmas[i] = vma;
+		i++;
+		start += PAGE_SIZE;
+		len--;
+	}
+	spin_unlock(&mm->page_table_lock);
+
+	*st = start;
+	*length = len;
+	return i;
+}
+
+/*
+ * Unmap part of a hugetlb vma.  The pages themselves stay with the
+ * file they belong to.
+ */
+void zap_hugepage_range(struct vm_area_struct *vma, unsigned long start,
+			unsigned long length)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr, end = start + length;
+	unsigned long freed = 0;
+	pte_t *ptep;
+
+	if ((start | length) & ~HPAGE_MASK)
+		BUG();
+
+	spin_lock(&mm->page_table_lock);
+	flush_cache_range(mm, start, end);
+	for (addr = start; addr < end; addr += HPAGE_SIZE) {
+		ptep = huge_pte_offset(mm, addr);
+		if (!ptep || pte_none(*ptep))
+			continue;
+		pte_clear(ptep);
+		freed += HPAGE_NR_PAGES;
+	}
+	flush_tlb_range(mm, start, end);
+	if (mm->rss > freed)
+		mm->rss -= freed;
+	else
+		mm->rss = 0;
+	spin_unlock(&mm->page_table_lock);
+}
@@ -1510,6 +1510,7 @@ void cleanup_module(void)
 		outw (0, mfm_irqenable);	/* Required to enable IRQs from MFM podule */
 	free_irq(mfm_irq, NULL);
 	unregister_blkdev(MAJOR_NR, "mfm");
+	blk_cleanup_queue(BLK_DEFAULT_QUEUE(MAJOR_NR));
 	del_gendisk(&mfm_gendisk);
 	if (ecs)
 		ecard_release(ecs);
@@ -521,14 +521,14 @@ static int cciss_ioctl(struct inode *inode, struct file *filep,
 //			printk("cciss_ioctl: delay and count cannot be 0\n");
 			return( -EINVAL);
 		}
-		spin_lock_irqsave(&io_request_lock, flags);
+		spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
 		/* Can only safely update if no commands outstanding */ 
 		if (c->commands_outstanding > 0 )
 		{
 //			printk("cciss_ioctl: cannot change coalasing "
 //				"%d commands outstanding on controller\n", 
 //					c->commands_outstanding);
-			spin_unlock_irqrestore(&io_request_lock, flags);
+			spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 			return(-EINVAL);
 		}
 		/* Update the field, and then ring the doorbell */ 
@@ -546,7 +546,7 @@ static int cciss_ioctl(struct inode *inode, struct file *filep,
 			/* delay and try again */
 			udelay(1000);
 		}	
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 		if (i >= MAX_CONFIG_WAIT)
 			return( -EFAULT);
                 return(0);
@@ -577,7 +577,7 @@ static int cciss_ioctl(struct inode *inode, struct file *filep,
 		if (copy_from_user(NodeName, (void *) arg, sizeof( NodeName_type)))
 			return -EFAULT;
 
-		spin_lock_irqsave(&io_request_lock, flags);
+		spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
 
 			/* Update the field, and then ring the doorbell */ 
 		for(i=0;i<16;i++)
@@ -593,7 +593,7 @@ static int cciss_ioctl(struct inode *inode, struct file *filep,
 			/* delay and try again */
 			udelay(1000);
 		}	
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 		if (i >= MAX_CONFIG_WAIT)
 			return( -EFAULT);
                 return(0);
@@ -742,11 +742,11 @@ static int cciss_ioctl(struct inode *inode, struct file *filep,
 		c->waiting = &wait;
 
 		/* Put the request on the tail of the request queue */
-		spin_lock_irqsave(&io_request_lock, flags);
+		spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
 		addQ(&h->reqQ, c);
 		h->Qdepth++;
 		start_io(h);
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 
 		wait_for_completion(&wait);
 
@@ -800,16 +800,16 @@ static int revalidate_logvol(kdev_t dev, int maxusage)
         ctlr = MAJOR(dev) - MAJOR_NR;
         gdev = &(hba[ctlr]->gendisk);
 
-        spin_lock_irqsave(&io_request_lock, flags);
+        spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
         if (hba[ctlr]->drv[target].usage_count > maxusage) {
-                spin_unlock_irqrestore(&io_request_lock, flags);
+                spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
                 printk(KERN_WARNING "cciss: Device busy for "
                         "revalidation (usage=%d)\n",
                         hba[ctlr]->drv[target].usage_count);
                 return -EBUSY;
         }
         hba[ctlr]->drv[target].usage_count++;
-        spin_unlock_irqrestore(&io_request_lock, flags);
+        spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 
         max_p = gdev->max_p;
         start = target << gdev->minor_shift;
@@ -1321,7 +1321,7 @@ static int cpq_merge_requests_fn(request_queue_t *q, struct request *rq,
  * Get a request and submit it to the controller. 
  * Currently we do one request at a time.  Ideally we would like to send
  * everything to the controller on the first call, but there is a danger
- * of holding the io_request_lock for to long.  
+ * of holding the controller lock for to long.  
  */
 static void do_cciss_request(request_queue_t *q)
 {
@@ -1362,7 +1362,7 @@ next:
 
 	blkdev_dequeue_request(creq);
 
-	spin_unlock_irq(&io_request_lock);
+	spin_unlock_irq(CCISS_LOCK(h->ctlr));
 
 	c->cmd_type = CMD_RWREQ;      
 	c->rq = creq;
@@ -1441,7 +1441,7 @@ next:
 	c->Request.CDB[8]= creq->nr_sectors & 0xff; 
 	c->Request.CDB[9] = c->Request.CDB[11] = c->Request.CDB[12] = 0;
 
-	spin_lock_irq(&io_request_lock);
+	spin_lock_irq(CCISS_LOCK(h->ctlr));
 
 	addQ(&(h->reqQ),c);
 	h->Qdepth++;
@@ -1470,7 +1470,7 @@ static void do_cciss_intr(int irq, void *dev_id, struct pt_regs *regs)
 	 * If there are completed commands in the completion queue,
 	 * we had better do something about it.
 	 */
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(CCISS_LOCK(h->ctlr), flags);
 	while( h->access.intr_pending(h))
 	{
 		while((a = h->access.command_completed(h)) != FIFO_EMPTY) 
@@ -1512,7 +1512,7 @@ static void do_cciss_intr(int irq, void *dev_id, struct pt_regs *regs)
 	 * See if we can queue up some more IO
 	 */
 	do_cciss_request(BLK_DEFAULT_QUEUE(MAJOR_NR + h->ctlr));
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(CCISS_LOCK(h->ctlr), flags);
 }
 /* 
  *  We cannot read the structure directly, for portablity we must use 
@@ -1966,6 +1966,7 @@ static int __init cciss_init_one(struct pci_dev *pdev,
 	if( i < 0 ) 
 		return (-1);
 	memset(hba[i], 0, sizeof(ctlr_info_t));
+	spin_lock_init(&hba[i]->lock);
 	if (cciss_pci_init(hba[i], pdev) != 0)
 	{
 		free_hba(i);
@@ -2060,7 +2061,7 @@ static int __init cciss_init_one(struct pci_dev *pdev,
 
 	q = BLK_DEFAULT_QUEUE(MAJOR_NR + i);
 	q->queuedata = hba[i];
-	blk_init_queue(q, do_cciss_request);
+	blk_init_queue_lock(q, do_cciss_request, CCISS_LOCK(i));
 	blk_queue_bounce_limit(q, hba[i]->pdev->dma_mask);
 	blk_queue_headactive(q, 0);		
 
@@ -2133,6 +2134,8 @@ static void __devexit cciss_remove_one (struct pci_dev *pdev)
 	iounmap((void*)hba[i]->vaddr);
 	cciss_unregister_scsi(i);  /* unhook from SCSI subsystem */
 	unregister_blkdev(MAJOR_NR+i, hba[i]->devname);
+	/* the queue lock lives in hba[i] */
+	blk_cleanup_queue(BLK_DEFAULT_QUEUE(MAJOR_NR + i));
 	remove_proc_entry(hba[i]->devname, proc_cciss);	
 	
 
@@ -68,6 +68,8 @@ struct ctlr_info
 	unsigned int Qdepth;
 	unsigned int maxQsinceinit;
 	unsigned int maxSG;
+	spinlock_t lock;	/* protects the queues, also the request queue
+				   and SCSI host lock */
 
 	//* pointers to command and error info pool */ 
 	CommandList_struct 	*cmd_pool;
@@ -90,6 +92,8 @@ struct ctlr_info
 #endif
 };
 
+#define CCISS_LOCK(i)	(&hba[i]->lock)
+
 /*  Defining the diffent access_menthods */
 /*
  * Memory mapped FIFO interface (SMART 53xx cards)
@@ -823,6 +823,8 @@ cciss_scsi_detect(Scsi_Host_Template *tpnt)
 	sh->irq = hba[i]->intr;
 	sh->unique_id = sh->irq;
 	scsi_set_pci_device(sh, hba[i]->pdev);
+	/* commands complete under the controller lock, see do_cciss_intr */
+	scsi_assign_lock(sh, CCISS_LOCK(i));
 
 	return 1;	/* Say we have 1 scsi adapter, this will be */
 			/* called multiple times, once for each adapter */
@@ -910,11 +912,11 @@ cciss_scsi_do_simple_cmd(ctlr_info_t *c,
 	cp->waiting = &wait;
 
 	/* Put the request on the tail of the request queue */
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(CCISS_LOCK(c->ctlr), flags);
 	addQ(&c->reqQ, cp);
 	c->Qdepth++;
 	start_io(c);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(CCISS_LOCK(c->ctlr), flags);
 
 	wait_for_completion(&wait);
 
@@ -1499,21 +1501,21 @@ cciss_unregister_scsi(int ctlr)
 
 	/* we are being forcibly unloaded, and may not refuse. */
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
 	sa = (struct cciss_scsi_adapter_data_t *) hba[ctlr]->scsi_ctlr;
 	stk = &sa->cmd_stack;
 
 	/* if we weren't ever actually registered, don't unregister */
 	if (((struct cciss_scsi_adapter_data_t *)
 		hba[ctlr]->scsi_ctlr)->registered) {
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 		scsi_unregister_module(MODULE_SCSI_HA, &driver_template[ctlr]);
-		spin_lock_irqsave(&io_request_lock, flags);
+		spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
 	}
 	init_driver_template(ctlr);
 	scsi_cmd_stack_free(ctlr);
 	kfree(hba[ctlr]->scsi_ctlr);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 }
 
 static int
@@ -1558,17 +1560,17 @@ cciss_engage_scsi(int ctlr)
 	struct cciss_scsi_cmd_stack_t *stk;
 	unsigned long flags;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(CCISS_LOCK(ctlr), flags);
 	sa = (struct cciss_scsi_adapter_data_t *) hba[ctlr]->scsi_ctlr;
 	stk = &sa->cmd_stack;
 
 	if (((struct cciss_scsi_adapter_data_t *)
 		hba[ctlr]->scsi_ctlr)->registered) {
 		printk("cciss%d: SCSI subsystem already engaged.\n", ctlr);
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 		return ENXIO;
 	}
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(CCISS_LOCK(ctlr), flags);
 	cciss_update_non_disk_devices(ctlr, -1);
 	cciss_register_scsi(ctlr, 0);
 	return 0;
@@ -71,9 +71,9 @@ notion of how many requests we have outstanding will be wrong most or
 all of the time.
 
 Note, the normal SCSI mid-layer error handling doesn't work well
-for this driver because 1) it takes the io_request_lock before
-calling error handlers and uses a local variable to store flags,
-so the io_request_lock cannot be released and interrupts enabled
+for this driver because 1) it takes the host lock (which is the
+controller lock) before calling error handlers and uses a local
+variable to store flags, so the lock cannot be released and interrupts enabled
 inside the error handlers, and, the error handlers cannot poll
 for command completion because they might get commands from the
 block half of the driver completing, and not know what to do
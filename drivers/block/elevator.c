@@ -18,6 +18,10 @@
  * Removed tests for max-bomb-segments, which was breaking elvtune
  *  when run without -bN
  *
+ * Deadline and anticipatory schedulers.  The elevator can now be
+ * chosen per queue at runtime through /proc/iosched, and the default
+ * with "elevator=" at boot.
+ *
  */
 
 #include <linux/fs.h>
@@ -25,6 +29,7 @@
 #include <linux/elevator.h>
 #include <linux/blk.h>
 #include <linux/module.h>
+#include <linux/init.h>
 #include <asm/uaccess.h>
 
 /*
@@ -179,6 +184,216 @@ int elevator_noop_merge(request_queue_t *q, struct request **req,
 
 void elevator_noop_merge_req(struct request *req, struct request *next) {}
 
+/*
+ * Deadline scheduler.
+ *
+ * Requests are kept sorted on the queue, reads ahead of writes.  Each
+ * request is also on a FIFO for its direction, and once it has waited
+ * longer than read_latency (reads) or write_latency (writes) jiffies
+ * it is moved up to the front of the queue, behind the ones moved up
+ * before it.  A request that has been moved up gets a zero
+ * elevator_sequence, so nothing is merged into or sorted in front of
+ * it afterwards.
+ */
+
+/* The first request that may be moved, skipping an active one */
+static inline struct list_head *deadline_queue_start(request_queue_t *q)
+{
+	struct list_head *head = &q->queue_head;
+
+	if (q->head_active && !q->plugged && !list_empty(head))
+		head = head->next;
+	return head;
+}
+
+/* Requests go after the returned entry to be served next */
+static struct list_head *deadline_queue_front(request_queue_t *q)
+{
+	struct list_head *entry = deadline_queue_start(q);
+
+	while (entry->next != &q->queue_head &&
+	       blkdev_entry_next_request(entry)->elevator_sequence <= 0)
+		entry = entry->next;
+	return entry;
+}
+
+int elevator_deadline_merge(request_queue_t *q, struct request **req,
+			    struct list_head * head,
+			    struct buffer_head *bh, int rw,
+			    int max_sectors)
+{
+	struct list_head *entry = &q->queue_head;
+	unsigned int count = bh->b_size >> 9;
+	struct request *__rq;
+
+	while ((entry = entry->prev) != head) {
+		__rq = blkdev_entry_to_request(entry);
+
+		if (__rq->elevator_sequence <= 0)
+			break;
+		if (__rq->cmd != rw)
+			continue;
+		if (__rq->rq_dev != bh->b_rdev)
+			continue;
+		if (__rq->nr_sectors + count > max_sectors)
+			continue;
+		if (__rq->waiting)
+			continue;
+		if (__rq->sector + __rq->nr_sectors == bh->b_rsector) {
+			*req = __rq;
+			return ELEVATOR_BACK_MERGE;
+		} else if (__rq->sector - count == bh->b_rsector) {
+			*req = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	/* elevator_deadline_add_req() puts the new request in its place */
+	return ELEVATOR_NO_MERGE;
+}
+
+/*
+ * Should rq go between prev and next, neighbours on the queue?  As
+ * with bh_rq_in_between(), the queue is served in ascending order and
+ * wraps around once.
+ */
+static int rq_in_between(struct request *rq, struct request *prev,
+			 struct request *next)
+{
+	if (prev->rq_dev != rq->rq_dev)
+		return 0;
+	if (next->rq_dev != prev->rq_dev)
+		return rq->sector > prev->sector;
+	if (rq->sector > prev->sector && rq->sector < next->sector)
+		return 1;
+	if (next->sector > prev->sector)
+		return 0;
+	return rq->sector > prev->sector || rq->sector < next->sector;
+}
+
+/* Sort a request in, reads in front of writes */
+static void deadline_sort_in(request_queue_t *q, struct request *rq)
+{
+	struct list_head *entry, *start = deadline_queue_front(q);
+	struct request *next;
+
+	if (rq->cmd != READ) {
+		while (start->next != &q->queue_head &&
+		       blkdev_entry_next_request(start)->cmd == READ)
+			start = start->next;
+	}
+
+	for (entry = start; entry->next != &q->queue_head; entry = entry->next) {
+		next = blkdev_entry_next_request(entry);
+		if (rq->cmd == READ && next->cmd != READ)
+			break;
+		if (entry != start &&
+		    rq_in_between(rq, blkdev_entry_to_request(entry), next))
+			break;
+	}
+	list_add(&rq->queue, entry);
+}
+
+/* Move requests that have waited too long up to the front */
+static void deadline_check_fifo(request_queue_t *q)
+{
+	elevator_t *e = &q->elevator;
+	struct list_head *start = deadline_queue_start(q);
+	struct request *rq;
+	int rw, expire;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		expire = rw == READ ? e->read_latency : e->write_latency;
+		while (!list_empty(&e->fifo[rw])) {
+			rq = list_entry(e->fifo[rw].next, struct request, fifo);
+			if (time_before(jiffies, rq->start_time + expire))
+				break;
+			list_del_init(&rq->fifo);
+			if (rq->elevator_sequence <= 0)
+				continue;
+			rq->elevator_sequence = 0;
+			if (&rq->queue == start)
+				continue;
+			list_del(&rq->queue);
+			list_add(&rq->queue, deadline_queue_front(q));
+		}
+	}
+}
+
+void elevator_deadline_add_req(request_queue_t *q, struct request *rq)
+{
+	rq->elevator_sequence = 1;
+	list_add_tail(&rq->fifo, &q->elevator.fifo[rq->cmd]);
+
+	list_del(&rq->queue);
+	deadline_sort_in(q, rq);
+	deadline_check_fifo(q);
+}
+
+void elevator_deadline_remove_req(request_queue_t *q, struct request *rq)
+{
+	if (!list_empty(&rq->fifo))
+		list_del_init(&rq->fifo);
+	if (!list_empty(&q->queue_head))
+		deadline_check_fifo(q);
+}
+
+/*
+ * Anticipatory scheduler.
+ *
+ * The deadline scheduler with shorter expiry times, which in addition
+ * keeps the queue plugged for ELV_ANTIC_EXPIRE after a read completes
+ * unless another read is ready to go.  A process reading a file
+ * sequentially sends its next read within that time, which then does
+ * not have to wait behind the writes that were queued meanwhile.
+ */
+static void elevator_antic_timeout(unsigned long data)
+{
+	request_queue_t *q = (request_queue_t *) data;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	if (q->elevator.antic_state) {
+		q->elevator.antic_state = 0;
+		__generic_unplug_device(q);
+	}
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+void elevator_antic_add_req(request_queue_t *q, struct request *rq)
+{
+	elevator_deadline_add_req(q, rq);
+
+	/*
+	 * The read we were waiting for: let it go as soon as tq_disk is
+	 * run, which whoever sent it is about to do.
+	 */
+	if (q->elevator.antic_state && rq->cmd == READ) {
+		q->elevator.antic_state = 0;
+		queue_task(&q->plug_tq, &tq_disk);
+	}
+}
+
+void elevator_antic_completed(request_queue_t *q, struct request *rq)
+{
+	struct request *next;
+
+	/* only queues that get unplugged by tq_disk can be kept idle */
+	if (rq->cmd != READ || q->plugged || q->elevator.antic_state ||
+	    q->plug_tq.routine != generic_unplug_device)
+		return;
+
+	if (!list_empty(&q->queue_head)) {
+		next = blkdev_entry_next_request(&q->queue_head);
+		if (next->cmd == READ || next->elevator_sequence <= 0)
+			return;
+	}
+
+	q->plugged = 1;
+	q->elevator.antic_state = 1;
+	mod_timer(&q->elevator.antic_timer, jiffies + ELV_ANTIC_EXPIRE);
+}
+
 int blkelvget_ioctl(elevator_t * elevator, blkelv_ioctl_arg_t * arg)
 {
 	blkelv_ioctl_arg_t output;
@@ -214,7 +429,92 @@ int blkelvset_ioctl(elevator_t * elevator, const blkelv_ioctl_arg_t * arg)
 void elevator_init(elevator_t * elevator, elevator_t type)
 {
 	static unsigned int queue_ID;
+	request_queue_t *q = list_entry(elevator, request_queue_t, elevator);
 
 	*elevator = type;
 	elevator->queue_ID = queue_ID++;
+
+	INIT_LIST_HEAD(&elevator->fifo[READ]);
+	INIT_LIST_HEAD(&elevator->fifo[WRITE]);
+	elevator->antic_state = 0;
+	init_timer(&elevator->antic_timer);
+	elevator->antic_timer.function = elevator_antic_timeout;
+	elevator->antic_timer.data = (unsigned long) q;
+}
+
+int elevator_find(const char *name, elevator_t *type)
+{
+	if (!strcmp(name, "noop"))
+		*type = ELEVATOR_NOOP;
+	else if (!strcmp(name, "linus"))
+		*type = ELEVATOR_LINUS;
+	else if (!strcmp(name, "deadline"))
+		*type = ELEVATOR_DEADLINE;
+	else if (!strcmp(name, "anticipatory"))
+		*type = ELEVATOR_ANTICIPATORY;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static char elevator_default_name[16] = "linus";
+
+static int __init elevator_setup(char *str)
+{
+	elevator_t type;
+
+	if (elevator_find(str, &type) == 0)
+		strcpy(elevator_default_name, str);
+	else
+		printk(KERN_WARNING "elevator: unknown elevator %s\n", str);
+	return 1;
+}
+
+__setup("elevator=", elevator_setup);
+
+/* The elevator for new queues, "elevator=" on the command line */
+elevator_t elevator_default(void)
+{
+	elevator_t type;
+
+	if (elevator_find(elevator_default_name, &type))
+		type = ELEVATOR_LINUS;
+	return type;
+}
+
+/**
+ * elevator_switch - change the elevator of a live queue
+ * @q:    the queue
+ * @type: the new elevator, from elevator_find()
+ *
+ * Requests already queued stay where they are.  The queue keeps its
+ * ID; the latency settings are reset to those of the new elevator.
+ * Called without the queue lock held.
+ **/
+void elevator_switch(request_queue_t *q, elevator_t *type)
+{
+	elevator_t *e = &q->elevator;
+	unsigned long flags;
+	int rw, idle;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	for (rw = READ; rw <= WRITE; rw++)
+		while (!list_empty(&e->fifo[rw]))
+			list_del_init(e->fifo[rw].next);
+	idle = e->antic_state;
+	e->antic_state = 0;
+
+	e->read_latency			= type->read_latency;
+	e->write_latency		= type->write_latency;
+	e->elevator_merge_fn		= type->elevator_merge_fn;
+	e->elevator_merge_req_fn	= type->elevator_merge_req_fn;
+	e->elevator_add_req_fn		= type->elevator_add_req_fn;
+	e->elevator_remove_req_fn	= type->elevator_remove_req_fn;
+	e->elevator_completed_fn	= type->elevator_completed_fn;
+	e->elevator_name		= type->elevator_name;
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	del_timer_sync(&e->antic_timer);
+	if (idle)
+		generic_unplug_device(q);
 }
@@ -27,10 +27,13 @@
 
 #include <asm/system.h>
 #include <asm/io.h>
+#include <asm/uaccess.h>
 #include <linux/blk.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 /*
  * MAC Floppy IWM hooks
@@ -52,16 +55,33 @@ static kmem_cache_t *request_cachep;
 DECLARE_TASK_QUEUE(tq_disk);
 
 /*
- * Protect the request list against multiple users..
- *
- * With this spinlock the Linux block IO subsystem is 100% SMP threaded
- * from the IRQ event side, and almost 100% SMP threaded from the syscall
- * side (we still have protect against block device array operations, and
- * the do_request() side is casually still unsafe. The kernel lock protects
- * this part currently.).
- *
- * there is a fair chance that things will work just OK if these functions
- * are called with no global kernel lock held ...
+ * All initialised queues, for /proc/iosched
+ */
+static LIST_HEAD(blk_queue_list);
+static spinlock_t blk_queue_list_lock = SPIN_LOCK_UNLOCKED;
+
+/*
+ * Is q on blk_queue_list?  Drivers may initialise the same queue again
+ * without cleaning it up, and queue_list of a queue that never was on
+ * the list can hold anything, so look for it rather than trust it.
+ * Called with blk_queue_list_lock held.
+ */
+static int blk_queue_listed(request_queue_t *q)
+{
+	struct list_head *entry;
+
+	list_for_each(entry, &blk_queue_list)
+		if (entry == &q->queue_list)
+			return 1;
+	return 0;
+}
+
+/*
+ * Every request queue is protected by the lock q->queue_lock points
+ * to.  Queues set up with blk_init_queue_lock() get a lock of their
+ * own (or one their driver shares between its queues); queues set up
+ * with plain blk_init_queue() all share this global one, which is what
+ * drivers that have not been converted still take themselves.
  */
 spinlock_t io_request_lock = SPIN_LOCK_UNLOCKED;
 
@@ -158,6 +178,8 @@ static int __blk_cleanup_queue(struct request_list *list)
 	return i;
 }
 
+static void blk_flush_batches(void);
+
 /**
  * blk_cleanup_queue: - release a &request_queue_t when it is no longer needed
  * @q:    the request queue to be released
@@ -176,6 +198,17 @@ void blk_cleanup_queue(request_queue_t * q)
 {
 	int count = q->nr_requests;
 
+	/* buffers for this queue may still be sitting in a batch */
+	blk_flush_batches();
+
+	spin_lock(&blk_queue_list_lock);
+	if (blk_queue_listed(q))
+		list_del_init(&q->queue_list);
+	spin_unlock(&blk_queue_list_lock);
+	while (atomic_read(&q->refcnt))
+		yield();
+	del_timer_sync(&q->elevator.antic_timer);
+
 	count -= __blk_cleanup_queue(&q->rq[READ]);
 	count -= __blk_cleanup_queue(&q->rq[WRITE]);
 
@@ -356,9 +389,10 @@ static void generic_plug_device(request_queue_t *q, kdev_t dev)
 /*
  * remove the plug and let it rip..
  */
-static inline void __generic_unplug_device(request_queue_t *q)
+void __generic_unplug_device(request_queue_t *q)
 {
-	if (q->plugged) {
+	/* the anticipatory elevator unplugs the queue itself */
+	if (q->plugged && !q->elevator.antic_state) {
 		q->plugged = 0;
 		if (!list_empty(&q->queue_head))
 			q->request_fn(q);
@@ -370,9 +404,9 @@ void generic_unplug_device(void *data)
 	request_queue_t *q = (request_queue_t *) data;
 	unsigned long flags;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(q->queue_lock, flags);
 	__generic_unplug_device(q);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(q->queue_lock, flags);
 }
 
 /** blk_grow_request_list
@@ -396,7 +430,7 @@ int blk_grow_request_list(request_queue_t *q, int nr_requests)
 	 * this causes system hangs during boot.
 	 * As a temporary fix, make the the function non-blocking.
 	 */
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(q->queue_lock, flags);
 	while (q->nr_requests < nr_requests) {
 		struct request *rq;
 		int rw;
@@ -414,7 +448,7 @@ int blk_grow_request_list(request_queue_t *q, int nr_requests)
 	q->batch_requests = q->nr_requests / 4;
 	if (q->batch_requests > 32)
 		q->batch_requests = 32;
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(q->queue_lock, flags);
 	return q->nr_requests;
 }
 
@@ -439,7 +473,6 @@ static void blk_init_free_list(request_queue_t *q)
 
 	init_waitqueue_head(&q->wait_for_requests[0]);
 	init_waitqueue_head(&q->wait_for_requests[1]);
-	spin_lock_init(&q->queue_lock);
 }
 
 static int __make_request(request_queue_t * q, int rw, struct buffer_head * bh);
@@ -465,8 +498,10 @@ static int __make_request(request_queue_t * q, int rw, struct buffer_head * bh);
  *    requests on the queue, it is responsible for arranging that the requests
  *    get dealt with eventually.
  *
- *    A global spin lock $io_request_lock must be held while manipulating the
- *    requests on the request queue.
+ *    The global spin lock $io_request_lock must be held while manipulating
+ *    the requests on a queue set up this way.  This is the compatibility
+ *    interface for drivers that still take that lock themselves; others
+ *    should use blk_init_queue_lock().
  *
  *    The request on the head of the queue is by default assumed to be
  *    potentially active, and it is not considered for re-ordering or merging
@@ -479,8 +514,36 @@ static int __make_request(request_queue_t * q, int rw, struct buffer_head * bh);
  **/
 void blk_init_queue(request_queue_t * q, request_fn_proc * rfn)
 {
+	blk_init_queue_lock(q, rfn, &io_request_lock);
+}
+
+/**
+ * blk_init_queue_lock - prepare a request queue with its own lock
+ * @q:    The &request_queue_t to be initialised
+ * @rfn:  The function to be called to process requests that have been
+ *        placed on the queue.
+ * @lock: The lock protecting the queue, or %NULL
+ *
+ * Description:
+ *    Like blk_init_queue(), but the queue is protected by @lock rather
+ *    than by $io_request_lock.  A driver with several queues that share
+ *    controller state passes the same lock for all of them; with a %NULL
+ *    @lock the queue uses a lock of its own.  Either way q->queue_lock
+ *    is held when @rfn is called and must be held by the driver when it
+ *    touches the queue or calls end_that_request_last() and
+ *    blkdev_release_request().
+ **/
+void blk_init_queue_lock(request_queue_t * q, request_fn_proc * rfn,
+			 spinlock_t * lock)
+{
+	if (lock == NULL) {
+		spin_lock_init(&q->__queue_lock);
+		lock = &q->__queue_lock;
+	}
+	q->queue_lock = lock;
+
 	INIT_LIST_HEAD(&q->queue_head);
-	elevator_init(&q->elevator, ELEVATOR_LINUS);
+	elevator_init(&q->elevator, elevator_default());
 	blk_init_free_list(q);
 	q->request_fn     	= rfn;
 	q->back_merge_fn       	= ll_back_merge_fn;
@@ -501,11 +564,19 @@ void blk_init_queue(request_queue_t * q, request_fn_proc * rfn)
 	q->head_active    	= 1;
 
 	blk_queue_bounce_limit(q, BLK_BOUNCE_HIGH);
+
+	memset(q->latency, 0, sizeof(q->latency));
+	spin_lock(&blk_queue_list_lock);
+	if (!blk_queue_listed(q)) {
+		atomic_set(&q->refcnt, 0);
+		list_add_tail(&q->queue_list, &blk_queue_list);
+	}
+	spin_unlock(&blk_queue_list_lock);
 }
 
 #define blkdev_free_rq(list) list_entry((list)->next, struct request, queue);
 /*
- * Get a free request. io_request_lock must be held and interrupts
+ * Get a free request. q->queue_lock must be held and interrupts
  * disabled on the way in.  Returns NULL if there are no free requests.
  */
 static struct request *get_request(request_queue_t *q, int rw)
@@ -521,6 +592,7 @@ static struct request *get_request(request_queue_t *q, int rw)
 		rq->cmd = rw;
 		rq->special = NULL;
 		rq->q = q;
+		INIT_LIST_HEAD(&rq->fifo);
 	}
 
 	return rq;
@@ -596,9 +668,9 @@ static struct request *__get_request_wait(request_queue_t *q, int rw)
 		set_current_state(TASK_UNINTERRUPTIBLE);
 		if (q->rq[rw].count == 0)
 			schedule();
-		spin_lock_irq(&io_request_lock);
+		spin_lock_irq(q->queue_lock);
 		rq = get_request(q, rw);
-		spin_unlock_irq(&io_request_lock);
+		spin_unlock_irq(q->queue_lock);
 	} while (rq == NULL);
 	remove_wait_queue(&q->wait_for_requests[rw], &wait);
 	current->state = TASK_RUNNING;
@@ -789,7 +861,7 @@ EXPORT_SYMBOL(req_finished_io);
 
 /*
  * add-request adds a request to the linked list.
- * io_request_lock is held and interrupts disabled, as we muck with the
+ * q->queue_lock is held and interrupts disabled, as we muck with the
  * request queue list.
  *
  * By this point, req->cmd is always either READ/WRITE, never READA,
@@ -801,7 +873,7 @@ static inline void add_request(request_queue_t * q, struct request * req,
 	drive_stat_acct(req->rq_dev, req->cmd, req->nr_sectors, 1);
 
 	if (!q->plugged && q->head_active && insert_here == &q->queue_head) {
-		spin_unlock_irq(&io_request_lock);
+		spin_unlock_irq(q->queue_lock);
 		BUG();
 	}
 
@@ -810,10 +882,11 @@ static inline void add_request(request_queue_t * q, struct request * req,
 	 * inserted at elevator_merge time
 	 */
 	list_add(&req->queue, insert_here);
+	elevator_add_req(q, req);
 }
 
 /*
- * Must be called with io_request_lock held and interrupts disabled
+ * Must be called with the queue lock held and interrupts disabled
  */
 void blkdev_release_request(struct request *req)
 {
@@ -828,6 +901,7 @@ void blkdev_release_request(struct request *req)
 	 * assume it has free buffers and check waiters
 	 */
 	if (q) {
+		elevator_remove_req(q, req);
 		list_add(&req->queue, &q->rq[rw].free);
 		if (++q->rq[rw].count >= q->batch_requests &&
 				waitqueue_active(&q->wait_for_requests[rw]))
@@ -899,8 +973,15 @@ static inline void attempt_front_merge(request_queue_t * q,
 	attempt_merge(q, blkdev_entry_to_request(prev), max_sectors, max_segments);
 }
 
-static int __make_request(request_queue_t * q, int rw,
-				  struct buffer_head * bh)
+/*
+ * Add a buffer to its queue, merging it into an existing request where
+ * possible.  Called with q->queue_lock held and interrupts disabled,
+ * which may be dropped (and retaken) while waiting for a free request.
+ * With nowait set it never sleeps; if the buffer needs a request and
+ * none is free, it is left alone and 1 is returned.
+ */
+static int __blk_add_bh(request_queue_t * q, int rw,
+			struct buffer_head * bh, int nowait)
 {
 	unsigned int sector, count;
 	int max_segments = MAX_SEGMENTS;
@@ -914,34 +995,13 @@ static int __make_request(request_queue_t * q, int rw,
 	sector = bh->b_rsector;
 
 	rw_ahead = 0;	/* normal case; gets changed below for READA */
-	switch (rw) {
-		case READA:
+	if (rw == READA) {
 #if 0	/* bread() misinterprets failed READA attempts as IO errors on SMP */
-			rw_ahead = 1;
+		rw_ahead = 1;
 #endif
-			rw = READ;	/* drop into READ */
-		case READ:
-		case WRITE:
-			latency = elevator_request_latency(elevator, rw);
-			break;
-		default:
-			BUG();
-			goto end_io;
+		rw = READ;	/* drop into READ */
 	}
-
-	/* We'd better have a real physical mapping!
-	   Check this bit only if the buffer was dirty and just locked
-	   down by us so at this point flushpage will block and
-	   won't clear the mapped bit under us. */
-	if (!buffer_mapped(bh))
-		BUG();
-
-	/*
-	 * Temporary solution - in 2.5 this will be done by the lowlevel
-	 * driver. Create a bounce buffer if the buffer data points into
-	 * high memory - keep the original buffer otherwise.
-	 */
-	bh = blk_queue_bounce(q, rw, bh);
+	latency = elevator_request_latency(elevator, rw);
 
 /* look for a free request. */
 	/*
@@ -952,11 +1012,6 @@ static int __make_request(request_queue_t * q, int rw,
 again:
 	req = NULL;
 	head = &q->queue_head;
-	/*
-	 * Now we acquire the request spinlock, we have to be mega careful
-	 * not to schedule or do something nonatomic
-	 */
-	spin_lock_irq(&io_request_lock);
 
 	insert_here = head->prev;
 	if (list_empty(head)) {
@@ -1032,8 +1087,10 @@ get_rq:
 		 */
 		if (rw_ahead) {
 			if (q->rq[rw].count < q->batch_requests) {
-				spin_unlock_irq(&io_request_lock);
-				goto end_io;
+				spin_unlock_irq(q->queue_lock);
+				bh->b_end_io(bh, test_bit(BH_Uptodate, &bh->b_state));
+				spin_lock_irq(q->queue_lock);
+				return 0;
 			}
 			req = get_request(q, rw);
 			if (req == NULL)
@@ -1041,8 +1098,11 @@ get_rq:
 		} else {
 			req = get_request(q, rw);
 			if (req == NULL) {
-				spin_unlock_irq(&io_request_lock);
+				if (nowait)
+					return 1;
+				spin_unlock_irq(q->queue_lock);
 				freereq = __get_request_wait(q, rw);
+				spin_lock_irq(q->queue_lock);
 				goto again;
 			}
 		}
@@ -1069,10 +1129,253 @@ get_rq:
 out:
 	if (freereq)
 		blkdev_release_request(freereq);
-	spin_unlock_irq(&io_request_lock);
 	return 0;
-end_io:
-	bh->b_end_io(bh, test_bit(BH_Uptodate, &bh->b_state));
+}
+
+/*
+ * Per-CPU submission batches.
+ *
+ * Rather than taking the queue lock for every buffer, __make_request()
+ * parks buffers in a small batch belonging to the submitting CPU.  The
+ * batch is fed to the queues when it fills up, taking each queue lock
+ * once for all the buffers that go to that queue, and whenever tq_disk
+ * is run, which is when the queues would have been unplugged anyway.
+ * So a buffer never waits longer than it would have sitting on a
+ * plugged queue.  Queues that do not use the generic plugging want
+ * their I/O to start right away and are not batched.
+ *
+ * Feeding a batch only ever sleeps for a request on the queue of the
+ * task that submits the buffer filling it, never from tq_disk, which
+ * must not sleep.  Other buffers which find no free request are passed
+ * on to keventd, which can wait for one.
+ */
+#define BLK_BATCH_SIZE	16
+
+struct blk_batch_entry {
+	request_queue_t *q;
+	struct buffer_head *bh;
+	int rw;
+};
+
+struct blk_cpu_batch {
+	spinlock_t lock;
+	int nr;
+	struct tq_struct flush_tq;
+	struct blk_batch_entry ent[BLK_BATCH_SIZE];
+} ____cacheline_aligned;
+
+static struct blk_cpu_batch blk_cpu_batch[NR_CPUS];
+
+/*
+ * Buffers waiting for keventd, in submission order, chained through
+ * b_reqnext.  They are kept apart by direction as nothing else in the
+ * buffer says whether it is to be read or written.
+ */
+static spinlock_t blk_deferred_lock = SPIN_LOCK_UNLOCKED;
+static DECLARE_MUTEX(blk_deferred_sem);
+static struct buffer_head *blk_deferred_head[2];
+static struct buffer_head **blk_deferred_tail[2] = {
+	&blk_deferred_head[READ], &blk_deferred_head[WRITE]
+};
+
+static void blk_run_deferred(void *data);
+
+static struct tq_struct blk_deferred_tq = {
+	routine:	blk_run_deferred,
+};
+
+static void blk_defer_bh(int rw, struct buffer_head * bh)
+{
+	unsigned long flags;
+
+	if (rw == READA)
+		rw = READ;
+	bh->b_reqnext = NULL;
+	spin_lock_irqsave(&blk_deferred_lock, flags);
+	*blk_deferred_tail[rw] = bh;
+	blk_deferred_tail[rw] = &bh->b_reqnext;
+	spin_unlock_irqrestore(&blk_deferred_lock, flags);
+}
+
+/*
+ * keventd: queue and start the buffers tq_disk could not.  The
+ * semaphore lets blk_flush_batches() wait for a run in progress.
+ */
+static void blk_run_deferred(void *data)
+{
+	struct buffer_head *bh, *next;
+	request_queue_t *q;
+	int rw;
+
+	down(&blk_deferred_sem);
+	for (rw = READ; rw <= WRITE; rw++) {
+		spin_lock_irq(&blk_deferred_lock);
+		bh = blk_deferred_head[rw];
+		blk_deferred_head[rw] = NULL;
+		blk_deferred_tail[rw] = &blk_deferred_head[rw];
+		spin_unlock_irq(&blk_deferred_lock);
+
+		for (; bh; bh = next) {
+			next = bh->b_reqnext;
+			bh->b_reqnext = NULL;
+			q = blk_get_queue(bh->b_rdev);
+			spin_lock_irq(q->queue_lock);
+			__blk_add_bh(q, rw, bh, 0);
+			__generic_unplug_device(q);
+			spin_unlock_irq(q->queue_lock);
+		}
+	}
+	up(&blk_deferred_sem);
+}
+
+/*
+ * Feed a batch to the queues, keeping the order of the buffers for any
+ * one queue.  With unplug set the queues are started as well, as this
+ * is done on behalf of tq_disk.  Only buffers for wait_q may sleep for
+ * a request: the batch holds other tasks' buffers for other queues,
+ * and a queue short of requests must not hold up the rest.  The
+ * buffers of any other queue which runs out go to keventd.
+ */
+static void blk_feed_batch(struct blk_batch_entry *ent, int nr, int unplug,
+			   request_queue_t *wait_q)
+{
+	request_queue_t *q;
+	int i, j, full, deferred = 0;
+
+	for (i = 0; i < nr; i++) {
+		q = ent[i].q;
+		if (q == NULL)
+			continue;
+
+		full = 0;
+		spin_lock_irq(q->queue_lock);
+		for (j = i; j < nr; j++) {
+			if (ent[j].q != q)
+				continue;
+			if (full || __blk_add_bh(q, ent[j].rw, ent[j].bh,
+						 q != wait_q)) {
+				blk_defer_bh(ent[j].rw, ent[j].bh);
+				full = deferred = 1;
+			}
+			ent[j].q = NULL;
+		}
+		if (unplug)
+			__generic_unplug_device(q);
+		spin_unlock_irq(q->queue_lock);
+	}
+
+	if (deferred)
+		schedule_task(&blk_deferred_tq);
+}
+
+static void blk_flush_cpu_batch(struct blk_cpu_batch *b, int unplug)
+{
+	struct blk_batch_entry ent[BLK_BATCH_SIZE];
+	unsigned long flags;
+	int nr;
+
+	spin_lock_irqsave(&b->lock, flags);
+	nr = b->nr;
+	memcpy(ent, b->ent, nr * sizeof(ent[0]));
+	b->nr = 0;
+	spin_unlock_irqrestore(&b->lock, flags);
+
+	if (nr)
+		blk_feed_batch(ent, nr, unplug, NULL);
+}
+
+/* tq_disk callback, one for each CPU that has buffers batched */
+static void blk_unplug_cpu_batch(void *data)
+{
+	blk_flush_cpu_batch((struct blk_cpu_batch *) data, 1);
+}
+
+/*
+ * Feed all batched buffers to their queues, including those waiting
+ * for keventd.  Only the latter are started.
+ */
+static void blk_flush_batches(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < smp_num_cpus; cpu++)
+		blk_flush_cpu_batch(&blk_cpu_batch[cpu_logical_map(cpu)], 0);
+	blk_run_deferred(NULL);
+}
+
+static void blk_batch_bh(request_queue_t * q, int rw, struct buffer_head * bh)
+{
+	struct blk_cpu_batch *b = &blk_cpu_batch[smp_processor_id()];
+	struct blk_batch_entry ent[BLK_BATCH_SIZE];
+	unsigned long flags;
+	int full = 0;
+
+	spin_lock_irqsave(&b->lock, flags);
+	if (b->nr == BLK_BATCH_SIZE) {
+		memcpy(ent, b->ent, sizeof(ent));
+		b->nr = 0;
+		full = 1;
+	}
+	b->ent[b->nr].q = q;
+	b->ent[b->nr].bh = bh;
+	b->ent[b->nr].rw = rw;
+	if (b->nr++ == 0)
+		queue_task(&b->flush_tq, &tq_disk);
+	spin_unlock_irqrestore(&b->lock, flags);
+
+	if (full)
+		blk_feed_batch(ent, BLK_BATCH_SIZE, 0, q);
+}
+
+static void __init blk_init_batches(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		struct blk_cpu_batch *b = &blk_cpu_batch[cpu];
+
+		spin_lock_init(&b->lock);
+		b->nr = 0;
+		b->flush_tq.sync = 0;
+		b->flush_tq.routine = blk_unplug_cpu_batch;
+		b->flush_tq.data = b;
+	}
+}
+
+static int __make_request(request_queue_t * q, int rw,
+				  struct buffer_head * bh)
+{
+	switch (rw) {
+		case READA:
+		case READ:
+		case WRITE:
+			break;
+		default:
+			BUG();
+	}
+
+	/* We'd better have a real physical mapping!
+	   Check this bit only if the buffer was dirty and just locked
+	   down by us so at this point flushpage will block and
+	   won't clear the mapped bit under us. */
+	if (!buffer_mapped(bh))
+		BUG();
+
+	/*
+	 * Temporary solution - in 2.5 this will be done by the lowlevel
+	 * driver. Create a bounce buffer if the buffer data points into
+	 * high memory - keep the original buffer otherwise.
+	 */
+	bh = blk_queue_bounce(q, rw, bh);
+
+	if (q->plug_device_fn == generic_plug_device) {
+		blk_batch_bh(q, rw, bh);
+		return 0;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	__blk_add_bh(q, rw, bh, 0);
+	spin_unlock_irq(q->queue_lock);
 	return 0;
 }
 
@@ -1374,15 +1677,173 @@ int end_that_request_first (struct request *req, int uptodate, char *name)
 	return 0;
 }
 
+/* Upper bounds of the latency histogram buckets, the last one is open */
+static const unsigned int blk_latency_ms[BLK_LATENCY_BUCKETS - 1] = {
+	10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+static inline void blk_account_latency(request_queue_t *q, struct request *req)
+{
+	unsigned long ms = (jiffies - req->start_time) * 1000 / HZ;
+	int i;
+
+	for (i = 0; i < BLK_LATENCY_BUCKETS - 1; i++)
+		if (ms < blk_latency_ms[i])
+			break;
+	q->latency[req->cmd][i]++;
+}
+
 void end_that_request_last(struct request *req)
 {
+	request_queue_t *q = req->q;
+
 	if (req->waiting != NULL)
 		complete(req->waiting);
 	req_finished_io(req);
 
+	if (q && (req->cmd == READ || req->cmd == WRITE)) {
+		blk_account_latency(q, req);
+		elevator_completed(q, req);
+	}
+
 	blkdev_release_request(req);
 }
 
+#ifdef CONFIG_PROC_FS
+/*
+ * /proc/iosched lists the queues by the ID elvtune shows, with their
+ * elevator and request latencies.  Writing "<ID> <elevator>" to it
+ * switches the elevator of a queue.
+ */
+static void *iosched_start(struct seq_file *m, loff_t *pos)
+{
+	struct list_head *entry;
+	loff_t n = *pos;
+
+	/* the list head stands for the header line */
+	spin_lock(&blk_queue_list_lock);
+	if (!n--)
+		return &blk_queue_list;
+	list_for_each(entry, &blk_queue_list)
+		if (!n--)
+			return entry;
+	return NULL;
+}
+
+static void *iosched_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct list_head *entry = v;
+
+	++*pos;
+	entry = entry->next;
+	return entry == &blk_queue_list ? NULL : entry;
+}
+
+static void iosched_stop(struct seq_file *m, void *v)
+{
+	spin_unlock(&blk_queue_list_lock);
+}
+
+static int iosched_show(struct seq_file *m, void *v)
+{
+	request_queue_t *q;
+	int rw, i;
+
+	if (v == &blk_queue_list) {
+		seq_printf(m, "queue elevator     dir  ");
+		for (i = 0; i < BLK_LATENCY_BUCKETS - 1; i++)
+			seq_printf(m, " <%5ums", blk_latency_ms[i]);
+		seq_printf(m, " >=%4ums\n", blk_latency_ms[i - 1]);
+		return 0;
+	}
+
+	q = list_entry((struct list_head *) v, request_queue_t, queue_list);
+	for (rw = READ; rw <= WRITE; rw++) {
+		seq_printf(m, "%5u %-12s %-5s", q->elevator.queue_ID,
+			   q->elevator.elevator_name, rw == READ ? "read" : "write");
+		for (i = 0; i < BLK_LATENCY_BUCKETS; i++)
+			seq_printf(m, " %8lu", q->latency[rw][i]);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+static struct seq_operations iosched_op = {
+	start:	iosched_start,
+	next:	iosched_next,
+	stop:	iosched_stop,
+	show:	iosched_show,
+};
+
+static int iosched_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &iosched_op);
+}
+
+static ssize_t iosched_write(struct file *file, const char *buf,
+			     size_t count, loff_t *ppos)
+{
+	char line[32], name[16];
+	struct list_head *entry;
+	request_queue_t *q, *found = NULL;
+	elevator_t type;
+	unsigned int id;
+	int ret = -ENODEV;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (count >= sizeof(line))
+		return -EINVAL;
+	if (copy_from_user(line, buf, count))
+		return -EFAULT;
+	line[count] = '\0';
+
+	if (sscanf(line, "%u %15s", &id, name) != 2)
+		return -EINVAL;
+	if (elevator_find(name, &type))
+		return -EINVAL;
+
+	/*
+	 * elevator_switch() waits for the anticipation timer and may run
+	 * the queue, so pin the queue and switch outside the list lock.
+	 */
+	spin_lock(&blk_queue_list_lock);
+	list_for_each(entry, &blk_queue_list) {
+		q = list_entry(entry, request_queue_t, queue_list);
+		if (q->elevator.queue_ID == id) {
+			atomic_inc(&q->refcnt);
+			found = q;
+			break;
+		}
+	}
+	spin_unlock(&blk_queue_list_lock);
+
+	if (found) {
+		elevator_switch(found, &type);
+		atomic_dec(&found->refcnt);
+		ret = count;
+	}
+	return ret;
+}
+
+static struct file_operations proc_iosched_operations = {
+	open:		iosched_open,
+	read:		seq_read,
+	write:		iosched_write,
+	llseek:		seq_lseek,
+	release:	seq_release,
+};
+
+static void __init blk_proc_init(void)
+{
+	struct proc_dir_entry *entry;
+
+	entry = create_proc_entry("iosched", S_IRUGO | S_IWUSR, NULL);
+	if (entry)
+		entry->proc_fops = &proc_iosched_operations;
+}
+#endif
+
 int __init blk_dev_init(void)
 {
 	struct blk_dev_struct *dev;
@@ -1394,6 +1855,11 @@ int __init blk_dev_init(void)
 	if (!request_cachep)
 		panic("Can't create request pool slab cache\n");
 
+	blk_init_batches();
+#ifdef CONFIG_PROC_FS
+	blk_proc_init();
+#endif
+
 	for (dev = blk_dev + MAX_BLKDEV; dev-- != blk_dev;)
 		dev->queue = NULL;
 
@@ -1513,6 +1979,7 @@ EXPORT_SYMBOL(end_that_request_first);
 EXPORT_SYMBOL(end_that_request_last);
 EXPORT_SYMBOL(blk_grow_request_list);
 EXPORT_SYMBOL(blk_init_queue);
+EXPORT_SYMBOL(blk_init_queue_lock);
 EXPORT_SYMBOL(blk_get_queue);
 EXPORT_SYMBOL(blk_cleanup_queue);
 EXPORT_SYMBOL(blk_queue_headactive);
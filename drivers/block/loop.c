@@ -572,7 +572,7 @@ static int loop_thread(void *data)
 	spin_unlock_irq(&current->sigmask_lock);
 
 	current->policy = SCHED_OTHER;
-	current->nice = -20;
+	set_user_nice(current, -20);
 
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_state = Lo_bound;
@@ -408,6 +408,7 @@ void	cleanup_module(void)
 	   }
 
 	unregister_blkdev(MAJOR_NR,name);
+	blk_cleanup_queue(BLK_DEFAULT_QUEUE(MAJOR_NR));
 }
 
 #endif
@@ -583,6 +583,7 @@ void    cleanup_module(void)
 	int unit;
 
         devfs_unregister_blkdev(MAJOR_NR,name);
+	blk_cleanup_queue(BLK_DEFAULT_QUEUE(MAJOR_NR));
 	del_gendisk(&pd_gendisk);
 
 	for (unit=0;unit<PD_UNITS;unit++) 
@@ -543,6 +543,7 @@ void    cleanup_module(void)
 {       int unit;
 
         unregister_blkdev(MAJOR_NR,name);
+	blk_cleanup_queue(BLK_DEFAULT_QUEUE(MAJOR_NR));
 
 	for (unit=0;unit<PF_UNITS;unit++)
 	  if (PF.present) pi_release(PI);
@@ -1221,7 +1221,7 @@ static void cdrom_attempt_remerge(ide_drive_t *drive, struct request *rq)
 	struct request *nxt;
 	unsigned long flags;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 
 	while (1) {
 		entry = rq->queue.next;
@@ -1238,7 +1238,7 @@ static void cdrom_attempt_remerge(ide_drive_t *drive, struct request *rq)
 			break;
 	}
 
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /* Fix up a possibly partially-processed request so that we can
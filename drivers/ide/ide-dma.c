@@ -587,10 +587,10 @@ static ide_startstop_t ide_dma_timeout_revovery (ide_drive_t *drive)
 	unsigned long flags;
 	ide_startstop_t startstop;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	hwgroup->handler = NULL;
 	del_timer(&hwgroup->timer);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 
 	drive->waiting_for_dma = 0;
 
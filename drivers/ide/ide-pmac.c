@@ -1556,7 +1556,7 @@ idepmac_wake_device(ide_drive_t *drive, int used_dma)
 		HWGROUP(drive)->busy = 0;
 		if (!list_empty(&drive->queue.queue_head))
 			ide_do_request(HWGROUP(drive), 0);
-		spin_unlock_irq(&io_request_lock);
+		spin_unlock_irq(&ide_queue_lock);
 	}
 #endif /* CONFIG_BLK_DEV_IDEDMA_PMAC */
 }
@@ -1609,7 +1609,7 @@ idepmac_sleep_drive(ide_drive_t *drive, int idx, unsigned long base)
 		idepmac_sleep_device(drive, idx, base);
 	}
 	if (unlock)
-		spin_unlock_irq(&io_request_lock);
+		spin_unlock_irq(&ide_queue_lock);
 }
 
 static void
@@ -1635,11 +1635,11 @@ idepmac_wake_drive(ide_drive_t *drive, unsigned long base)
 	}
 
 	/* We resume processing on the HW group */
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	HWGROUP(drive)->busy = 0;
 	if (!list_empty(&drive->queue.queue_head))
 		ide_do_request(HWGROUP(drive), 0);
-	spin_unlock_irqrestore(&io_request_lock, flags);			
+	spin_unlock_irqrestore(&ide_queue_lock, flags);			
 }
 
 /* Note: We support only master drives for now. This will have to be
@@ -1784,7 +1784,7 @@ pmac_ide_notify_reboot(struct notifier_block *this, unsigned long code, void *x)
 				}
 			}
 			if (unlock)
-				spin_unlock_irq(&io_request_lock);
+				spin_unlock_irq(&ide_queue_lock);
 		}
 	}
 	if (gotone)
@@ -605,7 +605,7 @@ static void ide_init_queue(ide_drive_t *drive)
 	request_queue_t *q = &drive->queue;
 
 	q->queuedata = HWGROUP(drive);
-	blk_init_queue(q, do_ide_request);
+	blk_init_queue_lock(q, do_ide_request, &ide_queue_lock);
 
 	if (drive->media == ide_disk) {
 #ifdef CONFIG_BLK_DEV_ELEVATOR_NOOP
@@ -936,7 +936,7 @@ static int hwif_init (ide_hwif_t *hwif)
 {
 	static int done = 0;
 	if (!done++)
-		printk("io_request_lock is %p\n", &io_request_lock);    /* FIXME */
+		printk("ide_queue_lock is %p\n", &ide_queue_lock);    /* FIXME */
 }
 #endif
 	return hwif->present;
@@ -512,9 +512,9 @@ void ide_end_taskfile (ide_drive_t *drive, byte stat, byte err)
 	ide_task_t *args;
 	task_ioreg_t command;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	rq = HWGROUP(drive)->rq;
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 	args = (ide_task_t *) rq->special;
 
 	command = args->tfRegister[IDE_COMMAND_OFFSET];
@@ -541,11 +541,11 @@ void ide_end_taskfile (ide_drive_t *drive, byte stat, byte err)
 
 /*	taskfile_settings_update(drive, args, command); */
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	blkdev_dequeue_request(rq);
 	HWGROUP(drive)->rq = NULL;
 	end_that_request_last(rq);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /*
@@ -196,6 +196,9 @@ static int	ide_lock;
 
 int noautodma = 0;
 
+/* protects all IDE request queues and hwgroups, see ide_do_request() */
+spinlock_t ide_queue_lock = SPIN_LOCK_UNLOCKED;
+
 /*
  * ide_modules keeps track of the available IDE chipset/probe/driver modules.
  */
@@ -563,7 +566,7 @@ void ide_end_request (byte uptodate, ide_hwgroup_t *hwgroup)
 	unsigned long flags;
 	ide_drive_t *drive = hwgroup->drive;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	rq = hwgroup->rq;
 
 	/*
@@ -581,7 +584,7 @@ void ide_end_request (byte uptodate, ide_hwgroup_t *hwgroup)
         	hwgroup->rq = NULL;
 		end_that_request_last(rq);
 	}
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /*
@@ -597,7 +600,7 @@ void ide_set_handler (ide_drive_t *drive, ide_handler_t *handler,
 	unsigned long flags;
 	ide_hwgroup_t *hwgroup = HWGROUP(drive);
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	if (hwgroup->handler != NULL) {
 		printk("%s: ide_set_handler: handler not null; old=%p, new=%p\n",
 			drive->name, hwgroup->handler, handler);
@@ -606,7 +609,7 @@ void ide_set_handler (ide_drive_t *drive, ide_handler_t *handler,
 	hwgroup->expiry		= expiry;
 	hwgroup->timer.expires	= jiffies + timeout;
 	add_timer(&hwgroup->timer);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /*
@@ -867,9 +870,9 @@ void ide_end_drive_cmd (ide_drive_t *drive, byte stat, byte err)
 	unsigned long flags;
 	struct request *rq;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	rq = HWGROUP(drive)->rq;
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 
 	switch(rq->cmd) {
 		case IDE_DRIVE_CMD:
@@ -932,11 +935,11 @@ void ide_end_drive_cmd (ide_drive_t *drive, byte stat, byte err)
 		default:
 			break;
 	}
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	blkdev_dequeue_request(rq);
 	HWGROUP(drive)->rq = NULL;
 	end_that_request_last(rq);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /*
@@ -1422,11 +1425,11 @@ ide_startstop_t restart_request (ide_drive_t *drive)
 	unsigned long flags;
 	struct request *rq;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	hwgroup->handler = NULL;
 	del_timer(&hwgroup->timer);
 	rq = hwgroup->rq;
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 
 	return start_request(drive, rq);
 }
@@ -1489,7 +1492,7 @@ repeat:
 
 /*
  * Issue a new request to a drive from hwgroup
- * Caller must have already done spin_lock_irqsave(&io_request_lock, ..);
+ * Caller must have already done spin_lock_irqsave(&ide_queue_lock, ..);
  *
  * A hwgroup is a serialized group of IDE interfaces.  Usually there is
  * exactly one hwif (interface) per hwgroup, but buggy controllers (eg. CMD640)
@@ -1501,8 +1504,10 @@ repeat:
  * possibly along with many other devices.  This is especially common in
  * PCI-based systems with off-board IDE controller cards.
  *
- * The IDE driver uses the single global io_request_lock spinlock to protect
- * access to the request queues, and to protect the hwgroup->busy flag.
+ * The IDE driver uses the single ide_queue_lock spinlock to protect access
+ * to its request queues, and to protect the hwgroup->busy flag.  It is
+ * shared by all IDE queues, as a hwgroup serves several of them, but
+ * not with the rest of the block layer.
  *
  * The first thread into the driver for a particular hwgroup sets the
  * hwgroup->busy flag to indicate that this hwgroup is now active,
@@ -1517,7 +1522,7 @@ repeat:
  * will start the next request from the queue.  If no more work remains,
  * the driver will clear the hwgroup->busy flag and exit.
  *
- * The io_request_lock (spinlock) is used to protect all access to the
+ * The ide_queue_lock (spinlock) is used to protect all access to the
  * hwgroup->busy flag, but is otherwise not needed for most processing in
  * the driver.  This makes the driver much more friendlier to shared IRQs
  * than previous designs, while remaining 100% (?) SMP safe and capable.
@@ -1594,10 +1599,10 @@ void ide_do_request (ide_hwgroup_t *hwgroup, int masked_irq)
 		 */
 		if (masked_irq && hwif->irq != masked_irq)
 			disable_irq_nosync(hwif->irq);
-		spin_unlock(&io_request_lock);
+		spin_unlock(&ide_queue_lock);
 		ide__sti();	/* allow other IRQs while we start this request */
 		startstop = start_request(drive, rq);
-		spin_lock_irq(&io_request_lock);
+		spin_lock_irq(&ide_queue_lock);
 		if (masked_irq && hwif->irq != masked_irq)
 			enable_irq(hwif->irq);
 		if (startstop == ide_stopped)
@@ -1679,7 +1684,7 @@ void ide_timer_expiry (unsigned long data)
  	unsigned long	flags;
 	unsigned long	wait;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	del_timer(&hwgroup->timer);
 
 	if ((handler = hwgroup->handler) == NULL) {
@@ -1711,7 +1716,7 @@ void ide_timer_expiry (unsigned long data)
 					/* reset timer */
 					hwgroup->timer.expires  = jiffies + wait;
 					add_timer(&hwgroup->timer);
-					spin_unlock_irqrestore(&io_request_lock, flags);
+					spin_unlock_irqrestore(&ide_queue_lock, flags);
 					return;
 				}
 			}
@@ -1721,7 +1726,7 @@ void ide_timer_expiry (unsigned long data)
 			 * the handler() function, which means we need to globally
 			 * mask the specific IRQ:
 			 */
-			spin_unlock(&io_request_lock);
+			spin_unlock(&ide_queue_lock);
 			hwif  = HWIF(drive);
 #if DISABLE_IRQ_NOSYNC
 			disable_irq_nosync(hwif->irq);
@@ -1747,13 +1752,13 @@ void ide_timer_expiry (unsigned long data)
 			set_recovery_timer(hwif);
 			drive->service_time = jiffies - drive->service_start;
 			enable_irq(hwif->irq);
-			spin_lock_irq(&io_request_lock);
+			spin_lock_irq(&ide_queue_lock);
 			if (startstop == ide_stopped)
 				hwgroup->busy = 0;
 		}
 	}
 	ide_do_request(hwgroup, 0);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /*
@@ -1816,11 +1821,11 @@ void ide_intr (int irq, void *dev_id, struct pt_regs *regs)
 	ide_handler_t *handler;
 	ide_startstop_t startstop;
 
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	hwif = hwgroup->hwif;
 
 	if (!ide_ack_intr(hwif)) {
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(&ide_queue_lock, flags);
 		return;
 	}
 
@@ -1854,7 +1859,7 @@ void ide_intr (int irq, void *dev_id, struct pt_regs *regs)
 			(void) IN_BYTE(hwif->io_ports[IDE_STATUS_OFFSET]);
 #endif /* CONFIG_BLK_DEV_IDEPCI */
 		}
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(&ide_queue_lock, flags);
 		return;
 	}
 	drive = hwgroup->drive;
@@ -1862,7 +1867,7 @@ void ide_intr (int irq, void *dev_id, struct pt_regs *regs)
 		/*
 		 * This should NEVER happen, and there isn't much we could do about it here.
 		 */
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(&ide_queue_lock, flags);
 		return;
 	}
 	if (!drive_is_ready(drive)) {
@@ -1872,7 +1877,7 @@ void ide_intr (int irq, void *dev_id, struct pt_regs *regs)
 		 * the IRQ before their status register is up to date.  Hopefully we have
 		 * enough advance overhead that the latter isn't a problem.
 		 */
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(&ide_queue_lock, flags);
 		return;
 	}
 	if (!hwgroup->busy) {
@@ -1881,12 +1886,12 @@ void ide_intr (int irq, void *dev_id, struct pt_regs *regs)
 	}
 	hwgroup->handler = NULL;
 	del_timer(&hwgroup->timer);
-	spin_unlock(&io_request_lock);
+	spin_unlock(&ide_queue_lock);
 
 	if (drive->unmask)
 		ide__sti();	/* local CPU only */
 	startstop = handler(drive);		/* service this interrupt, may set handler for next interrupt */
-	spin_lock_irq(&io_request_lock);
+	spin_lock_irq(&ide_queue_lock);
 
 	/*
 	 * Note that handler() may have set things up for another
@@ -1905,7 +1910,7 @@ void ide_intr (int irq, void *dev_id, struct pt_regs *regs)
 			printk("%s: ide_intr: huh? expected NULL handler on exit\n", drive->name);
 		}
 	}
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 }
 
 /*
@@ -1990,7 +1995,7 @@ int ide_do_drive_cmd (ide_drive_t *drive, struct request *rq, ide_action_t actio
 	rq->rq_dev = MKDEV(major,(drive->select.b.unit)<<PARTN_BITS);
 	if (action == ide_wait)
 		rq->waiting = &wait;
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	if (list_empty(queue_head) || action == ide_preempt) {
 		if (action == ide_preempt)
 			hwgroup->rq = NULL;
@@ -2002,7 +2007,7 @@ int ide_do_drive_cmd (ide_drive_t *drive, struct request *rq, ide_action_t actio
 	}
 	list_add(&rq->queue, queue_head);
 	ide_do_request(hwgroup, 0);
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 	if (action == ide_wait) {
 		wait_for_completion(&wait);	/* wait for it to be serviced */
 		return rq->errors ? -EIO : 0;	/* return -EIO if errors */
@@ -2031,14 +2036,14 @@ int ide_revalidate_disk (kdev_t i_rdev)
 	major = MAJOR(i_rdev);
 	minor = drive->select.b.unit << PARTN_BITS;
 	hwgroup = HWGROUP(drive);
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(&ide_queue_lock, flags);
 	if (drive->busy || (drive->usage > 1)) {
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(&ide_queue_lock, flags);
 		return -EBUSY;
 	};
 	drive->busy = 1;
 	MOD_INC_USE_COUNT;
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(&ide_queue_lock, flags);
 
 	for (p = 0; p < (1<<PARTN_BITS); ++p) {
 		if (drive->part[p].nr_sects > 0) {
@@ -2567,7 +2572,7 @@ int ide_read_setting (ide_drive_t *drive, ide_settings_t *setting)
 	unsigned long	flags;
 
 	if ((setting->rw & SETTING_READ)) {
-		spin_lock_irqsave(&io_request_lock, flags);
+		spin_lock_irqsave(&ide_queue_lock, flags);
 		switch(setting->data_type) {
 			case TYPE_BYTE:
 				val = *((u8 *) setting->data);
@@ -2580,7 +2585,7 @@ int ide_read_setting (ide_drive_t *drive, ide_settings_t *setting)
 				val = *((u32 *) setting->data);
 				break;
 		}
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(&ide_queue_lock, flags);
 	}
 	return val;
 }
@@ -2590,11 +2595,11 @@ int ide_spin_wait_hwgroup (ide_drive_t *drive)
 	ide_hwgroup_t *hwgroup = HWGROUP(drive);
 	unsigned long timeout = jiffies + (3 * HZ);
 
-	spin_lock_irq(&io_request_lock);
+	spin_lock_irq(&ide_queue_lock);
 
 	while (hwgroup->busy) {
 		unsigned long lflags;
-		spin_unlock_irq(&io_request_lock);
+		spin_unlock_irq(&ide_queue_lock);
 		__save_flags(lflags);	/* local CPU only */
 		__sti();		/* local CPU only; needed for jiffies */
 		if (0 < (signed long)(jiffies - timeout)) {
@@ -2603,7 +2608,7 @@ int ide_spin_wait_hwgroup (ide_drive_t *drive)
 			return -EBUSY;
 		}
 		__restore_flags(lflags);	/* local CPU only */
-		spin_lock_irq(&io_request_lock);
+		spin_lock_irq(&ide_queue_lock);
 	}
 	return 0;
 }
@@ -2644,7 +2649,7 @@ int ide_write_setting (ide_drive_t *drive, ide_settings_t *setting, int val)
 				*p = val;
 			break;
 	}
-	spin_unlock_irq(&io_request_lock);
+	spin_unlock_irq(&ide_queue_lock);
 	return 0;
 }
 
@@ -3015,7 +3020,7 @@ static int ide_ioctl (struct inode *inode, struct file *file,
 
 			if (!capable(CAP_SYS_ADMIN)) return -EACCES;
 #if 1
-			spin_lock_irqsave(&io_request_lock, flags);
+			spin_lock_irqsave(&ide_queue_lock, flags);
 			if (hwgroup->handler != NULL) {
 				printk("%s: ide_set_handler: handler not null; %p\n", drive->name, hwgroup->handler);
 				(void) hwgroup->handler(drive);
@@ -3024,7 +3029,7 @@ static int ide_ioctl (struct inode *inode, struct file *file,
 				hwgroup->timer.expires = jiffies + 0;;
 				del_timer(&hwgroup->timer);
 			}
-			spin_unlock_irqrestore(&io_request_lock, flags);
+			spin_unlock_irqrestore(&ide_queue_lock, flags);
 
 #endif
 			(void) ide_do_reset(drive);
@@ -3934,6 +3939,7 @@ struct block_device_operations ide_fops[] = {{
 }};
 
 EXPORT_SYMBOL(ide_hwifs);
+EXPORT_SYMBOL(ide_queue_lock);
 EXPORT_SYMBOL(ide_register_module);
 EXPORT_SYMBOL(ide_unregister_module);
 EXPORT_SYMBOL(ide_spin_wait_hwgroup);
@@ -2937,7 +2937,7 @@ int md_thread(void * arg)
 	 * many dirty RAID5 blocks.
 	 */
 	current->policy = SCHED_OTHER;
-	current->nice = -20;
+	set_user_nice(current, -20);
 	md_unlock_kernel();
 
 	complete(thread->event);
@@ -3394,7 +3394,7 @@ recheck:
 	/*
 	 * Resync has low priority.
 	 */
-	current->nice = 19;
+	set_user_nice(current, 19);
 
 	is_mddev_idle(mddev); /* this also initializes IO event counters */
 	for (m = 0; m < SYNC_MARKS; m++) {
@@ -3473,7 +3473,7 @@ recheck:
 		currspeed = (j-mddev->resync_mark_cnt)/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
 
 		if (currspeed > sysctl_speed_limit_min) {
-			current->nice = 19;
+			set_user_nice(current, 19);
 
 			if ((currspeed > sysctl_speed_limit_max) ||
 					!is_mddev_idle(mddev)) {
@@ -3482,7 +3482,7 @@ recheck:
 				goto repeat;
 			}
 		} else
-			current->nice = -20;
+			set_user_nice(current, -20);
 	}
 	printk(KERN_INFO "md: md%d: sync done.\n",mdidx(mddev));
 	err = 0;
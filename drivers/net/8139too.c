@@ -153,9 +153,12 @@
 static int media[MAX_UNITS] = {-1, -1, -1, -1, -1, -1, -1, -1};
 static int full_duplex[MAX_UNITS] = {-1, -1, -1, -1, -1, -1, -1, -1};
 
-/* Maximum events (Rx packets, etc.) to handle at each interrupt. */
+/* Maximum events (Tx completions, errors) to handle at each interrupt. */
 static int max_interrupt_work = 20;
 
+/* Rx packets to handle at each poll; receive is done by rtl8139_poll. */
+static int poll_weight = 64;
+
 /* Maximum number of multicast addresses to filter (vs. Rx-all-multicast).
    The RTL chips use a 64 element hash table based on the Ethernet CRC.  */
 static int multicast_filter_limit = 32;
@@ -579,6 +582,7 @@ struct rtl8139_private {
 	char twistie, twist_row, twist_col;	/* Twister tune state. */
 	unsigned int default_port:4;	/* Last dev->if_port value. */
 	spinlock_t lock;
+	spinlock_t rx_lock;	/* rx ring, against tx_timeout's reset */
 	chip_t chipset;
 	pid_t thr_pid;
 	wait_queue_head_t thr_wait;
@@ -596,12 +600,14 @@ MODULE_LICENSE("GPL");
 
 MODULE_PARM (multicast_filter_limit, "i");
 MODULE_PARM (max_interrupt_work, "i");
+MODULE_PARM (poll_weight, "i");
 MODULE_PARM (media, "1-" __MODULE_STRING(MAX_UNITS) "i");
 MODULE_PARM (full_duplex, "1-" __MODULE_STRING(MAX_UNITS) "i");
 MODULE_PARM (debug, "i");
 MODULE_PARM_DESC (debug, "8139too bitmapped message enable number");
 MODULE_PARM_DESC (multicast_filter_limit, "8139too maximum number of filtered multicast addresses");
 MODULE_PARM_DESC (max_interrupt_work, "8139too maximum events handled per interrupt");
+MODULE_PARM_DESC (poll_weight, "8139too maximum Rx packets handled per poll");
 MODULE_PARM_DESC (media, "8139too: Bits 4+9: force full duplex, bit 5: 100Mbps");
 MODULE_PARM_DESC (full_duplex, "8139too: Force full duplex for board(s) (1)");
 
@@ -617,6 +623,7 @@ static int rtl8139_start_xmit (struct sk_buff *skb,
 			       struct net_device *dev);
 static void rtl8139_interrupt (int irq, void *dev_instance,
 			       struct pt_regs *regs);
+static int rtl8139_poll (struct net_device *dev, int *budget);
 static int rtl8139_close (struct net_device *dev);
 static int netdev_ioctl (struct net_device *dev, struct ifreq *rq, int cmd);
 static struct net_device_stats *rtl8139_get_stats (struct net_device *dev);
@@ -686,6 +693,10 @@ static const u16 rtl8139_intr_mask =
 	PCIErr | PCSTimeout | RxUnderrun | RxOverflow | RxFIFOOver |
 	TxErr | TxOK | RxErr | RxOK;
 
+/* ...and while rtl8139_poll owns the Rx ring */
+static const u16 rtl8139_norx_intr_mask =
+	PCIErr | PCSTimeout | RxUnderrun | TxErr | TxOK | RxErr;
+
 static const unsigned int rtl8139_rx_config =
 	RxCfgRcv32K | RxNoWrap |
 	(RX_FIFO_THRESH << RxCfgFIFOShift) |
@@ -969,6 +980,8 @@ static int __devinit rtl8139_init_one (struct pci_dev *pdev,
 	dev->do_ioctl = netdev_ioctl;
 	dev->tx_timeout = rtl8139_tx_timeout;
 	dev->watchdog_timeo = TX_TIMEOUT;
+	dev->poll = rtl8139_poll;
+	dev->weight = poll_weight > 0 ? poll_weight : 64;
 	dev->features |= NETIF_F_SG|NETIF_F_HW_CSUM;
 
 	dev->irq = pdev->irq;
@@ -980,6 +993,7 @@ static int __devinit rtl8139_init_one (struct pci_dev *pdev,
 	tp->drv_flags = board_info[ent->driver_data].hw_flags;
 	tp->mmio_addr = ioaddr;
 	spin_lock_init (&tp->lock);
+	spin_lock_init (&tp->rx_lock);
 	init_waitqueue_head (&tp->thr_wait);
 	init_completion (&tp->thr_exited);
 	tp->mii.dev = dev;
@@ -1665,7 +1679,9 @@ static void rtl8139_tx_timeout (struct net_device *dev)
 	spin_unlock_irqrestore (&tp->lock, flags);
 
 	/* ...and finally, reset everything */
+	spin_lock (&tp->rx_lock);
 	rtl8139_hw_start (dev);
+	spin_unlock (&tp->rx_lock);
 
 	netif_wake_queue (dev);
 }
@@ -1864,9 +1880,11 @@ static void rtl8139_rx_err (u32 rx_status, struct net_device *dev,
 #endif
 }
 
-static void rtl8139_rx_interrupt (struct net_device *dev,
-				  struct rtl8139_private *tp, void *ioaddr)
+static int rtl8139_rx (struct net_device *dev, struct rtl8139_private *tp,
+		       int budget)
 {
+	void *ioaddr = tp->mmio_addr;
+	int received = 0;
 	unsigned char *rx_ring;
 	u16 cur_rx;
 
@@ -1882,7 +1900,7 @@ static void rtl8139_rx_interrupt (struct net_device *dev,
 		 RTL_R16 (RxBufAddr),
 		 RTL_R16 (RxBufPtr), RTL_R8 (ChipCmd));
 
-	while ((RTL_R8 (ChipCmd) & RxBufEmpty) == 0) {
+	while (received < budget && (RTL_R8 (ChipCmd) & RxBufEmpty) == 0) {
 		int ring_offset = cur_rx % RX_BUF_LEN;
 		u32 rx_status;
 		unsigned int rx_size;
@@ -1928,18 +1946,12 @@ static void rtl8139_rx_interrupt (struct net_device *dev,
 		    (rx_size < 8) ||
 		    (!(rx_status & RxStatusOK))) {
 			rtl8139_rx_err (rx_status, dev, tp, ioaddr);
-			return;
+			return received;
 		}
 
 		/* Malloc up new buffer, compatible with net-2e. */
 		/* Omit the four octet CRC from the length. */
 
-		/* TODO: consider allocating skb's outside of
-		 * interrupt context, both to speed interrupt processing,
-		 * and also to reduce the chances of having to
-		 * drop packets here under memory pressure.
-		 */
-
 		skb = dev_alloc_skb (pkt_size + 2);
 		if (skb) {
 			skb->dev = dev;
@@ -1949,7 +1961,7 @@ static void rtl8139_rx_interrupt (struct net_device *dev,
 			skb_put (skb, pkt_size);
 
 			skb->protocol = eth_type_trans (skb, dev);
-			netif_rx (skb);
+			netif_receive_skb (skb);
 			dev->last_rx = jiffies;
 			tp->stats.rx_bytes += pkt_size;
 			tp->stats.rx_packets++;
@@ -1959,6 +1971,7 @@ static void rtl8139_rx_interrupt (struct net_device *dev,
 				dev->name);
 			tp->stats.rx_dropped++;
 		}
+		received++;
 
 		cur_rx = (cur_rx + rx_size + 4 + 3) & ~3;
 		RTL_W16 (RxBufPtr, cur_rx - 16);
@@ -1973,6 +1986,40 @@ static void rtl8139_rx_interrupt (struct net_device *dev,
 		 RTL_R16 (RxBufPtr), RTL_R8 (ChipCmd));
 
 	tp->cur_rx = cur_rx;
+	return received;
+}
+
+
+/* Receive work scheduled by rtl8139_interrupt, with the Rx interrupt
+   sources masked until the ring has been emptied. */
+static int rtl8139_poll (struct net_device *dev, int *budget)
+{
+	struct rtl8139_private *tp = dev->priv;
+	void *ioaddr = tp->mmio_addr;
+	int orig_budget = min (*budget, dev->quota);
+	int done = 1;
+
+	spin_lock (&tp->rx_lock);
+	if (RTL_R16 (IntrStatus) & RxAckBits) {
+		int work_done;
+
+		work_done = rtl8139_rx (dev, tp, orig_budget);
+		*budget -= work_done;
+		dev->quota -= work_done;
+		done = (work_done < orig_budget);
+	}
+
+	if (done) {
+		/* An interrupt between the two would find the poll
+		 * still scheduled and leave Rx masked for good. */
+		local_irq_disable ();
+		RTL_W16_F (IntrMask, rtl8139_intr_mask);
+		__netif_rx_complete (dev);
+		local_irq_enable ();
+	}
+	spin_unlock (&tp->rx_lock);
+
+	return !done;
 }
 
 
@@ -2029,8 +2076,8 @@ static void rtl8139_weird_interrupt (struct net_device *dev,
 }
 
 
-/* The interrupt handler does all of the Rx thread work and cleans up
-   after the Tx thread. */
+/* The interrupt handler schedules the Rx work for rtl8139_poll and cleans
+   up after the Tx thread. */
 static void rtl8139_interrupt (int irq, void *dev_instance,
 			       struct pt_regs *regs)
 {
@@ -2038,6 +2085,7 @@ static void rtl8139_interrupt (int irq, void *dev_instance,
 	struct rtl8139_private *tp = dev->priv;
 	int boguscnt = max_interrupt_work;
 	void *ioaddr = tp->mmio_addr;
+	u16 mask = rtl8139_intr_mask;
 	int ackstat, status;
 	int link_changed = 0; /* avoid bogus "uninit" warning */
 
@@ -2050,9 +2098,9 @@ static void rtl8139_interrupt (int irq, void *dev_instance,
 		if (status == 0xFFFF)
 			break;
 
-		if ((status &
-		     (PCIErr | PCSTimeout | RxUnderrun | RxOverflow |
-		      RxFIFOOver | TxErr | TxOK | RxErr | RxOK)) == 0)
+		/* Rx bits stay set until the poll routine acks them */
+		status &= mask;
+		if (status == 0)
 			break;
 
 		/* Acknowledge all of the current interrupt sources ASAP, but
@@ -2069,8 +2117,15 @@ static void rtl8139_interrupt (int irq, void *dev_instance,
 		DPRINTK ("%s: interrupt  status=%#4.4x ackstat=%#4.4x new intstat=%#4.4x.\n",
 			 dev->name, ackstat, status, RTL_R16 (IntrStatus));
 
-		if (netif_running (dev) && (status & RxAckBits))
-			rtl8139_rx_interrupt (dev, tp, ioaddr);
+		/* Receive packets are processed by the poll routine */
+		if (status & RxAckBits) {
+			if (netif_running (dev) && netif_rx_schedule_prep (dev)) {
+				RTL_W16_F (IntrMask, rtl8139_norx_intr_mask);
+				dev->irq_count++;
+				__netif_rx_schedule (dev);
+			}
+			mask &= ~RxAckBits;
+		}
 
 		/* Check uncommon events with one test. */
 		if (status & (PCIErr | PCSTimeout | RxUnderrun | RxOverflow |
@@ -91,6 +91,8 @@
 #define E100_DEFAULT_FC           0
 #define E100_DEFAULT_IFS          true
 #define E100_DEFAULT_UCODE        true
+#define E100_DEFAULT_WEIGHT       64
+#define E100_MAX_WEIGHT           256
 
 #define TX_THRSHLD     8
 
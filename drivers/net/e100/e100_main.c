@@ -346,7 +346,8 @@ e100_alloc_skbs(struct e100_private *bdp)
 }
 
 void e100_tx_srv(struct e100_private *);
-u32 e100_rx_srv(struct e100_private *);
+u32 e100_rx_srv(struct e100_private *, int);
+static int e100_poll(struct net_device *, int *);
 
 void e100_watchdog(struct net_device *);
 static void e100_do_hwi(struct net_device *);
@@ -374,6 +375,7 @@ E100_PARAM(IntDelay, "Value for CPU saver's interrupt delay");
 E100_PARAM(BundleSmallFr, "Disable or enable interrupt bundling of small frames");
 E100_PARAM(BundleMax, "Maximum number for CPU saver's packet bundling");
 E100_PARAM(IFS, "Disable or enable the adaptive IFS algorithm");
+E100_PARAM(PollWeight, "Receive packets per poll");
 
 /**
  * e100_exec_cmd - issue a comand
@@ -638,6 +640,7 @@ e100_found1(struct pci_dev *pcid, const struct pci_device_id *ent)
 	dev->set_multicast_list = &e100_set_multi;
 	dev->set_mac_address = &e100_set_mac;
 	dev->do_ioctl = &e100_ioctl;
+	dev->poll = &e100_poll;
 	if (bdp->flags & USE_IPCB) {
 		dev->features |= NETIF_F_SG | NETIF_F_IP_CSUM;
 	}
@@ -853,6 +856,10 @@ e100_check_options(int board, struct e100_private *bdp)
 			    0xFFFF, E100_DEFAULT_CPUSAVER_BUNDLE_MAX,
 			    "CPU saver bundle max value");
 
+	e100_set_int_option(&(bdp->device->weight), PollWeight[board], 1,
+			    E100_MAX_WEIGHT, E100_DEFAULT_WEIGHT,
+			    "poll weight value");
+
 }
 
 /**
@@ -1798,8 +1805,8 @@ e100_manage_adaptive_ifs(struct e100_private *bdp)
  * @regs: registers (unused)
  *
  * This routine is the ISR for the e100 board. It services
- * the RX & TX queues & starts the RU if it has stopped due
- * to no resources.
+ * the TX queue and hands RX work to e100_poll, leaving the
+ * board's interrupts masked until the poll is done.
  */
 void
 e100intr(int irq, void *dev_inst, struct pt_regs *regs)
@@ -1833,27 +1840,73 @@ e100intr(int irq, void *dev_inst, struct pt_regs *regs)
 		goto exit;
 	}
 
-	/* SWI intr (triggered by watchdog) is signal to allocate new skb buffers */
-	if (intr_status & SCB_STATUS_ACK_SWI) {
-		e100_alloc_skbs(bdp);
-	}
-
-	/* do recv work if any */
-	if (intr_status &
-	    (SCB_STATUS_ACK_FR | SCB_STATUS_ACK_RNR | SCB_STATUS_ACK_SWI)) 
-		bdp->drv_stats.rx_intr_pkts += e100_rx_srv(bdp);
-
 	/* clean up after tx'ed packets */
 	if (intr_status & (SCB_STATUS_ACK_CNA | SCB_STATUS_ACK_CX)) {
 		bdp->tx_count = 0;	/* restart tx interrupt batch count */
 		e100_tx_srv(bdp);
 	}
 
+	/* recv work, and the SWI (triggered by watchdog) asking for new
+	 * skb buffers, are done by e100_poll with interrupts kept off.
+	 * A poll already pending will turn them back on itself. */
+	if ((intr_status &
+	     (SCB_STATUS_ACK_FR | SCB_STATUS_ACK_RNR | SCB_STATUS_ACK_SWI)) ||
+	    test_bit(__LINK_STATE_RX_SCHED, &dev->state)) {
+		if (netif_rx_schedule_prep(dev)) {
+			dev->irq_count++;
+			__netif_rx_schedule(dev);
+		}
+		read_unlock(&(bdp->isolate_lock));
+		return;
+	}
+
 exit:
 	e100_set_intr_mask(bdp);
 	read_unlock(&(bdp->isolate_lock));
 }
 
+/**
+ * e100_poll - NAPI RX polling callback
+ * @dev: the net_device struct
+ * @budget: packets left in this round of net_rx_action
+ *
+ * This routine services the RX queue on behalf of the ISR, at most
+ * dev->quota packets at a time, and unmasks the board's interrupts
+ * once the queue is empty.
+ */
+static int
+e100_poll(struct net_device *dev, int *budget)
+{
+	struct e100_private *bdp = dev->priv;
+	int work_to_do = min(*budget, dev->quota);
+	int work_done;
+
+	read_lock(&(bdp->isolate_lock));
+	if (bdp->driver_isolated) {
+		/* interrupts come back with e100_hwi_restore */
+		read_unlock(&(bdp->isolate_lock));
+		netif_rx_complete(dev);
+		return 0;
+	}
+
+	e100_alloc_skbs(bdp);
+	work_done = e100_rx_srv(bdp, work_to_do);
+	bdp->drv_stats.rx_intr_pkts += work_done;
+
+	*budget -= work_done;
+	dev->quota -= work_done;
+
+	if (work_done < work_to_do || !netif_running(dev)) {
+		netif_rx_complete(dev);
+		e100_set_intr_mask(bdp);
+		read_unlock(&(bdp->isolate_lock));
+		return 0;
+	}
+
+	read_unlock(&(bdp->isolate_lock));
+	return 1;
+}
+
 /**
  * e100_tx_skb_free - free TX skbs resources
  * @bdp: atapter's private data struct
@@ -1935,7 +1988,7 @@ e100_tx_srv(struct e100_private *bdp)
  * It returns the number of serviced RFDs.
  */
 u32
-e100_rx_srv(struct e100_private *bdp)
+e100_rx_srv(struct e100_private *bdp, int max_number_of_rfds)
 {
 	rfd_t *rfd;		/* new rfd, received rfd */
 	int i;
@@ -1960,6 +2013,8 @@ e100_rx_srv(struct e100_private *bdp)
 	 *    (watchdog trigger SWI intr and isr should allocate new skbs)
 	 */
 	for (i = 0; i < bdp->params.RxDescriptors; i++) {
+		if (rfd_cnt >= max_number_of_rfds)
+			break;
 		if (list_empty(&(bdp->active_rx_list))) {
 			break;
 		}
@@ -2024,7 +2079,7 @@ e100_rx_srv(struct e100_private *bdp)
 		} else {
 			skb->ip_summed = CHECKSUM_NONE;
 		}
-		switch (netif_rx(skb)) {
+		switch (netif_receive_skb(skb)) {
 		case NET_RX_BAD:
 		case NET_RX_DROP:
 		case NET_RX_CN_MOD:
@@ -61,6 +61,7 @@
 #include <linux/tcp.h>
 #include <linux/udp.h>
 #include <net/pkt_sched.h>
+#include <net/checksum.h>
 #include <linux/list.h>
 #include <linux/reboot.h>
 #include <linux/tqueue.h>
@@ -86,7 +87,6 @@ struct e1000_adapter;
 
 #define E1000_ERR(args...) printk(KERN_ERR "e1000: " args)
 
-#define E1000_MAX_INTR 10
 
 /* Supported Rx Buffer Sizes */
 #define E1000_RXBUFFER_2048  2048
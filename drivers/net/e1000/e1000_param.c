@@ -183,6 +183,15 @@ E1000_PARAM(RxIntDelay, "Receive Interrupt Delay");
 
 E1000_PARAM(RxAbsIntDelay, "Receive Absolute Interrupt Delay");
 
+/* Poll Weight - receive packets handled per dev->poll call
+ *
+ * Valid Range: 1-256
+ *
+ * Default Value: 64
+ */
+
+E1000_PARAM(PollWeight, "Receive packets per poll");
+
 #define AUTONEG_ADV_DEFAULT  0x2F
 #define AUTONEG_ADV_MASK     0x2F
 #define FLOW_CONTROL_DEFAULT FLOW_CONTROL_FULL
@@ -213,6 +222,10 @@ E1000_PARAM(RxAbsIntDelay, "Receive Absolute Interrupt Delay");
 #define MAX_TXABSDELAY            0xFFFF
 #define MIN_TXABSDELAY                 0
 
+#define DEFAULT_WEIGHT                64
+#define MAX_WEIGHT                   256
+#define MIN_WEIGHT                     1
+
 struct e1000_option {
 	enum { enable_option, range_option, list_option } type;
 	char *name;
@@ -422,6 +435,19 @@ e1000_check_options(struct e1000_adapter *adapter)
 		adapter->rx_abs_int_delay = RxAbsIntDelay[bd];
 		e1000_validate_option(&adapter->rx_abs_int_delay, &opt);
 	}
+	{ /* Poll Weight */
+		char *weight = "using default of " __MODULE_STRING(DEFAULT_WEIGHT);
+		struct e1000_option opt = {
+			.type = range_option,
+			.name = "Poll Weight",
+			.arg  = { r: { min: MIN_WEIGHT, max: MAX_WEIGHT }}
+		};
+		opt.def = DEFAULT_WEIGHT;
+		opt.err = weight;
+
+		adapter->netdev->weight = PollWeight[bd];
+		e1000_validate_option(&adapter->netdev->weight, &opt);
+	}
 	
 	switch(adapter->hw.media_type) {
 	case e1000_media_type_fiber:
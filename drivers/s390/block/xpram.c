@@ -1221,7 +1221,9 @@ void cleanup_module(void)
 
 #if (XPRAM_VERSION == 22)
 	blk_dev[major].request_fn = NULL;
-#endif /* V22 */
+#elif (XPRAM_VERSION == 24)
+	blk_cleanup_queue(BLK_DEFAULT_QUEUE(major));
+#endif /* V22/V24 */
 	read_ahead[major] = 0;
 	blk_size[major] = NULL;
 	kfree(blksize_size[major]);
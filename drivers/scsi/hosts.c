@@ -162,6 +162,8 @@ struct Scsi_Host * scsi_register(Scsi_Host_Template * tpnt, int j){
     }
     atomic_set(&retval->host_active,0);
     retval->host_busy = 0;
+    spin_lock_init(&retval->default_lock);
+    retval->host_lock = &io_request_lock;
     retval->host_failed = 0;
     if(j > 0xffff) panic("Too many extra bytes requested\n");
     retval->extra_bytes = j;
@@ -333,6 +333,9 @@ struct Scsi_Host
     atomic_t                host_active; /* commands checked out */
     volatile unsigned short host_busy;   /* commands actually active on low-level */
     volatile unsigned short host_failed; /* commands that failed. */
+    spinlock_t            * host_lock;   /* protects the host and the request
+                                          queues of its devices. */
+    spinlock_t              default_lock;
     
 /* public: */
     unsigned short extra_bytes;
@@ -489,6 +492,17 @@ static inline void scsi_set_pci_device(struct Scsi_Host *SHpnt,
 	SHpnt->pci_dev = pdev;
 }
 
+/*
+ * By default the mid-layer calls into a host, and runs the request
+ * queues of its devices, under io_request_lock.  A driver can have it
+ * use a lock of its own instead (or &SHpnt->default_lock) by calling
+ * this from its detect routine, before the devices are scanned.
+ */
+static inline void scsi_assign_lock(struct Scsi_Host *SHpnt, spinlock_t *lock)
+{
+	SHpnt->host_lock = lock;
+}
+
 
 /*
  * Prototypes for functions/data in scsi_scan.c
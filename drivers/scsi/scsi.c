@@ -195,7 +195,8 @@ void  scsi_initialize_queue(Scsi_Device * SDpnt, struct Scsi_Host * SHpnt)
 {
 	request_queue_t *q = &SDpnt->request_queue;
 
-	blk_init_queue(q, scsi_request_fn);
+	/* all the device queues of a host share its lock */
+	blk_init_queue_lock(q, scsi_request_fn, SHpnt->host_lock);
 	blk_queue_headactive(q, 0);
 	q->queuedata = (void *) SDpnt;
 }
@@ -628,7 +629,7 @@ int scsi_dispatch_cmd(Scsi_Cmnd * SCpnt)
 	unsigned long flags = 0;
 	unsigned long timeout;
 
-	ASSERT_LOCK(&io_request_lock, 0);
+	ASSERT_LOCK(SCpnt->host->host_lock, 0);
 
 #if DEBUG
 	unsigned long *ret = 0;
@@ -700,9 +701,9 @@ int scsi_dispatch_cmd(Scsi_Cmnd * SCpnt)
 			 * length exceeds what the host adapter can handle.
 			 */
 			if (CDB_SIZE(SCpnt) <= SCpnt->host->max_cmd_len) {
-				spin_lock_irqsave(&io_request_lock, flags);
+				spin_lock_irqsave(host->host_lock, flags);
 				rtn = host->hostt->queuecommand(SCpnt, scsi_done);
-				spin_unlock_irqrestore(&io_request_lock, flags);
+				spin_unlock_irqrestore(host->host_lock, flags);
 				if (rtn != 0) {
 					scsi_delete_timer(SCpnt);
 					scsi_mlqueue_insert(SCpnt, SCSI_MLQUEUE_HOST_BUSY);
@@ -711,9 +712,9 @@ int scsi_dispatch_cmd(Scsi_Cmnd * SCpnt)
 			} else {
 				SCSI_LOG_MLQUEUE(3, printk("queuecommand : command too long.\n"));
 				SCpnt->result = (DID_ABORT << 16);
-				spin_lock_irqsave(&io_request_lock, flags);
+				spin_lock_irqsave(host->host_lock, flags);
 				scsi_done(SCpnt);
-				spin_unlock_irqrestore(&io_request_lock, flags);
+				spin_unlock_irqrestore(host->host_lock, flags);
 				rtn = 1;
 			}
 		} else {
@@ -722,15 +723,15 @@ int scsi_dispatch_cmd(Scsi_Cmnd * SCpnt)
 			 * length exceeds what the host adapter can handle.
 			 */
 			if (CDB_SIZE(SCpnt) <= SCpnt->host->max_cmd_len) {
-				spin_lock_irqsave(&io_request_lock, flags);
+				spin_lock_irqsave(host->host_lock, flags);
 				host->hostt->queuecommand(SCpnt, scsi_old_done);
-				spin_unlock_irqrestore(&io_request_lock, flags);
+				spin_unlock_irqrestore(host->host_lock, flags);
 			} else {
 				SCSI_LOG_MLQUEUE(3, printk("queuecommand : command too long.\n"));
 				SCpnt->result = (DID_ABORT << 16);
-				spin_lock_irqsave(&io_request_lock, flags);
+				spin_lock_irqsave(host->host_lock, flags);
 				scsi_old_done(SCpnt);
-				spin_unlock_irqrestore(&io_request_lock, flags);
+				spin_unlock_irqrestore(host->host_lock, flags);
 				rtn = 1;
 			}
 		}
@@ -738,11 +739,11 @@ int scsi_dispatch_cmd(Scsi_Cmnd * SCpnt)
 		int temp;
 
 		SCSI_LOG_MLQUEUE(3, printk("command() :  routine at %p\n", host->hostt->command));
-                spin_lock_irqsave(&io_request_lock, flags);
+                spin_lock_irqsave(host->host_lock, flags);
 		temp = host->hostt->command(SCpnt);
 		SCpnt->result = temp;
 #ifdef DEBUG_DELAY
-                spin_unlock_irqrestore(&io_request_lock, flags);
+                spin_unlock_irqrestore(host->host_lock, flags);
 		clock = jiffies + 4 * HZ;
 		while (time_before(jiffies, clock)) {
 			barrier();
@@ -750,14 +751,14 @@ int scsi_dispatch_cmd(Scsi_Cmnd * SCpnt)
 		}
 		printk("done(host = %d, result = %04x) : routine at %p\n",
 		       host->host_no, temp, host->hostt->command);
-                spin_lock_irqsave(&io_request_lock, flags);
+                spin_lock_irqsave(host->host_lock, flags);
 #endif
 		if (host->hostt->use_new_eh_code) {
 			scsi_done(SCpnt);
 		} else {
 			scsi_old_done(SCpnt);
 		}
-                spin_unlock_irqrestore(&io_request_lock, flags);
+                spin_unlock_irqrestore(host->host_lock, flags);
 	}
 	SCSI_LOG_MLQUEUE(3, printk("leaving scsi_dispatch_cmnd()\n"));
 	return rtn;
@@ -827,7 +828,7 @@ void scsi_do_req(Scsi_Request * SRpnt, const void *cmnd,
 	Scsi_Device * SDpnt = SRpnt->sr_device;
 	struct Scsi_Host *host = SDpnt->host;
 
-	ASSERT_LOCK(&io_request_lock, 0);
+	ASSERT_LOCK(host->host_lock, 0);
 
 	SCSI_LOG_MLQUEUE(4,
 			 {
@@ -924,7 +925,7 @@ void scsi_init_cmd_from_req(Scsi_Cmnd * SCpnt, Scsi_Request * SRpnt)
 {
 	struct Scsi_Host *host = SCpnt->host;
 
-	ASSERT_LOCK(&io_request_lock, 0);
+	ASSERT_LOCK(host->host_lock, 0);
 
 	SCpnt->owner = SCSI_OWNER_MIDLEVEL;
 	SRpnt->sr_command = SCpnt;
@@ -1014,7 +1015,7 @@ void scsi_do_cmd(Scsi_Cmnd * SCpnt, const void *cmnd,
 {
 	struct Scsi_Host *host = SCpnt->host;
 
-	ASSERT_LOCK(&io_request_lock, 0);
+	ASSERT_LOCK(host->host_lock, 0);
 
 	SCpnt->pid = scsi_pid++;
 	SCpnt->owner = SCSI_OWNER_MIDLEVEL;
@@ -1174,13 +1175,12 @@ void scsi_done(Scsi_Cmnd * SCpnt)
 	 * Scsi_Cmnds, as it happens pretty often scsi_done is called multiple times
 	 * before bh is serviced. -jj
 	 *
-	 * We already have the io_request_lock here, since we are called from the
+	 * We already have the host lock here, since we are called from the
 	 * interrupt handler or the error handler. (DB)
 	 *
-	 * This may be true at the moment, but I would like to wean all of the low
-	 * level drivers away from using io_request_lock.   Technically they should
-	 * all use their own locking.  I am adding a small spinlock to protect
-	 * this datastructure to make it safe for that day.  (ERY)
+	 * Hosts may have locks of their own rather than io_request_lock,
+	 * so commands from different hosts can get here at the same time.
+	 * A small spinlock protects this datastructure.  (ERY)
 	 */
 	if (!scsi_bh_queue_head) {
 		scsi_bh_queue_head = SCpnt;
@@ -1208,7 +1208,7 @@ void scsi_done(Scsi_Cmnd * SCpnt)
  *              interrupt latency, stack depth, and reentrancy of the low-level
  *              drivers.
  *
- * The io_request_lock is required in all the routine. There was a subtle
+ * The host lock is required in all the routine. There was a subtle
  * race condition when scsi_done is called after a command has already
  * timed out but before the time out is processed by the error handler.
  * (DB)
@@ -1365,7 +1365,7 @@ void scsi_finish_command(Scsi_Cmnd * SCpnt)
 	Scsi_Request * SRpnt;
 	unsigned long flags;
 
-	ASSERT_LOCK(&io_request_lock, 0);
+	ASSERT_LOCK(SCpnt->host->host_lock, 0);
 
 	host = SCpnt->host;
 	device = SCpnt->device;
@@ -1377,10 +1377,10 @@ void scsi_finish_command(Scsi_Cmnd * SCpnt)
          * one execution context, but the device and host structures are
          * shared.
          */
-	spin_lock_irqsave(&io_request_lock, flags);
+	spin_lock_irqsave(host->host_lock, flags);
 	host->host_busy--;	/* Indicate that we are free */
 	device->device_busy--;	/* Decrement device usage counter. */
-	spin_unlock_irqrestore(&io_request_lock, flags);
+	spin_unlock_irqrestore(host->host_lock, flags);
 
         /*
          * Clear the flags which say that the device/host is no longer
@@ -2820,9 +2820,9 @@ scsi_reset_provider(Scsi_Device *dev, int flag)
 	} else {
 		unsigned long flags;
 
-		spin_lock_irqsave(&io_request_lock, flags);
+		spin_lock_irqsave(dev->host->host_lock, flags);
 		rtn = scsi_old_reset(SCpnt, flag);
-		spin_unlock_irqrestore(&io_request_lock, flags);
+		spin_unlock_irqrestore(dev->host->host_lock, flags);
 	}
 
 	scsi_delete_timer(SCpnt);
@@ -58,26 +58,97 @@
 					     number of unused buffer heads */
 
 /* Anti-deadlock ordering:
- *	lru_list_lock > hash_table_lock > unused_list_lock
+ *	lru set lock > hash bucket lock > inode_buffers_lock > unused_list_lock
+ *
+ * Only one lru set lock and one hash bucket lock are ever held at a time.
  */
 
 #define BH_ENTRY(list) list_entry((list), struct buffer_head, b_inode_buffers)
 
 /*
- * Hash table gook..
+ * Hash table gook..  Every chain has its own lock.  The chains are
+ * hashed by the page a buffer lives on in its block device's page cache,
+ * so all buffers of one page are on the same chain and whoever works on
+ * a whole page (grow_buffers, try_to_free_buffers) needs just one lock.
  */
+struct bh_hash_bucket {
+	struct buffer_head *head;
+	rwlock_t lock;
+};
+
 static unsigned int bh_hash_mask;
 static unsigned int bh_hash_shift;
-static struct buffer_head **hash_table;
-static rwlock_t hash_table_lock = RW_LOCK_UNLOCKED;
+static struct bh_hash_bucket *hash_table;
+
+/*
+ * The lru lists are split into sets, each under its own lock, and a
+ * buffer is filed in the set of its device, so that buffer traffic on
+ * different devices doesn't contend (unless the devices share a set).
+ * b_lru_set says which set the buffer is on.  nr and size are kept per
+ * set and only summed up when needed.
+ */
+#define NR_LRU_SETS	16
+
+struct bh_lru {
+	spinlock_t lock;
+	struct buffer_head *list[NR_LIST];
+	int nr_buffers[NR_LIST];
+	unsigned long size_buffers[NR_LIST];
+} ____cacheline_aligned_in_smp;
+
+static struct bh_lru lru_sets[NR_LRU_SETS];
+
+static inline struct bh_lru *dev_lru(kdev_t dev)
+{
+	unsigned int nr = HASHDEV(dev);
+
+	return &lru_sets[(nr ^ (nr >> 4) ^ (nr >> 8)) & (NR_LRU_SETS - 1)];
+}
+
+/* The set a buffer is on, or will go to.  Stable under that set's lock */
+static inline struct bh_lru *bh_lru(struct buffer_head *bh)
+{
+	if (bh->b_next_free)
+		return &lru_sets[bh->b_lru_set];
+	return dev_lru(bh->b_dev);
+}
+
+static struct bh_lru *lock_bh_lru(struct buffer_head *bh)
+{
+	struct bh_lru *lru;
+
+	for (;;) {
+		lru = bh_lru(bh);
+		spin_lock(&lru->lock);
+		if (lru == bh_lru(bh))
+			return lru;
+		spin_unlock(&lru->lock);
+	}
+}
 
-static struct buffer_head *lru_list[NR_LIST];
+static inline void unlock_bh_lru(struct bh_lru *lru)
+{
+	spin_unlock(&lru->lock);
+}
+
+static unsigned long size_buffers_type(int blist)
+{
+	unsigned long size = 0;
+	int i;
 
-static spinlock_cacheline_t lru_list_lock_cacheline = {SPIN_LOCK_UNLOCKED};
-#define lru_list_lock  lru_list_lock_cacheline.lock
+	for (i = 0; i < NR_LRU_SETS; i++)
+		size += lru_sets[i].size_buffers[blist];
+	return size;
+}
+
+/* The lru sets buffers of dev can be on: all of them for NODEV */
+#define for_each_dev_lru(lru, dev)					\
+	for (lru = (dev) == NODEV ? lru_sets : dev_lru(dev);		\
+	     lru < ((dev) == NODEV ? lru_sets + NR_LRU_SETS : dev_lru(dev) + 1); \
+	     lru++)
 
-static int nr_buffers_type[NR_LIST];
-static unsigned long size_buffers_type[NR_LIST];
+/* Protects the inode dirty buffer lists and b_inode */
+static spinlock_t inode_buffers_lock = SPIN_LOCK_UNLOCKED;
 
 static struct buffer_head * unused_list;
 static int nr_unused_buffer_heads;
@@ -189,21 +260,21 @@ static void write_locked_buffers(struct buffer_head **array, unsigned int count)
 }
 
 /*
- * Write some buffers from the head of the dirty queue.
+ * Write some buffers from the head of the dirty queue of an lru set.
  *
- * This must be called with the LRU lock held, and will
+ * This must be called with the set's lock held, and will
  * return without it!
  */
 #define NRSYNC (32)
-static int write_some_buffers(kdev_t dev)
+static int write_some_buffers(struct bh_lru *lru, kdev_t dev)
 {
 	struct buffer_head *next;
 	struct buffer_head *array[NRSYNC];
 	unsigned int count;
 	int nr;
 
-	next = lru_list[BUF_DIRTY];
-	nr = nr_buffers_type[BUF_DIRTY];
+	next = lru->list[BUF_DIRTY];
+	nr = lru->nr_buffers[BUF_DIRTY];
 	count = 0;
 	while (next && --nr >= 0) {
 		struct buffer_head * bh = next;
@@ -220,43 +291,62 @@ static int write_some_buffers(kdev_t dev)
 			if (count < NRSYNC)
 				continue;
 
-			spin_unlock(&lru_list_lock);
+			spin_unlock(&lru->lock);
 			write_locked_buffers(array, count);
 			return -EAGAIN;
 		}
 		unlock_buffer(bh);
 		__refile_buffer(bh);
 	}
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&lru->lock);
 
 	if (count)
 		write_locked_buffers(array, count);
 	return 0;
 }
 
+/*
+ * Write one batch from every lru set of dev that has dirty buffers, so
+ * that the devices are written out side by side instead of one after
+ * the other.  Returns the number of sets that may have more.
+ */
+static int write_dirty_round(kdev_t dev)
+{
+	struct bh_lru *lru;
+	int more = 0;
+
+	for_each_dev_lru(lru, dev) {
+		if (!lru->nr_buffers[BUF_DIRTY])
+			continue;
+		spin_lock(&lru->lock);
+		if (write_some_buffers(lru, dev))
+			more++;
+	}
+	return more;
+}
+
 /*
  * Write out all buffers on the dirty list.
  */
 static void write_unlocked_buffers(kdev_t dev)
 {
-	do
-		spin_lock(&lru_list_lock);
-	while (write_some_buffers(dev));
+	while (write_dirty_round(dev))
+		;
 }
 
 /*
- * Wait for a buffer on the proper list.
+ * Wait for a buffer on the proper list of an lru set.
  *
- * This must be called with the LRU lock held, and
+ * This must be called with the set's lock held, and
  * will return with it released.
  */
-static int wait_for_buffers(kdev_t dev, int index, int refile)
+static int wait_for_buffers(struct bh_lru *lru, kdev_t dev, int index, int refile)
 {
 	struct buffer_head * next;
 	int nr;
 
-	next = lru_list[index];
-	nr = nr_buffers_type[index];
+	next = lru->list[index];
+	nr = lru->nr_buffers[index];
 	while (next && --nr >= 0) {
 		struct buffer_head *bh = next;
 		next = bh->b_next_free;
@@ -270,20 +360,24 @@ static int wait_for_buffers(kdev_t dev, int index, int refile)
 			continue;
 
 		get_bh(bh);
-		spin_unlock(&lru_list_lock);
+		spin_unlock(&lru->lock);
 		wait_on_buffer (bh);
 		put_bh(bh);
 		return -EAGAIN;
 	}
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&lru->lock);
 	return 0;
 }
 
 static int wait_for_locked_buffers(kdev_t dev, int index, int refile)
 {
-	do {
-		spin_lock(&lru_list_lock);
-	} while (wait_for_buffers(dev, index, refile));
+	struct bh_lru *lru;
+
+	for_each_dev_lru(lru, dev) {
+		do {
+			spin_lock(&lru->lock);
+		} while (wait_for_buffers(lru, dev, index, refile));
+	}
 	return 0;
 }
 
@@ -476,11 +570,14 @@ out:
 	((((dev)<<(bh_hash_shift - 6)) ^ ((dev)<<(bh_hash_shift - 9))) ^ \
 	 (((block)<<(bh_hash_shift - 6)) ^ ((block) >> 13) ^ \
 	  ((block) << (bh_hash_shift - 12))))
-#define hash(dev,block) hash_table[(_hashfn(HASHDEV(dev),block) & bh_hash_mask)]
+#define hash(dev,block,size) \
+	(hash_table + (_hashfn(HASHDEV(dev), \
+		(block) >> (PAGE_SHIFT - blksize_bits(size))) & bh_hash_mask))
+#define bh_hash(bh) hash((bh)->b_dev, (bh)->b_blocknr, (bh)->b_size)
 
 static inline void __insert_into_hash_list(struct buffer_head *bh)
 {
-	struct buffer_head **head = &hash(bh->b_dev, bh->b_blocknr);
+	struct buffer_head **head = &bh_hash(bh)->head;
 	struct buffer_head *next = *head;
 
 	*head = bh;
@@ -502,12 +599,16 @@ static __inline__ void __hash_unlink(struct buffer_head *bh)
 	}
 }
 
+/* must be called with the lock of bh_lru(bh) held */
 static void __insert_into_lru_list(struct buffer_head * bh, int blist)
 {
-	struct buffer_head **bhp = &lru_list[blist];
+	struct bh_lru *lru = dev_lru(bh->b_dev);
+	struct buffer_head **bhp = &lru->list[blist];
 
 	if (bh->b_prev_free || bh->b_next_free) BUG();
 
+	bh->b_lru_set = lru - lru_sets;
+
 	if(!*bhp) {
 		*bhp = bh;
 		bh->b_prev_free = bh;
@@ -516,32 +617,34 @@ static void __insert_into_lru_list(struct buffer_head * bh, int blist)
 	bh->b_prev_free = (*bhp)->b_prev_free;
 	(*bhp)->b_prev_free->b_next_free = bh;
 	(*bhp)->b_prev_free = bh;
-	nr_buffers_type[blist]++;
-	size_buffers_type[blist] += bh->b_size;
+	lru->nr_buffers[blist]++;
+	lru->size_buffers[blist] += bh->b_size;
 }
 
+/* must be called with the lock of bh_lru(bh) held */
 static void __remove_from_lru_list(struct buffer_head * bh)
 {
 	struct buffer_head *next = bh->b_next_free;
 	if (next) {
+		struct bh_lru *lru = &lru_sets[bh->b_lru_set];
 		struct buffer_head *prev = bh->b_prev_free;
 		int blist = bh->b_list;
 
 		prev->b_next_free = next;
 		next->b_prev_free = prev;
-		if (lru_list[blist] == bh) {
+		if (lru->list[blist] == bh) {
 			if (next == bh)
 				next = NULL;
-			lru_list[blist] = next;
+			lru->list[blist] = next;
 		}
 		bh->b_next_free = NULL;
 		bh->b_prev_free = NULL;
-		nr_buffers_type[blist]--;
-		size_buffers_type[blist] -= bh->b_size;
+		lru->nr_buffers[blist]--;
+		lru->size_buffers[blist] -= bh->b_size;
 	}
 }
 
-/* must be called with both the hash_table_lock and the lru_list_lock
+/* must be called with both the hash bucket lock and the lru set lock
    held */
 static void __remove_from_queues(struct buffer_head *bh)
 {
@@ -551,18 +654,21 @@ static void __remove_from_queues(struct buffer_head *bh)
 
 static void remove_from_queues(struct buffer_head *bh)
 {
-	spin_lock(&lru_list_lock);
-	write_lock(&hash_table_lock);
+	struct bh_lru *lru = lock_bh_lru(bh);
+	struct bh_hash_bucket *b = bh_hash(bh);
+
+	write_lock(&b->lock);
 	__remove_from_queues(bh);
-	write_unlock(&hash_table_lock);	
-	spin_unlock(&lru_list_lock);
+	write_unlock(&b->lock);
+	unlock_bh_lru(lru);
 }
 
 struct buffer_head * get_hash_table(kdev_t dev, int block, int size)
 {
-	struct buffer_head *bh, **p = &hash(dev, block);
+	struct bh_hash_bucket *b = hash(dev, block, size);
+	struct buffer_head *bh, **p = &b->head;
 
-	read_lock(&hash_table_lock);
+	read_lock(&b->lock);
 
 	for (;;) {
 		bh = *p;
@@ -579,31 +685,31 @@ struct buffer_head * get_hash_table(kdev_t dev, int block, int size)
 		break;
 	}
 
-	read_unlock(&hash_table_lock);
+	read_unlock(&b->lock);
 	return bh;
 }
 
 void buffer_insert_inode_queue(struct buffer_head *bh, struct inode *inode)
 {
-	spin_lock(&lru_list_lock);
+	spin_lock(&inode_buffers_lock);
 	if (bh->b_inode)
 		list_del(&bh->b_inode_buffers);
 	bh->b_inode = inode;
 	list_add(&bh->b_inode_buffers, &inode->i_dirty_buffers);
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&inode_buffers_lock);
 }
 
 void buffer_insert_inode_data_queue(struct buffer_head *bh, struct inode *inode)
 {
-	spin_lock(&lru_list_lock);
+	spin_lock(&inode_buffers_lock);
 	if (bh->b_inode)
 		list_del(&bh->b_inode_buffers);
 	bh->b_inode = inode;
 	list_add(&bh->b_inode_buffers, &inode->i_dirty_data_buffers);
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&inode_buffers_lock);
 }
 
-/* The caller must have the lru_list lock before calling the 
+/* The caller must have the inode_buffers_lock before calling the 
    remove_inode_queue functions.  */
 static void __remove_inode_queue(struct buffer_head *bh)
 {
@@ -621,9 +727,9 @@ int inode_has_buffers(struct inode *inode)
 {
 	int ret;
 	
-	spin_lock(&lru_list_lock);
+	spin_lock(&inode_buffers_lock);
 	ret = !list_empty(&inode->i_dirty_buffers) || !list_empty(&inode->i_dirty_data_buffers);
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&inode_buffers_lock);
 	
 	return ret;
 }
@@ -664,16 +770,18 @@ void invalidate_bdev(struct block_device *bdev, int destroy_dirty_buffers)
 {
 	int i, nlist, slept;
 	struct buffer_head * bh, * bh_next;
+	struct bh_hash_bucket *b;
 	kdev_t dev = to_kdev_t(bdev->bd_dev);	/* will become bdev */
+	struct bh_lru *lru = dev_lru(dev);
 
  retry:
 	slept = 0;
-	spin_lock(&lru_list_lock);
+	spin_lock(&lru->lock);
 	for(nlist = 0; nlist < NR_LIST; nlist++) {
-		bh = lru_list[nlist];
+		bh = lru->list[nlist];
 		if (!bh)
 			continue;
-		for (i = nr_buffers_type[nlist]; i > 0 ; bh = bh_next, i--) {
+		for (i = lru->nr_buffers[nlist]; i > 0 ; bh = bh_next, i--) {
 			bh_next = bh->b_next_free;
 
 			/* Another device? */
@@ -684,14 +792,15 @@ void invalidate_bdev(struct block_device *bdev, int destroy_dirty_buffers)
 				continue;
 			if (buffer_locked(bh)) {
 				get_bh(bh);
-				spin_unlock(&lru_list_lock);
+				spin_unlock(&lru->lock);
 				wait_on_buffer(bh);
 				slept = 1;
-				spin_lock(&lru_list_lock);
+				spin_lock(&lru->lock);
 				put_bh(bh);
 			}
 
-			write_lock(&hash_table_lock);
+			b = bh_hash(bh);
+			write_lock(&b->lock);
 			/* All buffers in the lru lists are mapped */
 			if (!buffer_mapped(bh))
 				BUG();
@@ -699,18 +808,20 @@ void invalidate_bdev(struct block_device *bdev, int destroy_dirty_buffers)
 				printk("invalidate: dirty buffer\n");
 			if (!atomic_read(&bh->b_count)) {
 				if (destroy_dirty_buffers || !buffer_dirty(bh)) {
+					spin_lock(&inode_buffers_lock);
 					remove_inode_queue(bh);
+					spin_unlock(&inode_buffers_lock);
 				}
 			} else
 				printk("invalidate: busy buffer\n");
 
-			write_unlock(&hash_table_lock);
+			write_unlock(&b->lock);
 			if (slept)
 				goto out;
 		}
 	}
 out:
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&lru->lock);
 	if (slept)
 		goto retry;
 
@@ -836,7 +947,7 @@ int fsync_buffers_list(struct list_head *list)
 	
 	INIT_LIST_HEAD(&tmp.i_dirty_buffers);
 	
-	spin_lock(&lru_list_lock);
+	spin_lock(&inode_buffers_lock);
 
 	while (!list_empty(list)) {
 		bh = BH_ENTRY(list->next);
@@ -848,7 +959,7 @@ int fsync_buffers_list(struct list_head *list)
 			list_add(&bh->b_inode_buffers, &tmp.i_dirty_buffers);
 			if (buffer_dirty(bh)) {
 				get_bh(bh);
-				spin_unlock(&lru_list_lock);
+				spin_unlock(&inode_buffers_lock);
 			/*
 			 * Wait I/O completion before submitting
 			 * the buffer, to be sure the write will
@@ -860,7 +971,7 @@ int fsync_buffers_list(struct list_head *list)
 				wait_on_buffer(bh);
 				ll_rw_block(WRITE, 1, &bh);
 				brelse(bh);
-				spin_lock(&lru_list_lock);
+				spin_lock(&inode_buffers_lock);
 			}
 		}
 	}
@@ -869,15 +980,15 @@ int fsync_buffers_list(struct list_head *list)
 		bh = BH_ENTRY(tmp.i_dirty_buffers.prev);
 		remove_inode_queue(bh);
 		get_bh(bh);
-		spin_unlock(&lru_list_lock);
+		spin_unlock(&inode_buffers_lock);
 		wait_on_buffer(bh);
 		if (!buffer_uptodate(bh))
 			err = -EIO;
 		brelse(bh);
-		spin_lock(&lru_list_lock);
+		spin_lock(&inode_buffers_lock);
 	}
 	
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&inode_buffers_lock);
 	err2 = osync_buffers_list(list);
 
 	if (err)
@@ -902,24 +1013,24 @@ static int osync_buffers_list(struct list_head *list)
 	struct list_head *p;
 	int err = 0;
 
-	spin_lock(&lru_list_lock);
+	spin_lock(&inode_buffers_lock);
 	
  repeat:
 	list_for_each_prev(p, list) {
 		bh = BH_ENTRY(p);
 		if (buffer_locked(bh)) {
 			get_bh(bh);
-			spin_unlock(&lru_list_lock);
+			spin_unlock(&inode_buffers_lock);
 			wait_on_buffer(bh);
 			if (!buffer_uptodate(bh))
 				err = -EIO;
 			brelse(bh);
-			spin_lock(&lru_list_lock);
+			spin_lock(&inode_buffers_lock);
 			goto repeat;
 		}
 	}
 
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&inode_buffers_lock);
 	return err;
 }
 
@@ -932,12 +1043,12 @@ void invalidate_inode_buffers(struct inode *inode)
 {
 	struct list_head * entry;
 	
-	spin_lock(&lru_list_lock);
+	spin_lock(&inode_buffers_lock);
 	while ((entry = inode->i_dirty_buffers.next) != &inode->i_dirty_buffers)
 		remove_inode_queue(BH_ENTRY(entry));
 	while ((entry = inode->i_dirty_data_buffers.next) != &inode->i_dirty_data_buffers)
 		remove_inode_queue(BH_ENTRY(entry));
-	spin_unlock(&lru_list_lock);
+	spin_unlock(&inode_buffers_lock);
 }
 
 
@@ -974,7 +1085,7 @@ static int balance_dirty_state(void)
 {
 	unsigned long dirty, tot, hard_dirty_limit, soft_dirty_limit;
 
-	dirty = size_buffers_type[BUF_DIRTY] >> PAGE_SHIFT;
+	dirty = size_buffers_type(BUF_DIRTY) >> PAGE_SHIFT;
 	tot = nr_free_buffer_pages();
 
 	dirty *= 100;
@@ -995,7 +1106,7 @@ static int bdflush_stop(void)
 {
 	unsigned long dirty, tot, dirty_limit;
 
-	dirty = size_buffers_type[BUF_DIRTY] >> PAGE_SHIFT;
+	dirty = size_buffers_type(BUF_DIRTY) >> PAGE_SHIFT;
 	tot = nr_free_buffer_pages();
 
 	dirty *= 100;
@@ -1015,7 +1126,9 @@ static int bdflush_stop(void)
  */
 void balance_dirty(void)
 {
+	static unsigned int next_lru;
 	int state = balance_dirty_state();
+	int i;
 
 	if (state < 0)
 		return;
@@ -1028,8 +1141,16 @@ void balance_dirty(void)
 	 * This will throttle heavy writers.
 	 */
 	if (state > 0) {
-		spin_lock(&lru_list_lock);
-		write_some_buffers(NODEV);
+		/* Take turns among the lru sets, so writers share the work */
+		for (i = 0; i < NR_LRU_SETS; i++) {
+			struct bh_lru *lru = &lru_sets[next_lru++ % NR_LRU_SETS];
+
+			if (lru->nr_buffers[BUF_DIRTY]) {
+				spin_lock(&lru->lock);
+				write_some_buffers(lru, NODEV);
+				break;
+			}
+		}
 	}
 }
 
@@ -1075,17 +1196,23 @@ static void __refile_buffer(struct buffer_head *bh)
 	if (dispose != bh->b_list) {
 		__remove_from_lru_list(bh);
 		bh->b_list = dispose;
-		if (dispose == BUF_CLEAN)
-			remove_inode_queue(bh);
+		if (dispose == BUF_CLEAN && bh->b_inode) {
+			spin_lock(&inode_buffers_lock);
+			/* mark_buffer_dirty_inode() may have raced with us */
+			if (!buffer_dirty(bh))
+				remove_inode_queue(bh);
+			spin_unlock(&inode_buffers_lock);
+		}
 		__insert_into_lru_list(bh, dispose);
 	}
 }
 
 void refile_buffer(struct buffer_head *bh)
 {
-	spin_lock(&lru_list_lock);
+	struct bh_lru *lru = lock_bh_lru(bh);
+
 	__refile_buffer(bh);
-	spin_unlock(&lru_list_lock);
+	unlock_bh_lru(lru);
 }
 
 /*
@@ -2475,13 +2602,16 @@ static void hash_page_buffers(struct page *page, kdev_t dev, int block, int size
 {
 	struct buffer_head *head = page->buffers;
 	struct buffer_head *bh = head;
+	struct bh_hash_bucket *b;
 	unsigned int uptodate;
 
 	uptodate = 1 << BH_Mapped;
 	if (Page_Uptodate(page))
 		uptodate |= 1 << BH_Uptodate;
 
-	write_lock(&hash_table_lock);
+	/* All buffers of the page hash to the same chain */
+	b = hash(dev, block, size);
+	write_lock(&b->lock);
 	do {
 		if (!(bh->b_state & (1 << BH_Mapped))) {
 			init_buffer(bh, NULL, NULL);
@@ -2497,7 +2627,7 @@ static void hash_page_buffers(struct page *page, kdev_t dev, int block, int size
 		block++;
 		bh = bh->b_this_page;
 	} while (bh != head);
-	write_unlock(&hash_table_lock);
+	write_unlock(&b->lock);
 }
 
 /*
@@ -2642,17 +2772,45 @@ static int sync_page_buffers(struct buffer_head *head)
 int try_to_free_buffers(struct page * page, unsigned int gfp_mask)
 {
 	struct buffer_head * tmp, * bh = page->buffers;
+	struct bh_hash_bucket *b;
+	struct bh_lru *lru;
 
 cleaned_buffers_try_again:
-	spin_lock(&lru_list_lock);
-	write_lock(&hash_table_lock);
+	/*
+	 * The buffers of a page are on one lru set, and if hashed, on
+	 * one hash chain.  Hashing only changes under the page lock, which
+	 * we hold; a buffer which is not on an lru list can only be filed
+	 * by someone holding a reference to it.
+	 */
+	b = NULL;
+	tmp = bh;
+	do {
+		if (tmp->b_pprev) {
+			b = bh_hash(tmp);
+			break;
+		}
+		tmp = tmp->b_this_page;
+	} while (tmp != bh);
+	tmp = bh;
+	do {
+		if (tmp->b_next_free)
+			break;
+		tmp = tmp->b_this_page;
+	} while (tmp != bh);
+
+	lru = lock_bh_lru(tmp);
+	if (b)
+		write_lock(&b->lock);
 	tmp = bh;
 	do {
 		if (buffer_busy(tmp))
 			goto busy_buffer_page;
+		if (tmp->b_next_free && &lru_sets[tmp->b_lru_set] != lru)
+			goto busy_buffer_page;
 		tmp = tmp->b_this_page;
 	} while (tmp != bh);
 
+	spin_lock(&inode_buffers_lock);
 	spin_lock(&unused_list_lock);
 	tmp = bh;
 
@@ -2670,6 +2828,7 @@ cleaned_buffers_try_again:
 		__put_unused_buffer_head(p);
 	} while (tmp != bh);
 	spin_unlock(&unused_list_lock);
+	spin_unlock(&inode_buffers_lock);
 
 	/* Wake up anyone waiting for buffer heads */
 	wake_up(&buffer_wait);
@@ -2677,14 +2836,16 @@ cleaned_buffers_try_again:
 	/* And free the page */
 	page->buffers = NULL;
 	page_cache_release(page);
-	write_unlock(&hash_table_lock);
-	spin_unlock(&lru_list_lock);
+	if (b)
+		write_unlock(&b->lock);
+	unlock_bh_lru(lru);
 	return 1;
 
 busy_buffer_page:
 	/* Uhhuh, start writeback so that we don't end up with all dirty pages */
-	write_unlock(&hash_table_lock);
-	spin_unlock(&lru_list_lock);
+	if (b)
+		write_unlock(&b->lock);
+	unlock_bh_lru(lru);
 	gfp_mask = pf_gfp_mask(gfp_mask);
 	if (gfp_mask & __GFP_IO) {
 		if ((gfp_mask & __GFP_HIGHIO) || !PageHighMem(page)) {
@@ -2708,7 +2869,8 @@ void show_buffers(void)
 #ifdef CONFIG_SMP
 	struct buffer_head * bh;
 	int found = 0, locked = 0, dirty = 0, used = 0, lastused = 0;
-	int nlist;
+	int reported = 0;
+	int nlist, i;
 	static char *buf_types[NR_LIST] = { "CLEAN", "LOCKED", "DIRTY", };
 #endif
 
@@ -2719,35 +2881,39 @@ void show_buffers(void)
 			(atomic_read(&page_cache_size)- atomic_read(&buffermem_pages)) << (PAGE_SHIFT-10));
 
 #ifdef CONFIG_SMP /* trylock does nothing on UP and so we could deadlock */
-	if (!spin_trylock(&lru_list_lock))
-		return;
 	for(nlist = 0; nlist < NR_LIST; nlist++) {
-		found = locked = dirty = used = lastused = 0;
-		bh = lru_list[nlist];
-		if(!bh) continue;
+		found = locked = dirty = used = lastused = reported = 0;
+		for (i = 0; i < NR_LRU_SETS; i++) {
+			struct bh_lru *lru = &lru_sets[i];
 
-		do {
-			found++;
-			if (buffer_locked(bh))
-				locked++;
-			if (buffer_dirty(bh))
-				dirty++;
-			if (atomic_read(&bh->b_count))
-				used++, lastused = found;
-			bh = bh->b_next_free;
-		} while (bh != lru_list[nlist]);
-		{
-			int tmp = nr_buffers_type[nlist];
-			if (found != tmp)
-				printk("%9s: BUG -> found %d, reported %d\n",
-				       buf_types[nlist], found, tmp);
+			if (!spin_trylock(&lru->lock))
+				continue;
+			reported += lru->nr_buffers[nlist];
+			bh = lru->list[nlist];
+			if (bh) {
+				do {
+					found++;
+					if (buffer_locked(bh))
+						locked++;
+					if (buffer_dirty(bh))
+						dirty++;
+					if (atomic_read(&bh->b_count))
+						used++, lastused = found;
+					bh = bh->b_next_free;
+				} while (bh != lru->list[nlist]);
+			}
+			spin_unlock(&lru->lock);
 		}
+		if (!found)
+			continue;
+		if (found != reported)
+			printk("%9s: BUG -> found %d, reported %d\n",
+			       buf_types[nlist], found, reported);
 		printk("%9s: %d buffers, %lu kbyte, %d used (last=%d), "
 		       "%d locked, %d dirty\n",
-		       buf_types[nlist], found, size_buffers_type[nlist]>>10,
+		       buf_types[nlist], found, size_buffers_type(nlist)>>10,
 		       used, lastused, locked, dirty);
 	}
-	spin_unlock(&lru_list_lock);
 #endif
 }
 
@@ -2779,7 +2945,7 @@ void __init buffer_init(unsigned long mempages)
 	do {
 		unsigned long tmp;
 
-		nr_hash = (PAGE_SIZE << order) / sizeof(struct buffer_head *);
+		nr_hash = (PAGE_SIZE << order) / sizeof(struct bh_hash_bucket);
 		bh_hash_mask = (nr_hash - 1);
 
 		tmp = nr_hash;
@@ -2787,7 +2953,7 @@ void __init buffer_init(unsigned long mempages)
 		while((tmp >>= 1UL) != 0UL)
 			bh_hash_shift++;
 
-		hash_table = (struct buffer_head **)
+		hash_table = (struct bh_hash_bucket *)
 		    __get_free_pages(GFP_ATOMIC, order);
 	} while (hash_table == NULL && --order > 0);
 	printk("Buffer-cache hash table entries: %d (order: %d, %ld bytes)\n",
@@ -2797,12 +2963,14 @@ void __init buffer_init(unsigned long mempages)
 		panic("Failed to allocate buffer hash table\n");
 
 	/* Setup hash chains. */
-	for(i = 0; i < nr_hash; i++)
-		hash_table[i] = NULL;
+	for(i = 0; i < nr_hash; i++) {
+		hash_table[i].head = NULL;
+		rwlock_init(&hash_table[i].lock);
+	}
 
 	/* Setup lru lists. */
-	for(i = 0; i < NR_LIST; i++)
-		lru_list[i] = NULL;
+	for(i = 0; i < NR_LRU_SETS; i++)
+		spin_lock_init(&lru_sets[i].lock);
 
 }
 
@@ -2836,18 +3004,28 @@ static int sync_old_buffers(void)
 	sync_supers(0);
 	unlock_kernel();
 
+	/* Write the lru sets side by side, as long as they have old buffers */
 	for (;;) {
-		struct buffer_head *bh;
+		struct bh_lru *lru;
+		int more = 0;
+
+		for (lru = lru_sets; lru < lru_sets + NR_LRU_SETS; lru++) {
+			struct buffer_head *bh;
 
-		spin_lock(&lru_list_lock);
-		bh = lru_list[BUF_DIRTY];
-		if (!bh || time_before(jiffies, bh->b_flushtime))
+			if (!lru->nr_buffers[BUF_DIRTY])
+				continue;
+			spin_lock(&lru->lock);
+			bh = lru->list[BUF_DIRTY];
+			if (!bh || time_before(jiffies, bh->b_flushtime)) {
+				spin_unlock(&lru->lock);
+				continue;
+			}
+			if (write_some_buffers(lru, NODEV))
+				more++;
+		}
+		if (!more)
 			break;
-		if (write_some_buffers(NODEV))
-			continue;
-		return 0;
 	}
-	spin_unlock(&lru_list_lock);
 	return 0;
 }
 
@@ -2954,10 +3132,11 @@ int bdflush(void *startup)
 		CHECK_EMERGENCY_SYNC
 
 		while (ndirty > 0) {
-			spin_lock(&lru_list_lock);
-			if (!write_some_buffers(NODEV))
+			int more = write_dirty_round(NODEV);
+
+			if (!more)
 				break;
-			ndirty -= NRSYNC;
+			ndirty -= NRSYNC * more;
 		}
 		if (ndirty > 0 || bdflush_stop())
 			interruptible_sleep_on(&bdflush_wait);
@@ -23,12 +23,24 @@
 #include <linux/smp_lock.h>
 #include <linux/cache.h>
 #include <linux/module.h>
+#include <linux/rcupdate.h>
 
 #include <asm/uaccess.h>
 
 #define DCACHE_PARANOIA 1
 /* #define DCACHE_DEBUG 1 */
 
+/*
+ * dcache_lock serializes everybody who changes the hash chains, the
+ * unused list or the shape of the tree.  d_lookup() walks the hash
+ * chains without it: a dentry's d_lock guards its name, parent and
+ * hashed state against that walk, and d_free() gives the memory back
+ * only after an RCU grace period.  Take dcache_lock before d_lock.
+ *
+ * Since d_lookup() can take a reference to a dentry on the unused
+ * list, dentries with a count may sit there until prune_dcache() or
+ * dget_locked() gets to them.
+ */
 spinlock_t dcache_lock __cacheline_aligned_in_smp = SPIN_LOCK_UNLOCKED;
 
 /* Right now the dcache depends on the kernel lock */
@@ -55,21 +67,31 @@ static LIST_HEAD(dentry_unused);
 /* Statistics gathering. */
 struct dentry_stat_t dentry_stat = {0, 0, 45, 0,};
 
-/* no dcache_lock, please */
-static inline void d_free(struct dentry *dentry)
+static void d_callback(void *arg)
 {
-	if (dentry->d_op && dentry->d_op->d_release)
-		dentry->d_op->d_release(dentry);
+	struct dentry *dentry = arg;
+
 	if (dname_external(dentry)) 
 		kfree(dentry->d_name.name);
 	kmem_cache_free(dentry_cache, dentry); 
+}
+
+/*
+ * no dcache_lock, please.  A lockless d_lookup() may still be looking
+ * at the name, so the memory goes back after a grace period.
+ */
+static inline void d_free(struct dentry *dentry)
+{
+	if (dentry->d_op && dentry->d_op->d_release)
+		dentry->d_op->d_release(dentry);
+	call_rcu(&dentry->d_rcu, d_callback, dentry);
 	dentry_stat.nr_dentry--;
 }
 
 /*
  * Release the dentry's inode, using the filesystem
  * d_iput() operation if defined.
- * Called with dcache_lock held, drops it.
+ * Called with dcache_lock and dentry->d_lock held, drops both.
  */
 static inline void dentry_iput(struct dentry * dentry)
 {
@@ -77,13 +99,16 @@ static inline void dentry_iput(struct dentry * dentry)
 	if (inode) {
 		dentry->d_inode = NULL;
 		list_del_init(&dentry->d_alias);
+		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
 		if (dentry->d_op && dentry->d_op->d_iput)
 			dentry->d_op->d_iput(dentry, inode);
 		else
 			iput(inode);
-	} else
+	} else {
+		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
+	}
 }
 
 /* 
@@ -124,9 +149,13 @@ repeat:
 	if (!atomic_dec_and_lock(&dentry->d_count, &dcache_lock))
 		return;
 
-	/* dput on a free dentry? */
-	if (!list_empty(&dentry->d_lru))
-		BUG();
+	/* d_lookup() may have found it again meanwhile */
+	spin_lock(&dentry->d_lock);
+	if (atomic_read(&dentry->d_count)) {
+		spin_unlock(&dentry->d_lock);
+		spin_unlock(&dcache_lock);
+		return;
+	}
 	/*
 	 * AV: ->d_delete() is _NOT_ allowed to block now.
 	 */
@@ -137,8 +166,12 @@ repeat:
 	/* Unreachable? Get rid of it */
 	if (list_empty(&dentry->d_hash))
 		goto kill_it;
-	list_add(&dentry->d_lru, &dentry_unused);
-	dentry_stat.nr_unused++;
+	/* Still there if d_lookup() revived it from the unused list */
+	if (list_empty(&dentry->d_lru)) {
+		list_add(&dentry->d_lru, &dentry_unused);
+		dentry_stat.nr_unused++;
+	}
+	spin_unlock(&dentry->d_lock);
 	spin_unlock(&dcache_lock);
 	return;
 
@@ -147,8 +180,12 @@ unhash_it:
 
 kill_it: {
 		struct dentry *parent;
+		if (!list_empty(&dentry->d_lru)) {
+			list_del(&dentry->d_lru);
+			dentry_stat.nr_unused--;
+		}
 		list_del(&dentry->d_child);
-		/* drops the lock, at that point nobody can reach this dentry */
+		/* drops the locks, at that point nobody can reach this dentry */
 		dentry_iput(dentry);
 		parent = dentry->d_parent;
 		d_free(dentry);
@@ -201,14 +238,17 @@ int d_invalidate(struct dentry * dentry)
 	 * we might still populate it if it was a
 	 * working directory or similar).
 	 */
+	spin_lock(&dentry->d_lock);
 	if (atomic_read(&dentry->d_count) > 1) {
 		if (dentry->d_inode && S_ISDIR(dentry->d_inode->i_mode)) {
+			spin_unlock(&dentry->d_lock);
 			spin_unlock(&dcache_lock);
 			return -EBUSY;
 		}
 	}
 
 	list_del_init(&dentry->d_hash);
+	spin_unlock(&dentry->d_lock);
 	spin_unlock(&dcache_lock);
 	return 0;
 }
@@ -218,7 +258,7 @@ int d_invalidate(struct dentry * dentry)
 static inline struct dentry * __dget_locked(struct dentry *dentry)
 {
 	atomic_inc(&dentry->d_count);
-	if (atomic_read(&dentry->d_count) == 1) {
+	if (!list_empty(&dentry->d_lru)) {
 		dentry_stat.nr_unused--;
 		list_del_init(&dentry->d_lru);
 	}
@@ -289,7 +329,8 @@ restart:
  * Throw away a dentry - free the inode, dput the parent.
  * This requires that the LRU list has already been
  * removed.
- * Called with dcache_lock, drops it and then regains.
+ * Called with dcache_lock and dentry->d_lock, drops them
+ * and then regains dcache_lock.
  */
 static inline void prune_one_dentry(struct dentry * dentry)
 {
@@ -340,9 +381,12 @@ void prune_dcache(int count)
 		}
 		dentry_stat.nr_unused--;
 
-		/* Unused dentry with a count? */
-		if (atomic_read(&dentry->d_count))
-			BUG();
+		/* Revived by d_lookup()?  dput() will put it back. */
+		spin_lock(&dentry->d_lock);
+		if (atomic_read(&dentry->d_count)) {
+			spin_unlock(&dentry->d_lock);
+			continue;
+		}
 
 		prune_one_dentry(dentry);
 		if (!--count)
@@ -407,6 +451,11 @@ repeat:
 			continue;
 		if (atomic_read(&dentry->d_count))
 			continue;
+		spin_lock(&dentry->d_lock);
+		if (atomic_read(&dentry->d_count)) {
+			spin_unlock(&dentry->d_lock);
+			continue;
+		}
 		dentry_stat.nr_unused--;
 		list_del_init(tmp);
 		prune_one_dentry(dentry);
@@ -605,6 +654,7 @@ struct dentry * d_alloc(struct dentry * parent, const struct qstr *name)
 	str[name->len] = 0;
 
 	atomic_set(&dentry->d_count, 1);
+	spin_lock_init(&dentry->d_lock);
 	dentry->d_vfs_flags = 0;
 	dentry->d_flags = 0;
 	dentry->d_inode = NULL;
@@ -689,6 +739,21 @@ static inline struct list_head * d_hash(struct dentry * parent, unsigned long ha
 	return dentry_hashtable + (hash & D_HASHMASK);
 }
 
+/*
+ * The lockless walk in d_lookup() can't step on freed memory, but the
+ * dentry it stands on can be unhashed (list_del_init() points it at
+ * itself) or moved to another chain by d_move().  Both are noticed and
+ * the walk restarts.  A d_move() can also make the walk skip part of
+ * the chain, so a miss only counts if no d_move() ran meanwhile;
+ * d_move_count is odd while one is in progress.
+ */
+static unsigned int d_move_count;
+
+static inline int d_hash_head(struct list_head *p)
+{
+	return p >= dentry_hashtable && p <= dentry_hashtable + d_hash_mask;
+}
+
 /**
  * d_lookup - search for a dentry
  * @parent: parent dentry
@@ -698,6 +763,8 @@ static inline struct list_head * d_hash(struct dentry * parent, unsigned long ha
  * the dentry is found its reference count is incremented and the dentry
  * is returned. The caller must use d_put to free the entry when it has
  * finished using it. %NULL is returned on failure.
+ *
+ * No shared lock is taken: only the d_lock of a dentry that matches.
  */
  
 struct dentry * d_lookup(struct dentry * parent, struct qstr * name)
@@ -706,35 +773,67 @@ struct dentry * d_lookup(struct dentry * parent, struct qstr * name)
 	unsigned int hash = name->hash;
 	const unsigned char *str = name->name;
 	struct list_head *head = d_hash(parent,hash);
-	struct list_head *tmp;
-
-	spin_lock(&dcache_lock);
+	struct list_head *tmp, *next;
+	struct dentry *found;
+	unsigned int move_count;
+
+again:
+	move_count = d_move_count;
+	smp_rmb();
+	found = NULL;
+	rcu_read_lock();
 	tmp = head->next;
 	for (;;) {
 		struct dentry * dentry = list_entry(tmp, struct dentry, d_hash);
 		if (tmp == head)
 			break;
-		tmp = tmp->next;
+		if (d_hash_head(tmp))
+			goto restart;
+		smp_read_barrier_depends();
+		next = tmp->next;
+		if (next == tmp)
+			goto restart;
+		tmp = next;
 		if (dentry->d_name.hash != hash)
 			continue;
 		if (dentry->d_parent != parent)
 			continue;
+
+		spin_lock(&dentry->d_lock);
+		/* d_move() may have got there first */
+		if (dentry->d_name.hash != hash || dentry->d_parent != parent)
+			goto next_unlock;
 		if (parent->d_op && parent->d_op->d_compare) {
 			if (parent->d_op->d_compare(parent, &dentry->d_name, name))
-				continue;
+				goto next_unlock;
 		} else {
 			if (dentry->d_name.len != len)
-				continue;
+				goto next_unlock;
 			if (memcmp(dentry->d_name.name, str, len))
-				continue;
+				goto next_unlock;
 		}
-		__dget_locked(dentry);
-		dentry->d_vfs_flags |= DCACHE_REFERENCED;
-		spin_unlock(&dcache_lock);
-		return dentry;
+		if (!list_empty(&dentry->d_hash)) {
+			atomic_inc(&dentry->d_count);
+			dentry->d_vfs_flags |= DCACHE_REFERENCED;
+			found = dentry;
+		}
+		spin_unlock(&dentry->d_lock);
+		break;
+next_unlock:
+		spin_unlock(&dentry->d_lock);
 	}
-	spin_unlock(&dcache_lock);
-	return NULL;
+	rcu_read_unlock();
+
+	if (!found) {
+		smp_rmb();
+		if ((move_count & 1) || move_count != d_move_count)
+			goto again;
+	}
+	return found;
+
+restart:
+	rcu_read_unlock();
+	goto again;
 }
 
 /**
@@ -807,13 +906,16 @@ out:
 void d_delete(struct dentry * dentry)
 {
 	/*
-	 * Are we the only user?
+	 * Are we the only user?  d_lock keeps d_lookup() from
+	 * finding it until the inode is gone.
 	 */
 	spin_lock(&dcache_lock);
+	spin_lock(&dentry->d_lock);
 	if (atomic_read(&dentry->d_count) == 1) {
 		dentry_iput(dentry);
 		return;
 	}
+	spin_unlock(&dentry->d_lock);
 	spin_unlock(&dcache_lock);
 
 	/*
@@ -835,7 +937,7 @@ void d_rehash(struct dentry * entry)
 	struct list_head *list = d_hash(entry->d_parent, entry->d_name.hash);
 	if (!list_empty(&entry->d_hash)) BUG();
 	spin_lock(&dcache_lock);
-	list_add(&entry->d_hash, list);
+	list_add_rcu(&entry->d_hash, list);
 	spin_unlock(&dcache_lock);
 }
 
@@ -903,9 +1005,21 @@ void d_move(struct dentry * dentry, struct dentry * target)
 		printk(KERN_WARNING "VFS: moving negative dcache entry\n");
 
 	spin_lock(&dcache_lock);
+	d_move_count++;
+	smp_wmb();
+
+	/* Keep d_lookup() from comparing half switched names */
+	if (target < dentry) {
+		spin_lock(&target->d_lock);
+		spin_lock(&dentry->d_lock);
+	} else {
+		spin_lock(&dentry->d_lock);
+		spin_lock(&target->d_lock);
+	}
+
 	/* Move the dentry to the target hash queue */
-	list_del(&dentry->d_hash);
-	list_add(&dentry->d_hash, &target->d_hash);
+	list_del_rcu(&dentry->d_hash);
+	list_add_rcu(&dentry->d_hash, &target->d_hash);
 
 	/* Unhash the target: dput() will then get rid of it */
 	list_del_init(&target->d_hash);
@@ -922,6 +1036,11 @@ void d_move(struct dentry * dentry, struct dentry * target)
 	/* And add them back to the (new) parent lists */
 	list_add(&target->d_child, &target->d_parent->d_subdirs);
 	list_add(&dentry->d_child, &dentry->d_parent->d_subdirs);
+	spin_unlock(&target->d_lock);
+	spin_unlock(&dentry->d_lock);
+
+	smp_wmb();
+	d_move_count++;
 	spin_unlock(&dcache_lock);
 }
 
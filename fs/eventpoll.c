@@ -0,0 +1,836 @@
+/*
+ *  linux/fs/eventpoll.c
+ *
+ *  Scalable event notification.
+ *
+ *  select() and poll() hand the whole interest set to the kernel on
+ *  every call and then walk it, so their cost grows with the number of
+ *  descriptors watched rather than the number that are ready.  Here the
+ *  interest set is registered once with sys_epoll_ctl(): each watched
+ *  file gets a wait queue callback hooked into the queues its ->poll()
+ *  method reports, and the callback moves the item onto a per-instance
+ *  ready list.  sys_epoll_wait() then only looks at the ready list.
+ *
+ *  Locking:
+ *	ep->lock	spinlock, irq-safe.  Protects the ready list; it is
+ *			taken from the wakeup callback, under the lock of
+ *			the wait queue that is being woken.
+ *	ep->sem		rw semaphore.  Held for writing while items are
+ *			added, modified or removed, and for reading while
+ *			sys_epoll_wait() polls and reports ready items.
+ *	epsem		global semaphore, serializes the teardown of an
+ *			epoll instance against the release of a file that
+ *			is still watched, so neither can vanish under the
+ *			other.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/list.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/smp_lock.h>
+#include <linux/eventpoll.h>
+#include <asm/uaccess.h>
+#include <asm/semaphore.h>
+
+#define EVENTPOLLFS_MAGIC 0x03111965
+
+/* Hash size limits, the hint passed to sys_epoll_create() picks one between */
+#define EP_MIN_HASH_BITS 7
+#define EP_MAX_HASH_BITS 12
+
+/* Maximum number of events a single sys_epoll_wait() can return */
+#define EP_MAX_EVENTS (INT_MAX / sizeof(struct epoll_event))
+
+/* Longest timeout, in milliseconds, that still fits in jiffies */
+#define EP_MAX_MSTIMEO ((MAX_SCHEDULE_TIMEOUT - 1000) / HZ)
+
+struct eventpoll {
+	spinlock_t lock;
+	struct rw_semaphore sem;
+
+	/* sys_epoll_wait() sleepers */
+	wait_queue_head_t wq;
+
+	/* select()/poll() sleepers on the epoll file itself */
+	wait_queue_head_t poll_wait;
+
+	/* items whose file reported an event we are interested in */
+	struct list_head rdllist;
+
+	/* registered items, hashed on (file, fd) */
+	unsigned int hashbits;
+	struct list_head *hash;
+};
+
+/* One of these for each wait queue a watched file is hooked into */
+struct eppoll_entry {
+	struct list_head llink;
+	struct epitem *base;
+	wait_queue_t wait;
+	wait_queue_head_t *whead;
+};
+
+/* One of these for each file descriptor added to an epoll set */
+struct epitem {
+	struct list_head llink;		/* hash chain */
+	struct list_head rdllink;	/* ready list, empty when not queued */
+	struct list_head fllink;	/* file->f_ep_links */
+	struct list_head pwqlist;	/* eppoll_entry list */
+	int nwait;
+	struct eventpoll *ep;
+	int fd;
+	struct file *file;
+	struct epoll_event event;
+};
+
+/* Argument block for ep_ptable_queue_proc() */
+struct ep_pqueue {
+	poll_table pt;
+	struct epitem *epi;
+};
+
+static DECLARE_MUTEX(epsem);
+
+static kmem_cache_t *epi_cache;
+static kmem_cache_t *pwq_cache;
+
+static struct vfsmount *eventpoll_mnt;
+
+static int ep_eventpoll_close(struct inode *inode, struct file *file);
+static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait);
+
+static struct file_operations eventpoll_fops = {
+	release:	ep_eventpoll_close,
+	poll:		ep_eventpoll_poll,
+};
+
+static inline int is_file_epoll(struct file *f)
+{
+	return f->f_op == &eventpoll_fops;
+}
+
+static inline struct list_head *ep_hash_entry(struct eventpoll *ep,
+					      struct file *file, int fd)
+{
+	unsigned long h = ((unsigned long) file / L1_CACHE_BYTES) ^ fd;
+
+	h ^= h >> ep->hashbits;
+	return &ep->hash[h & ((1UL << ep->hashbits) - 1)];
+}
+
+static unsigned int ep_hash_bits(int size)
+{
+	unsigned int bits = EP_MIN_HASH_BITS;
+
+	while (bits < EP_MAX_HASH_BITS && (1 << bits) < size)
+		bits++;
+	return bits;
+}
+
+static int ep_alloc(int size, struct eventpoll **pep)
+{
+	unsigned int i, bits = ep_hash_bits(size);
+	struct eventpoll *ep;
+
+	ep = kmalloc(sizeof(*ep), GFP_KERNEL);
+	if (!ep)
+		return -ENOMEM;
+	ep->hash = kmalloc(sizeof(struct list_head) << bits, GFP_KERNEL);
+	if (!ep->hash) {
+		kfree(ep);
+		return -ENOMEM;
+	}
+	for (i = 0; i < (1U << bits); i++)
+		INIT_LIST_HEAD(&ep->hash[i]);
+	ep->hashbits = bits;
+	spin_lock_init(&ep->lock);
+	init_rwsem(&ep->sem);
+	init_waitqueue_head(&ep->wq);
+	init_waitqueue_head(&ep->poll_wait);
+	INIT_LIST_HEAD(&ep->rdllist);
+
+	*pep = ep;
+	return 0;
+}
+
+static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
+{
+	struct list_head *head = ep_hash_entry(ep, file, fd), *tmp;
+	struct epitem *epi;
+
+	list_for_each(tmp, head) {
+		epi = list_entry(tmp, struct epitem, llink);
+		if (epi->file == file && epi->fd == fd)
+			return epi;
+	}
+	return NULL;
+}
+
+/*
+ * Wakeup callback hooked into the wait queues of the watched files.
+ * Runs under the wait queue lock, possibly from interrupt context.
+ */
+static int ep_poll_callback(wait_queue_t *wait, unsigned int mode, int sync)
+{
+	struct epitem *epi = list_entry(wait, struct eppoll_entry, wait)->base;
+	struct eventpoll *ep = epi->ep;
+	unsigned long flags;
+	int pwake = 0;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (list_empty(&epi->rdllink)) {
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+		if (waitqueue_active(&ep->wq))
+			wake_up(&ep->wq);
+		pwake = waitqueue_active(&ep->poll_wait);
+	}
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+	return 1;
+}
+
+/*
+ * poll_table callback used while adding an item: hook ep_poll_callback()
+ * into every wait queue the target file's ->poll() reports.
+ */
+static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
+				 poll_table *pt)
+{
+	struct epitem *epi = ((struct ep_pqueue *) pt)->epi;
+	struct eppoll_entry *pwq;
+
+	if (epi->nwait < 0)
+		return;
+	pwq = kmem_cache_alloc(pwq_cache, SLAB_KERNEL);
+	if (!pwq) {
+		/* ep_insert() notices this and backs out */
+		epi->nwait = -1;
+		return;
+	}
+	init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
+	pwq->whead = whead;
+	pwq->base = epi;
+	add_wait_queue(whead, &pwq->wait);
+	list_add_tail(&pwq->llink, &epi->pwqlist);
+	epi->nwait++;
+}
+
+static void ep_unregister_pollwait(struct epitem *epi)
+{
+	struct eppoll_entry *pwq;
+
+	while (!list_empty(&epi->pwqlist)) {
+		pwq = list_entry(epi->pwqlist.next, struct eppoll_entry, llink);
+		list_del(&pwq->llink);
+		remove_wait_queue(pwq->whead, &pwq->wait);
+		kmem_cache_free(pwq_cache, pwq);
+	}
+	epi->nwait = 0;
+}
+
+/* Queue the item on the ready list, unless it already is; ep->lock held */
+static inline void ep_queue_ready(struct eventpoll *ep, struct epitem *epi,
+				  int *pwake)
+{
+	if (!list_empty(&epi->rdllink))
+		return;
+	list_add_tail(&epi->rdllink, &ep->rdllist);
+	if (waitqueue_active(&ep->wq))
+		wake_up(&ep->wq);
+	if (waitqueue_active(&ep->poll_wait))
+		*pwake = 1;
+}
+
+/* Called with ep->sem held for writing */
+static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
+		     struct file *tfile, int fd)
+{
+	struct ep_pqueue epq;
+	struct epitem *epi;
+	unsigned int revents;
+	unsigned long flags;
+	int pwake = 0;
+
+	epi = kmem_cache_alloc(epi_cache, SLAB_KERNEL);
+	if (!epi)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&epi->rdllink);
+	INIT_LIST_HEAD(&epi->fllink);
+	INIT_LIST_HEAD(&epi->pwqlist);
+	epi->ep = ep;
+	epi->file = tfile;
+	epi->fd = fd;
+	epi->event = *event;
+	epi->nwait = 0;
+
+	/* Hook into the target's wait queues and read its current state */
+	init_poll_funcptr(&epq.pt, ep_ptable_queue_proc);
+	epq.epi = epi;
+	revents = tfile->f_op->poll(tfile, &epq.pt);
+	if (epi->nwait < 0) {
+		/*
+		 * A wakeup through the entries already queued may have put
+		 * the item on the ready list; take it off before freeing.
+		 */
+		ep_unregister_pollwait(epi);
+		spin_lock_irqsave(&ep->lock, flags);
+		if (!list_empty(&epi->rdllink))
+			list_del_init(&epi->rdllink);
+		spin_unlock_irqrestore(&ep->lock, flags);
+		kmem_cache_free(epi_cache, epi);
+		return -ENOMEM;
+	}
+
+	spin_lock(&tfile->f_ep_lock);
+	list_add_tail(&epi->fllink, &tfile->f_ep_links);
+	spin_unlock(&tfile->f_ep_lock);
+
+	list_add(&epi->llink, ep_hash_entry(ep, tfile, fd));
+
+	/* Already ready: report it without waiting for the next wakeup */
+	spin_lock_irqsave(&ep->lock, flags);
+	if (revents & event->events)
+		ep_queue_ready(ep, epi, &pwake);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+	return 0;
+}
+
+/* Called with ep->sem held for writing */
+static int ep_modify(struct eventpoll *ep, struct epitem *epi,
+		     struct epoll_event *event)
+{
+	unsigned int revents;
+	unsigned long flags;
+	int pwake = 0;
+
+	/*
+	 * Set the new mask before polling, so that an event arriving in
+	 * between is caught either here or by the callback.
+	 */
+	spin_lock_irqsave(&ep->lock, flags);
+	epi->event = *event;
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	revents = epi->file->f_op->poll(epi->file, NULL);
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (revents & event->events)
+		ep_queue_ready(ep, epi, &pwake);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+	return 0;
+}
+
+/* Called with ep->sem held for writing, or with the instance going away */
+static void ep_remove(struct eventpoll *ep, struct epitem *epi)
+{
+	struct file *file = epi->file;
+	unsigned long flags;
+
+	/*
+	 * Once off the wait queues the callback can no longer run for
+	 * this item, so the ready list link is stable afterwards.
+	 */
+	ep_unregister_pollwait(epi);
+
+	spin_lock(&file->f_ep_lock);
+	list_del(&epi->fllink);
+	spin_unlock(&file->f_ep_lock);
+
+	list_del(&epi->llink);
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (!list_empty(&epi->rdllink))
+		list_del(&epi->rdllink);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	kmem_cache_free(epi_cache, epi);
+}
+
+static void ep_free(struct eventpoll *ep)
+{
+	unsigned int i;
+
+	/*
+	 * Nobody can reach the instance through its file any more; epsem
+	 * keeps eventpoll_release_file() from freeing items under us.
+	 */
+	down(&epsem);
+	for (i = 0; i < (1U << ep->hashbits); i++)
+		while (!list_empty(&ep->hash[i]))
+			ep_remove(ep, list_entry(ep->hash[i].next,
+						 struct epitem, llink));
+	up(&epsem);
+
+	kfree(ep->hash);
+	kfree(ep);
+}
+
+/*
+ * Drop a file that is going away from every epoll set still watching
+ * it.  Called from fput(), before ->release(), so the file can still be
+ * polled by a concurrent sys_epoll_wait() until we get ep->sem.
+ */
+void eventpoll_release_file(struct file *file)
+{
+	struct list_head *lsthead = &file->f_ep_links;
+	struct eventpoll *ep;
+	struct epitem *epi;
+
+	down(&epsem);
+	while (!list_empty(lsthead)) {
+		epi = list_entry(lsthead->next, struct epitem, fllink);
+		ep = epi->ep;
+		down_write(&ep->sem);
+		ep_remove(ep, epi);
+		up_write(&ep->sem);
+	}
+	up(&epsem);
+}
+
+/*
+ * Report up to maxevents ready items to userspace.  Each item is
+ * unqueued before its file is polled, so an event arriving while we
+ * look at it queues the item again instead of being lost; level
+ * triggered items are requeued after a report so that the next call
+ * checks them again.
+ */
+static int ep_send_events(struct eventpoll *ep, struct epoll_event *events,
+			  int maxevents)
+{
+	struct list_head txlist;
+	struct epitem *epi;
+	unsigned int revents;
+	unsigned long flags;
+	int eventcnt = 0, error = 0, pwake = 0;
+
+	INIT_LIST_HEAD(&txlist);
+
+	down_read(&ep->sem);
+
+	spin_lock_irqsave(&ep->lock, flags);
+	while (eventcnt < maxevents && !list_empty(&ep->rdllist)) {
+		epi = list_entry(ep->rdllist.next, struct epitem, rdllink);
+		list_del(&epi->rdllink);
+		list_add_tail(&epi->rdllink, &txlist);
+		eventcnt++;
+	}
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	eventcnt = 0;
+	while (!list_empty(&txlist)) {
+		epi = list_entry(txlist.next, struct epitem, rdllink);
+
+		spin_lock_irqsave(&ep->lock, flags);
+		list_del_init(&epi->rdllink);
+		spin_unlock_irqrestore(&ep->lock, flags);
+
+		revents = epi->file->f_op->poll(epi->file, NULL);
+		revents &= epi->event.events;
+		if (!revents)
+			continue;
+
+		if (__put_user(revents, &events[eventcnt].events) ||
+		    __put_user(epi->event.data, &events[eventcnt].data)) {
+			spin_lock_irqsave(&ep->lock, flags);
+			ep_queue_ready(ep, epi, &pwake);
+			spin_unlock_irqrestore(&ep->lock, flags);
+			error = -EFAULT;
+			break;
+		}
+		eventcnt++;
+
+		if (!(epi->event.events & EPOLLET)) {
+			spin_lock_irqsave(&ep->lock, flags);
+			ep_queue_ready(ep, epi, &pwake);
+			spin_unlock_irqrestore(&ep->lock, flags);
+		}
+	}
+
+	/* Whatever we did not get to goes back on the ready list */
+	if (!list_empty(&txlist)) {
+		spin_lock_irqsave(&ep->lock, flags);
+		while (!list_empty(&txlist)) {
+			epi = list_entry(txlist.next, struct epitem, rdllink);
+			list_del_init(&epi->rdllink);
+			ep_queue_ready(ep, epi, &pwake);
+		}
+		spin_unlock_irqrestore(&ep->lock, flags);
+	}
+
+	up_read(&ep->sem);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+	return eventcnt ? eventcnt : error;
+}
+
+static int ep_poll(struct eventpoll *ep, struct epoll_event *events,
+		   int maxevents, long timeout)
+{
+	wait_queue_t wait;
+	unsigned long flags;
+	long jtimeout;
+	int res, eavail;
+
+	if (timeout < 0 || timeout >= EP_MAX_MSTIMEO)
+		jtimeout = MAX_SCHEDULE_TIMEOUT;
+	else
+		jtimeout = (timeout * HZ + 999) / 1000;
+
+retry:
+	res = 0;
+	spin_lock_irqsave(&ep->lock, flags);
+	if (list_empty(&ep->rdllist)) {
+		init_waitqueue_entry(&wait, current);
+		add_wait_queue_exclusive(&ep->wq, &wait);
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (!list_empty(&ep->rdllist) || !jtimeout)
+				break;
+			if (signal_pending(current)) {
+				res = -EINTR;
+				break;
+			}
+			spin_unlock_irqrestore(&ep->lock, flags);
+			jtimeout = schedule_timeout(jtimeout);
+			spin_lock_irqsave(&ep->lock, flags);
+		}
+		remove_wait_queue(&ep->wq, &wait);
+		set_current_state(TASK_RUNNING);
+	}
+	eavail = !list_empty(&ep->rdllist);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	/*
+	 * Everything on the ready list may turn out to be stale; go back
+	 * to sleep in that case if there is time left.
+	 */
+	if (!res && eavail &&
+	    !(res = ep_send_events(ep, events, maxevents)) && jtimeout)
+		goto retry;
+
+	return res;
+}
+
+static int ep_eventpoll_close(struct inode *inode, struct file *file)
+{
+	struct eventpoll *ep = file->private_data;
+
+	if (ep)
+		ep_free(ep);
+	return 0;
+}
+
+static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
+{
+	struct eventpoll *ep = file->private_data;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(file, &ep->poll_wait, wait);
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (!list_empty(&ep->rdllist))
+		mask = POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&ep->lock, flags);
+	return mask;
+}
+
+static int eventpollfs_delete_dentry(struct dentry *dentry)
+{
+	return 1;
+}
+
+static struct dentry_operations eventpollfs_dentry_operations = {
+	d_delete:	eventpollfs_delete_dentry,
+};
+
+static struct inode *ep_eventpoll_inode(void)
+{
+	struct inode *inode = new_inode(eventpoll_mnt->mnt_sb);
+
+	if (!inode)
+		return NULL;
+	inode->i_fop = &eventpoll_fops;
+
+	/* See get_pipe_inode() */
+	inode->i_state = I_DIRTY;
+	inode->i_mode = S_IRUSR | S_IWUSR;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_blksize = PAGE_SIZE;
+	return inode;
+}
+
+static int ep_getfd(int *efd, struct eventpoll *ep)
+{
+	struct qstr this;
+	char name[32];
+	struct dentry *dentry;
+	struct inode *inode;
+	struct file *file;
+	int error, fd;
+
+	error = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto no_file;
+
+	inode = ep_eventpoll_inode();
+	if (!inode)
+		goto close_file;
+
+	error = get_unused_fd();
+	if (error < 0)
+		goto close_file_inode;
+	fd = error;
+
+	error = -ENOMEM;
+	sprintf(name, "[%lu]", inode->i_ino);
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = inode->i_ino;
+	dentry = d_alloc(eventpoll_mnt->mnt_sb->s_root, &this);
+	if (!dentry)
+		goto close_file_inode_fd;
+	dentry->d_op = &eventpollfs_dentry_operations;
+	d_add(dentry, inode);
+
+	file->f_vfsmnt = mntget(eventpoll_mnt);
+	file->f_dentry = dentry;
+	file->f_pos = 0;
+	file->f_flags = O_RDONLY;
+	file->f_op = &eventpoll_fops;
+	file->f_mode = FMODE_READ;
+	file->f_version = 0;
+	file->private_data = ep;
+
+	fd_install(fd, file);
+	*efd = fd;
+	return 0;
+
+close_file_inode_fd:
+	put_unused_fd(fd);
+close_file_inode:
+	iput(inode);
+close_file:
+	put_filp(file);
+no_file:
+	return error;
+}
+
+/*
+ * Create an epoll instance.  "size" is only a hint of how many
+ * descriptors will be watched, used to size the item hash.
+ */
+asmlinkage long sys_epoll_create(int size)
+{
+	struct eventpoll *ep;
+	int error, fd;
+
+	if (size <= 0)
+		return -EINVAL;
+
+	error = ep_alloc(size, &ep);
+	if (error)
+		return error;
+
+	error = ep_getfd(&fd, ep);
+	if (error) {
+		kfree(ep->hash);
+		kfree(ep);
+		return error;
+	}
+	return fd;
+}
+
+asmlinkage long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	struct file *file, *tfile;
+	struct eventpoll *ep;
+	struct epitem *epi;
+	struct epoll_event epds;
+	int error;
+
+	if (op != EPOLL_CTL_DEL &&
+	    copy_from_user(&epds, event, sizeof(struct epoll_event)))
+		return -EFAULT;
+
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto out;
+	tfile = fget(fd);
+	if (!tfile)
+		goto out_fput;
+
+	/* The target has to support poll; nesting epoll sets is not supported */
+	error = -EPERM;
+	if (!tfile->f_op || !tfile->f_op->poll)
+		goto out_tfput;
+	error = -EINVAL;
+	if (!is_file_epoll(file) || is_file_epoll(tfile))
+		goto out_tfput;
+
+	ep = file->private_data;
+
+	down_write(&ep->sem);
+
+	epi = ep_find(ep, tfile, fd);
+
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (!epi) {
+			epds.events |= POLLERR | POLLHUP;
+			error = ep_insert(ep, &epds, tfile, fd);
+		} else
+			error = -EEXIST;
+		break;
+	case EPOLL_CTL_DEL:
+		if (epi) {
+			ep_remove(ep, epi);
+			error = 0;
+		} else
+			error = -ENOENT;
+		break;
+	case EPOLL_CTL_MOD:
+		if (epi) {
+			epds.events |= POLLERR | POLLHUP;
+			error = ep_modify(ep, epi, &epds);
+		} else
+			error = -ENOENT;
+		break;
+	}
+
+	up_write(&ep->sem);
+
+out_tfput:
+	fput(tfile);
+out_fput:
+	fput(file);
+out:
+	return error;
+}
+
+/*
+ * Wait for events on an epoll instance; "timeout" is in milliseconds,
+ * -1 waits forever.
+ */
+asmlinkage long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+			       int timeout)
+{
+	struct file *file;
+	int error;
+
+	if (maxevents <= 0 || maxevents > EP_MAX_EVENTS)
+		return -EINVAL;
+
+	if (verify_area(VERIFY_WRITE, events, maxevents * sizeof(struct epoll_event)))
+		return -EFAULT;
+
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto out;
+
+	error = -EINVAL;
+	if (!is_file_epoll(file))
+		goto out_fput;
+
+	error = ep_poll(file->private_data, events, maxevents, timeout);
+
+out_fput:
+	fput(file);
+out:
+	return error;
+}
+
+static int eventpollfs_statfs(struct super_block *sb, struct statfs *buf)
+{
+	buf->f_type = EVENTPOLLFS_MAGIC;
+	buf->f_bsize = 1024;
+	buf->f_namelen = 255;
+	return 0;
+}
+
+static struct super_operations eventpollfs_ops = {
+	statfs:		eventpollfs_statfs,
+};
+
+static struct super_block *eventpollfs_read_super(struct super_block *sb,
+						  void *data, int silent)
+{
+	struct inode *root = new_inode(sb);
+	if (!root)
+		return NULL;
+	root->i_mode = S_IFDIR | S_IRUSR | S_IWUSR;
+	root->i_uid = root->i_gid = 0;
+	root->i_atime = root->i_mtime = root->i_ctime = CURRENT_TIME;
+	sb->s_blocksize = 1024;
+	sb->s_blocksize_bits = 10;
+	sb->s_magic = EVENTPOLLFS_MAGIC;
+	sb->s_op = &eventpollfs_ops;
+	sb->s_root = d_alloc(NULL, &(const struct qstr) { "eventpoll:", 10, 0 });
+	if (!sb->s_root) {
+		iput(root);
+		return NULL;
+	}
+	sb->s_root->d_sb = sb;
+	sb->s_root->d_parent = sb->s_root;
+	d_instantiate(sb->s_root, root);
+	return sb;
+}
+
+static DECLARE_FSTYPE(eventpoll_fs_type, "eventpollfs", eventpollfs_read_super,
+		      FS_NOMOUNT);
+
+static int __init eventpoll_init(void)
+{
+	int error;
+
+	error = -ENOMEM;
+	epi_cache = kmem_cache_create("eventpoll_epi", sizeof(struct epitem),
+				      0, SLAB_HWCACHE_ALIGN, NULL, NULL);
+	if (!epi_cache)
+		goto out;
+	pwq_cache = kmem_cache_create("eventpoll_pwq", sizeof(struct eppoll_entry),
+				      0, SLAB_HWCACHE_ALIGN, NULL, NULL);
+	if (!pwq_cache)
+		goto out_epi;
+
+	error = register_filesystem(&eventpoll_fs_type);
+	if (error)
+		goto out_pwq;
+	eventpoll_mnt = kern_mount(&eventpoll_fs_type);
+	error = PTR_ERR(eventpoll_mnt);
+	if (IS_ERR(eventpoll_mnt))
+		goto out_unregister;
+	return 0;
+
+out_unregister:
+	unregister_filesystem(&eventpoll_fs_type);
+out_pwq:
+	kmem_cache_destroy(pwq_cache);
+out_epi:
+	kmem_cache_destroy(epi_cache);
+out:
+	return error;
+}
+
+module_init(eventpoll_init)
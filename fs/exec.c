@@ -35,6 +35,7 @@
 #include <linux/highmem.h>
 #include <linux/spinlock.h>
 #include <linux/personality.h>
+#include <linux/rmap.h>
 #define __NO_VERSION__
 #include <linux/module.h>
 
@@ -282,11 +283,14 @@ void put_dirty_page(struct task_struct * tsk, struct page *page, unsigned long a
 	pgd_t * pgd;
 	pmd_t * pmd;
 	pte_t * pte;
+	struct pte_chain *pte_chain = NULL;
 
 	if (page_count(page) != 1)
 		printk(KERN_ERR "mem_map disagrees with %p at %08lx\n", page, address);
 	pgd = pgd_offset(tsk->mm, address);
 
+	if (pte_chain_reserve(&pte_chain, GFP_KERNEL))
+		goto out_nolock;
 	spin_lock(&tsk->mm->page_table_lock);
 	pmd = pmd_alloc(tsk->mm, pgd, address);
 	if (!pmd)
@@ -300,13 +304,17 @@ void put_dirty_page(struct task_struct * tsk, struct page *page, unsigned long a
 	flush_dcache_page(page);
 	flush_page_to_ram(page);
 	set_pte(pte, pte_mkdirty(pte_mkwrite(mk_pte(page, PAGE_COPY))));
+	page_add_rmap(page, pte, &pte_chain);
 	tsk->mm->rss++;
 	spin_unlock(&tsk->mm->page_table_lock);
+	pte_chain_release(pte_chain);
 
 	/* no need for flush_tlb */
 	return;
 out:
 	spin_unlock(&tsk->mm->page_table_lock);
+out_nolock:
+	pte_chain_release(pte_chain);
 	__free_page(page);
 	force_sig(SIGKILL, tsk);
 	return;
@@ -346,12 +346,170 @@ error_return:
 	return;
 }
 
+/*
+ * Reservation windows.
+ *
+ * A growing regular file allocates from a window of blocks in one group
+ * which the windows of other files stay out of, so that files written
+ * concurrently don't interleave block by block.  Windows only exist in
+ * memory: their blocks stay free on disk, and allocations which don't
+ * go through a window may still take them.  A new window is opened at
+ * the goal when the file moves outside its window or uses it up, and it
+ * doubles in size (up to EXT2_MAX_RESERVE_BLOCKS) each time the file
+ * used more than half of the previous one.  The windows of a filesystem
+ * sit in an rbtree sorted by start block, under s_rsv_lock.
+ */
+
+static void rsv_window_add(struct super_block * sb,
+			   struct ext2_reserve_window * rsv)
+{
+	rb_root_t * root = &EXT2_SB(sb)->s_rsv_root;
+	rb_node_t ** p = &root->rb_node;
+	rb_node_t * parent = NULL;
+	struct ext2_reserve_window * this;
+
+	while (*p) {
+		parent = *p;
+		this = rb_entry(parent, struct ext2_reserve_window, rsv_node);
+		if (rsv->rsv_start < this->rsv_start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&rsv->rsv_node, parent, p);
+	rb_insert_color(&rsv->rsv_node, root);
+	EXT2_SB(sb)->s_rsv_count++;
+}
+
+static void rsv_window_remove(struct super_block * sb,
+			      struct ext2_reserve_window * rsv)
+{
+	rb_erase(&rsv->rsv_node, &EXT2_SB(sb)->s_rsv_root);
+	EXT2_SB(sb)->s_rsv_count--;
+	rsv->rsv_start = rsv->rsv_end = 0;
+}
+
+/*
+ * Find the first window that ends at or after "block".
+ */
+static struct ext2_reserve_window * rsv_search(struct super_block * sb,
+					       unsigned long block)
+{
+	rb_node_t * n = EXT2_SB(sb)->s_rsv_root.rb_node;
+	struct ext2_reserve_window * rsv, * found = NULL;
+
+	while (n) {
+		rsv = rb_entry(n, struct ext2_reserve_window, rsv_node);
+		if (rsv->rsv_end < block)
+			n = n->rb_right;
+		else {
+			found = rsv;
+			n = n->rb_left;
+		}
+	}
+	return found;
+}
+
+void ext2_init_reservation (struct inode * inode)
+{
+	struct ext2_reserve_window * rsv = &inode->u.ext2_i.i_rsv_window;
+
+	rsv->rsv_start = rsv->rsv_end = 0;
+	rsv->rsv_goal_size = EXT2_DEFAULT_RESERVE_BLOCKS;
+	rsv->rsv_alloc_hit = 0;
+}
+
+/*
+ * Give the window back: on the last close for writing, on truncate
+ * and when the inode goes away.
+ */
+void ext2_discard_reservation (struct inode * inode)
+{
+	struct ext2_reserve_window * rsv = &inode->u.ext2_i.i_rsv_window;
+	struct super_block * sb = inode->i_sb;
+
+	if (!rsv->rsv_end)
+		return;
+	spin_lock(&EXT2_SB(sb)->s_rsv_lock);
+	if (rsv->rsv_end)
+		rsv_window_remove(sb, rsv);
+	spin_unlock(&EXT2_SB(sb)->s_rsv_lock);
+}
+
+/*
+ * Pick a block for "inode" in group "group", whose bitmap is in "bh",
+ * from the inode's window, or open a new window at the first free block
+ * from bit "start" on which is in nobody else's window.  Returns the bit,
+ * or -1 to fall back to a plain search.  Called under lock_super.
+ */
+static int ext2_alloc_from_rsv (struct super_block * sb, struct inode * inode,
+				int group, struct buffer_head * bh, int start)
+{
+	struct ext2_sb_info * sbi = EXT2_SB(sb);
+	struct ext2_reserve_window * rsv = &inode->u.ext2_i.i_rsv_window;
+	struct ext2_reserve_window * next;
+	unsigned long base, goal;
+	int j, end, size = EXT2_BLOCKS_PER_GROUP(sb);
+
+	base = group * EXT2_BLOCKS_PER_GROUP(sb) +
+		le32_to_cpu(sbi->s_es->s_first_data_block);
+	goal = base + start;
+
+	spin_lock(&sbi->s_rsv_lock);
+	if (rsv->rsv_end && goal >= rsv->rsv_start && goal <= rsv->rsv_end) {
+		end = rsv->rsv_end - base + 1;
+		j = ext2_find_next_zero_bit(bh->b_data, end, start);
+		if (j < end) {
+			rsv->rsv_alloc_hit++;
+			sbi->s_rsv_hits++;
+			spin_unlock(&sbi->s_rsv_lock);
+			return j;
+		}
+	}
+
+	sbi->s_rsv_misses++;
+	if (rsv->rsv_end) {
+		if (rsv->rsv_alloc_hit > (rsv->rsv_end - rsv->rsv_start + 1) / 2) {
+			rsv->rsv_goal_size *= 2;
+			if (rsv->rsv_goal_size > EXT2_MAX_RESERVE_BLOCKS)
+				rsv->rsv_goal_size = EXT2_MAX_RESERVE_BLOCKS;
+		}
+		rsv_window_remove(sb, rsv);
+	}
+
+	j = start;
+	while (j < size) {
+		j = ext2_find_next_zero_bit(bh->b_data, size, j);
+		if (j >= size)
+			break;
+		next = rsv_search(sb, base + j);
+		if (next && next->rsv_start <= base + j) {
+			/* somebody else's window, skip it */
+			j = next->rsv_end - base + 1;
+			continue;
+		}
+		rsv->rsv_start = base + j;
+		rsv->rsv_end = base + j + rsv->rsv_goal_size - 1;
+		if (rsv->rsv_end > base + size - 1)
+			rsv->rsv_end = base + size - 1;
+		if (next && next->rsv_start <= rsv->rsv_end)
+			rsv->rsv_end = next->rsv_start - 1;
+		rsv->rsv_alloc_hit = 1;
+		rsv_window_add(sb, rsv);
+		spin_unlock(&sbi->s_rsv_lock);
+		return j;
+	}
+	spin_unlock(&sbi->s_rsv_lock);
+	return -1;
+}
+
 /*
  * ext2_new_block uses a goal block to assist allocation.  If the goal is
  * free, or there is a free block within 32 blocks of the goal, that block
  * is allocated.  Otherwise a forward search is made for a free block; within 
  * each block group the search first looks for an entire free byte in the block
- * bitmap, and then for any free bit if that fails.
+ * bitmap, and then for any free bit if that fails.  Regular files
+ * first try their reservation window, see above.
  * This function also updates quota and i_blocks field.
  */
 int ext2_new_block (struct inode * inode, unsigned long goal,
@@ -365,6 +523,7 @@ int ext2_new_block (struct inode * inode, unsigned long goal,
 	struct super_block * sb;
 	struct ext2_group_desc * gdp;
 	struct ext2_super_block * es;
+	int use_rsv;
 #ifdef EXT2FS_DEBUG
 	static int goal_hits = 0, goal_attempts = 0;
 #endif
@@ -385,6 +544,7 @@ int ext2_new_block (struct inode * inode, unsigned long goal,
 		goto out;
 
 	ext2_debug ("goal=%lu.\n", goal);
+	use_rsv = S_ISREG(inode->i_mode) && test_opt(sb, RESERVATION);
 
 repeat:
 	/*
@@ -412,6 +572,14 @@ repeat:
 
 		ext2_debug ("goal is at %d:%d.\n", i, j);
 
+		if (use_rsv) {
+			k = ext2_alloc_from_rsv(sb, inode, i, bh, j);
+			if (k >= 0) {
+				j = k;
+				goto got_block;
+			}
+		}
+
 		if (!ext2_test_bit(j, bh->b_data)) {
 			ext2_debug("goal bit allocated, %d hits\n",++goal_hits);
 			goto got_block;
@@ -29,8 +29,12 @@
  */
 static int ext2_release_file (struct inode * inode, struct file * filp)
 {
-	if (filp->f_mode & FMODE_WRITE)
+	if (filp->f_mode & FMODE_WRITE) {
 		ext2_discard_prealloc (inode);
+		/* the last writer is done growing the file */
+		if (atomic_read(&inode->i_writecount) == 1)
+			ext2_discard_reservation (inode);
+	}
 	return 0;
 }
 
@@ -327,6 +327,7 @@ struct inode * ext2_new_inode (const struct inode * dir, int mode)
 	inode = new_inode(sb);
 	if (!inode)
 		return ERR_PTR(-ENOMEM);
+	ext2_init_reservation(inode);
 
 	lock_super (sb);
 	es = sb->u.ext2_sb.s_es;
@@ -805,6 +805,7 @@ void ext2_truncate (struct inode * inode)
 		return;
 
 	ext2_discard_prealloc(inode);
+	ext2_discard_reservation(inode);
 
 	blocksize = inode->i_sb->s_blocksize;
 	iblock = (inode->i_size + blocksize-1)
@@ -888,6 +889,8 @@ void ext2_read_inode (struct inode * inode)
 	unsigned long offset;
 	struct ext2_group_desc * gdp;
 
+	/* before anything can fail: clear_inode() looks at it */
+	ext2_init_reservation(inode);
 	if ((inode->i_ino != EXT2_ROOT_INO && inode->i_ino != EXT2_ACL_IDX_INO &&
 	     inode->i_ino != EXT2_ACL_DATA_INO &&
 	     inode->i_ino < EXT2_FIRST_INO(inode->i_sb)) ||
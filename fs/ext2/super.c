@@ -25,6 +25,7 @@
 #include <linux/init.h>
 #include <linux/locks.h>
 #include <linux/blkdev.h>
+#include <linux/proc_fs.h>
 #include <asm/uaccess.h>
 
 
@@ -33,6 +34,35 @@ static void ext2_sync_super(struct super_block *sb,
 
 static char error_buf[1024];
 
+#ifdef CONFIG_PROC_FS
+/* /proc/fs/ext2/<device>: reservation window statistics */
+static struct proc_dir_entry * ext2_proc_root;
+
+static int ext2_rsv_read_proc (char * page, char ** start, off_t off,
+			       int count, int * eof, void * data)
+{
+	struct super_block * sb = data;
+	struct ext2_sb_info * sbi = EXT2_SB(sb);
+	int len;
+
+	len = sprintf(page, "reservation: %s\n"
+			    "windows: %lu\n"
+			    "hits: %lu\n"
+			    "misses: %lu\n",
+		      test_opt(sb, RESERVATION) ? "on" : "off",
+		      sbi->s_rsv_count, sbi->s_rsv_hits, sbi->s_rsv_misses);
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+#endif
+
 void ext2_error (struct super_block * sb, const char * function,
 		 const char * fmt, ...)
 {
@@ -143,6 +173,10 @@ void ext2_put_super (struct super_block * sb)
 		if (sb->u.ext2_sb.s_block_bitmap[i])
 			brelse (sb->u.ext2_sb.s_block_bitmap[i]);
 	brelse (sb->u.ext2_sb.s_sbh);
+#ifdef CONFIG_PROC_FS
+	if (ext2_proc_root)
+		remove_proc_entry(kdevname(sb->s_dev), ext2_proc_root);
+#endif
 
 	return;
 }
@@ -156,6 +190,7 @@ static struct super_operations ext2_sops = {
 	write_super:	ext2_write_super,
 	statfs:		ext2_statfs,
 	remount_fs:	ext2_remount,
+	clear_inode:	ext2_discard_reservation,
 };
 
 /*
@@ -229,6 +264,10 @@ static int parse_options (char * options, unsigned long * sb_block,
 		else if (!strcmp (this_char, "nogrpid") ||
 			 !strcmp (this_char, "sysvgroups"))
 			clear_opt (*mount_options, GRPID);
+		else if (!strcmp (this_char, "reservation"))
+			set_opt (*mount_options, RESERVATION);
+		else if (!strcmp (this_char, "noreservation"))
+			clear_opt (*mount_options, RESERVATION);
 		else if (!strcmp (this_char, "resgid")) {
 			if (!value || !*value) {
 				printk ("EXT2-fs: the resgid option requires "
@@ -424,6 +463,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 	    blocksize = BLOCK_SIZE;
 
 	sb->u.ext2_sb.s_mount_opt = 0;
+	set_opt (sb->u.ext2_sb.s_mount_opt, RESERVATION);
 	if (!parse_options ((char *) data, &sb_block, &resuid, &resgid,
 	    &sb->u.ext2_sb.s_mount_opt)) {
 		return NULL;
@@ -634,6 +674,11 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 	sb->u.ext2_sb.s_loaded_inode_bitmaps = 0;
 	sb->u.ext2_sb.s_loaded_block_bitmaps = 0;
 	sb->u.ext2_sb.s_gdb_count = db_count;
+	spin_lock_init(&sb->u.ext2_sb.s_rsv_lock);
+	sb->u.ext2_sb.s_rsv_root = RB_ROOT;
+	sb->u.ext2_sb.s_rsv_count = 0;
+	sb->u.ext2_sb.s_rsv_hits = 0;
+	sb->u.ext2_sb.s_rsv_misses = 0;
 	/*
 	 * set up enough so that it can read an inode
 	 */
@@ -650,6 +695,11 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 		goto failed_mount2;
 	}
 	ext2_setup_super (sb, es, sb->s_flags & MS_RDONLY);
+#ifdef CONFIG_PROC_FS
+	if (ext2_proc_root)
+		create_proc_read_entry(kdevname(dev), 0, ext2_proc_root,
+				       ext2_rsv_read_proc, sb);
+#endif
 	return sb;
 failed_mount2:
 	for (i = 0; i < db_count; i++)
@@ -813,12 +863,19 @@ static DECLARE_FSTYPE_DEV(ext2_fs_type, "ext2", ext2_read_super);
 
 static int __init init_ext2_fs(void)
 {
+#ifdef CONFIG_PROC_FS
+	ext2_proc_root = proc_mkdir("ext2", proc_root_fs);
+#endif
         return register_filesystem(&ext2_fs_type);
 }
 
 static void __exit exit_ext2_fs(void)
 {
 	unregister_filesystem(&ext2_fs_type);
+#ifdef CONFIG_PROC_FS
+	if (ext2_proc_root)
+		remove_proc_entry("ext2", proc_root_fs);
+#endif
 }
 
 EXPORT_NO_SYMBOLS;
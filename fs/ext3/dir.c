@@ -21,20 +21,48 @@
 #include <linux/fs.h>
 #include <linux/jbd.h>
 #include <linux/ext3_fs.h>
+#include <linux/slab.h>
+#include <linux/rbtree.h>
 
 static unsigned char ext3_filetype_table[] = {
 	DT_UNKNOWN, DT_REG, DT_DIR, DT_CHR, DT_BLK, DT_FIFO, DT_SOCK, DT_LNK
 };
 
 static int ext3_readdir(struct file *, void *, filldir_t);
+static int ext3_dx_readdir(struct file *, void *, filldir_t);
+static int ext3_release_dir(struct inode *, struct file *);
 
 struct file_operations ext3_dir_operations = {
 	read:		generic_read_dir,
 	readdir:	ext3_readdir,		/* BKL held */
 	ioctl:		ext3_ioctl,		/* BKL held */
 	fsync:		ext3_sync_file,		/* BKL held */
+	release:	ext3_release_dir,	/* BKL not held */
 };
 
+static unsigned char get_dtype(struct super_block *sb, int filetype)
+{
+	if (!EXT3_HAS_INCOMPAT_FEATURE(sb, EXT3_FEATURE_INCOMPAT_FILETYPE) ||
+	    filetype >= EXT3_FT_MAX)
+		return DT_UNKNOWN;
+
+	return ext3_filetype_table[filetype];
+}
+
+/*
+ * Directories which can be read in hash order: indexed ones, and
+ * those of a single block which will become indexed when they grow,
+ * so that a readdir running across the conversion keeps its place.
+ */
+static int is_dx_dir(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	return EXT3_HAS_COMPAT_FEATURE(sb, EXT3_FEATURE_COMPAT_DIR_INDEX) &&
+	       ((inode->u.ext3_i.i_flags & EXT3_INDEX_FL) ||
+		(inode->i_size >> EXT3_BLOCK_SIZE_BITS(sb)) == 1);
+}
+
 int ext3_check_dir_entry (const char * function, struct inode * dir,
 			  struct ext3_dir_entry_2 * de,
 			  struct buffer_head * bh,
@@ -79,6 +107,18 @@ static int ext3_readdir(struct file * filp,
 
 	sb = inode->i_sb;
 
+	if (is_dx_dir(inode)) {
+		err = ext3_dx_readdir(filp, dirent, filldir);
+		if (err != ERR_BAD_DX_DIR)
+			return err;
+		/*
+		 * The index is damaged: forget it and read the blocks
+		 * linearly, as ext3_add_entry() does.
+		 */
+		inode->u.ext3_i.i_flags &= ~EXT3_INDEX_FL;
+		filp->f_pos = 0;
+	}
+
 	stored = 0;
 	bh = NULL;
 	offset = filp->f_pos & (sb->s_blocksize - 1);
@@ -188,3 +228,280 @@ revalidate:
 	UPDATE_ATIME(inode);
 	return 0;
 }
+
+/*
+ * Hash order readdir
+ *
+ * Splitting a leaf moves half of its names to a block appended at the
+ * end of the directory, so a reader walking the blocks in order would
+ * see some names twice and miss others.  Indexed directories are read
+ * in hash order instead: ext3_htree_fill_tree() collects the names of
+ * a leaf (and of any leaves continuing its hash collisions) into an
+ * rbtree sorted by hash, and f_pos is the hash of the next name to
+ * return, which a split never moves.
+ */
+struct fname {
+	__u32		hash;
+	__u32		minor_hash;
+	rb_node_t	rb_hash;
+	struct fname	*next;		/* names with the same hashes */
+	__u32		inode;
+	__u8		name_len;
+	__u8		file_type;
+	char		name[0];
+};
+
+struct dir_private_info {
+	rb_root_t	root;
+	rb_node_t	*curr_node;
+	struct fname	*extra_fname;	/* rest of a chain not yet returned */
+	loff_t		last_pos;
+	__u32		curr_hash;
+	__u32		curr_minor_hash;
+	__u32		next_hash;
+};
+
+/*
+ * f_pos holds the major hash shifted down one bit, which keeps it
+ * positive in an off_t and clear of EXT3_HTREE_EOF.
+ */
+static inline loff_t hash2pos(__u32 major)
+{
+	loff_t pos = major >> 1;
+
+	return pos == EXT3_HTREE_EOF ? EXT3_HTREE_EOF - 1 : pos;
+}
+
+#define pos2maj_hash(pos)	((__u32) (((pos) << 1) & 0xffffffff))
+
+static void free_rb_tree_fname(rb_root_t *root)
+{
+	rb_node_t *n = root->rb_node;
+	rb_node_t *parent;
+	struct fname *fname;
+
+	/* Free bottom up, without rebalancing on the way */
+	while (n) {
+		if (n->rb_left) {
+			n = n->rb_left;
+			continue;
+		}
+		if (n->rb_right) {
+			n = n->rb_right;
+			continue;
+		}
+		parent = n->rb_parent;
+		fname = rb_entry(n, struct fname, rb_hash);
+		while (fname) {
+			struct fname *old = fname;
+
+			fname = fname->next;
+			kfree(old);
+		}
+		if (!parent)
+			root->rb_node = NULL;
+		else if (parent->rb_left == n)
+			parent->rb_left = NULL;
+		else
+			parent->rb_right = NULL;
+		n = parent;
+	}
+	root->rb_node = NULL;
+}
+
+static struct dir_private_info *create_dir_info(loff_t pos)
+{
+	struct dir_private_info *p;
+
+	p = kmalloc(sizeof(struct dir_private_info), GFP_KERNEL);
+	if (!p)
+		return NULL;
+	p->root.rb_node = NULL;
+	p->curr_node = NULL;
+	p->extra_fname = NULL;
+	p->last_pos = 0;
+	p->curr_hash = pos2maj_hash(pos);
+	p->curr_minor_hash = 0;
+	p->next_hash = 0;
+	return p;
+}
+
+static void ext3_htree_free_dir_info(struct dir_private_info *p)
+{
+	free_rb_tree_fname(&p->root);
+	kfree(p);
+}
+
+/*
+ * Add a name to the tree of names being read.  Names with the same
+ * hash and minor hash are chained off the node of the first one.
+ */
+int ext3_htree_store_dirent(struct file *dir_file, __u32 hash,
+			    __u32 minor_hash,
+			    struct ext3_dir_entry_2 *dirent)
+{
+	struct dir_private_info *info = dir_file->private_data;
+	rb_node_t **p, *parent = NULL;
+	struct fname *fname, *new_fn;
+	int len;
+
+	p = &info->root.rb_node;
+
+	len = sizeof(struct fname) + dirent->name_len + 1;
+	new_fn = kmalloc(len, GFP_KERNEL);
+	if (!new_fn)
+		return -ENOMEM;
+	memset(new_fn, 0, len);
+	new_fn->hash = hash;
+	new_fn->minor_hash = minor_hash;
+	new_fn->inode = le32_to_cpu(dirent->inode);
+	new_fn->name_len = dirent->name_len;
+	new_fn->file_type = dirent->file_type;
+	memcpy(new_fn->name, dirent->name, dirent->name_len);
+	new_fn->name[dirent->name_len] = 0;
+
+	while (*p) {
+		parent = *p;
+		fname = rb_entry(parent, struct fname, rb_hash);
+
+		if (new_fn->hash == fname->hash &&
+		    new_fn->minor_hash == fname->minor_hash) {
+			new_fn->next = fname->next;
+			fname->next = new_fn;
+			return 0;
+		}
+
+		if (new_fn->hash < fname->hash ||
+		    (new_fn->hash == fname->hash &&
+		     new_fn->minor_hash < fname->minor_hash))
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&new_fn->rb_hash, parent, p);
+	rb_insert_color(&new_fn->rb_hash, &info->root);
+	return 0;
+}
+
+/*
+ * Hand a name and the others chained to it to filldir.  If filldir
+ * has no room left, f_pos stays at their hash and the names not
+ * returned are kept for the next call.
+ */
+static int call_filldir(struct file * filp, void * dirent,
+			filldir_t filldir, struct fname *fname)
+{
+	struct dir_private_info *info = filp->private_data;
+	struct inode *inode = filp->f_dentry->d_inode;
+	loff_t curr_pos;
+	int error;
+
+	curr_pos = hash2pos(fname->hash);
+	while (fname) {
+		error = filldir(dirent, fname->name, fname->name_len,
+				curr_pos, fname->inode,
+				get_dtype(inode->i_sb, fname->file_type));
+		if (error) {
+			filp->f_pos = curr_pos;
+			info->extra_fname = fname;
+			return error;
+		}
+		fname = fname->next;
+	}
+	return 0;
+}
+
+static int ext3_dx_readdir(struct file * filp,
+			   void * dirent, filldir_t filldir)
+{
+	struct dir_private_info *info = filp->private_data;
+	struct inode *inode = filp->f_dentry->d_inode;
+	struct fname *fname;
+	int ret;
+
+	if (!info) {
+		info = create_dir_info(filp->f_pos);
+		if (!info)
+			return -ENOMEM;
+		info->last_pos = filp->f_pos;
+		filp->private_data = info;
+	}
+
+	if (filp->f_pos == EXT3_HTREE_EOF)
+		return 0;
+
+	/* Someone has seeked the directory: start again from f_pos */
+	if (info->last_pos != filp->f_pos) {
+		free_rb_tree_fname(&info->root);
+		info->curr_node = NULL;
+		info->extra_fname = NULL;
+		info->curr_hash = pos2maj_hash(filp->f_pos);
+		info->curr_minor_hash = 0;
+	}
+
+	/* Names left over on a hash collision chain go out first */
+	if (info->extra_fname) {
+		if (call_filldir(filp, dirent, filldir, info->extra_fname))
+			goto finished;
+		info->extra_fname = NULL;
+		goto next_node;
+	} else if (!info->curr_node)
+		info->curr_node = rb_first(&info->root);
+
+	while (1) {
+		/*
+		 * Fill the tree when it has run dry, or again from the
+		 * current hash when the directory has changed since.
+		 */
+		if (!info->curr_node ||
+		    filp->f_version != inode->i_version) {
+			info->curr_node = NULL;
+			free_rb_tree_fname(&info->root);
+			filp->f_version = inode->i_version;
+			ret = ext3_htree_fill_tree(filp, info->curr_hash,
+						   info->curr_minor_hash,
+						   &info->next_hash);
+			if (ret < 0)
+				return ret;
+			if (ret == 0) {
+				filp->f_pos = EXT3_HTREE_EOF;
+				break;
+			}
+			info->curr_node = rb_first(&info->root);
+		}
+
+		fname = rb_entry(info->curr_node, struct fname, rb_hash);
+		info->curr_hash = fname->hash;
+		info->curr_minor_hash = fname->minor_hash;
+		if (call_filldir(filp, dirent, filldir, fname))
+			break;
+	next_node:
+		info->curr_node = rb_next(info->curr_node);
+		if (info->curr_node) {
+			fname = rb_entry(info->curr_node, struct fname,
+					 rb_hash);
+			info->curr_hash = fname->hash;
+			info->curr_minor_hash = fname->minor_hash;
+		} else {
+			if (info->next_hash == ~0) {
+				filp->f_pos = EXT3_HTREE_EOF;
+				break;
+			}
+			info->curr_hash = info->next_hash;
+			info->curr_minor_hash = 0;
+		}
+	}
+finished:
+	info->last_pos = filp->f_pos;
+	UPDATE_ATIME(inode);
+	return 0;
+}
+
+static int ext3_release_dir(struct inode * inode, struct file * filp)
+{
+	if (filp->private_data)
+		ext3_htree_free_dir_info(filp->private_data);
+
+	return 0;
+}
@@ -318,6 +318,7 @@ struct inode * ext3_new_inode (handle_t *handle,
 	inode = new_inode(sb);
 	if (!inode)
 		return ERR_PTR(-ENOMEM);
+	ext3_init_reservation(inode);
 	init_rwsem(&inode->u.ext3_i.truncate_sem);
 
 	lock_super (sb);
@@ -1859,6 +1859,7 @@ void ext3_truncate(struct inode * inode)
 		return;
 
 	ext3_discard_prealloc(inode);
+	ext3_discard_reservation(inode);
 
 	handle = start_transaction(inode);
 	if (IS_ERR(handle))
@@ -2060,6 +2061,8 @@ void ext3_read_inode(struct inode * inode)
 	struct buffer_head *bh;
 	int block;
 	
+	/* before anything can fail: clear_inode() looks at it */
+	ext3_init_reservation(inode);
 	if(ext3_get_inode_loc(inode, &iloc))
 		goto bad_inode;
 	bh = iloc.bh;
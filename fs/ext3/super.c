@@ -30,6 +30,7 @@
 #include <linux/blkdev.h>
 #include <linux/smp_lock.h>
 #include <linux/random.h>
+#include <linux/proc_fs.h>
 #include <asm/uaccess.h>
 
 #ifdef CONFIG_JBD_DEBUG
@@ -106,6 +107,35 @@ static void clear_ro_after(struct super_block *sb)
 
 static char error_buf[1024];
 
+#ifdef CONFIG_PROC_FS
+/* /proc/fs/ext3/<device>: reservation window statistics */
+static struct proc_dir_entry * ext3_proc_root;
+
+static int ext3_rsv_read_proc (char * page, char ** start, off_t off,
+			       int count, int * eof, void * data)
+{
+	struct super_block * sb = data;
+	struct ext3_sb_info * sbi = EXT3_SB(sb);
+	int len;
+
+	len = sprintf(page, "reservation: %s\n"
+			    "windows: %lu\n"
+			    "hits: %lu\n"
+			    "misses: %lu\n",
+		      test_opt(sb, RESERVATION) ? "on" : "off",
+		      sbi->s_rsv_count, sbi->s_rsv_hits, sbi->s_rsv_misses);
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+#endif
+
 /* Determine the appropriate response to ext3_error on a given filesystem */
 
 static int ext3_error_behaviour(struct super_block *sb)
@@ -442,6 +472,10 @@ void ext3_put_super (struct super_block * sb)
 		ext3_blkdev_remove(sbi);
 	}
 	clear_ro_after(sb);
+#ifdef CONFIG_PROC_FS
+	if (ext3_proc_root)
+		remove_proc_entry(kdevname(sb->s_dev), ext3_proc_root);
+#endif
 
 	return;
 }
@@ -458,6 +492,7 @@ static struct super_operations ext3_sops = {
 	unlockfs:	ext3_unlockfs,		/* BKL not held.  We take it */
 	statfs:		ext3_statfs,		/* BKL held */
 	remount_fs:	ext3_remount,		/* BKL held */
+	clear_inode:	ext3_discard_reservation, /* BKL not held.  Don't need */
 };
 
 static int want_value(char *value, char *option)
@@ -566,6 +601,10 @@ static int parse_options (char * options, unsigned long * sb_block,
 		else if (!strcmp (this_char, "nogrpid") ||
 			 !strcmp (this_char, "sysvgroups"))
 			clear_opt (*mount_options, GRPID);
+		else if (!strcmp (this_char, "reservation"))
+			set_opt (*mount_options, RESERVATION);
+		else if (!strcmp (this_char, "noreservation"))
+			clear_opt (*mount_options, RESERVATION);
 		else if (!strcmp (this_char, "resgid")) {
 			unsigned long v;
 			if (want_numeric(value, "resgid", &v))
@@ -617,6 +656,15 @@ static int parse_options (char * options, unsigned long * sb_block,
 		}
 		else if (!strcmp (this_char, "noload"))
 			set_opt (*mount_options, NOLOAD);
+		else if (!strcmp (this_char, "journal_async_commit")) {
+			if (is_remount && !(*mount_options &
+					EXT3_MOUNT_JOURNAL_ASYNC_COMMIT)) {
+				printk(KERN_ERR "EXT3-fs: cannot change "
+				       "journal commit mode on remount\n");
+				return 0;
+			}
+			set_opt (*mount_options, JOURNAL_ASYNC_COMMIT);
+		}
 		else if (!strcmp (this_char, "data")) {
 			int data_opt = 0;
 
@@ -923,6 +971,7 @@ struct super_block * ext3_read_super (struct super_block * sb, void * data,
 		blocksize = hblock;
 
 	sbi->s_mount_opt = 0;
+	set_opt (sbi->s_mount_opt, RESERVATION);
 	sbi->s_resuid = EXT3_DEF_RESUID;
 	sbi->s_resgid = EXT3_DEF_RESGID;
 	if (!parse_options ((char *) data, &sb_block, sbi, &journal_inum, 0)) {
@@ -1064,6 +1113,9 @@ struct super_block * ext3_read_super (struct super_block * sb, void * data,
 	if (sbi->s_resgid == EXT3_DEF_RESGID)
 		sbi->s_resgid = le16_to_cpu(es->s_def_resgid);
 	sbi->s_mount_state = le16_to_cpu(es->s_state);
+	for (i = 0; i < 4; i++)
+		sbi->s_hash_seed[i] = le32_to_cpu(es->s_hash_seed[i]);
+	sbi->s_def_hash_version = es->s_def_hash_version;
 	sbi->s_addr_per_block_bits = log2(EXT3_ADDR_PER_BLOCK(sb));
 	sbi->s_desc_per_block_bits = log2(EXT3_DESC_PER_BLOCK(sb));
 
@@ -1120,6 +1172,11 @@ struct super_block * ext3_read_super (struct super_block * sb, void * data,
 	sbi->s_loaded_inode_bitmaps = 0;
 	sbi->s_loaded_block_bitmaps = 0;
 	sbi->s_gdb_count = db_count;
+	spin_lock_init(&sbi->s_rsv_lock);
+	sbi->s_rsv_root = RB_ROOT;
+	sbi->s_rsv_count = 0;
+	sbi->s_rsv_hits = 0;
+	sbi->s_rsv_misses = 0;
 	get_random_bytes(&sbi->s_next_generation, sizeof(u32));
 	/*
 	 * set up enough so that it can read an inode
@@ -1178,6 +1235,25 @@ struct super_block * ext3_read_super (struct super_block * sb, void * data,
 		break;
 	}
 
+	/*
+	 * The log is empty now, so the commit record format can be
+	 * switched either way.  Asynchronous commits are an incompat
+	 * feature: an older kernel would trust a commit record that
+	 * made it to disk without the rest of its transaction.
+	 */
+	if (test_opt(sb, JOURNAL_ASYNC_COMMIT)) {
+		if (!journal_set_features(sbi->s_journal,
+				JFS_FEATURE_COMPAT_CHECKSUM, 0,
+				JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+			printk(KERN_ERR "EXT3-fs: Journal does not support "
+			       "asynchronous commits\n");
+			goto failed_mount3;
+		}
+	} else
+		journal_clear_features(sbi->s_journal,
+				JFS_FEATURE_COMPAT_CHECKSUM, 0,
+				JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
+
 	/*
 	 * The journal_load will have done any necessary log recovery,
 	 * so we can safely mount the rest of the filesystem now.
@@ -1217,6 +1293,11 @@ struct super_block * ext3_read_super (struct super_block * sb, void * data,
 		test_opt(sb,DATA_FLAGS) == EXT3_MOUNT_JOURNAL_DATA ? "journal":
 		test_opt(sb,DATA_FLAGS) == EXT3_MOUNT_ORDERED_DATA ? "ordered":
 		"writeback");
+#ifdef CONFIG_PROC_FS
+	if (ext3_proc_root)
+		create_proc_read_entry(kdevname(dev), 0, ext3_proc_root,
+				       ext3_rsv_read_proc, sb);
+#endif
 
 	return sb;
 
@@ -1761,12 +1842,19 @@ static DECLARE_FSTYPE_DEV(ext3_fs_type, "ext3", ext3_read_super);
 
 static int __init init_ext3_fs(void)
 {
+#ifdef CONFIG_PROC_FS
+	ext3_proc_root = proc_mkdir("ext3", proc_root_fs);
+#endif
         return register_filesystem(&ext3_fs_type);
 }
 
 static void __exit exit_ext3_fs(void)
 {
 	unregister_filesystem(&ext3_fs_type);
+#ifdef CONFIG_PROC_FS
+	if (ext3_proc_root)
+		remove_proc_entry("ext3", proc_root_fs);
+#endif
 }
 
 EXPORT_NO_SYMBOLS;
@@ -0,0 +1,542 @@
+/*
+ * hugetlbfs: a ramfs-like filesystem whose files are backed by huge
+ * TLB pages.
+ *
+ * Files can only be mmap()ed, shared, at huge page aligned addresses
+ * and offsets; there is no read() or write().  The whole mapping is
+ * populated at mmap time, so a hugetlb vma never takes a page fault
+ * unless the file was truncated under it.
+ *
+ * The huge pages of a file are kept in a per-inode array indexed by
+ * file offset in huge page units, rather than in the page cache: page
+ * reclaim must never see them.  SysV shm segments created with
+ * SHM_HUGETLB are unlinked files on an internal mount, set up by
+ * hugetlb_file_setup().
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/file.h>
+#include <linux/hugetlb.h>
+
+#include <asm/uaccess.h>
+
+/* some random number */
+#define HUGETLBFS_MAGIC	0x958458f6
+
+/* the page array is kmalloc()ed, which caps the file size */
+#define HUGETLBFS_MAX_PAGES	(128 * 1024 / sizeof(struct page *))
+
+struct hugetlbfs_inode_info {
+	struct semaphore sem;		/* protects the fields below */
+	unsigned long nr_slots;
+	struct page **pages;
+};
+
+#define HUGETLBFS_I(inode)	((struct hugetlbfs_inode_info *) (inode)->u.generic_ip)
+
+static struct super_operations hugetlbfs_ops;
+static struct inode_operations hugetlbfs_dir_inode_operations;
+static struct inode_operations hugetlbfs_inode_operations;
+
+static struct vfsmount *hugetlbfs_vfsmount;
+
+/* Make room for nr pages in the page array.  Called with info->sem held. */
+static int hugetlbfs_grow(struct hugetlbfs_inode_info *info, unsigned long nr)
+{
+	struct page **pages;
+
+	if (nr <= info->nr_slots)
+		return 0;
+	if (nr > HUGETLBFS_MAX_PAGES)
+		return -EFBIG;
+
+	pages = kmalloc(nr * sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+	if (info->nr_slots)
+		memcpy(pages, info->pages, info->nr_slots * sizeof(struct page *));
+	memset(pages + info->nr_slots, 0,
+	       (nr - info->nr_slots) * sizeof(struct page *));
+	if (info->pages)
+		kfree(info->pages);
+	info->pages = pages;
+	info->nr_slots = nr;
+	return 0;
+}
+
+/* Give back the pages from index start on.  Called with info->sem held. */
+static void hugetlbfs_free_pages(struct hugetlbfs_inode_info *info,
+				 unsigned long start)
+{
+	unsigned long i;
+
+	for (i = start; i < info->nr_slots; i++) {
+		if (info->pages[i]) {
+			free_huge_page(info->pages[i]);
+			info->pages[i] = NULL;
+		}
+	}
+}
+
+/* Like vmtruncate_list(), for mappings made of huge pages */
+static void hugetlbfs_zap_mappings(struct vm_area_struct *vma,
+				   unsigned long pgoff)
+{
+	unsigned long start, len, diff;
+
+	for (; vma; vma = vma->vm_next_share) {
+		start = vma->vm_start;
+		len = vma->vm_end - start;
+
+		if (vma->vm_pgoff >= pgoff) {
+			zap_hugepage_range(vma, start, len);
+			continue;
+		}
+
+		len >>= PAGE_SHIFT;
+		diff = pgoff - vma->vm_pgoff;
+		if (diff >= len)
+			continue;
+
+		start += diff << PAGE_SHIFT;
+		len = (len - diff) << PAGE_SHIFT;
+		zap_hugepage_range(vma, start, len);
+	}
+}
+
+static int hugetlbfs_truncate(struct inode *inode, loff_t size)
+{
+	struct hugetlbfs_inode_info *info = HUGETLBFS_I(inode);
+	struct address_space *mapping = inode->i_mapping;
+	unsigned long nr = size >> HPAGE_SHIFT;
+	int error = 0;
+
+	if (size & ~HPAGE_MASK)
+		return -EINVAL;
+
+	down(&info->sem);
+	if (size < inode->i_size) {
+		spin_lock(&mapping->i_shared_lock);
+		hugetlbfs_zap_mappings(mapping->i_mmap, size >> PAGE_SHIFT);
+		hugetlbfs_zap_mappings(mapping->i_mmap_shared, size >> PAGE_SHIFT);
+		spin_unlock(&mapping->i_shared_lock);
+		hugetlbfs_free_pages(info, nr);
+	} else
+		error = hugetlbfs_grow(info, nr);
+	if (!error)
+		inode->i_size = size;
+	up(&info->sem);
+	return error;
+}
+
+static int hugetlbfs_setattr(struct dentry *dentry, struct iattr *attr)
+{
+	struct inode *inode = dentry->d_inode;
+	int error;
+
+	error = inode_change_ok(inode, attr);
+	if (error)
+		return error;
+
+	if (attr->ia_valid & ATTR_SIZE) {
+		error = hugetlbfs_truncate(inode, attr->ia_size);
+		if (error)
+			return error;
+		attr->ia_valid &= ~ATTR_SIZE;
+	}
+	return inode_setattr(inode, attr);
+}
+
+/*
+ * Allocate the huge pages covering the mapping and map them all.  A
+ * mapping reaching beyond the end of the file extends it.
+ */
+static int hugetlbfs_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+	struct hugetlbfs_inode_info *info = HUGETLBFS_I(inode);
+	unsigned long first, nr, i;
+	loff_t len;
+	int error;
+
+	if ((vma->vm_start | vma->vm_end) & ~HPAGE_MASK)
+		return -EINVAL;
+	if (vma->vm_pgoff & ((HPAGE_SIZE >> PAGE_SHIFT) - 1))
+		return -EINVAL;
+	/* there is no copy-on-write for huge pages */
+	if (!(vma->vm_flags & VM_MAYSHARE))
+		return -EINVAL;
+
+	first = vma->vm_pgoff >> (HPAGE_SHIFT - PAGE_SHIFT);
+	nr = (vma->vm_end - vma->vm_start) >> HPAGE_SHIFT;
+
+	down(&info->sem);
+	error = hugetlbfs_grow(info, first + nr);
+	if (error)
+		goto out;
+	for (i = first; i < first + nr; i++) {
+		if (info->pages[i])
+			continue;
+		info->pages[i] = alloc_huge_page();
+		if (!info->pages[i]) {
+			error = -ENOMEM;
+			goto out;
+		}
+	}
+	len = (loff_t) (first + nr) << HPAGE_SHIFT;
+	if (inode->i_size < len)
+		inode->i_size = len;
+
+	vma->vm_flags |= VM_HUGETLB | VM_RESERVED;
+	error = hugetlb_prefault(vma, info->pages + first);
+	if (error)
+		zap_hugepage_range(vma, vma->vm_start, vma->vm_end - vma->vm_start);
+out:
+	up(&info->sem);
+	UPDATE_ATIME(inode);
+	return error;
+}
+
+static unsigned long hugetlb_get_unmapped_area(struct file *file,
+		unsigned long addr, unsigned long len, unsigned long pgoff,
+		unsigned long flags)
+{
+	struct vm_area_struct *vma;
+
+	if (len & ~HPAGE_MASK)
+		return -EINVAL;
+	if (len > TASK_SIZE)
+		return -ENOMEM;
+
+	if (addr) {
+		addr = (addr + ~HPAGE_MASK) & HPAGE_MASK;
+		vma = find_vma(current->mm, addr);
+		if (TASK_SIZE - len >= addr &&
+		    (!vma || addr + len <= vma->vm_start))
+			return addr;
+	}
+	addr = (TASK_UNMAPPED_BASE + ~HPAGE_MASK) & HPAGE_MASK;
+
+	for (vma = find_vma(current->mm, addr); ; vma = vma->vm_next) {
+		if (TASK_SIZE - len < addr)
+			return -ENOMEM;
+		if (!vma || addr + len <= vma->vm_start)
+			return addr;
+		addr = (vma->vm_end + ~HPAGE_MASK) & HPAGE_MASK;
+	}
+}
+
+static int hugetlbfs_sync_file(struct file *file, struct dentry *dentry,
+			       int datasync)
+{
+	return 0;
+}
+
+static int hugetlbfs_statfs(struct super_block *sb, struct statfs *buf)
+{
+	buf->f_type = HUGETLBFS_MAGIC;
+	buf->f_bsize = HPAGE_SIZE;
+	buf->f_namelen = 255;
+	return 0;
+}
+
+static struct inode *hugetlbfs_get_inode(struct super_block *sb, int mode,
+					 int dev)
+{
+	struct inode *inode = new_inode(sb);
+	struct hugetlbfs_inode_info *info;
+
+	if (!inode)
+		return NULL;
+
+	inode->i_mode = mode;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_blksize = HPAGE_SIZE;
+	inode->i_blocks = 0;
+	inode->i_rdev = NODEV;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	switch (mode & S_IFMT) {
+	default:
+		init_special_inode(inode, mode, dev);
+		break;
+	case S_IFREG:
+		info = kmalloc(sizeof(*info), GFP_KERNEL);
+		if (!info) {
+			iput(inode);
+			return NULL;
+		}
+		init_MUTEX(&info->sem);
+		info->nr_slots = 0;
+		info->pages = NULL;
+		inode->u.generic_ip = info;
+		inode->i_op = &hugetlbfs_inode_operations;
+		inode->i_fop = &hugetlbfs_file_operations;
+		break;
+	case S_IFDIR:
+		inode->i_op = &hugetlbfs_dir_inode_operations;
+		inode->i_fop = &dcache_dir_ops;
+		break;
+	}
+	return inode;
+}
+
+static void hugetlbfs_clear_inode(struct inode *inode)
+{
+	struct hugetlbfs_inode_info *info = HUGETLBFS_I(inode);
+
+	if (!info)
+		return;
+	hugetlbfs_free_pages(info, 0);
+	if (info->pages)
+		kfree(info->pages);
+	kfree(info);
+	inode->u.generic_ip = NULL;
+}
+
+/*
+ * The directory operations are those of ramfs: the dcache is all
+ * there is to a directory.
+ */
+static struct dentry *hugetlbfs_lookup(struct inode *dir, struct dentry *dentry)
+{
+	d_add(dentry, NULL);
+	return NULL;
+}
+
+static int hugetlbfs_mknod(struct inode *dir, struct dentry *dentry, int mode,
+			   int dev)
+{
+	struct inode *inode = hugetlbfs_get_inode(dir->i_sb, mode, dev);
+	int error = -ENOSPC;
+
+	if (inode) {
+		d_instantiate(dentry, inode);
+		dget(dentry);		/* Extra count - pin the dentry in core */
+		error = 0;
+	}
+	return error;
+}
+
+static int hugetlbfs_mkdir(struct inode *dir, struct dentry *dentry, int mode)
+{
+	return hugetlbfs_mknod(dir, dentry, mode | S_IFDIR, 0);
+}
+
+static int hugetlbfs_create(struct inode *dir, struct dentry *dentry, int mode)
+{
+	return hugetlbfs_mknod(dir, dentry, mode | S_IFREG, 0);
+}
+
+static int hugetlbfs_link(struct dentry *old_dentry, struct inode *dir,
+			  struct dentry *dentry)
+{
+	struct inode *inode = old_dentry->d_inode;
+
+	if (S_ISDIR(inode->i_mode))
+		return -EPERM;
+
+	inode->i_nlink++;
+	atomic_inc(&inode->i_count);	/* New dentry reference */
+	dget(dentry);		/* Extra pinning count for the created dentry */
+	d_instantiate(dentry, inode);
+	return 0;
+}
+
+static inline int hugetlbfs_positive(struct dentry *dentry)
+{
+	return dentry->d_inode && !d_unhashed(dentry);
+}
+
+static int hugetlbfs_empty(struct dentry *dentry)
+{
+	struct list_head *list;
+
+	spin_lock(&dcache_lock);
+	list = dentry->d_subdirs.next;
+
+	while (list != &dentry->d_subdirs) {
+		struct dentry *de = list_entry(list, struct dentry, d_child);
+
+		if (hugetlbfs_positive(de)) {
+			spin_unlock(&dcache_lock);
+			return 0;
+		}
+		list = list->next;
+	}
+	spin_unlock(&dcache_lock);
+	return 1;
+}
+
+static int hugetlbfs_unlink(struct inode *dir, struct dentry *dentry)
+{
+	int error = -ENOTEMPTY;
+
+	if (hugetlbfs_empty(dentry)) {
+		struct inode *inode = dentry->d_inode;
+
+		inode->i_nlink--;
+		dput(dentry);	/* Undo the count from "create" */
+		error = 0;
+	}
+	return error;
+}
+
+#define hugetlbfs_rmdir hugetlbfs_unlink
+
+static int hugetlbfs_rename(struct inode *old_dir, struct dentry *old_dentry,
+			    struct inode *new_dir, struct dentry *new_dentry)
+{
+	int error = -ENOTEMPTY;
+
+	if (hugetlbfs_empty(new_dentry)) {
+		struct inode *inode = new_dentry->d_inode;
+		if (inode) {
+			inode->i_nlink--;
+			dput(new_dentry);
+		}
+		error = 0;
+	}
+	return error;
+}
+
+struct file_operations hugetlbfs_file_operations = {
+	mmap:			hugetlbfs_file_mmap,
+	fsync:			hugetlbfs_sync_file,
+	get_unmapped_area:	hugetlb_get_unmapped_area,
+};
+
+static struct inode_operations hugetlbfs_inode_operations = {
+	setattr:	hugetlbfs_setattr,
+};
+
+static struct inode_operations hugetlbfs_dir_inode_operations = {
+	create:		hugetlbfs_create,
+	lookup:		hugetlbfs_lookup,
+	link:		hugetlbfs_link,
+	unlink:		hugetlbfs_unlink,
+	mkdir:		hugetlbfs_mkdir,
+	rmdir:		hugetlbfs_rmdir,
+	mknod:		hugetlbfs_mknod,
+	rename:		hugetlbfs_rename,
+};
+
+static struct super_operations hugetlbfs_ops = {
+	statfs:		hugetlbfs_statfs,
+	put_inode:	force_delete,
+	clear_inode:	hugetlbfs_clear_inode,
+};
+
+static struct super_block *hugetlbfs_read_super(struct super_block *sb,
+						void *data, int silent)
+{
+	struct inode *inode;
+	struct dentry *root;
+
+	sb->s_blocksize = HPAGE_SIZE;
+	sb->s_blocksize_bits = HPAGE_SHIFT;
+	sb->s_magic = HUGETLBFS_MAGIC;
+	sb->s_maxbytes = (loff_t) HUGETLBFS_MAX_PAGES << HPAGE_SHIFT;
+	sb->s_op = &hugetlbfs_ops;
+	inode = hugetlbfs_get_inode(sb, S_IFDIR | 0755, 0);
+	if (!inode)
+		return NULL;
+
+	root = d_alloc_root(inode);
+	if (!root) {
+		iput(inode);
+		return NULL;
+	}
+	sb->s_root = root;
+	return sb;
+}
+
+/**
+ * hugetlb_file_setup - get an unlinked file backed by huge pages
+ * @name: name for the dentry (to be seen in /proc/<pid>/maps)
+ * @size: size of the file, rounded up to a whole number of huge pages
+ *
+ * Used by SysV shm for SHM_HUGETLB segments.
+ */
+struct file *hugetlb_file_setup(char *name, size_t size)
+{
+	int error;
+	struct file *file;
+	struct inode *inode;
+	struct dentry *dentry, *root;
+	struct qstr this;
+
+	if (!hugetlbfs_vfsmount)
+		return ERR_PTR(-ENOENT);
+	if (!is_hugepage_mem_enough(size))
+		return ERR_PTR(-ENOMEM);
+
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = 0;
+	root = hugetlbfs_vfsmount->mnt_root;
+	dentry = d_alloc(root, &this);
+	if (!dentry)
+		return ERR_PTR(-ENOMEM);
+
+	error = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto put_dentry;
+
+	error = -ENOSPC;
+	inode = hugetlbfs_get_inode(root->d_sb, S_IFREG | S_IRWXUGO, 0);
+	if (!inode)
+		goto close_file;
+
+	d_instantiate(dentry, inode);
+	inode->i_nlink = 0;	/* It is unlinked */
+	file->f_vfsmnt = mntget(hugetlbfs_vfsmount);
+	file->f_dentry = dentry;
+	file->f_op = &hugetlbfs_file_operations;
+	file->f_mode = FMODE_WRITE | FMODE_READ;
+
+	error = hugetlbfs_truncate(inode, (size + ~HPAGE_MASK) & HPAGE_MASK);
+	if (error) {
+		fput(file);
+		return ERR_PTR(error);
+	}
+	return file;
+
+close_file:
+	put_filp(file);
+put_dentry:
+	dput(dentry);
+	return ERR_PTR(error);
+}
+
+static DECLARE_FSTYPE(hugetlbfs_fs_type, "hugetlbfs", hugetlbfs_read_super, FS_LITTER);
+
+static int __init init_hugetlbfs_fs(void)
+{
+	struct vfsmount *mnt;
+	int error;
+
+	error = register_filesystem(&hugetlbfs_fs_type);
+	if (error)
+		return error;
+
+	mnt = kern_mount(&hugetlbfs_fs_type);
+	if (IS_ERR(mnt)) {
+		printk(KERN_ERR "could not kern_mount hugetlbfs\n");
+		unregister_filesystem(&hugetlbfs_fs_type);
+		return PTR_ERR(mnt);
+	}
+	hugetlbfs_vfsmount = mnt;
+	return 0;
+}
+
+module_init(init_hugetlbfs_fs)
+
+MODULE_LICENSE("GPL");
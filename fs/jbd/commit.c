@@ -33,6 +33,50 @@ void journal_end_buffer_io_sync(struct buffer_head *bh, int uptodate)
 	unlock_buffer(bh);
 }
 
+/*
+ * Build the commit record for commit_transaction and send it to the
+ * log, without waiting.  Returns NULL if there is no room for it.
+ */
+static struct journal_head *
+journal_submit_commit_record(journal_t *journal,
+			     transaction_t *commit_transaction, __u32 crc32_sum)
+{
+	struct journal_head *descriptor;
+	struct buffer_head *bh;
+	commit_header_t *tmp;
+
+	descriptor = journal_get_descriptor_buffer(journal);
+	if (!descriptor)
+		return NULL;
+
+	bh = jh2bh(descriptor);
+	memset(bh->b_data, 0, bh->b_size);
+	tmp = (commit_header_t *)bh->b_data;
+	tmp->c_header.h_magic = htonl(JFS_MAGIC_NUMBER);
+	tmp->c_header.h_blocktype = htonl(JFS_COMMIT_BLOCK);
+	tmp->c_header.h_sequence = htonl(commit_transaction->t_tid);
+	if (JFS_HAS_COMPAT_FEATURE(journal, JFS_FEATURE_COMPAT_CHECKSUM)) {
+		tmp->c_chksum_type = JFS_CRC32_CHKSUM;
+		tmp->c_chksum_size = JFS_CRC32_CHKSUM_SIZE;
+		tmp->c_chksum[0] = htonl(crc32_sum);
+	}
+
+	JBUFFER_TRACE(descriptor, "write commit block");
+	clear_bit(BH_Dirty, &bh->b_state);
+	bh->b_end_io = journal_end_buffer_io_sync;
+	submit_bh(WRITE, bh);
+	return descriptor;
+}
+
+static void journal_wait_on_commit_record(struct journal_head *descriptor)
+{
+	struct buffer_head *bh = jh2bh(descriptor);
+
+	wait_on_buffer(bh);
+	put_bh(bh);		/* One for getblk() */
+	journal_unlock_journal_head(descriptor);
+}
+
 /*
  * journal_commit_transaction
  *
@@ -43,6 +87,7 @@ void journal_commit_transaction(journal_t *journal)
 {
 	transaction_t *commit_transaction;
 	struct journal_head *jh, *new_jh, *descriptor;
+	struct journal_head *commit_record = NULL;
 	struct journal_head *next_jh, *last_jh;
 	struct buffer_head *wbuf[64];
 	int bufs;
@@ -56,6 +101,11 @@ void journal_commit_transaction(journal_t *journal)
 	int first_tag = 0;
 	int tag_flag;
 	int i;
+	struct timeval start_time;
+	long commit_time;
+	__u32 crc32_sum = ~0U;
+	int checksum = JFS_HAS_COMPAT_FEATURE(journal,
+					      JFS_FEATURE_COMPAT_CHECKSUM);
 
 	/*
 	 * First job: lock down the current transaction and wait for
@@ -88,6 +138,10 @@ void journal_commit_transaction(journal_t *journal)
 		lock_journal(journal);
 	}
 
+	/* Commit latency, for group commit: start the clock only now,
+	 * handles batching in journal_stop() must not count */
+	do_gettimeofday(&start_time);
+
 	J_ASSERT (commit_transaction->t_outstanding_credits <=
 			journal->j_max_transaction_buffers);
 
@@ -319,6 +373,19 @@ sync_datalist_empty:
 	 */
 	commit_transaction->t_state = T_COMMIT;
 
+	/*
+	 * The revoke blocks written in phase 1 are the first blocks of
+	 * the transaction in the log, so they start the checksum.
+	 */
+	if (checksum && (jh = commit_transaction->t_log_list) != NULL) {
+		do {
+			struct buffer_head *bh = jh2bh(jh);
+			crc32_sum = journal_crc32(crc32_sum, bh->b_data,
+						  bh->b_size);
+			jh = jh->b_tnext;
+		} while (jh != commit_transaction->t_log_list);
+	}
+
 	descriptor = 0;
 	bufs = 0;
 	while (commit_transaction->t_buffers) {
@@ -454,6 +521,9 @@ start_journal_io:
 			unlock_journal(journal);
 			for (i=0; i<bufs; i++) {
 				struct buffer_head *bh = wbuf[i];
+				if (checksum)
+					crc32_sum = journal_crc32(crc32_sum,
+							bh->b_data, bh->b_size);
 				clear_bit(BH_Dirty, &bh->b_state);
 				bh->b_end_io = journal_end_buffer_io_sync;
 				submit_bh(WRITE, bh);
@@ -469,6 +539,21 @@ start_journal_io:
 		}
 	}
 
+	/*
+	 * With an asynchronous commit, recovery checks the commit
+	 * record's checksum against the blocks in the log instead of
+	 * trusting that they reached the disk first, so the commit
+	 * record can go out right behind them and one wait covers both.
+	 */
+	if (JFS_HAS_INCOMPAT_FEATURE(journal,
+				     JFS_FEATURE_INCOMPAT_ASYNC_COMMIT) &&
+	    !is_journal_aborted(journal)) {
+		commit_record = journal_submit_commit_record(journal,
+						commit_transaction, crc32_sum);
+		if (!commit_record)
+			__journal_abort_hard(journal);
+	}
+
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
            complete.  Control buffers being written are on the
@@ -566,6 +651,14 @@ start_journal_io:
 
 	jbd_debug(3, "JBD: commit phase 6\n");
 
+	/* An asynchronous commit record only needs waiting for; even
+	 * if we aborted meanwhile, it is on its way to the disk. */
+	if (commit_record) {
+		unlock_journal(journal);
+		journal_wait_on_commit_record(commit_record);
+		goto skip_commit;
+	}
+
 	if (is_journal_aborted(journal)) {
 		unlock_journal(journal);
 		goto skip_commit;
@@ -576,33 +669,16 @@ start_journal_io:
 	 * mode we can now just skip the rest of the journal write
 	 * entirely. */
 
-	descriptor = journal_get_descriptor_buffer(journal);
+	descriptor = journal_submit_commit_record(journal, commit_transaction,
+						  crc32_sum);
 	if (!descriptor) {
 		__journal_abort_hard(journal);
 		unlock_journal(journal);
 		goto skip_commit;
 	}
 
-	/* AKPM: buglet - add `i' to tmp! */
-	for (i = 0; i < jh2bh(descriptor)->b_size; i += 512) {
-		journal_header_t *tmp =
-			(journal_header_t*)jh2bh(descriptor)->b_data;
-		tmp->h_magic = htonl(JFS_MAGIC_NUMBER);
-		tmp->h_blocktype = htonl(JFS_COMMIT_BLOCK);
-		tmp->h_sequence = htonl(commit_transaction->t_tid);
-	}
-
 	unlock_journal(journal);
-	JBUFFER_TRACE(descriptor, "write commit block");
-	{
-		struct buffer_head *bh = jh2bh(descriptor);
-		clear_bit(BH_Dirty, &bh->b_state);
-		bh->b_end_io = journal_end_buffer_io_sync;
-		submit_bh(WRITE, bh);
-		wait_on_buffer(bh);
-		put_bh(bh);		/* One for getblk() */
-		journal_unlock_journal_head(descriptor);
-	}
+	journal_wait_on_commit_record(descriptor);
 
 	/* End of a transaction!  Finally, we can do checkpoint
            processing: any buffers committed as a result of this
@@ -725,6 +801,17 @@ skip_commit: /* The journal should be unlocked by now. */
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
 
+	commit_time = jbd_usecs_since(&start_time);
+	if (commit_time >= 0) {
+		if (journal->j_average_commit_time)
+			journal->j_average_commit_time = (commit_time +
+				3 * journal->j_average_commit_time) / 4;
+		else
+			journal->j_average_commit_time = commit_time;
+	}
+	journal->j_stats.js_commits++;
+	journal->j_stats.js_handles += commit_transaction->t_handle_count;
+
 	spin_lock(&journal_datalist_lock);
 	if (commit_transaction->t_checkpoint_list == NULL) {
 		__journal_drop_transaction(journal, commit_transaction);
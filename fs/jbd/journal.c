@@ -66,6 +66,7 @@ EXPORT_SYMBOL(journal_update_format);
 EXPORT_SYMBOL(journal_check_used_features);
 EXPORT_SYMBOL(journal_check_available_features);
 EXPORT_SYMBOL(journal_set_features);
+EXPORT_SYMBOL(journal_clear_features);
 EXPORT_SYMBOL(journal_create);
 EXPORT_SYMBOL(journal_load);
 EXPORT_SYMBOL(journal_destroy);
@@ -680,6 +681,65 @@ struct journal_head * journal_get_descriptor_buffer(journal_t *journal)
  * destroy journal_t structures, and to initialise and read existing
  * journal blocks from disk.  */
 
+/*
+ * Per-journal statistics in /proc/fs/jbd/<device>.  Rates are averaged
+ * over the time since the journal was set up.
+ */
+#ifdef CONFIG_PROC_FS
+
+static struct proc_dir_entry *proc_jbd_stats;
+
+static int journal_read_stats(char *page, char **start, off_t off,
+			      int count, int *eof, void *data)
+{
+	journal_t *journal = data;
+	struct journal_stats_s *js = &journal->j_stats;
+	unsigned long secs = (jiffies - js->js_start) / HZ;
+	int len;
+
+	len = sprintf(page, "commits: %lu\n"
+			    "commits per second: %lu\n"
+			    "handles per commit: %lu\n"
+			    "average commit time: %lu us\n"
+			    "batched sync handles: %lu\n",
+		      js->js_commits,
+		      secs ? js->js_commits / secs : js->js_commits,
+		      js->js_commits ? js->js_handles / js->js_commits : 0,
+		      journal->j_average_commit_time,
+		      js->js_batched);
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+
+static void journal_proc_add(journal_t *journal)
+{
+	if (proc_jbd_stats)
+		journal->j_proc_entry =
+			create_proc_read_entry(kdevname(journal->j_dev), 0,
+					       proc_jbd_stats,
+					       journal_read_stats, journal);
+}
+
+static void journal_proc_remove(journal_t *journal)
+{
+	if (journal->j_proc_entry)
+		remove_proc_entry(kdevname(journal->j_dev), proc_jbd_stats);
+}
+
+#else
+
+#define journal_proc_add(journal) do {} while (0)
+#define journal_proc_remove(journal) do {} while (0)
+
+#endif
+
 /* First: create and setup a journal_t object in memory.  We initialise
  * very few fields yet: that has to wait until we have created the
  * journal structures from from scratch, or loaded them from disk. */
@@ -707,6 +767,7 @@ static journal_t * journal_init_common (void)
 	init_MUTEX(&journal->j_sem);
 
 	journal->j_commit_interval = (HZ * 5);
+	journal->j_stats.js_start = jiffies;
 
 	/* The journal is marked for error until we succeed with recovery! */
 	journal->j_flags = JFS_ABORT;
@@ -757,6 +818,7 @@ journal_t * journal_init_dev(kdev_t dev, kdev_t fs_dev,
 	J_ASSERT(bh != NULL);
 	journal->j_sb_buffer = bh;
 	journal->j_superblock = (journal_superblock_t *)bh->b_data;
+	journal_proc_add(journal);
 
 	return journal;
 }
@@ -796,6 +858,7 @@ journal_t * journal_init_inode (struct inode *inode)
 	J_ASSERT(bh != NULL);
 	journal->j_sb_buffer = bh;
 	journal->j_superblock = (journal_superblock_t *)bh->b_data;
+	journal_proc_add(journal);
 
 	return journal;
 }
@@ -1121,6 +1184,7 @@ void journal_destroy (journal_t *journal)
 		iput(journal->j_inode);
 	if (journal->j_revoke)
 		journal_destroy_revoke(journal);
+	journal_proc_remove(journal);
 
 	unlock_journal(journal);
 	kfree(journal);
@@ -1206,6 +1270,55 @@ int journal_set_features (journal_t *journal, unsigned long compat,
 	return 1;
 }
 
+/* Published API: Clear a given set of journal features on the
+ * superblock.  Only safe while the log is empty, e.g. right after
+ * journal_load(). */
+
+void journal_clear_features (journal_t *journal, unsigned long compat,
+			     unsigned long ro, unsigned long incompat)
+{
+	journal_superblock_t *sb;
+
+	if (journal->j_format_version == 1)
+		return;
+
+	jbd_debug(1, "Clearing features 0x%lx/0x%lx/0x%lx\n",
+		  compat, ro, incompat);
+
+	sb = journal->j_superblock;
+
+	sb->s_feature_compat    &= ~cpu_to_be32(compat);
+	sb->s_feature_ro_compat &= ~cpu_to_be32(ro);
+	sb->s_feature_incompat  &= ~cpu_to_be32(incompat);
+}
+
+/*
+ * Big-endian CRC32 (the ethernet polynomial, MSB first) for commit block
+ * checksums.  The table is built when jbd initialises.
+ */
+static __u32 journal_crc32_table[256];
+
+static void __init journal_init_crc32(void)
+{
+	__u32 crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = (__u32) i << 24;
+		for (j = 0; j < 8; j++)
+			crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+		journal_crc32_table[i] = crc;
+	}
+}
+
+__u32 journal_crc32(__u32 crc, const char *p, unsigned int len)
+{
+	while (len--)
+		crc = (crc << 8) ^
+		      journal_crc32_table[((crc >> 24) ^ (__u8) *p++) & 0xff];
+	return crc;
+}
+
 
 /*
  * Published API:
@@ -1892,10 +2005,14 @@ static int __init journal_init(void)
 	int ret;
 
 	printk(KERN_INFO "Journalled Block Device driver loaded\n");
+	journal_init_crc32();
 	ret = journal_init_caches();
 	if (ret != 0)
 		journal_destroy_caches();
 	create_jbd_proc_entry();
+#ifdef CONFIG_PROC_FS
+	proc_jbd_stats = proc_mkdir("jbd", proc_root_fs);
+#endif
 	return ret;
 }
 
@@ -1907,6 +2024,10 @@ static void __exit journal_exit(void)
 		printk(KERN_EMERG "JBD: leaked %d journal_heads!\n", n);
 #endif
 	remove_jbd_proc_entry();
+#ifdef CONFIG_PROC_FS
+	if (proc_jbd_stats)
+		remove_proc_entry("jbd", proc_root_fs);
+#endif
 	journal_destroy_caches();
 }
 
@@ -207,6 +207,36 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Add a descriptor block and the blocks it describes to the running
+ * checksum of a transaction, moving next_log_block past them.
+ */
+static int calc_chksums(journal_t *journal, struct buffer_head *bh,
+			unsigned long *next_log_block, __u32 *crc32_sum)
+{
+	int i, num_blks, err;
+	unsigned long io_block;
+	struct buffer_head *obh;
+
+	num_blks = count_tags(bh, journal->j_blocksize);
+	*crc32_sum = journal_crc32(*crc32_sum, bh->b_data, bh->b_size);
+
+	for (i = 0; i < num_blks; i++) {
+		io_block = (*next_log_block)++;
+		wrap(journal, *next_log_block);
+		err = jread(&obh, journal, io_block);
+		if (err) {
+			printk(KERN_ERR "JBD: IO error %d recovering block "
+				"%lu in log\n", err, io_block);
+			return -EIO;
+		}
+		*crc32_sum = journal_crc32(*crc32_sum, obh->b_data,
+					   obh->b_size);
+		brelse(obh);
+	}
+	return 0;
+}
+
 /*
  * journal_recover
  *
@@ -319,6 +349,8 @@ static int do_one_pass(journal_t *journal,
 	struct buffer_head *	bh;
 	unsigned int		sequence;
 	int			blocktype;
+	__u32			crc32_sum = ~0U;
+	int			checksum;
 	
 	/* Precompute the maximum metadata descriptors in a descriptor block */
 	int			MAX_BLOCKS_PER_DESC;
@@ -339,6 +371,11 @@ static int do_one_pass(journal_t *journal,
 	if (pass == PASS_SCAN)
 		info->start_transaction = first_commit_ID;
 
+	/* Checksums are verified once, in the scan pass, which then
+	 * sets end_transaction for the passes after it. */
+	checksum = pass == PASS_SCAN &&
+		JFS_HAS_COMPAT_FEATURE(journal, JFS_FEATURE_COMPAT_CHECKSUM);
+
 	jbd_debug(1, "Starting recovery pass %d\n", pass);
 
 	/*
@@ -410,6 +447,14 @@ static int do_one_pass(journal_t *journal,
 			/* If it is a valid descriptor block, replay it
 			 * in pass REPLAY; otherwise, just skip over the
 			 * blocks it describes. */
+			if (checksum) {
+				err = calc_chksums(journal, bh,
+						   &next_log_block, &crc32_sum);
+				brelse(bh);
+				if (err)
+					goto failed;
+				continue;
+			}
 			if (pass != PASS_REPLAY) {
 				next_log_block +=
 					count_tags(bh, journal->j_blocksize);
@@ -506,12 +551,35 @@ static int do_one_pass(journal_t *journal,
 		case JFS_COMMIT_BLOCK:
 			/* Found an expected commit block: not much to
 			 * do other than move on to the next sequence
-			 * number. */
+			 * number.  If it is checksummed, the transaction
+			 * only counts if all of it reached the log: a
+			 * commit record may be written together with the
+			 * blocks it covers, so a crash can leave it behind
+			 * without them.  Such a torn transaction ends the
+			 * log. */
+			if (checksum) {
+				commit_header_t *cbh =
+					(commit_header_t *) bh->b_data;
+
+				if (cbh->c_chksum_type != JFS_CRC32_CHKSUM ||
+				    cbh->c_chksum_size != JFS_CRC32_CHKSUM_SIZE ||
+				    ntohl(cbh->c_chksum[0]) != crc32_sum) {
+					printk(KERN_NOTICE "JBD: checksum "
+					       "mismatch in transaction %u, "
+					       "dropping it\n", next_commit_ID);
+					brelse(bh);
+					goto done;
+				}
+				crc32_sum = ~0U;
+			}
 			brelse(bh);
 			next_commit_ID++;
 			continue;
 
 		case JFS_REVOKE_BLOCK:
+			if (checksum)
+				crc32_sum = journal_crc32(crc32_sum,
+						bh->b_data, bh->b_size);
 			/* If we aren't in the REVOKE pass, then we can
 			 * just skip over this block. */
 			if (pass != PASS_REVOKE) {
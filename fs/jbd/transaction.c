@@ -57,6 +57,7 @@ static transaction_t * get_transaction (journal_t * journal, int is_try)
 	transaction->t_state = T_RUNNING;
 	transaction->t_tid = journal->j_transaction_sequence++;
 	transaction->t_expires = jiffies + journal->j_commit_interval;
+	do_gettimeofday(&transaction->t_start_time);
 	INIT_LIST_HEAD(&transaction->t_jcb);
 
 	/* Set up the commit timer for the new transaction. */
@@ -1398,18 +1399,39 @@ int journal_stop(handle_t *handle)
 
 	/*
 	 * Implement synchronous transaction batching.  If the handle
-	 * was synchronous, don't force a commit immediately.  Let's
-	 * yield and let another thread piggyback onto this transaction.
-	 * Keep doing that while new threads continue to arrive.
-	 * It doesn't cost much - we're about to run a commit and sleep
-	 * on IO anyway.  Speeds up many-threaded, many-dir operations
-	 * by 30x or more...
+	 * was synchronous and somebody else did a synchronous update
+	 * since we last did, several processes are forcing commits: don't
+	 * force one immediately, but let the others piggyback onto this
+	 * transaction.  Keep doing that while new handles continue to
+	 * arrive, until the transaction is as old as a commit takes
+	 * (capped at JBD_MAX_BATCH_TIME) - a process which just missed
+	 * this commit would wait that long for the next one anyway.  A
+	 * lone process doing synchronous updates never waits.  Speeds up
+	 * many-threaded fsync loads by a lot...
 	 */
-	if (handle->h_sync) {
-		do {
+	if (handle->h_sync && journal->j_last_sync_writer != current->pid) {
+		long commit_time, trans_time;
+
+		journal->j_last_sync_writer = current->pid;
+		commit_time = journal->j_average_commit_time;
+		if (commit_time > JBD_MAX_BATCH_TIME)
+			commit_time = JBD_MAX_BATCH_TIME;
+		trans_time = jbd_usecs_since(&transaction->t_start_time);
+		if (trans_time >= 0 && trans_time < commit_time)
+			journal->j_stats.js_batched++;
+		while (trans_time >= 0 && trans_time < commit_time) {
 			old_handle_count = transaction->t_handle_count;
-			yield();
-		} while (old_handle_count != transaction->t_handle_count);
+			/* Sleep a tick if we can afford it, else just
+			 * let the other runnable writers in */
+			if (commit_time - trans_time >= 1000000 / HZ) {
+				set_current_state(TASK_UNINTERRUPTIBLE);
+				schedule_timeout(1);
+			} else
+				yield();
+			if (old_handle_count == transaction->t_handle_count)
+				break;
+			trans_time = jbd_usecs_since(&transaction->t_start_time);
+		}
 	}
 
 	current->journal_info = NULL;
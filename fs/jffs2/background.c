@@ -107,7 +107,7 @@ static int jffs2_garbage_collect_thread(void *_c)
         sprintf(current->comm, "jffs2_gcd_mtd%d", c->mtd->index);
 
 	/* FIXME in the 2.2 backport */
-	current->nice = 10;
+	set_user_nice(current, 10);
 
 	for (;;) {
 		spin_lock_irq(&current->sigmask_lock);
@@ -1386,7 +1386,11 @@ static void d_unhash(struct dentry *dentry)
 		if (atomic_read(&dentry->d_count) != 2)
 			break;
 	case 2:
-		list_del_init(&dentry->d_hash);
+		/* d_lookup() takes references without dcache_lock */
+		spin_lock(&dentry->d_lock);
+		if (atomic_read(&dentry->d_count) == 2)
+			list_del_init(&dentry->d_hash);
+		spin_unlock(&dentry->d_lock);
 	}
 	spin_unlock(&dcache_lock);
 }
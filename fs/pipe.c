@@ -5,6 +5,8 @@
  */
 
 #include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
 #include <linux/file.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
@@ -15,9 +17,14 @@
 #include <asm/ioctls.h>
 
 /*
- * We use a start+len construction, which provides full use of the 
- * allocated memory.
- * -- Florian Coosmann (FGC)
+ * The pipe is a ring of page references (see pipe_fs_i.h), read from
+ * curbuf on.  Written data goes into private pages; small writes are
+ * appended to the last one while it has room, so a stream of them does
+ * not use a page each.
+ *
+ * Readers only ever sleep on an empty pipe and writers on a full one,
+ * so the other side only wakes them up on those transitions: a reader
+ * gets to drain a whole ring's worth of pages per wakeup.
  * 
  * Reads with count = 0 should always return 0.
  * -- Julian Bradfield 1999-06-07.
@@ -36,11 +43,24 @@ void pipe_wait(struct inode * inode)
 	down(PIPE_SEM(*inode));
 }
 
+/* Called with the pipe semaphore held */
+void pipe_buf_consume(struct pipe_inode_info *info)
+{
+	struct pipe_buffer *buf = info->bufs + info->curbuf;
+
+	page_cache_release(buf->page);
+	buf->page = NULL;
+	info->curbuf = PIPE_BUF_SLOT(info, 1);
+	info->nrbufs--;
+}
+
 static ssize_t
 pipe_read(struct file *filp, char *buf, size_t count, loff_t *ppos)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
-	ssize_t size, read, ret;
+	struct pipe_inode_info *info;
+	ssize_t read, ret;
+	int was_full;
 
 	/* Seeks are not allowed on pipes.  */
 	ret = -ESPIPE;
@@ -85,30 +105,32 @@ do_more_read:
 
 	/* Read what data is available.  */
 	ret = -EFAULT;
-	while (count > 0 && (size = PIPE_LEN(*inode))) {
-		char *pipebuf = PIPE_BASE(*inode) + PIPE_START(*inode);
-		ssize_t chars = PIPE_MAX_RCHUNK(*inode);
+	info = inode->i_pipe;
+	was_full = PIPE_FULL(*inode);
+	while (count > 0 && info->nrbufs) {
+		struct pipe_buffer *pbuf = info->bufs + info->curbuf;
+		ssize_t chars = pbuf->len;
+		char *addr;
+		int error;
 
 		if (chars > count)
 			chars = count;
-		if (chars > size)
-			chars = size;
 
-		if (copy_to_user(buf, pipebuf, chars))
+		addr = kmap(pbuf->page);
+		error = copy_to_user(buf, addr + pbuf->offset, chars);
+		kunmap(pbuf->page);
+		if (error)
 			goto out;
 
 		read += chars;
-		PIPE_START(*inode) += chars;
-		PIPE_START(*inode) &= (PIPE_SIZE - 1);
-		PIPE_LEN(*inode) -= chars;
+		pbuf->offset += chars;
+		pbuf->len -= chars;
 		count -= chars;
 		buf += chars;
+		if (!pbuf->len)
+			pipe_buf_consume(info);
 	}
 
-	/* Cache behaviour optimization */
-	if (!PIPE_LEN(*inode))
-		PIPE_START(*inode) = 0;
-
 	if (count && PIPE_WAITING_WRITERS(*inode) && !(filp->f_flags & O_NONBLOCK)) {
 		/*
 		 * We know that we are going to sleep: signal
@@ -120,8 +142,9 @@ do_more_read:
 			BUG();
 		goto do_more_read;
 	}
-	/* Signal writers asynchronously that there is more room.  */
-	wake_up_interruptible(PIPE_WAIT(*inode));
+	/* Signal writers asynchronously that there is room again.  */
+	if (was_full && !PIPE_FULL(*inode))
+		wake_up_interruptible(PIPE_WAIT(*inode));
 
 	ret = read;
 out:
@@ -138,7 +161,10 @@ static ssize_t
 pipe_write(struct file *filp, const char *buf, size_t count, loff_t *ppos)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
-	ssize_t free, written, ret;
+	struct pipe_inode_info *info;
+	ssize_t written, ret;
+	size_t chars;
+	int do_wakeup;
 
 	/* Seeks are not allowed on pipes.  */
 	ret = -ESPIPE;
@@ -159,79 +185,109 @@ pipe_write(struct file *filp, const char *buf, size_t count, loff_t *ppos)
 	if (!PIPE_READERS(*inode))
 		goto sigpipe;
 
-	/* If count <= PIPE_BUF, we have to make it atomic.  */
-	free = (count <= PIPE_BUF ? count : 1);
-
-	/* Wait, or check for, available space.  */
-	if (filp->f_flags & O_NONBLOCK) {
-		ret = -EAGAIN;
-		if (PIPE_FREE(*inode) < free)
-			goto out;
-	} else {
-		while (PIPE_FREE(*inode) < free) {
-			PIPE_WAITING_WRITERS(*inode)++;
-			pipe_wait(inode);
-			PIPE_WAITING_WRITERS(*inode)--;
-			ret = -ERESTARTSYS;
-			if (signal_pending(current))
+	/*
+	 * Append the part that does not fill whole pages to the last
+	 * buffer if it fits; the rest goes into fresh pages.  A write of
+	 * at most PIPE_BUF bytes thus either lands in the last buffer or
+	 * in a single new one, which keeps it atomic.
+	 */
+	info = inode->i_pipe;
+	chars = count & (PAGE_SIZE - 1);
+	if (info->nrbufs && chars) {
+		struct pipe_buffer *pbuf;
+		char *addr;
+		int error;
+
+		pbuf = info->bufs + PIPE_BUF_SLOT(info, info->nrbufs - 1);
+		if ((pbuf->flags & PIPE_BUF_FLAG_MERGE) &&
+		    pbuf->offset + pbuf->len + chars <= PAGE_SIZE) {
+			addr = kmap(pbuf->page);
+			error = copy_from_user(addr + pbuf->offset + pbuf->len,
+					       buf, chars);
+			kunmap(pbuf->page);
+			ret = -EFAULT;
+			if (error)
 				goto out;
 
-			if (!PIPE_READERS(*inode))
-				goto sigpipe;
+			written += chars;
+			pbuf->len += chars;
+			count -= chars;
+			buf += chars;
 		}
 	}
 
-	/* Copy into available space.  */
-	ret = -EFAULT;
+	do_wakeup = 0;
 	while (count > 0) {
-		int space;
-		char *pipebuf = PIPE_BASE(*inode) + PIPE_END(*inode);
-		ssize_t chars = PIPE_MAX_WCHUNK(*inode);
+		if (!PIPE_READERS(*inode))
+			goto sigpipe;
+
+		if (!PIPE_FULL(*inode)) {
+			struct pipe_buffer *pbuf;
+			struct page *page;
+			char *addr;
+			int error;
+
+			ret = -ENOMEM;
+			page = alloc_page(GFP_HIGHUSER);
+			if (!page)
+				break;
 
-		if ((space = PIPE_FREE(*inode)) != 0) {
-			if (chars > count)
-				chars = count;
-			if (chars > space)
-				chars = space;
+			chars = count;
+			if (chars > PAGE_SIZE)
+				chars = PAGE_SIZE;
+			addr = kmap(page);
+			error = copy_from_user(addr, buf, chars);
+			kunmap(page);
+			ret = -EFAULT;
+			if (error) {
+				page_cache_release(page);
+				break;
+			}
 
-			if (copy_from_user(pipebuf, buf, chars))
-				goto out;
+			if (PIPE_EMPTY(*inode))
+				do_wakeup = 1;
+			pbuf = info->bufs + PIPE_BUF_SLOT(info, info->nrbufs);
+			pbuf->page = page;
+			pbuf->offset = 0;
+			pbuf->len = chars;
+			pbuf->flags = PIPE_BUF_FLAG_MERGE;
+			info->nrbufs++;
 
 			written += chars;
-			PIPE_LEN(*inode) += chars;
 			count -= chars;
 			buf += chars;
-			space = PIPE_FREE(*inode);
 			continue;
 		}
 
-		ret = written;
+		ret = -EAGAIN;
 		if (filp->f_flags & O_NONBLOCK)
 			break;
+		ret = -ERESTARTSYS;
+		if (signal_pending(current))
+			break;
 
-		do {
-			/*
-			 * Synchronous wake-up: it knows that this process
-			 * is going to give up this CPU, so it doesn't have
-			 * to do idle reschedules.
-			 */
+		/*
+		 * Synchronous wake-up: it knows that this process
+		 * is going to give up this CPU, so it doesn't have
+		 * to do idle reschedules.
+		 */
+		if (do_wakeup) {
 			wake_up_interruptible_sync(PIPE_WAIT(*inode));
-			PIPE_WAITING_WRITERS(*inode)++;
-			pipe_wait(inode);
-			PIPE_WAITING_WRITERS(*inode)--;
-			if (signal_pending(current))
-				goto out;
-			if (!PIPE_READERS(*inode))
-				goto sigpipe;
-		} while (!PIPE_FREE(*inode));
-		ret = -EFAULT;
+			do_wakeup = 0;
+		}
+		PIPE_WAITING_WRITERS(*inode)++;
+		pipe_wait(inode);
+		PIPE_WAITING_WRITERS(*inode)--;
 	}
 
-	/* Signal readers asynchronously that there is more data.  */
-	wake_up_interruptible(PIPE_WAIT(*inode));
+	/* Signal readers asynchronously that there is data.  */
+	if (do_wakeup)
+		wake_up_interruptible(PIPE_WAIT(*inode));
 
-	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
-	mark_inode_dirty(inode);
+	if (written) {
+		inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+		mark_inode_dirty(inode);
+	}
 
 out:
 	up(PIPE_SEM(*inode));
@@ -264,9 +320,17 @@ static int
 pipe_ioctl(struct inode *pino, struct file *filp,
 	   unsigned int cmd, unsigned long arg)
 {
+	struct pipe_inode_info *info = pino->i_pipe;
+	int i, count;
+
 	switch (cmd) {
 		case FIONREAD:
-			return put_user(PIPE_LEN(*pino), (int *)arg);
+			down(PIPE_SEM(*pino));
+			count = 0;
+			for (i = 0; i < info->nrbufs; i++)
+				count += info->bufs[PIPE_BUF_SLOT(info, i)].len;
+			up(PIPE_SEM(*pino));
+			return put_user(count, (int *)arg);
 		default:
 			return -EINVAL;
 	}
@@ -281,10 +345,15 @@ pipe_poll(struct file *filp, poll_table *wait)
 
 	poll_wait(filp, PIPE_WAIT(*inode), wait);
 
-	/* Reading only -- no need for acquiring the semaphore.  */
-	mask = POLLIN | POLLRDNORM;
-	if (PIPE_EMPTY(*inode))
-		mask = POLLOUT | POLLWRNORM;
+	/*
+	 * Reading only -- no need for acquiring the semaphore.  A free
+	 * slot is room for an atomic PIPE_BUF write.
+	 */
+	mask = 0;
+	if (!PIPE_EMPTY(*inode))
+		mask |= POLLIN | POLLRDNORM;
+	if (!PIPE_FULL(*inode))
+		mask |= POLLOUT | POLLWRNORM;
 	if (!PIPE_WRITERS(*inode) && filp->f_version != PIPE_WCOUNTER(*inode))
 		mask |= POLLHUP;
 	if (!PIPE_READERS(*inode))
@@ -303,10 +372,7 @@ pipe_release(struct inode *inode, int decr, int decw)
 	PIPE_READERS(*inode) -= decr;
 	PIPE_WRITERS(*inode) -= decw;
 	if (!PIPE_READERS(*inode) && !PIPE_WRITERS(*inode)) {
-		struct pipe_inode_info *info = inode->i_pipe;
-		inode->i_pipe = NULL;
-		free_page((unsigned long) info->base);
-		kfree(info);
+		free_pipe_info(inode);
 	} else {
 		wake_up_interruptible(PIPE_WAIT(*inode));
 	}
@@ -438,29 +504,96 @@ struct file_operations rdwr_pipe_fops = {
 
 struct inode* pipe_new(struct inode* inode)
 {
-	unsigned long page;
+	struct pipe_inode_info *info;
 
-	page = __get_free_page(GFP_USER);
-	if (!page)
+	info = kmalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
+	if (!info)
 		return NULL;
+	memset(info, 0, sizeof(struct pipe_inode_info));
 
-	inode->i_pipe = kmalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
-	if (!inode->i_pipe)
-		goto fail_page;
+	info->bufs = kmalloc(PIPE_DEF_BUFFERS * sizeof(struct pipe_buffer),
+			     GFP_KERNEL);
+	if (!info->bufs)
+		goto fail_info;
+	info->buffers = PIPE_DEF_BUFFERS;
 
+	inode->i_pipe = info;
 	init_waitqueue_head(PIPE_WAIT(*inode));
-	PIPE_BASE(*inode) = (char*) page;
-	PIPE_START(*inode) = PIPE_LEN(*inode) = 0;
-	PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 0;
-	PIPE_WAITING_READERS(*inode) = PIPE_WAITING_WRITERS(*inode) = 0;
 	PIPE_RCOUNTER(*inode) = PIPE_WCOUNTER(*inode) = 1;
 
 	return inode;
-fail_page:
-	free_page(page);
+fail_info:
+	kfree(info);
 	return NULL;
 }
 
+void free_pipe_info(struct inode* inode)
+{
+	struct pipe_inode_info *info = inode->i_pipe;
+
+	inode->i_pipe = NULL;
+	while (info->nrbufs)
+		pipe_buf_consume(info);
+	kfree(info->bufs);
+	kfree(info);
+}
+
+int pipe_max_size = 1024 * 1024;
+
+/*
+ * F_SETPIPE_SZ rounds the requested size up to a power of two pages.
+ * Going past pipe_max_size takes CAP_SYS_RESOURCE, and the ring can't
+ * shrink below what it currently holds.  Both return the ring size.
+ */
+long pipe_fcntl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	struct inode *inode = filp->f_dentry->d_inode;
+	struct pipe_inode_info *info;
+	struct pipe_buffer *bufs;
+	unsigned int nr, i;
+	long ret;
+
+	if (!S_ISFIFO(inode->i_mode) || !inode->i_pipe)
+		return -EBADF;
+
+	down(PIPE_SEM(*inode));
+	info = inode->i_pipe;
+	ret = info->buffers * PAGE_SIZE;
+	if (cmd == F_GETPIPE_SZ)
+		goto out;
+
+	ret = -EINVAL;
+	if (!arg || arg > (1UL << 30))
+		goto out;
+	for (nr = 1; ((unsigned long) nr << PAGE_SHIFT) < arg; nr <<= 1)
+		;
+
+	ret = -EPERM;
+	if (nr * PAGE_SIZE > pipe_max_size && !capable(CAP_SYS_RESOURCE))
+		goto out;
+	ret = -EBUSY;
+	if (nr < info->nrbufs + info->reserved)
+		goto out;
+
+	ret = -ENOMEM;
+	bufs = kmalloc(nr * sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs)
+		goto out;
+	for (i = 0; i < info->nrbufs; i++)
+		bufs[i] = info->bufs[PIPE_BUF_SLOT(info, i)];
+	kfree(info->bufs);
+	info->bufs = bufs;
+	info->buffers = nr;
+	info->curbuf = 0;
+
+	/* a full pipe may have room now */
+	wake_up_interruptible(PIPE_WAIT(*inode));
+	ret = nr * PAGE_SIZE;
+out:
+	up(PIPE_SEM(*inode));
+	return ret;
+}
+
 static struct vfsmount *pipe_mnt;
 static int pipefs_delete_dentry(struct dentry *dentry)
 {
@@ -572,9 +705,7 @@ close_f12_inode_i_j:
 close_f12_inode_i:
 	put_unused_fd(i);
 close_f12_inode:
-	free_page((unsigned long) PIPE_BASE(*inode));
-	kfree(inode->i_pipe);
-	inode->i_pipe = NULL;
+	free_pipe_info(inode);
 	iput(inode);
 close_f12:
 	put_filp(f2);
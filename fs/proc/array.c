@@ -70,6 +70,7 @@
 #include <linux/smp.h>
 #include <linux/signal.h>
 #include <linux/highmem.h>
+#include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -336,10 +337,9 @@ int proc_pid_stat(struct task_struct *task, char * buffer)
 
 	collect_sigign_sigcatch(task, &sigign, &sigcatch);
 
-	/* scale priority and nice values from timeslices to -20..20 */
-	/* to make it look like a "normal" Unix priority/nice value  */
-	priority = task->counter;
-	priority = 20 - (priority * 10 + DEF_COUNTER / 2) / DEF_COUNTER;
+	/* scale priority to -100..39, the SCHED_OTHER range being */
+	/* 0..39 to make it look like a "normal" Unix priority value */
+	priority = task->prio - MAX_RT_PRIO;
 	nice = task->nice;
 
 	read_lock(&tasklist_lock);
@@ -489,7 +489,12 @@ int proc_pid_statm(struct task_struct *task, char * buffer)
 			pgd_t *pgd = pgd_offset(mm, vma->vm_start);
 			int pages = 0, shared = 0, dirty = 0, total = 0;
 
-			statm_pgd_range(pgd, vma->vm_start, vma->vm_end, &pages, &shared, &dirty, &total);
+			if (is_vm_hugetlb_page(vma)) {
+				/* mapped up front, and always shared */
+				total = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+				pages = shared = total;
+			} else
+				statm_pgd_range(pgd, vma->vm_start, vma->vm_end, &pages, &shared, &dirty, &total);
 			resident += pages;
 			share += shared;
 			dt += dirty;
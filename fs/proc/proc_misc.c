@@ -36,6 +36,7 @@
 #include <linux/init.h>
 #include <linux/smp_lock.h>
 #include <linux/seq_file.h>
+#include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -106,11 +107,11 @@ static int loadavg_read_proc(char *page, char **start, off_t off,
 	a = avenrun[0] + (FIXED_1/200);
 	b = avenrun[1] + (FIXED_1/200);
 	c = avenrun[2] + (FIXED_1/200);
-	len = sprintf(page,"%d.%02d %d.%02d %d.%02d %d/%d %d\n",
+	len = sprintf(page,"%d.%02d %d.%02d %d.%02d %lu/%d %d\n",
 		LOAD_INT(a), LOAD_FRAC(a),
 		LOAD_INT(b), LOAD_FRAC(b),
 		LOAD_INT(c), LOAD_FRAC(c),
-		nr_running, nr_threads, last_pid);
+		nr_running(), nr_threads, last_pid);
 	return proc_calc_metrics(page, start, off, count, eof, len);
 }
 
@@ -207,6 +208,8 @@ static int meminfo_read_proc(char *page, char **start, off_t off,
 		K(i.totalswap),
 		K(i.freeswap));
 
+	len += hugetlb_report_meminfo(page + len);
+
 	return proc_calc_metrics(page, start, off, count, eof, len);
 #undef B
 #undef K
@@ -300,6 +303,18 @@ static struct file_operations proc_slabinfo_operations = {
 	release:	seq_release,
 };
 
+extern struct seq_operations pagesetinfo_op;
+static int pagesetinfo_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &pagesetinfo_op);
+}
+static struct file_operations proc_pagesetinfo_operations = {
+	open:		pagesetinfo_open,
+	read:		seq_read,
+	llseek:		seq_lseek,
+	release:	seq_release,
+};
+
 static int kstat_read_proc(char *page, char **start, off_t off,
 				 int count, int *eof, void *data)
 {
@@ -337,11 +352,14 @@ static int kstat_read_proc(char *page, char **start, off_t off,
 	proc_sprintf(page, &off, &len,
 		"page %u %u\n"
 		"swap %u %u\n"
+		"reclaim %u %u\n"
 		"intr %u",
 			kstat.pgpgin >> 1,
 			kstat.pgpgout >> 1,
 			kstat.pswpin,
 			kstat.pswpout,
+			kstat.pgscan,
+			kstat.pgsteal,
 			sum
 	);
 #if !defined(CONFIG_ARCH_S390)
@@ -592,6 +610,7 @@ void __init proc_misc_init(void)
 	create_seq_entry("cpuinfo", 0, &proc_cpuinfo_operations);
 	create_seq_entry("partitions", 0, &proc_partitions_operations);
 	create_seq_entry("slabinfo",S_IWUSR|S_IRUGO,&proc_slabinfo_operations);
+	create_seq_entry("pagesetinfo", 0, &proc_pagesetinfo_operations);
 #ifdef CONFIG_MODULES
 	create_seq_entry("ksyms", 0, &proc_ksyms_operations);
 #endif
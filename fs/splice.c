@@ -0,0 +1,500 @@
+/*
+ *  linux/fs/splice.c
+ *
+ *  splice() and tee(): move data between a pipe and another file, or
+ *  between two pipes, without a round trip through user space.
+ *
+ *  Pipes hold page references (see <linux/pipe_fs_i.h>), so
+ *
+ *  - file -> pipe queues page cache pages by reference; files without
+ *    a page cache (sockets, ...) are read into private pages,
+ *  - pipe -> file hands the pages to ->sendpage() when the target has
+ *    one (sockets) and does one in-kernel ->write() per buffer else,
+ *  - pipe -> pipe moves buffers from one ring to the other, and tee()
+ *    makes both rings reference the same pages.
+ *
+ *  A page cache page in a pipe is not a snapshot: if the file is
+ *  written before the data is read out of the pipe, the new contents
+ *  are seen.
+ */
+
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+
+#include <asm/uaccess.h>
+
+static inline int is_pipe(struct file *file)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+
+	return S_ISFIFO(inode->i_mode) && inode->i_pipe;
+}
+
+/*
+ * Wait for data in a pipe, with its semaphore held.  Returns 1 when
+ * there is some, 0 when all writers are gone, or an error.
+ */
+static int pipe_wait_data(struct inode *inode, int nonblock)
+{
+	while (PIPE_EMPTY(*inode)) {
+		if (!PIPE_WRITERS(*inode))
+			return 0;
+		if (nonblock)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		PIPE_WAITING_READERS(*inode)++;
+		pipe_wait(inode);
+		PIPE_WAITING_READERS(*inode)--;
+	}
+	return 1;
+}
+
+/* Wait for a free slot in a pipe, with its semaphore held */
+static int pipe_wait_room(struct inode *inode, int nonblock)
+{
+	for (;;) {
+		if (!PIPE_READERS(*inode)) {
+			send_sig(SIGPIPE, current, 0);
+			return -EPIPE;
+		}
+		if (!PIPE_FULL(*inode))
+			return 1;
+		if (nonblock)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		wake_up_interruptible_sync(PIPE_WAIT(*inode));
+		PIPE_WAITING_WRITERS(*inode)++;
+		pipe_wait(inode);
+		PIPE_WAITING_WRITERS(*inode)--;
+	}
+}
+
+static void pipe_double_lock(struct inode *a, struct inode *b)
+{
+	if (a < b) {
+		down(PIPE_SEM(*a));
+		down(PIPE_SEM(*b));
+	} else {
+		down(PIPE_SEM(*b));
+		down(PIPE_SEM(*a));
+	}
+}
+
+static void pipe_double_unlock(struct inode *a, struct inode *b)
+{
+	up(PIPE_SEM(*a));
+	up(PIPE_SEM(*b));
+}
+
+/* Queue page cache pages handed to us by do_generic_file_read() */
+static int splice_read_actor(read_descriptor_t *desc, struct page *page,
+			     unsigned long offset, unsigned long size)
+{
+	struct inode *inode = (struct inode *) desc->buf;
+	struct pipe_inode_info *info = inode->i_pipe;
+	struct pipe_buffer *buf;
+
+	if (PIPE_FULL(*inode))
+		return 0;
+	if (size > desc->count)
+		size = desc->count;
+
+	page_cache_get(page);
+	buf = info->bufs + PIPE_BUF_SLOT(info, info->nrbufs);
+	buf->page = page;
+	buf->offset = offset;
+	buf->len = size;
+	buf->flags = 0;
+	info->nrbufs++;
+
+	desc->count -= size;
+	desc->written += size;
+	return size;
+}
+
+/*
+ * Read from a file without a page cache into a private pipe page.
+ * Such a read (a socket, a tty) may sleep for as long as it likes, so
+ * it is done without the pipe semaphore, which readers draining the
+ * pipe and pipe_release() need meanwhile, and only once per call.
+ * A slot is reserved before reading, so that whatever the read
+ * consumes always has a place in the pipe.
+ */
+static long splice_read_copy(struct file *in, loff_t *ppos,
+			     struct inode *inode, size_t len,
+			     unsigned int flags)
+{
+	struct pipe_inode_info *info = inode->i_pipe;
+	int nonblock = flags & SPLICE_F_NONBLOCK;
+	struct pipe_buffer *buf;
+	struct page *page;
+	mm_segment_t old_fs;
+	long ret;
+
+	down(PIPE_SEM(*inode));
+	ret = pipe_wait_room(inode, nonblock);
+	if (ret > 0)
+		info->reserved++;
+	up(PIPE_SEM(*inode));
+	if (ret <= 0)
+		return ret;
+
+	ret = -EAGAIN;
+	if (nonblock && in->f_op->poll &&
+	    !(in->f_op->poll(in, NULL) &
+	      (POLLIN | POLLRDNORM | POLLERR | POLLHUP)))
+		goto out_unreserve;
+
+	if (len > PAGE_SIZE)
+		len = PAGE_SIZE;
+	ret = -ENOMEM;
+	page = alloc_page(GFP_HIGHUSER);
+	if (!page)
+		goto out_unreserve;
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	ret = in->f_op->read(in, kmap(page), len, ppos);
+	kunmap(page);
+	set_fs(old_fs);
+	if (ret <= 0) {
+		page_cache_release(page);
+		goto out_unreserve;
+	}
+
+	/*
+	 * The data is consumed: it goes into the reserved slot whatever
+	 * happened to the pipe meanwhile, even if the readers are gone.
+	 */
+	down(PIPE_SEM(*inode));
+	info->reserved--;
+	buf = info->bufs + PIPE_BUF_SLOT(info, info->nrbufs);
+	buf->page = page;
+	buf->offset = 0;
+	buf->len = ret;
+	buf->flags = PIPE_BUF_FLAG_MERGE;
+	info->nrbufs++;
+
+	wake_up_interruptible(PIPE_WAIT(*inode));
+	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+	mark_inode_dirty(inode);
+	up(PIPE_SEM(*inode));
+	return ret;
+
+out_unreserve:
+	/* the slot may be what a writer is waiting for */
+	down(PIPE_SEM(*inode));
+	info->reserved--;
+	wake_up_interruptible(PIPE_WAIT(*inode));
+	up(PIPE_SEM(*inode));
+	return ret;
+}
+
+static long splice_to_pipe(struct file *in, loff_t *ppos,
+			   struct inode *inode, size_t len, unsigned int flags)
+{
+	struct address_space *mapping = in->f_dentry->d_inode->i_mapping;
+	read_descriptor_t desc;
+	long ret;
+
+	if (!mapping->a_ops->readpage)
+		return splice_read_copy(in, ppos, inode, len, flags);
+
+	down(PIPE_SEM(*inode));
+	ret = pipe_wait_room(inode, flags & SPLICE_F_NONBLOCK);
+	if (ret <= 0)
+		goto out;
+
+	desc.written = 0;
+	desc.count = len;
+	desc.buf = (char *) inode;
+	desc.error = 0;
+	do_generic_file_read(in, ppos, &desc, splice_read_actor);
+
+	ret = desc.written;
+	if (!ret)
+		ret = desc.error;
+
+	if (ret > 0) {
+		wake_up_interruptible(PIPE_WAIT(*inode));
+		inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+		mark_inode_dirty(inode);
+	}
+out:
+	up(PIPE_SEM(*inode));
+	return ret;
+}
+
+static long splice_from_pipe(struct inode *inode, struct file *out,
+			     loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct pipe_inode_info *info = inode->i_pipe;
+	long ret, total = 0;
+
+	down(PIPE_SEM(*inode));
+	ret = pipe_wait_data(inode, flags & SPLICE_F_NONBLOCK);
+	if (ret <= 0)
+		goto out;
+
+	while (len && info->nrbufs) {
+		struct pipe_buffer *buf = info->bufs + info->curbuf;
+		size_t chars = buf->len;
+		int more;
+		ssize_t n;
+
+		if (chars > len)
+			chars = len;
+		more = (flags & SPLICE_F_MORE) ||
+		       (chars < len && info->nrbufs > 1);
+
+		if (out->f_op->sendpage) {
+			n = out->f_op->sendpage(out, buf->page, buf->offset,
+						chars, ppos, more);
+		} else {
+			mm_segment_t old_fs;
+
+			old_fs = get_fs();
+			set_fs(KERNEL_DS);
+			n = out->f_op->write(out, (char *) kmap(buf->page) + buf->offset,
+					     chars, ppos);
+			kunmap(buf->page);
+			set_fs(old_fs);
+		}
+		if (n <= 0) {
+			if (!total)
+				total = n;
+			break;
+		}
+
+		buf->offset += n;
+		buf->len -= n;
+		if (!buf->len)
+			pipe_buf_consume(info);
+		total += n;
+		len -= n;
+		if (n < chars)
+			break;
+	}
+	ret = total;
+	if (ret > 0)
+		wake_up_interruptible(PIPE_WAIT(*inode));
+out:
+	up(PIPE_SEM(*inode));
+	return ret;
+}
+
+/*
+ * Move (or, for tee, share) up to len bytes of buffers from one pipe
+ * to the other, with both semaphores held.
+ */
+static long pipe_link(struct inode *in, struct inode *out,
+		      size_t len, int move)
+{
+	struct pipe_inode_info *ipipe = in->i_pipe;
+	struct pipe_inode_info *opipe = out->i_pipe;
+	long total = 0;
+	int i = 0;
+
+	while (len && i < ipipe->nrbufs && !PIPE_FULL(*out)) {
+		struct pipe_buffer *ibuf = ipipe->bufs + PIPE_BUF_SLOT(ipipe, i);
+		struct pipe_buffer *obuf = opipe->bufs + PIPE_BUF_SLOT(opipe, opipe->nrbufs);
+		size_t chars = ibuf->len;
+
+		if (chars > len)
+			chars = len;
+
+		if (move && chars == ibuf->len) {
+			*obuf = *ibuf;
+			ibuf->page = NULL;
+			ipipe->curbuf = PIPE_BUF_SLOT(ipipe, 1);
+			ipipe->nrbufs--;
+		} else {
+			/* the page is shared now, nobody may append to it */
+			page_cache_get(ibuf->page);
+			ibuf->flags &= ~PIPE_BUF_FLAG_MERGE;
+			*obuf = *ibuf;
+			obuf->len = chars;
+			if (move) {
+				ibuf->offset += chars;
+				ibuf->len -= chars;
+			} else
+				i++;
+		}
+		opipe->nrbufs++;
+		total += chars;
+		len -= chars;
+	}
+	return total;
+}
+
+static long splice_pipe_to_pipe(struct inode *in, struct inode *out,
+				size_t len, unsigned int flags, int move)
+{
+	int nonblock = flags & SPLICE_F_NONBLOCK;
+	long ret;
+
+	if (in == out)
+		return -EINVAL;
+
+	/*
+	 * Wait on each side alone, then take both semaphores and move
+	 * what is there; somebody may have got in between, so retry
+	 * until something moved.
+	 */
+	do {
+		down(PIPE_SEM(*in));
+		ret = pipe_wait_data(in, nonblock);
+		up(PIPE_SEM(*in));
+		if (ret <= 0)
+			return ret;
+
+		down(PIPE_SEM(*out));
+		ret = pipe_wait_room(out, nonblock);
+		up(PIPE_SEM(*out));
+		if (ret <= 0)
+			return ret;
+
+		pipe_double_lock(in, out);
+		ret = pipe_link(in, out, len, move);
+		pipe_double_unlock(in, out);
+	} while (!ret);
+
+	wake_up_interruptible(PIPE_WAIT(*out));
+	if (move)
+		wake_up_interruptible(PIPE_WAIT(*in));
+	return ret;
+}
+
+/* Explicit offsets are only allowed on seekable files */
+static int splice_get_pos(struct file *file, loff_t *off, loff_t *pos,
+			  loff_t **ppos)
+{
+	*ppos = &file->f_pos;
+	if (!off)
+		return 0;
+	if (!file->f_op->llseek || file->f_op->llseek == no_llseek)
+		return -ESPIPE;
+	if (copy_from_user(pos, off, sizeof(*pos)))
+		return -EFAULT;
+	*ppos = pos;
+	return 0;
+}
+
+asmlinkage long sys_splice(int fd_in, loff_t *off_in, int fd_out,
+			   loff_t *off_out, size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	struct inode *in_inode, *out_inode;
+	loff_t pos, *ppos;
+	long ret;
+
+	if (!len)
+		return 0;
+
+	ret = -EBADF;
+	in = fget(fd_in);
+	if (!in)
+		goto out;
+	if (!(in->f_mode & FMODE_READ))
+		goto fput_in;
+	out = fget(fd_out);
+	if (!out)
+		goto fput_in;
+	if (!(out->f_mode & FMODE_WRITE))
+		goto fput_out;
+
+	in_inode = in->f_dentry->d_inode;
+	out_inode = out->f_dentry->d_inode;
+
+	if (is_pipe(in) && is_pipe(out)) {
+		ret = -ESPIPE;
+		if (off_in || off_out)
+			goto fput_out;
+		ret = splice_pipe_to_pipe(in_inode, out_inode, len, flags, 1);
+	} else if (is_pipe(in)) {
+		ret = -ESPIPE;
+		if (off_in)
+			goto fput_out;
+		ret = -EINVAL;
+		if (!out->f_op || (!out->f_op->write && !out->f_op->sendpage))
+			goto fput_out;
+		ret = splice_get_pos(out, off_out, &pos, &ppos);
+		if (ret)
+			goto fput_out;
+		ret = locks_verify_area(FLOCK_VERIFY_WRITE, out_inode, out, *ppos, len);
+		if (ret)
+			goto fput_out;
+		ret = splice_from_pipe(in_inode, out, ppos, len, flags);
+		if (off_out && copy_to_user(off_out, &pos, sizeof(pos)))
+			ret = -EFAULT;
+	} else if (is_pipe(out)) {
+		ret = -ESPIPE;
+		if (off_out)
+			goto fput_out;
+		ret = -EINVAL;
+		if (!in_inode->i_mapping->a_ops->readpage &&
+		    (!in->f_op || !in->f_op->read))
+			goto fput_out;
+		ret = splice_get_pos(in, off_in, &pos, &ppos);
+		if (ret)
+			goto fput_out;
+		ret = locks_verify_area(FLOCK_VERIFY_READ, in_inode, in, *ppos, len);
+		if (ret)
+			goto fput_out;
+		ret = splice_to_pipe(in, ppos, out_inode, len, flags);
+		if (off_in && copy_to_user(off_in, &pos, sizeof(pos)))
+			ret = -EFAULT;
+	} else
+		ret = -EINVAL;
+
+fput_out:
+	fput(out);
+fput_in:
+	fput(in);
+out:
+	return ret;
+}
+
+/*
+ * Duplicate up to len bytes from the front of one pipe into another
+ * without consuming them.
+ */
+asmlinkage long sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	long ret;
+
+	if (!len)
+		return 0;
+
+	ret = -EBADF;
+	in = fget(fd_in);
+	if (!in)
+		goto out;
+	if (!(in->f_mode & FMODE_READ))
+		goto fput_in;
+	out = fget(fd_out);
+	if (!out)
+		goto fput_in;
+	if (!(out->f_mode & FMODE_WRITE))
+		goto fput_out;
+
+	ret = -EINVAL;
+	if (is_pipe(in) && is_pipe(out))
+		ret = splice_pipe_to_pipe(in->f_dentry->d_inode,
+					  out->f_dentry->d_inode, len, flags, 0);
+
+fput_out:
+	fput(out);
+fput_in:
+	fput(in);
+out:
+	return ret;
+}
@@ -45,3 +45,15 @@ static inline void pte_free_slow(pte_t *pte)
 	} while (0)
 
 
+
+/*
+ * Reverse mapping support.  Many PTE tables share each (32K) page, so
+ * there is nowhere to record which mm a table belongs to: ptes are
+ * not reverse mapped and reclaim leaves mapped pages alone.
+ */
+#define __HAVE_ARCH_PGTABLE_RMAP
+
+#define pgtable_add_rmap(ptep, mm, address)	do { } while (0)
+#define pgtable_remove_rmap(ptep)		do { } while (0)
+#define ptep_to_mm(ptep)			((struct mm_struct *)NULL)
+#define ptep_to_address(ptep)			0UL
@@ -56,3 +56,53 @@ static inline void pte_free_slow(pte_t *pte)
 		set_pmd(pmdp, __mk_pmd(pte, __prot));	\
 	} while (0)
 
+
+/*
+ * Reverse mapping support.  PTE tables come from a slab, two to a
+ * page, so each half of the page keeps its own mm and base address:
+ * the first in ->mapping and ->index, the second in ->lru, which
+ * slab pages do not otherwise use.
+ */
+#define __HAVE_ARCH_PGTABLE_RMAP
+
+#define PTE_TABLE_BYTES		(2 * PTRS_PER_PTE * sizeof(pte_t))
+
+static inline void pgtable_set_rmap(pte_t *ptep, struct mm_struct *mm,
+				    unsigned long address)
+{
+	struct page *page = virt_to_page(ptep);
+
+	if (((unsigned long)ptep & ~PAGE_MASK) < PTE_TABLE_BYTES) {
+		page->mapping = (void *)mm;
+		page->index = address;
+	} else {
+		page->lru.next = (void *)mm;
+		page->lru.prev = (void *)address;
+	}
+}
+
+#define pgtable_add_rmap(ptep, mm, address)				\
+	pgtable_set_rmap(ptep, mm, (address) & ~((PTRS_PER_PTE * PAGE_SIZE) - 1))
+#define pgtable_remove_rmap(ptep)	pgtable_set_rmap(ptep, NULL, 0)
+
+static inline struct mm_struct *ptep_to_mm(pte_t *ptep)
+{
+	struct page *page = virt_to_page(ptep);
+
+	if (((unsigned long)ptep & ~PAGE_MASK) < PTE_TABLE_BYTES)
+		return (struct mm_struct *)page->mapping;
+	return (struct mm_struct *)page->lru.next;
+}
+
+static inline unsigned long ptep_to_address(pte_t *ptep)
+{
+	struct page *page = virt_to_page(ptep);
+	unsigned long base, idx;
+
+	if (((unsigned long)ptep & ~PAGE_MASK) < PTE_TABLE_BYTES)
+		base = page->index;
+	else
+		base = (unsigned long)page->lru.prev;
+	idx = ((unsigned long)ptep & (PTRS_PER_PTE * sizeof(pte_t) - 1)) / sizeof(pte_t);
+	return base + (idx << PAGE_SHIFT);
+}
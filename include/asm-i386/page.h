@@ -49,6 +49,17 @@ typedef struct { unsigned long pgd; } pgd_t;
 #endif
 #define PTE_MASK	PAGE_MASK
 
+#ifdef CONFIG_HUGETLB_PAGE
+#if CONFIG_X86_PAE
+#define HPAGE_SHIFT	21
+#else
+#define HPAGE_SHIFT	22
+#endif
+#define HPAGE_SIZE	((1UL) << HPAGE_SHIFT)
+#define HPAGE_MASK	(~(HPAGE_SIZE - 1))
+#define HUGETLB_PAGE_ORDER	(HPAGE_SHIFT - PAGE_SHIFT)
+#endif
+
 typedef struct { unsigned long pgprot; } pgprot_t;
 
 #define pmd_val(x)	((x).pmd)
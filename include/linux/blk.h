@@ -87,6 +87,8 @@ void initrd_init(void);
 static inline void blkdev_dequeue_request(struct request * req)
 {
 	list_del(&req->queue);
+	if (req->q)
+		elevator_remove_req(req->q, req);
 }
 
 int end_that_request_first(struct request *req, int uptodate, char *name);
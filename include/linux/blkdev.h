@@ -22,6 +22,7 @@ typedef struct elevator_s elevator_t;
 struct request {
 	struct list_head queue;
 	int elevator_sequence;
+	struct list_head fifo;	/* age order, for the deadline schedulers */
 
 	volatile int rq_status;	/* should split this into a few status bits */
 #define RQ_INACTIVE		(-1)
@@ -70,6 +71,11 @@ typedef void (unplug_device_fn) (void *q);
  */
 #define QUEUE_NR_REQUESTS	8192
 
+/*
+ * Request latency histogram buckets, see blk_account_latency()
+ */
+#define BLK_LATENCY_BUCKETS	10
+
 struct request_list {
 	unsigned int count;
 	struct list_head free;
@@ -129,17 +135,56 @@ struct request_queue
 	unsigned long		bounce_pfn;
 
 	/*
-	 * Is meant to protect the queue in the future instead of
-	 * io_request_lock
+	 * Protects the queue.  Points to io_request_lock for queues set
+	 * up with blk_init_queue(), to a lock of the driver's, or to
+	 * __queue_lock below.
 	 */
-	spinlock_t		queue_lock;
+	spinlock_t		*queue_lock;
+	spinlock_t		__queue_lock;
 
 	/*
 	 * Tasks wait here for free read and write requests
 	 */
 	wait_queue_head_t	wait_for_requests[2];
+
+	/*
+	 * All queues are on blk_queue_list, for /proc/iosched
+	 */
+	struct list_head	queue_list;
+
+	/*
+	 * Users found through blk_queue_list, which dropped the list
+	 * lock; blk_cleanup_queue waits for them to go away
+	 */
+	atomic_t		refcnt;
+
+	/*
+	 * Completed read and write requests, by how long they took
+	 */
+	unsigned long		latency[2][BLK_LATENCY_BUCKETS];
 };
 
+/*
+ * Elevator hooks, called with the queue lock held
+ */
+static inline void elevator_add_req(request_queue_t *q, struct request *rq)
+{
+	if (q->elevator.elevator_add_req_fn)
+		q->elevator.elevator_add_req_fn(q, rq);
+}
+
+static inline void elevator_remove_req(request_queue_t *q, struct request *rq)
+{
+	if (q->elevator.elevator_remove_req_fn)
+		q->elevator.elevator_remove_req_fn(q, rq);
+}
+
+static inline void elevator_completed(request_queue_t *q, struct request *rq)
+{
+	if (q->elevator.elevator_completed_fn)
+		q->elevator.elevator_completed_fn(q, rq);
+}
+
 extern unsigned long blk_max_low_pfn, blk_max_pfn;
 
 #define BLK_BOUNCE_HIGH		(blk_max_low_pfn << PAGE_SHIFT)
@@ -207,10 +252,12 @@ extern void blkdev_release_request(struct request *);
  */
 extern int blk_grow_request_list(request_queue_t *q, int nr_requests);
 extern void blk_init_queue(request_queue_t *, request_fn_proc *);
+extern void blk_init_queue_lock(request_queue_t *, request_fn_proc *, spinlock_t *);
 extern void blk_cleanup_queue(request_queue_t *);
 extern void blk_queue_headactive(request_queue_t *, int);
 extern void blk_queue_make_request(request_queue_t *, make_request_fn *);
 extern void generic_unplug_device(void *);
+extern void __generic_unplug_device(request_queue_t *);
 extern inline int blk_seg_merge_ok(struct buffer_head *, struct buffer_head *);
 
 extern int * blk_size[MAX_BLKDEV];
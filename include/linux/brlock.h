@@ -34,6 +34,8 @@
 enum brlock_indices {
 	BR_GLOBALIRQ_LOCK,
 	BR_NETPROTO_LOCK,
+	BR_FIB_LOCK,
+	BR_RT_HASH_LOCK,
 
 	__BR_END
 };
@@ -6,6 +6,8 @@
 #include <asm/atomic.h>
 #include <linux/mount.h>
 #include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
 
 /*
  * linux/include/linux/dcache.h
@@ -67,6 +69,7 @@ static __inline__ unsigned int full_name_hash(const unsigned char * name, unsign
 struct dentry {
 	atomic_t d_count;
 	unsigned int d_flags;
+	spinlock_t d_lock;		/* per dentry lock, see d_lookup() */
 	struct inode  * d_inode;	/* Where the name belongs to - NULL is negative */
 	struct dentry * d_parent;	/* parent directory */
 	struct list_head d_hash;	/* lookup hash list */
@@ -81,6 +84,7 @@ struct dentry {
 	struct super_block * d_sb;	/* The root of the dentry tree */
 	unsigned long d_vfs_flags;
 	void * d_fsdata;		/* fs-specific data */
+	struct rcu_head d_rcu;		/* deferred free, see d_free() */
 	unsigned char d_iname[DNAME_INLINE_LEN]; /* small names */
 };
 
@@ -100,12 +104,15 @@ struct dentry_operations {
  * might be a negative dentry which has no information associated with
  * it */
 
+/* d_lookup() calls d_compare under the candidate's d_lock, and
+ * d_delete runs under its d_lock as well as dcache_lock. */
+
 /*
 locking rules:
 		big lock	dcache_lock	may block
 d_revalidate:	no		no		yes
 d_hash		no		no		yes
-d_compare:	no		yes		no
+d_compare:	no		no		no
 d_delete:	no		yes		no
 d_release:	no		no		yes
 d_iput:		no		no		yes
@@ -144,11 +151,21 @@ extern spinlock_t dcache_lock;
  * timeouts or autofs deletes).
  */
 
+/*
+ * Lockless d_lookup() checks the hash chain membership under d_lock,
+ * so unhashing must take it too.  Called with dcache_lock held.
+ */
+static __inline__ void __d_drop(struct dentry * dentry)
+{
+	spin_lock(&dentry->d_lock);
+	list_del_init(&dentry->d_hash);
+	spin_unlock(&dentry->d_lock);
+}
+
 static __inline__ void d_drop(struct dentry * dentry)
 {
 	spin_lock(&dcache_lock);
-	list_del(&dentry->d_hash);
-	INIT_LIST_HEAD(&dentry->d_hash);
+	__d_drop(dentry);
 	spin_unlock(&dcache_lock);
 }
 
@@ -12,6 +12,8 @@ typedef void (elevator_merge_cleanup_fn) (request_queue_t *, struct request *, i
 
 typedef void (elevator_merge_req_fn) (struct request *, struct request *);
 
+typedef void (elevator_req_fn) (request_queue_t *, struct request *);
+
 struct elevator_s
 {
 	int read_latency;
@@ -19,8 +21,19 @@ struct elevator_s
 
 	elevator_merge_fn *elevator_merge_fn;
 	elevator_merge_req_fn *elevator_merge_req_fn;
+	elevator_req_fn *elevator_add_req_fn;		/* new request queued */
+	elevator_req_fn *elevator_remove_req_fn;	/* request left the queue */
+	elevator_req_fn *elevator_completed_fn;		/* request completed */
+	const char *elevator_name;
 
 	unsigned int queue_ID;
+
+	/*
+	 * Scheduler state, set up by elevator_init().
+	 */
+	struct list_head fifo[2];	/* READ and WRITE requests, oldest first */
+	int antic_state;		/* idling, waiting for another read */
+	struct timer_list antic_timer;
 };
 
 int elevator_noop_merge(request_queue_t *, struct request **, struct list_head *, struct buffer_head *, int, int);
@@ -31,6 +44,13 @@ int elevator_linus_merge(request_queue_t *, struct request **, struct list_head
 void elevator_linus_merge_cleanup(request_queue_t *, struct request *, int);
 void elevator_linus_merge_req(struct request *, struct request *);
 
+int elevator_deadline_merge(request_queue_t *, struct request **, struct list_head *, struct buffer_head *, int, int);
+void elevator_deadline_add_req(request_queue_t *, struct request *);
+void elevator_deadline_remove_req(request_queue_t *, struct request *);
+
+void elevator_antic_add_req(request_queue_t *, struct request *);
+void elevator_antic_completed(request_queue_t *, struct request *);
+
 typedef struct blkelv_ioctl_arg_s {
 	int queue_ID;
 	int read_latency;
@@ -45,6 +65,9 @@ extern int blkelvget_ioctl(elevator_t *, blkelv_ioctl_arg_t *);
 extern int blkelvset_ioctl(elevator_t *, const blkelv_ioctl_arg_t *);
 
 extern void elevator_init(elevator_t *, elevator_t);
+extern elevator_t elevator_default(void);
+extern int elevator_find(const char *, elevator_t *);
+extern void elevator_switch(request_queue_t *, elevator_t *);
 
 /*
  * Return values from elevator merger
@@ -82,6 +105,12 @@ static inline int elevator_request_latency(elevator_t * elevator, int rw)
 
 #define ELV_LINUS_SEEK_COST	16
 
+/*
+ * How long the anticipatory scheduler keeps the queue idle after a
+ * read has completed, waiting for the next read to come in.
+ */
+#define ELV_ANTIC_EXPIRE	(HZ / 100 + 1)
+
 #define ELEVATOR_NOOP							\
 ((elevator_t) {								\
 	0,				/* read_latency */		\
@@ -89,6 +118,10 @@ static inline int elevator_request_latency(elevator_t * elevator, int rw)
 									\
 	elevator_noop_merge,		/* elevator_merge_fn */		\
 	elevator_noop_merge_req,	/* elevator_merge_req_fn */	\
+	NULL,				/* elevator_add_req_fn */	\
+	NULL,				/* elevator_remove_req_fn */	\
+	NULL,				/* elevator_completed_fn */	\
+	"noop",				/* elevator_name */		\
 	})
 
 #define ELEVATOR_LINUS							\
@@ -98,6 +131,36 @@ static inline int elevator_request_latency(elevator_t * elevator, int rw)
 									\
 	elevator_linus_merge,		/* elevator_merge_fn */		\
 	elevator_linus_merge_req,	/* elevator_merge_req_fn */	\
+	NULL,				/* elevator_add_req_fn */	\
+	NULL,				/* elevator_remove_req_fn */	\
+	NULL,				/* elevator_completed_fn */	\
+	"linus",			/* elevator_name */		\
+	})
+
+#define ELEVATOR_DEADLINE						\
+((elevator_t) {								\
+	HZ / 2,				/* read expiry, jiffies */	\
+	5 * HZ,				/* write expiry, jiffies */	\
+									\
+	elevator_deadline_merge,	/* elevator_merge_fn */		\
+	elevator_noop_merge_req,	/* elevator_merge_req_fn */	\
+	elevator_deadline_add_req,	/* elevator_add_req_fn */	\
+	elevator_deadline_remove_req,	/* elevator_remove_req_fn */	\
+	NULL,				/* elevator_completed_fn */	\
+	"deadline",			/* elevator_name */		\
+	})
+
+#define ELEVATOR_ANTICIPATORY						\
+((elevator_t) {								\
+	HZ / 8,				/* read expiry, jiffies */	\
+	HZ / 4,				/* write expiry, jiffies */	\
+									\
+	elevator_deadline_merge,	/* elevator_merge_fn */		\
+	elevator_noop_merge_req,	/* elevator_merge_req_fn */	\
+	elevator_antic_add_req,		/* elevator_add_req_fn */	\
+	elevator_deadline_remove_req,	/* elevator_remove_req_fn */	\
+	elevator_antic_completed,	/* elevator_completed_fn */	\
+	"anticipatory",			/* elevator_name */		\
 	})
 
 #endif
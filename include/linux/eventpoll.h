@@ -0,0 +1,71 @@
+/*
+ *  include/linux/eventpoll.h
+ *
+ *  Scalable event notification: interest in a set of file descriptors
+ *  is registered once and readiness is reported per ready descriptor.
+ */
+
+#ifndef _LINUX_EVENTPOLL_H
+#define _LINUX_EVENTPOLL_H
+
+#include <linux/types.h>
+
+/* Valid opcodes to issue to sys_epoll_ctl() */
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+/* Report only transitions to the ready state (edge triggered) */
+#define EPOLLET (1U << 31)
+
+/*
+ * The x86-64 layout has to match the 32-bit one so that the ia32
+ * emulation can share it.
+ */
+#ifdef __x86_64__
+#define EPOLL_PACKED __attribute__((packed))
+#else
+#define EPOLL_PACKED
+#endif
+
+struct epoll_event {
+	__u32 events;
+	__u64 data;
+} EPOLL_PACKED;
+
+#ifdef __KERNEL__
+
+#include <linux/linkage.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/fs.h>
+
+asmlinkage long sys_epoll_create(int size);
+asmlinkage long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+asmlinkage long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+			       int timeout);
+
+/* Used to initialize the epoll bits inside the "struct file" */
+static inline void eventpoll_init_file(struct file *file)
+{
+	INIT_LIST_HEAD(&file->f_ep_links);
+	spin_lock_init(&file->f_ep_lock);
+}
+
+extern void eventpoll_release_file(struct file *file);
+
+/*
+ * Called by fput() before the file goes away: drop it from every epoll
+ * set still watching it.  Files that were never added to one cost a
+ * single list check.
+ */
+static inline void eventpoll_release(struct file *file)
+{
+	if (list_empty(&file->f_ep_links))
+		return;
+	eventpoll_release_file(file);
+}
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_EVENTPOLL_H */
@@ -33,6 +33,14 @@
 #define EXT2_PREALLOCATE
 #define EXT2_DEFAULT_PREALLOC_BLOCKS	8
 
+/*
+ * Growing regular files allocate from a per-inode reservation window,
+ * which starts at EXT2_DEFAULT_RESERVE_BLOCKS and doubles while the file
+ * keeps filling it, up to EXT2_MAX_RESERVE_BLOCKS.
+ */
+#define EXT2_DEFAULT_RESERVE_BLOCKS	8
+#define EXT2_MAX_RESERVE_BLOCKS		1024
+
 /*
  * The second extended file system version
  */
@@ -314,6 +322,7 @@ struct ext2_inode {
 #define EXT2_MOUNT_ERRORS_PANIC		0x0040	/* Panic on errors */
 #define EXT2_MOUNT_MINIX_DF		0x0080	/* Mimics the Minix statfs */
 #define EXT2_MOUNT_NO_UID32		0x0200  /* Disable 32-bit UIDs */
+#define EXT2_MOUNT_RESERVATION		0x0400	/* Block reservation windows */
 
 #define clear_opt(o, opt)		o &= ~EXT2_MOUNT_##opt
 #define set_opt(o, opt)			o |= EXT2_MOUNT_##opt
@@ -557,6 +566,8 @@ extern void ext2_check_blocks_bitmap (struct super_block *);
 extern struct ext2_group_desc * ext2_get_group_desc(struct super_block * sb,
 						    unsigned int block_group,
 						    struct buffer_head ** bh);
+extern void ext2_init_reservation (struct inode *);
+extern void ext2_discard_reservation (struct inode *);
 
 /* dir.c */
 extern int ext2_add_link (struct dentry *, struct inode *);
@@ -16,6 +16,20 @@
 #ifndef _LINUX_EXT2_FS_I
 #define _LINUX_EXT2_FS_I
 
+#include <linux/rbtree.h>
+
+/*
+ * Block reservation window of a growing regular file, see
+ * fs/ext2/balloc.c.  It is never written to disk.
+ */
+struct ext2_reserve_window {
+	rb_node_t	rsv_node;	/* in the per-fs tree, by start */
+	__u32		rsv_start;	/* first block of the window */
+	__u32		rsv_end;	/* last block, 0 if there is no window */
+	__u32		rsv_goal_size;	/* size of the next window */
+	__u32		rsv_alloc_hit;	/* blocks allocated from this one */
+};
+
 /*
  * second extended file system inode data in memory
  */
@@ -35,6 +49,7 @@ struct ext2_inode_info {
 	__u32	i_prealloc_count;
 	__u32	i_dir_start_lookup;
 	int	i_new_inode:1;	/* Is a freshly allocated inode */
+	struct ext2_reserve_window i_rsv_window;
 };
 
 #endif	/* _LINUX_EXT2_FS_I */
@@ -16,6 +16,8 @@
 #ifndef _LINUX_EXT2_FS_SB
 #define _LINUX_EXT2_FS_SB
 
+#include <linux/rbtree.h>
+
 /*
  * The following is not needed anymore since the descriptors buffer
  * heads are now dynamically allocated
@@ -56,6 +58,13 @@ struct ext2_sb_info {
 	int s_desc_per_block_bits;
 	int s_inode_size;
 	int s_first_ino;
+
+	/* Reservation windows, see fs/ext2/balloc.c */
+	spinlock_t s_rsv_lock;		/* guards the tree and the windows */
+	rb_root_t s_rsv_root;		/* windows, sorted by start block */
+	unsigned long s_rsv_count;	/* windows in the tree */
+	unsigned long s_rsv_hits;	/* allocations from a window */
+	unsigned long s_rsv_misses;	/* windows that had to be opened */
 };
 
 #endif	/* _LINUX_EXT2_FS_SB */
@@ -17,6 +17,19 @@
 #define _LINUX_EXT3_FS_I
 
 #include <linux/rwsem.h>
+#include <linux/rbtree.h>
+
+/*
+ * Block reservation window of a growing regular file, see
+ * fs/ext3/balloc.c.  It is never written to disk.
+ */
+struct ext3_reserve_window {
+	rb_node_t	rsv_node;	/* in the per-fs tree, by start */
+	__u32		rsv_start;	/* first block of the window */
+	__u32		rsv_end;	/* last block, 0 if there is no window */
+	__u32		rsv_goal_size;	/* size of the next window */
+	__u32		rsv_alloc_hit;	/* blocks allocated from this one */
+};
 
 /*
  * second extended file system inode data in memory
@@ -73,6 +86,8 @@ struct ext3_inode_info {
 	 * by other means, so we have truncate_sem.
 	 */
 	struct rw_semaphore truncate_sem;
+
+	struct ext3_reserve_window i_rsv_window;
 };
 
 #endif	/* _LINUX_EXT3_FS_I */
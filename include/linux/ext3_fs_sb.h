@@ -19,6 +19,7 @@
 #ifdef __KERNEL__
 #include <linux/timer.h>
 #include <linux/wait.h>
+#include <linux/rbtree.h>
 #endif
 
 /*
@@ -62,6 +63,15 @@ struct ext3_sb_info {
 	int s_inode_size;
 	int s_first_ino;
 	u32 s_next_generation;
+	u32 s_hash_seed[4];
+	int s_def_hash_version;
+
+	/* Reservation windows, see fs/ext3/balloc.c */
+	spinlock_t s_rsv_lock;		/* guards the tree and the windows */
+	rb_root_t s_rsv_root;		/* windows, sorted by start block */
+	unsigned long s_rsv_count;	/* windows in the tree */
+	unsigned long s_rsv_hits;	/* allocations from a window */
+	unsigned long s_rsv_misses;	/* windows that had to be opened */
 
 	/* Journaling */
 	struct inode * s_journal_inode;
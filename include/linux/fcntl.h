@@ -12,6 +12,12 @@
  */
 #define F_NOTIFY	(F_LINUX_SPECIFIC_BASE+2)
 
+/*
+ * Set and get the size of a pipe's buffer ring, in bytes.
+ */
+#define F_SETPIPE_SZ	(F_LINUX_SPECIFIC_BASE+7)
+#define F_GETPIPE_SZ	(F_LINUX_SPECIFIC_BASE+8)
+
 /*
  * Types of directory notifications that may be requested.
  */
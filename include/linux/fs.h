@@ -246,6 +246,7 @@ struct buffer_head {
 	unsigned short b_size;		/* block size */
 	unsigned short b_list;		/* List that this buffer appears */
 	kdev_t b_dev;			/* device (B_FREE = free) */
+	unsigned short b_lru_set;	/* LRU set b_list is on (buffer.c) */
 
 	atomic_t b_count;		/* users using this block */
 	kdev_t b_rdev;			/* Real device */
@@ -542,6 +543,10 @@ struct file {
 	/* preallocated helper kiobuf to speedup O_DIRECT */
 	struct kiobuf		*f_iobuf;
 	long			f_iobuf_lock;
+
+	/* epoll sets watching this file, see fs/eventpoll.c */
+	struct list_head	f_ep_links;
+	spinlock_t		f_ep_lock;
 };
 extern spinlock_t files_lock;
 #define file_list_lock() spin_lock(&files_lock);
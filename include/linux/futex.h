@@ -0,0 +1,18 @@
+#ifndef _LINUX_FUTEX_H
+#define _LINUX_FUTEX_H
+
+/* Second argument to futex syscall */
+#define FUTEX_WAIT	0
+#define FUTEX_WAKE	1
+#define FUTEX_REQUEUE	3
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/linkage.h>
+#include <linux/time.h>
+
+asmlinkage long sys_futex(u32 *uaddr, int op, int val,
+			  struct timespec *utime, u32 *uaddr2);
+#endif
+
+#endif
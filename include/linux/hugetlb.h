@@ -0,0 +1,79 @@
+#ifndef _LINUX_HUGETLB_H
+#define _LINUX_HUGETLB_H
+/*
+ * Huge TLB pages: shared memory backed by large (PSE) pages.
+ *
+ * The pages come from a pool reserved at boot with "hugepages=" or
+ * later through /proc/sys/vm/nr_hugepages.  They are only ever mapped
+ * shared, by a pmd-level entry, through a hugetlbfs file or a SysV shm
+ * segment created with SHM_HUGETLB, and are never swapped.  Each page
+ * belongs to the file it was allocated for until that file is
+ * truncated or goes away.
+ */
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+
+#ifdef CONFIG_HUGETLB_PAGE
+
+struct ctl_table;
+
+static inline int is_vm_hugetlb_page(struct vm_area_struct *vma)
+{
+	return vma->vm_flags & VM_HUGETLB;
+}
+
+/* arch/<arch>/mm/hugetlbpage.c */
+extern int htlbpage_max;
+extern int hugetlb_sysctl_handler(struct ctl_table *, int, struct file *,
+				  void *, size_t *);
+extern struct page *alloc_huge_page(void);
+extern void free_huge_page(struct page *);
+extern int is_hugepage_mem_enough(size_t);
+extern int hugetlb_report_meminfo(char *);
+extern int hugetlb_prefault(struct vm_area_struct *, struct page **);
+extern int copy_hugetlb_page_range(struct mm_struct *, struct mm_struct *,
+				   struct vm_area_struct *);
+extern int follow_hugetlb_page(struct mm_struct *, struct vm_area_struct *,
+			       struct page **, struct vm_area_struct **,
+			       unsigned long *, int *, int);
+extern void zap_hugepage_range(struct vm_area_struct *, unsigned long,
+			       unsigned long);
+
+/* fs/hugetlbfs/inode.c */
+extern struct file_operations hugetlbfs_file_operations;
+extern struct file *hugetlb_file_setup(char *, size_t);
+
+/*
+ * SysV shm swaps in its own file_operations, so look at the inode's
+ * to recognise a hugetlbfs file.
+ */
+static inline int is_file_hugepages(struct file *file)
+{
+	return file->f_dentry->d_inode->i_fop == &hugetlbfs_file_operations;
+}
+
+#else /* !CONFIG_HUGETLB_PAGE */
+
+static inline int is_vm_hugetlb_page(struct vm_area_struct *vma)
+{
+	return 0;
+}
+
+static inline int is_file_hugepages(struct file *file)
+{
+	return 0;
+}
+
+#define hugetlb_report_meminfo(buf)			0
+#define hugetlb_file_setup(name, size)			ERR_PTR(-ENOSYS)
+#define copy_hugetlb_page_range(dst, src, vma)		({ BUG(); 0; })
+#define follow_hugetlb_page(m, v, p, vs, st, len, i)	({ BUG(); 0; })
+#define zap_hugepage_range(vma, start, len)		BUG()
+
+#endif /* CONFIG_HUGETLB_PAGE */
+
+#endif /* __KERNEL__ */
+#endif /* _LINUX_HUGETLB_H */
@@ -762,6 +762,7 @@ extern	ide_module_t	*ide_modules;
 extern	ide_module_t	*ide_probe;
 #endif
 extern int noautodma;
+extern spinlock_t ide_queue_lock;
 
 /*
  * We need blk.h, but we replace its end_request by our own version.
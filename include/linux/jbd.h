@@ -104,6 +104,24 @@ typedef struct journal_header_s
 	__u32		h_sequence;
 } journal_header_t;
 
+/*
+ * Commit block.  With JFS_FEATURE_COMPAT_CHECKSUM it carries a checksum
+ * over the transaction's revoke, descriptor and journaled blocks in log
+ * order, so that recovery can tell whether all of them made it to disk.
+ */
+#define JFS_CRC32_CHKSUM	1
+#define JFS_CRC32_CHKSUM_SIZE	4
+#define JFS_CHECKSUM_BYTES	(32 / sizeof(__u32))
+
+typedef struct commit_header_s
+{
+	journal_header_t c_header;
+	__u8		c_chksum_type;	/* JFS_CRC32_CHKSUM, or 0 */
+	__u8		c_chksum_size;	/* bytes of c_chksum in use */
+	__u8		c_padding[2];
+	__u32		c_chksum[JFS_CHECKSUM_BYTES];
+} commit_header_t;
+
 
 /* 
  * The block tag: used to describe a single buffer in the journal 
@@ -190,12 +208,16 @@ typedef struct journal_superblock_s
 	((j)->j_format_version >= 2 &&					\
 	 ((j)->j_superblock->s_feature_incompat & cpu_to_be32((mask))))
 
+#define JFS_FEATURE_COMPAT_CHECKSUM	0x00000001
+
 #define JFS_FEATURE_INCOMPAT_REVOKE	0x00000001
+#define JFS_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 
 /* Features known to this kernel version: */
-#define JFS_KNOWN_COMPAT_FEATURES	0
+#define JFS_KNOWN_COMPAT_FEATURES	JFS_FEATURE_COMPAT_CHECKSUM
 #define JFS_KNOWN_ROCOMPAT_FEATURES	0
-#define JFS_KNOWN_INCOMPAT_FEATURES	JFS_FEATURE_INCOMPAT_REVOKE
+#define JFS_KNOWN_INCOMPAT_FEATURES	(JFS_FEATURE_INCOMPAT_REVOKE | \
+					 JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -420,6 +442,10 @@ struct transaction_s
 	/* How many handles used this transaction? */
 	int t_handle_count;
 
+	/* When was the transaction started?  Synchronous handles keep
+	 * it open for a while, see journal_stop(). */
+	struct timeval		t_start_time;
+
 	/* List of registered callback functions for this transaction.
 	 * Called when the transaction is committed. */
 	struct list_head	t_jcb;
@@ -561,8 +587,35 @@ struct journal_s
 	/* The revoke table: maintains the list of revoked blocks in the
            current transaction. */
 	struct jbd_revoke_table_s *j_revoke;
+
+	/* Group commit: the last process to stop a synchronous handle,
+	 * and a running average of how long a commit takes, in usecs */
+	pid_t			j_last_sync_writer;
+	unsigned long		j_average_commit_time;
+
+	/* Statistics, shown in /proc/fs/jbd/<device> */
+	struct journal_stats_s {
+		unsigned long	js_start;	/* jiffies at journal setup */
+		unsigned long	js_commits;	/* transactions committed */
+		unsigned long	js_handles;	/* handles in those */
+		unsigned long	js_batched;	/* sync handles which waited */
+	}			j_stats;
+	struct proc_dir_entry *	j_proc_entry;
 };
 
+/* Longest a synchronous handle waits for others to join its transaction */
+#define JBD_MAX_BATCH_TIME	15000	/* usecs */
+
+/* Microseconds since *start (negative if the clock was set back) */
+static inline long jbd_usecs_since(struct timeval *start)
+{
+	struct timeval now;
+
+	do_gettimeofday(&now);
+	return (now.tv_sec - start->tv_sec) * 1000000L +
+		(now.tv_usec - start->tv_usec);
+}
+
 /* 
  * Journal flag definitions 
  */
@@ -688,6 +741,8 @@ extern int	   journal_check_available_features
 		   (journal_t *, unsigned long, unsigned long, unsigned long);
 extern int	   journal_set_features 
 		   (journal_t *, unsigned long, unsigned long, unsigned long);
+extern void	   journal_clear_features
+		   (journal_t *, unsigned long, unsigned long, unsigned long);
 extern int	   journal_create     (journal_t *);
 extern int	   journal_load       (journal_t *journal);
 extern void	   journal_destroy    (journal_t *);
@@ -731,6 +786,9 @@ extern int	   journal_test_revoke(journal_t *, unsigned long, tid_t);
 extern void	   journal_clear_revoke(journal_t *);
 extern void	   journal_brelse_array(struct buffer_head *b[], int n);
 
+/* Commit block checksums */
+extern __u32	   journal_crc32(__u32 crc, const char *p, unsigned int len);
+
 /* The log thread user interface:
  *
  * Request space in the current transaction, and force transaction commit
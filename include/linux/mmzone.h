@@ -8,6 +8,8 @@
 #include <linux/spinlock.h>
 #include <linux/list.h>
 #include <linux/wait.h>
+#include <linux/threads.h>
+#include <linux/cache.h>
 
 /*
  * Free memory management - zoned buddy allocator.
@@ -26,6 +28,31 @@ typedef struct free_area_struct {
 
 struct pglist_data;
 
+/*
+ * Per-CPU lists of free order-0 pages sitting in front of the buddy
+ * lists, so that most single page allocations and frees never touch
+ * zone->lock.  The lists are refilled from and drained back to the
+ * buddy allocator "batch" pages at a time whenever the count crosses
+ * the low or high watermark.
+ *
+ * pcp[0] holds recently freed pages that are likely still in the CPU
+ * cache, pcp[1] holds cold ones (freed by reclaim, or about to be
+ * overwritten by DMA).  Pages on these lists are not counted in
+ * zone->free_pages, so the allocator drains them back to the buddy
+ * lists before it reclaims memory or fails.
+ */
+struct per_cpu_pages {
+	int count;		/* number of pages in the list */
+	int low;		/* refill when count drops to this */
+	int high;		/* drain when count reaches this */
+	int batch;		/* chunk size for buddy add/remove */
+	struct list_head list;	/* the list of pages */
+};
+
+struct per_cpu_pageset {
+	struct per_cpu_pages pcp[2];	/* 0: hot.  1: cold */
+} ____cacheline_aligned_in_smp;
+
 /*
  * On machines where it is needed (eg PCs) we divide physical memory
  * into multiple physical zones. On a PC we have 3 zones:
@@ -48,6 +75,11 @@ typedef struct zone_struct {
 	 */
 	free_area_t		free_area[MAX_ORDER];
 
+	/*
+	 * per-CPU hot and cold order-0 page lists, indexed by cpu
+	 */
+	struct per_cpu_pageset	pageset[NR_CPUS];
+
 	/*
 	 * wait_table		-- the array holding the hash table
 	 * wait_table_size	-- the size of the hash table array
@@ -221,6 +221,18 @@ struct netdev_boot_setup {
 };
 #define NETDEV_BOOT_SETUP_MAX 8
 
+/*
+ * One hardware transmit ring of a device that has several.  Each ring
+ * is stopped and woken on its own, and has its own hard_start_xmit
+ * synchronizer, so different CPUs can feed different rings at once.
+ */
+struct netdev_tx_ring
+{
+	spinlock_t		xmit_lock;
+	int			xmit_lock_owner;
+	unsigned long		state;		/* __LINK_STATE_XOFF */
+} ____cacheline_aligned_in_smp;
+
 
 /*
  *	The DEVICE structure.
@@ -334,6 +346,9 @@ struct net_device
 	struct list_head	poll_list;	/* Link to poll list	*/
 	int			quota;
 	int			weight;
+	unsigned long		poll_count;	/* dev->poll calls	*/
+	unsigned long		poll_pkts;	/* packets taken by them */
+	unsigned long		irq_count;	/* interrupts, polling drivers */
 
 	struct Qdisc		*qdisc;
 	struct Qdisc		*qdisc_sleeping;
@@ -347,6 +362,12 @@ struct net_device
 	   if nobody entered there.
 	 */
 	int			xmit_lock_owner;
+	/* Multi-ring devices: tx_rings rings, fed through
+	   hard_start_xmit_ring() instead of hard_start_xmit().
+	   Zero for everybody else.
+	 */
+	int			tx_rings;
+	struct netdev_tx_ring	*tx_ring;
 	/* device queue lock */
 	spinlock_t		queue_lock;
 	/* Number of references to this device */
@@ -367,6 +388,7 @@ struct net_device
 #define NETIF_F_HW_VLAN_RX	256	/* Receive VLAN hw acceleration */
 #define NETIF_F_HW_VLAN_FILTER	512	/* Receive filtering on VLAN */
 #define NETIF_F_VLAN_CHALLENGED	1024	/* Device cannot handle VLAN packets */
+#define NETIF_F_TSO		2048	/* Can offload TCP/IP segmentation */
 
 	/* Called after device is detached from network. */
 	void			(*uninit)(struct net_device *dev);
@@ -378,6 +400,12 @@ struct net_device
 	int			(*stop)(struct net_device *dev);
 	int			(*hard_start_xmit) (struct sk_buff *skb,
 						    struct net_device *dev);
+#define HAVE_NETDEV_TX_RINGS
+	int			(*hard_start_xmit_ring) (struct sk_buff *skb,
+							 struct net_device *dev,
+							 int ring);
+	int			(*select_tx_ring) (struct net_device *dev,
+						   struct sk_buff *skb);
 #define HAVE_NETDEV_POLL
 	int			(*poll) (struct net_device *dev, int *quota);
 	int			(*hard_header) (struct sk_buff *skb,
@@ -552,6 +580,48 @@ static inline int netif_queue_stopped(struct net_device *dev)
 	return test_bit(__LINK_STATE_XOFF, &dev->state);
 }
 
+/*
+ * Multi-ring transmit.  The driver hands its rings to
+ * netdev_init_tx_rings() before registering the device, and stops and
+ * wakes each of them as it fills and drains; netif_stop_queue() still
+ * stops them all.  The core calls hard_start_xmit_ring() with the ring's
+ * xmit_lock held, choosing the ring by CPU unless the driver supplies
+ * select_tx_ring().  Code outside the packet scheduler that calls
+ * hard_start_xmit() directly holds only dev->xmit_lock, so a driver's
+ * hard_start_xmit() must lock the ring it uses itself.
+ */
+static inline void netif_start_tx_ring(struct net_device *dev, int ring)
+{
+	clear_bit(__LINK_STATE_XOFF, &dev->tx_ring[ring].state);
+}
+
+static inline void netif_wake_tx_ring(struct net_device *dev, int ring)
+{
+	if (test_and_clear_bit(__LINK_STATE_XOFF, &dev->tx_ring[ring].state))
+		__netif_schedule(dev);
+}
+
+static inline void netif_stop_tx_ring(struct net_device *dev, int ring)
+{
+	set_bit(__LINK_STATE_XOFF, &dev->tx_ring[ring].state);
+}
+
+static inline int netif_tx_ring_stopped(struct net_device *dev, int ring)
+{
+	return test_bit(__LINK_STATE_XOFF, &dev->tx_ring[ring].state);
+}
+
+static inline int netif_select_tx_ring(struct net_device *dev,
+				       struct sk_buff *skb)
+{
+	if (dev->select_tx_ring)
+		return dev->select_tx_ring(dev, skb);
+	return smp_processor_id() % dev->tx_rings;
+}
+
+extern void netdev_init_tx_rings(struct net_device *dev,
+				 struct netdev_tx_ring *ring, int rings);
+
 static inline int netif_running(struct net_device *dev)
 {
 	return test_bit(__LINK_STATE_START, &dev->state);
@@ -772,14 +842,22 @@ static inline int netif_rx_reschedule(struct net_device *dev, int undo)
  * it completes the work. The device cannot be out of poll list at this
  * moment, it is BUG().
  */
+/* Same as netif_rx_complete, except that local interrupts are already
+ * off: lets a driver unmask its device in the same critical section.
+ */
+static inline void __netif_rx_complete(struct net_device *dev)
+{
+	if (!test_bit(__LINK_STATE_RX_SCHED, &dev->state)) BUG();
+	list_del(&dev->poll_list);
+	clear_bit(__LINK_STATE_RX_SCHED, &dev->state);
+}
+
 static inline void netif_rx_complete(struct net_device *dev)
 {
 	unsigned long flags;
 
 	local_irq_save(flags);
-	if (!test_bit(__LINK_STATE_RX_SCHED, &dev->state)) BUG();
-	list_del(&dev->poll_list);
-	clear_bit(__LINK_STATE_RX_SCHED, &dev->state);
+	__netif_rx_complete(dev);
 	local_irq_restore(flags);
 }
 
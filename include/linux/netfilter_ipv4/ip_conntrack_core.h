@@ -13,6 +13,8 @@ extern unsigned int ip_conntrack_in(unsigned int hooknum,
 
 extern int ip_conntrack_init(void);
 extern void ip_conntrack_cleanup(void);
+/* Rebuild the hash table with size buckets, keeping all conntracks */
+extern int ip_conntrack_resize(unsigned int size);
 
 struct ip_conntrack_protocol;
 extern struct ip_conntrack_protocol *ip_ct_find_proto(u_int8_t protocol);
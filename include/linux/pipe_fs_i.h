@@ -2,11 +2,31 @@
 #define _LINUX_PIPE_FS_I_H
 
 #define PIPEFS_MAGIC 0x50495045
+
+/*
+ * A pipe is a ring of page references.  Data written to the pipe lands
+ * in private pages, but splice() can also queue page cache pages, and
+ * tee() can make two pipes reference the same page.  The ring has a
+ * power of two slots, PIPE_DEF_BUFFERS unless changed by F_SETPIPE_SZ.
+ */
+#define PIPE_DEF_BUFFERS	16
+
+struct pipe_buffer {
+	struct page *page;
+	unsigned int offset;
+	unsigned int len;
+	unsigned int flags;
+};
+
+#define PIPE_BUF_FLAG_MERGE	0x01	/* private page, writes may append */
+
 struct pipe_inode_info {
 	wait_queue_head_t wait;
-	char *base;
-	unsigned int len;
-	unsigned int start;
+	unsigned int nrbufs;
+	unsigned int curbuf;
+	unsigned int buffers;
+	unsigned int reserved;	/* slots promised to splice() reads in progress */
+	struct pipe_buffer *bufs;
 	unsigned int readers;
 	unsigned int writers;
 	unsigned int waiting_readers;
@@ -15,15 +35,9 @@ struct pipe_inode_info {
 	unsigned int w_counter;
 };
 
-/* Differs from PIPE_BUF in that PIPE_SIZE is the length of the actual
-   memory allocation, whereas PIPE_BUF makes atomicity guarantees.  */
-#define PIPE_SIZE		PAGE_SIZE
-
 #define PIPE_SEM(inode)		(&(inode).i_sem)
 #define PIPE_WAIT(inode)	(&(inode).i_pipe->wait)
-#define PIPE_BASE(inode)	((inode).i_pipe->base)
-#define PIPE_START(inode)	((inode).i_pipe->start)
-#define PIPE_LEN(inode)		((inode).i_pipe->len)
+#define PIPE_NRBUFS(inode)	((inode).i_pipe->nrbufs)
 #define PIPE_READERS(inode)	((inode).i_pipe->readers)
 #define PIPE_WRITERS(inode)	((inode).i_pipe->writers)
 #define PIPE_WAITING_READERS(inode)	((inode).i_pipe->waiting_readers)
@@ -31,16 +45,27 @@ struct pipe_inode_info {
 #define PIPE_RCOUNTER(inode)	((inode).i_pipe->r_counter)
 #define PIPE_WCOUNTER(inode)	((inode).i_pipe->w_counter)
 
-#define PIPE_EMPTY(inode)	(PIPE_LEN(inode) == 0)
-#define PIPE_FULL(inode)	(PIPE_LEN(inode) == PIPE_SIZE)
-#define PIPE_FREE(inode)	(PIPE_SIZE - PIPE_LEN(inode))
-#define PIPE_END(inode)	((PIPE_START(inode) + PIPE_LEN(inode)) & (PIPE_SIZE-1))
-#define PIPE_MAX_RCHUNK(inode)	(PIPE_SIZE - PIPE_START(inode))
-#define PIPE_MAX_WCHUNK(inode)	(PIPE_SIZE - PIPE_END(inode))
+#define PIPE_EMPTY(inode)	(PIPE_NRBUFS(inode) == 0)
+#define PIPE_FULL(inode)	\
+	(PIPE_NRBUFS(inode) + (inode).i_pipe->reserved >= (inode).i_pipe->buffers)
+
+/* Slot of the n-th buffer from the read end */
+#define PIPE_BUF_SLOT(info, n)	(((info)->curbuf + (n)) & ((info)->buffers-1))
+
+/* splice() flags */
+#define SPLICE_F_MOVE		0x01	/* move pages if possible (a hint) */
+#define SPLICE_F_NONBLOCK	0x02	/* don't block on the pipe */
+#define SPLICE_F_MORE		0x04	/* more data will follow */
 
 /* Drop the inode semaphore and wait for a pipe event, atomically */
 void pipe_wait(struct inode * inode);
 
 struct inode* pipe_new(struct inode* inode);
+void free_pipe_info(struct inode* inode);
+void pipe_buf_consume(struct pipe_inode_info *info);
+
+/* fs.pipe-max-size: ring size (bytes) allowed without CAP_SYS_RESOURCE */
+extern int pipe_max_size;
+long pipe_fcntl(struct file *filp, unsigned int cmd, unsigned long arg);
 
 #endif
@@ -143,6 +143,21 @@ enum
 
 #define TCA_FW_MAX TCA_FW_POLICE
 
+/* IPv4 address hash filter */
+
+enum
+{
+	TCA_IPHASH_UNSPEC,
+	TCA_IPHASH_CLASSID,
+	TCA_IPHASH_KEY,
+	TCA_IPHASH_POLICE,
+};
+
+#define TCA_IPHASH_MAX TCA_IPHASH_POLICE
+
+#define TCA_IPHASH_KEY_DST	0
+#define TCA_IPHASH_KEY_SRC	1
+
 /* TC index filter */
 
 enum
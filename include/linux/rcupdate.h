@@ -0,0 +1,136 @@
+#ifndef __LINUX_RCUPDATE_H
+#define __LINUX_RCUPDATE_H
+
+/*
+ * Read-Copy Update.
+ *
+ * Readers walk shared data without taking any lock.  Writers unlink
+ * an object and hand it to call_rcu(), which frees it only after every
+ * CPU has passed through a quiescent state: a context switch, or a
+ * timer tick taken in user mode or in the idle loop.  Nobody can still
+ * be looking at the object by then, because a read-side section (between
+ * rcu_read_lock() and rcu_read_unlock()) may not sleep.
+ */
+
+#include <linux/config.h>
+#include <linux/list.h>
+#include <linux/threads.h>
+#include <linux/cache.h>
+#include <linux/spinlock.h>
+#include <asm/system.h>
+#include <asm/bitops.h>
+
+struct rcu_head {
+	struct list_head list;
+	void (*func)(void *arg);
+	void *arg;
+};
+
+#define RCU_HEAD_INIT(head) \
+		{ list: LIST_HEAD_INIT(head.list), func: NULL, arg: NULL }
+#define RCU_HEAD(head) struct rcu_head head = RCU_HEAD_INIT(head)
+#define INIT_RCU_HEAD(ptr) do { \
+	INIT_LIST_HEAD(&(ptr)->list); (ptr)->func = NULL; (ptr)->arg = NULL; \
+} while (0)
+
+/* Global grace period state, batches are numbered */
+struct rcu_ctrlblk {
+	spinlock_t	mutex;		/* guards the fields below */
+	long		curbatch;	/* batch waiting for quiescent states */
+	long		maxbatch;	/* highest batch anybody waits for */
+	unsigned long	rcu_cpu_mask;	/* CPUs yet to pass a quiescent state */
+};
+
+static inline int rcu_batch_before(long a, long b)
+{
+	return (a - b) < 0;
+}
+
+static inline int rcu_batch_after(long a, long b)
+{
+	return (a - b) > 0;
+}
+
+/* Per-CPU state */
+struct rcu_data {
+	long		qsctr;		/* quiescent states seen */
+	long		last_qsctr;	/* value of qsctr when batch started */
+	long		batch;		/* batch curlist belongs to */
+	struct list_head nxtlist;	/* callbacks waiting for a batch */
+	struct list_head curlist;	/* callbacks of batch "batch" */
+} ____cacheline_aligned_in_smp;
+
+extern struct rcu_ctrlblk rcu_ctrlblk;
+extern struct rcu_data rcu_data[NR_CPUS];
+
+#define RCU_qsctr(cpu)		(rcu_data[(cpu)].qsctr)
+#define RCU_last_qsctr(cpu)	(rcu_data[(cpu)].last_qsctr)
+#define RCU_batch(cpu)		(rcu_data[(cpu)].batch)
+#define RCU_nxtlist(cpu)	(rcu_data[(cpu)].nxtlist)
+#define RCU_curlist(cpu)	(rcu_data[(cpu)].curlist)
+
+#define RCU_QSCTR_INVALID	0
+
+/* Called by schedule(): a context switch is a quiescent state */
+static inline void rcu_qsctr_inc(int cpu)
+{
+	RCU_qsctr(cpu)++;
+}
+
+/* Does this CPU have RCU work for its tasklet? */
+static inline int rcu_pending(int cpu)
+{
+	if ((!list_empty(&RCU_curlist(cpu)) &&
+	     rcu_batch_before(RCU_batch(cpu), rcu_ctrlblk.curbatch)) ||
+	    (list_empty(&RCU_curlist(cpu)) &&
+	     !list_empty(&RCU_nxtlist(cpu))) ||
+	    test_bit(cpu, &rcu_ctrlblk.rcu_cpu_mask))
+		return 1;
+	return 0;
+}
+
+/*
+ * The kernel is not preemptible, so read-side sections cost nothing:
+ * they only document where the lockless walk is.
+ */
+#define rcu_read_lock()		do { } while (0)
+#define rcu_read_unlock()	do { } while (0)
+
+/*
+ * Only Alpha can reorder dependent loads; everywhere else a pointer
+ * that was published after smp_wmb() can just be followed.
+ */
+#ifdef CONFIG_ALPHA
+#define smp_read_barrier_depends()	smp_rmb()
+#else
+#define smp_read_barrier_depends()	do { } while (0)
+#endif
+
+/*
+ * Publish an initialized entry to lockless readers.  Writers still
+ * serialize against each other with their own lock.
+ */
+static inline void list_add_rcu(struct list_head *new, struct list_head *head)
+{
+	new->next = head->next;
+	new->prev = head;
+	smp_wmb();
+	head->next->prev = new;
+	head->next = new;
+}
+
+/*
+ * Unlink an entry but leave its next pointer alone, so that a reader
+ * standing on it can still walk on.
+ */
+static inline void list_del_rcu(struct list_head *entry)
+{
+	__list_del(entry->prev, entry->next);
+}
+
+extern void rcu_init(void);
+extern void rcu_check_callbacks(int cpu, int user);
+extern void call_rcu(struct rcu_head *head, void (*func)(void *arg), void *arg);
+extern void synchronize_kernel(void);
+
+#endif /* __LINUX_RCUPDATE_H */
@@ -0,0 +1,91 @@
+#ifndef _LINUX_RMAP_H
+#define _LINUX_RMAP_H
+/*
+ * Reverse mapping from a struct page to the ptes that map it.
+ *
+ * page->pte holds either the single pte mapping the page (PG_direct)
+ * or a chain of them.  It is protected by the PG_chainlock bit, which
+ * nests inside mm->page_table_lock.
+ */
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/mm.h>
+#include <asm/pgalloc.h>
+
+static inline void pte_chain_lock(struct page *page)
+{
+#ifdef CONFIG_SMP
+	while (test_and_set_bit(PG_chainlock, &page->flags)) {
+		while (test_bit(PG_chainlock, &page->flags))
+			cpu_relax();
+	}
+#endif
+}
+
+static inline void pte_chain_unlock(struct page *page)
+{
+#ifdef CONFIG_SMP
+	smp_mb__before_clear_bit();
+	clear_bit(PG_chainlock, &page->flags);
+#endif
+}
+
+/*
+ * Each page table page records the mm it belongs to and the virtual
+ * address it starts at, so a pte pointer is enough to find both.
+ * Architectures whose page tables are not whole pages provide their
+ * own versions in <asm/pgalloc.h>.
+ */
+#ifndef __HAVE_ARCH_PGTABLE_RMAP
+static inline void pgtable_add_rmap(pte_t *ptep, struct mm_struct *mm,
+				    unsigned long address)
+{
+	struct page *page = virt_to_page(ptep);
+
+	page->mapping = (void *) mm;
+	page->index = address & ~((PTRS_PER_PTE * PAGE_SIZE) - 1);
+}
+
+static inline void pgtable_remove_rmap(pte_t *ptep)
+{
+	struct page *page = virt_to_page(ptep);
+
+	page->mapping = NULL;
+	page->index = 0;
+}
+
+static inline struct mm_struct *ptep_to_mm(pte_t *ptep)
+{
+	struct page *page = virt_to_page(ptep);
+
+	return (struct mm_struct *) page->mapping;
+}
+
+static inline unsigned long ptep_to_address(pte_t *ptep)
+{
+	struct page *page = virt_to_page(ptep);
+	unsigned long idx;
+
+	idx = ((unsigned long) ptep & ~PAGE_MASK) / sizeof(pte_t);
+	return page->index + (idx << PAGE_SHIFT);
+}
+#endif /* __HAVE_ARCH_PGTABLE_RMAP */
+
+/* Return values of try_to_unmap() */
+#define SWAP_SUCCESS	0
+#define SWAP_AGAIN	1
+#define SWAP_FAIL	2
+
+/* mm/rmap.c */
+struct pte_chain;
+extern int pte_chain_reserve(struct pte_chain **, int);
+extern void pte_chain_release(struct pte_chain *);
+extern void FASTCALL(page_add_rmap(struct page *, pte_t *, struct pte_chain **));
+extern void FASTCALL(page_remove_rmap(struct page *, pte_t *));
+extern void FASTCALL(page_move_rmap(struct page *, pte_t *, pte_t *));
+extern int FASTCALL(page_referenced(struct page *));
+extern int FASTCALL(try_to_unmap(struct page *));
+
+#endif /* __KERNEL__ */
+#endif /* _LINUX_RMAP_H */
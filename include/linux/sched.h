@@ -73,7 +73,7 @@ extern unsigned long avenrun[];		/* Load averages */
 #define CT_TO_SECS(x)	((x) / HZ)
 #define CT_TO_USECS(x)	(((x) % HZ) * 1000000/HZ)
 
-extern int nr_running, nr_threads;
+extern int nr_threads;
 extern int last_pid;
 
 #include <linux/fs.h>
@@ -125,6 +125,15 @@ extern int last_pid;
  */
 #define SCHED_YIELD		0x10
 
+/*
+ * Priority of a process goes from 0..MAX_PRIO-1, valid RT
+ * priority is 0..MAX_RT_PRIO-1, and SCHED_OTHER tasks are
+ * in the range MAX_RT_PRIO..MAX_PRIO-1. Lower values mean
+ * higher priority. The idle threads run at MAX_PRIO.
+ */
+#define MAX_RT_PRIO		100
+#define MAX_PRIO		(MAX_RT_PRIO + 40)
+
 struct sched_param {
 	int sched_priority;
 };
@@ -135,18 +144,13 @@ struct completion;
 
 #include <linux/spinlock.h>
 
-/*
- * This serializes "schedule()" and also protects
- * the run-queue from deletions/modifications (but
- * _adding_ to the beginning of the run-queue has
- * a separate lock).
- */
 extern rwlock_t tasklist_lock;
-extern spinlock_t runqueue_lock;
 extern spinlock_t mmlist_lock;
 
 extern void sched_init(void);
 extern void init_idle(void);
+extern void scheduler_tick(void);
+extern unsigned long nr_running(void);
 extern void show_state(void);
 extern void cpu_init (void);
 extern void trap_init(void);
@@ -229,7 +233,6 @@ struct mm_struct {
 	unsigned long rss, total_vm, locked_vm;
 	unsigned long def_flags;
 	unsigned long cpu_vm_mask;
-	unsigned long swap_address;
 
 	unsigned dumpable:1;
 
@@ -284,6 +287,8 @@ struct user_struct {
 extern struct user_struct root_user;
 #define INIT_USER (&root_user)
 
+typedef struct prio_array prio_array_t;
+
 struct task_struct {
 	/*
 	 * offsets of these are hardcoded elsewhere - touch with care
@@ -303,14 +308,15 @@ struct task_struct {
 
 /*
  * offset 32 begins here on 32-bit platforms. We keep
- * all fields in a single cacheline that are needed for
- * the goodness() loop in schedule().
+ * the fields schedule() and the timer tick look at
+ * close together.
  */
-	long counter;
+	long counter;		/* ticks left of the current timeslice */
 	long nice;
 	unsigned long policy;
 	struct mm_struct *mm;
 	int processor;
+	int prio;		/* priority the task is queued with */
 	/*
 	 * cpus_runnable is ~0 if the process is not running on any
 	 * CPU. It's (1 << cpu) if it's running on a CPU. This mask
@@ -321,11 +327,14 @@ struct task_struct {
 	 */
 	unsigned long cpus_runnable, cpus_allowed;
 	/*
-	 * (only the 'next' pointer fits into the cacheline, but
-	 * that's just fine.)
+	 * run_list links the task into its priority queue in
+	 * 'array', which is NULL while the task is not runnable.
+	 * sleep_time is the jiffies value when the task last went
+	 * off a CPU, sleep_avg its interactivity credit in ticks.
 	 */
 	struct list_head run_list;
-	unsigned long sleep_time;
+	prio_array_t *array;
+	unsigned long sleep_time, sleep_avg;
 
 	struct task_struct *next_task, *prev_task;
 	struct mm_struct *active_mm;
@@ -459,6 +468,7 @@ struct task_struct {
 #define DEF_NICE	(0)
 
 extern void yield(void);
+extern void set_user_nice(struct task_struct *p, long nice);
 
 /*
  * The default (Linux) execution domain.
@@ -480,6 +490,7 @@ extern struct exec_domain	default_exec_domain;
     counter:		DEF_COUNTER,					\
     nice:		DEF_NICE,					\
     policy:		SCHED_OTHER,					\
+    prio:		MAX_PRIO-20,					\
     mm:			NULL,						\
     active_mm:		&init_mm,					\
     cpus_runnable:	-1,						\
@@ -600,6 +611,7 @@ extern void FASTCALL(interruptible_sleep_on(wait_queue_head_t *q));
 extern long FASTCALL(interruptible_sleep_on_timeout(wait_queue_head_t *q,
 						    signed long timeout));
 extern int FASTCALL(wake_up_process(struct task_struct * tsk));
+extern void FASTCALL(wake_up_forked_process(struct task_struct * tsk));
 
 #define wake_up(x)			__wake_up((x),TASK_UNINTERRUPTIBLE | TASK_INTERRUPTIBLE, 1)
 #define wake_up_nr(x, nr)		__wake_up((x),TASK_UNINTERRUPTIBLE | TASK_INTERRUPTIBLE, nr)
@@ -888,17 +900,11 @@ do {									\
 
 #define thread_group_leader(p)	(p->pid == p->tgid)
 
-static inline void del_from_runqueue(struct task_struct * p)
-{
-	nr_running--;
-	p->sleep_time = jiffies;
-	list_del(&p->run_list);
-	p->run_list.next = NULL;
-}
+extern void del_from_runqueue(struct task_struct * p);
 
 static inline int task_on_runqueue(struct task_struct *p)
 {
-	return (p->run_list.next != NULL);
+	return (p->array != NULL);
 }
 
 static inline void unhash_process(struct task_struct *p)
@@ -39,6 +39,9 @@ struct shmid_ds {
 #define SHM_R		0400	/* or S_IRUGO from <linux/stat.h> */
 #define SHM_W		0200	/* or S_IWUGO from <linux/stat.h> */
 
+/* segment flag for shmget */
+#define SHM_HUGETLB	04000	/* back the segment with huge TLB pages */
+
 /* mode for attach */
 #define	SHM_RDONLY	010000	/* read-only access */
 #define	SHM_RND		020000	/* round attach address to SHMLBA boundary */
@@ -122,6 +122,8 @@ struct skb_frag_struct
 struct skb_shared_info {
 	atomic_t	dataref;
 	unsigned int	nr_frags;
+	unsigned short	tso_size;	/* TCP segment size, 0 if not TSO */
+	unsigned short	tso_segs;	/* Number of segments to cut */
 	struct sk_buff	*frag_list;
 	skb_frag_t	frags[MAX_SKB_FRAGS];
 };
@@ -127,6 +127,8 @@ enum {
 #define TCP_WINDOW_CLAMP	10	/* Bound advertised window */
 #define TCP_INFO		11	/* Information about this connection. */
 #define TCP_QUICKACK		12	/* Block/reenable quick acks */
+#define TCP_ZEROCOPY_RECV	13	/* Map received pages instead of copying */
+#define TCP_ZEROCOPY_INFO	14	/* Bytes mapped vs. copied by recvmsg */
 
 #define TCPI_OPT_TIMESTAMPS	1
 #define TCPI_OPT_SACK		2
@@ -185,4 +187,10 @@ struct tcp_info
 	__u32	tcpi_reordering;
 };
 
+struct tcp_zerocopy_info
+{
+	__u64	tcpzi_flipped;		/* Received bytes mapped into user space */
+	__u64	tcpzi_copied;		/* Received bytes copied */
+};
+
 #endif	/* _LINUX_TCP_H */
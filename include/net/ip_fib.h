@@ -116,6 +116,7 @@ struct fib_result
 struct fib_table
 {
 	unsigned char	tb_id;
+	unsigned char	tb_private;	/* not used for routing: no netlink messages */
 	unsigned	tb_stamp;
 	int		(*tb_lookup)(struct fib_table *tb, const struct rt_key *key, struct fib_result *res);
 	int		(*tb_insert)(struct fib_table *table, struct rtmsg *r,
@@ -224,8 +225,17 @@ extern int fib_convert_rtentry(int cmd, struct nlmsghdr *nl, struct rtmsg *rtm,
 extern void fib_node_get_info(int type, int dead, struct fib_info *fi, u32 prefix, u32 mask, char *buffer);
 extern u32  __fib_res_prefsrc(struct fib_result *res);
 
-/* Exported by fib_hash.c */
+/* Exported by fib_hash.c and fib_trie.c */
 extern struct fib_table *fib_hash_init(int id);
+extern struct fib_table *fib_trie_init(int id);
+extern void fib_hash_free(struct fib_table *tb);
+
+/* The lookup engine chosen at build time */
+#ifdef CONFIG_IP_FIB_TRIE
+#define fib_new_engine_table(id)	fib_trie_init(id)
+#else
+#define fib_new_engine_table(id)	fib_hash_init(id)
+#endif
 
 #ifdef CONFIG_IP_MULTIPLE_TABLES
 /* Exported by fib_rules.c */
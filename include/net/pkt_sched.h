@@ -79,6 +79,7 @@ struct Qdisc
 #define TCQ_F_BUILTIN	1
 #define TCQ_F_THROTTLED	2
 #define TCQ_F_INGRES	4
+#define TCQ_F_CAN_BYPASS 8	/* may be skipped while empty (qdisc_bypass) */
 	struct Qdisc_ops	*ops;
 	struct Qdisc		*next;
 	u32			handle;
@@ -433,6 +434,7 @@ int tc_filter_init(void);
 int pktsched_init(void);
 
 extern int qdisc_restart(struct net_device *dev);
+extern int qdisc_bypass(struct net_device *dev, struct sk_buff *skb);
 
 static inline void qdisc_run(struct net_device *dev)
 {
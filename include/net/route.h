@@ -114,6 +114,10 @@ struct rt_cache_stat
         unsigned int gc_ignored;
         unsigned int gc_goal_miss;
         unsigned int gc_dst_overflow;
+        unsigned int hash_insert;	/* new entries */
+        unsigned int hash_search;	/* entries passed over inserting them */
+        unsigned int gc_evict;		/* dropped from a full chain */
+        unsigned int gc_scanned;	/* buckets swept by rt_garbage_collect */
 } ____cacheline_aligned_in_smp;
 
 extern struct ip_rt_acct *ip_rt_acct;
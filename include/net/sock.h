@@ -289,6 +289,11 @@ struct tcp_opt {
 		int			len;
 	} ucopy;
 
+	/* Receive page flipping (TCP_ZEROCOPY_RECV) */
+	int	zc_recv;
+	__u64	zc_flipped;	/* Bytes mapped into user space		*/
+	__u64	zc_copied;	/* Bytes copied by recvmsg		*/
+
 	__u32	snd_wl1;	/* Sequence for window update		*/
 	__u32	snd_wnd;	/* The window we expect to receive	*/
 	__u32	max_window;	/* Maximal window ever seen from peer	*/
@@ -296,6 +301,7 @@ struct tcp_opt {
 	__u16	mss_cache;	/* Cached effective mss, not including SACKS */
 	__u16	mss_clamp;	/* Maximal mss, negotiated at connection setup */
 	__u16	ext_header_len;	/* Network protocol overhead (IP/IPv6 options) */
+	__u16	mss_cache_tso;	/* Large send size on a TSO capable route */
 	__u8	ca_state;	/* State of fast-retransmit machine 	*/
 	__u8	retransmits;	/* Number of unrecovered RTO timeouts.	*/
 
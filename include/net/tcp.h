@@ -283,6 +283,9 @@ static __inline__ int tcp_sk_listen_hashfn(struct sock *sk)
 /* Maximal number of ACKs sent quickly to accelerate slow-start. */
 #define TCP_MAX_QUICKACKS	16U
 
+/* A TSO frame may carry at most this fraction of the congestion window. */
+#define TCP_TSO_WIN_DIVISOR	4
+
 /* urg_data states */
 #define TCP_URG_VALID	0x0100
 #define TCP_URG_NOTYET	0x0200
@@ -815,6 +818,9 @@ extern void tcp_clear_xmit_timers(struct sock *);
 extern void tcp_delete_keepalive_timer (struct sock *);
 extern void tcp_reset_keepalive_timer (struct sock *, unsigned long);
 extern int tcp_sync_mss(struct sock *sk, u32 pmtu);
+extern unsigned int tcp_sync_tso_mss(struct sock *sk);
+extern int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len);
+extern struct sk_buff *tcp_tso_segment(struct sk_buff *skb);
 
 extern const char timer_bug_msg[];
 
@@ -893,23 +899,46 @@ static inline void tcp_reset_xmit_timer(struct sock *sk, int what, unsigned long
 
 /* Compute the current effective MSS, taking SACKs and IP options,
  * and even PMTU discovery events into account.
+ *
+ * With large set the caller may build segments of up to
+ * tp->mss_cache_tso bytes, for the device to cut down to mss_cache.
+ * That size follows the send and congestion windows, so it is
+ * recomputed on every call.  Urgent data and SACK options are never
+ * sent that way.
  */
 
-static __inline__ unsigned int tcp_current_mss(struct sock *sk)
+static __inline__ unsigned int tcp_current_mss(struct sock *sk, int large)
 {
 	struct tcp_opt *tp = &sk->tp_pinfo.af_tcp;
 	struct dst_entry *dst = __sk_dst_get(sk);
-	int mss_now = tp->mss_cache; 
+	int mss_now;
 
 	if (dst && dst->pmtu != tp->pmtu_cookie)
-		mss_now = tcp_sync_mss(sk, dst->pmtu);
+		tcp_sync_mss(sk, dst->pmtu);
+
+	if (large && (sk->route_caps & NETIF_F_TSO) &&
+	    !tp->urg_mode && !tp->eff_sacks)
+		return tcp_sync_tso_mss(sk);
 
+	mss_now = tp->mss_cache;
 	if (tp->eff_sacks)
 		mss_now -= (TCPOLEN_SACK_BASE_ALIGNED +
 			    (tp->eff_sacks * TCPOLEN_SACK_PERBLOCK));
 	return mss_now;
 }
 
+/* Sockets only send TSO frames on a route whose device can also do
+ * the scatter-gather and checksumming that large segments are built on.
+ */
+static inline void tcp_v4_setup_caps(struct sock *sk, struct dst_entry *dst)
+{
+	sk->route_caps = dst->dev->features;
+	if ((sk->route_caps & NETIF_F_TSO) &&
+	    (!(sk->route_caps & NETIF_F_SG) ||
+	     !(sk->route_caps & (NETIF_F_IP_CSUM|NETIF_F_NO_CSUM|NETIF_F_HW_CSUM))))
+		sk->route_caps &= ~NETIF_F_TSO;
+}
+
 /* Initialize RCV_MSS value.
  * RCV_MSS is an our guess about MSS used by the peer.
  * We haven't any direct information about the MSS.
@@ -981,8 +1010,8 @@ extern u32	__tcp_select_window(struct sock *sk);
 /* This is what the send packet queueing engine uses to pass
  * TCP per-packet control information to the transmission
  * code.  We also store the host-order sequence numbers in
- * here too.  This is 36 bytes on 32-bit architectures,
- * 40 bytes on 64-bit machines, if this grows please adjust
+ * here too.  This is 40 bytes on 32-bit architectures,
+ * 44 bytes on 64-bit machines, if this grows please adjust
  * skbuff.h:skbuff->cb[xxx] size appropriately.
  */
 struct tcp_skb_cb {
@@ -1024,10 +1053,30 @@ struct tcp_skb_cb {
 
 	__u16		urg_ptr;	/* Valid w/URG flags is set.	*/
 	__u32		ack_seq;	/* Sequence number ACK'd	*/
+	__u16		tso_factor;	/* Segments the device makes of it */
 };
 
 #define TCP_SKB_CB(__skb)	((struct tcp_skb_cb *)&((__skb)->cb[0]))
 
+/* A TSO frame leaves as several mss sized segments, and packets_out,
+ * sacked_out, lost_out, retrans_out and fackets_out count those
+ * segments, not skbs.  The factor is fixed when the skb is first sent
+ * and only changes when tcp_fragment splits it.
+ */
+static inline int tcp_skb_pcount(struct sk_buff *skb)
+{
+	return TCP_SKB_CB(skb)->tso_factor;
+}
+
+static inline void tcp_set_skb_tso_factor(struct sk_buff *skb,
+					  unsigned int mss_std)
+{
+	if (skb->len <= mss_std)
+		TCP_SKB_CB(skb)->tso_factor = 1;
+	else
+		TCP_SKB_CB(skb)->tso_factor = (skb->len + mss_std - 1) / mss_std;
+}
+
 #define for_retrans_queue(skb, sk, tp) \
 		for (skb = (sk)->write_queue.next;			\
 		     (skb != (tp)->send_head) &&			\
@@ -1191,6 +1240,10 @@ tcp_nagle_check(struct tcp_opt *tp, struct sk_buff *skb, unsigned mss_now, int n
 static __inline__ int tcp_snd_test(struct tcp_opt *tp, struct sk_buff *skb,
 				   unsigned cur_mss, int nonagle)
 {
+	unsigned int nagle_mss = min_t(unsigned int, cur_mss, tp->mss_cache);
+	unsigned int len = min_t(unsigned int, skb->len, cur_mss);
+	unsigned int pkts = 1;
+
 	/*	RFC 1122 - section 4.2.3.4
 	 *
 	 *	We must queue if
@@ -1210,14 +1263,21 @@ static __inline__ int tcp_snd_test(struct tcp_opt *tp, struct sk_buff *skb,
 	 *	sit in the middle of queue (they have no chances
 	 *	to get new data) and if room at tail of skb is
 	 *	not enough to save something seriously (<32 for now).
+	 *
+	 *	A TSO frame is small only if it is below one real mss,
+	 *	and it takes as much of the congestion window as the
+	 *	segments of it which go out now: the callers cut it down
+	 *	to cur_mss first.
 	 */
+	if (len > tp->mss_cache)
+		pkts = (len + tp->mss_cache - 1) / tp->mss_cache;
 
 	/* Don't be strict about the congestion window for the
 	 * final FIN frame.  -DaveM
 	 */
 	return ((nonagle==1 || tp->urg_mode
-		 || !tcp_nagle_check(tp, skb, cur_mss, nonagle)) &&
-		((tcp_packets_in_flight(tp) < tp->snd_cwnd) ||
+		 || !tcp_nagle_check(tp, skb, nagle_mss, nonagle)) &&
+		((tcp_packets_in_flight(tp) + pkts <= tp->snd_cwnd) ||
 		 (TCP_SKB_CB(skb)->flags & TCPCB_FLAG_FIN)) &&
 		!after(TCP_SKB_CB(skb)->end_seq, tp->snd_una + tp->snd_wnd));
 }
@@ -1257,7 +1317,7 @@ static __inline__ void __tcp_push_pending_frames(struct sock *sk,
 static __inline__ void tcp_push_pending_frames(struct sock *sk,
 					       struct tcp_opt *tp)
 {
-	__tcp_push_pending_frames(sk, tp, tcp_current_mss(sk), tp->nonagle);
+	__tcp_push_pending_frames(sk, tp, tcp_current_mss(sk, 1), tp->nonagle);
 }
 
 static __inline__ int tcp_may_send_now(struct sock *sk, struct tcp_opt *tp)
@@ -1265,7 +1325,7 @@ static __inline__ int tcp_may_send_now(struct sock *sk, struct tcp_opt *tp)
 	struct sk_buff *skb = tp->send_head;
 
 	return (skb &&
-		tcp_snd_test(tp, skb, tcp_current_mss(sk),
+		tcp_snd_test(tp, skb, tcp_current_mss(sk, 1),
 			     tcp_skb_is_last(sk, skb) ? 1 : tp->nonagle));
 }
 
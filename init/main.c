@@ -93,6 +93,7 @@ extern void sbus_init(void);
 extern void ppc_init(void);
 extern void sysctl_init(void);
 extern void signals_init(void);
+extern void pte_chain_init(void);
 extern int init_pcmcia_ds(void);
 
 extern void free_initmem(void);
@@ -115,6 +116,7 @@ extern void ipc_init(void);
 
 extern void time_init(void);
 extern void softirq_init(void);
+extern void rcu_init(void);
 
 int rows, cols;
 
@@ -362,6 +364,7 @@ asmlinkage void __init start_kernel(void)
 	init_IRQ();
 	sched_init();
 	softirq_init();
+	rcu_init();
 	time_init();
 
 	/*
@@ -397,6 +400,7 @@ asmlinkage void __init start_kernel(void)
 	mem_init();
 	kmem_cache_sizes_init();
 	pgtable_cache_init();
+	pte_chain_init();
 
 	/*
 	 * For architectures that have highmem, num_mappedpages represents
@@ -0,0 +1,388 @@
+/*
+ *  linux/kernel/futex.c
+ *
+ *  Fast userspace mutexes.
+ *
+ *  A futex is an aligned int in user memory.  Userspace does the
+ *  uncontended lock and unlock with atomic instructions on it and only
+ *  calls in here to sleep until the value changes (FUTEX_WAIT) or to
+ *  wake the sleepers after changing it (FUTEX_WAKE).  FUTEX_REQUEUE
+ *  wakes some sleepers and moves the rest to another futex without
+ *  waking them, which lets a condition variable broadcast avoid a
+ *  thundering herd on the associated mutex.
+ *
+ *  Sleepers are kept in a hash of wait queues, keyed on what the user
+ *  address refers to rather than on the address itself:
+ *	- private mappings: (mm, virtual address), so threads sharing
+ *	  the mm find each other;
+ *	- shared mappings: (inode, page index), so processes that map
+ *	  the same file or shm segment at different addresses do too.
+ *  The key holds a reference on the mm or inode while queued.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/time.h>
+#include <linux/futex.h>
+#include <asm/uaccess.h>
+
+#define FUTEX_HASHBITS 8
+
+/*
+ * The low bit of the offset tells the two kinds apart, so that a
+ * private key can never match a shared one.
+ */
+union futex_key {
+	struct {
+		unsigned long pgoff;
+		struct inode *inode;
+		int offset;
+	} shared;
+	struct {
+		unsigned long uaddr;
+		struct mm_struct *mm;
+		int offset;
+	} private;
+	struct {
+		unsigned long word;
+		void *ptr;
+		int offset;
+	} both;
+};
+
+struct futex_hash_bucket {
+	spinlock_t lock;
+	struct list_head chain;
+} ____cacheline_aligned_in_smp;
+
+/* One of these for each task sleeping in FUTEX_WAIT */
+struct futex_q {
+	struct list_head list;		/* hash chain, empty once woken */
+	wait_queue_head_t waiters;
+	union futex_key key;
+
+	/* the bucket we are on, changes under both bucket locks on requeue */
+	struct futex_hash_bucket *bh;
+};
+
+static struct futex_hash_bucket futex_queues[1 << FUTEX_HASHBITS];
+
+static inline struct futex_hash_bucket *hash_futex(union futex_key *key)
+{
+	u32 h = key->both.word + (unsigned long) key->both.ptr +
+		key->both.offset;
+
+	/* multiplicative hashing, 0x9e370001 is a prime near 2^32/phi */
+	h *= 0x9e370001UL;
+	return &futex_queues[h >> (32 - FUTEX_HASHBITS)];
+}
+
+static inline int match_futex(union futex_key *key1, union futex_key *key2)
+{
+	return key1->both.word == key2->both.word &&
+	       key1->both.ptr == key2->both.ptr &&
+	       key1->both.offset == key2->both.offset;
+}
+
+/*
+ * Work out the key for a user address.  Called with mm->mmap_sem held
+ * for reading; takes a reference on the mm or inode, dropped again by
+ * drop_key_refs().
+ */
+static int get_futex_key(unsigned long uaddr, union futex_key *key)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	unsigned long offset = uaddr % PAGE_SIZE;
+
+	if (offset % sizeof(u32))
+		return -EINVAL;
+
+	vma = find_vma(mm, uaddr);
+	if (!vma || uaddr < vma->vm_start)
+		return -EFAULT;
+	if (!(vma->vm_flags & VM_READ))
+		return -EFAULT;
+
+	if (!(vma->vm_flags & VM_SHARED) || !vma->vm_file) {
+		key->private.mm = mm;
+		key->private.uaddr = uaddr - offset;
+		key->private.offset = offset;
+		atomic_inc(&mm->mm_count);
+		return 0;
+	}
+
+	key->shared.inode = vma->vm_file->f_dentry->d_inode;
+	key->shared.pgoff = vma->vm_pgoff +
+			    ((uaddr - vma->vm_start) >> PAGE_SHIFT);
+	key->shared.offset = offset + 1;
+	atomic_inc(&key->shared.inode->i_count);
+	return 0;
+}
+
+static inline void get_key_refs(union futex_key *key)
+{
+	if (key->both.offset & 1)
+		atomic_inc(&key->shared.inode->i_count);
+	else
+		atomic_inc(&key->private.mm->mm_count);
+}
+
+/* May sleep: never call it with a bucket lock held */
+static void drop_key_refs(union futex_key *key)
+{
+	if (key->both.offset & 1)
+		iput(key->shared.inode);
+	else
+		mmdrop(key->private.mm);
+}
+
+static int futex_get_key(unsigned long uaddr, union futex_key *key)
+{
+	struct mm_struct *mm = current->mm;
+	int ret;
+
+	down_read(&mm->mmap_sem);
+	ret = get_futex_key(uaddr, key);
+	up_read(&mm->mmap_sem);
+	return ret;
+}
+
+/* Lock the bucket a waiter is on; it can move under us while requeued */
+static struct futex_hash_bucket *lock_futex_q(struct futex_q *q)
+{
+	struct futex_hash_bucket *bh;
+
+	for (;;) {
+		bh = q->bh;
+		spin_lock(&bh->lock);
+		if (likely(bh == q->bh))
+			return bh;
+		spin_unlock(&bh->lock);
+	}
+}
+
+static void queue_me(struct futex_q *q)
+{
+	struct futex_hash_bucket *bh = hash_futex(&q->key);
+
+	init_waitqueue_head(&q->waiters);
+	q->bh = bh;
+	spin_lock(&bh->lock);
+	list_add_tail(&q->list, &bh->chain);
+	spin_unlock(&bh->lock);
+}
+
+/* Returns 1 if we were still queued, 0 if somebody woke us */
+static int unqueue_me(struct futex_q *q)
+{
+	struct futex_hash_bucket *bh;
+	int ret = 0;
+
+	bh = lock_futex_q(q);
+	if (!list_empty(&q->list)) {
+		list_del(&q->list);
+		ret = 1;
+	}
+	spin_unlock(&bh->lock);
+
+	drop_key_refs(&q->key);
+	return ret;
+}
+
+/* Wake up to nr_wake waiters on the futex at uaddr */
+static int futex_wake(unsigned long uaddr, int nr_wake)
+{
+	union futex_key key;
+	struct futex_hash_bucket *bh;
+	struct list_head *i, *next;
+	struct futex_q *this;
+	int ret;
+
+	ret = futex_get_key(uaddr, &key);
+	if (ret)
+		return ret;
+
+	bh = hash_futex(&key);
+	spin_lock(&bh->lock);
+	list_for_each_safe(i, next, &bh->chain) {
+		if (ret >= nr_wake)
+			break;
+		this = list_entry(i, struct futex_q, list);
+		if (!match_futex(&this->key, &key))
+			continue;
+		list_del_init(&this->list);
+		wake_up_all(&this->waiters);
+		ret++;
+	}
+	spin_unlock(&bh->lock);
+
+	drop_key_refs(&key);
+	return ret;
+}
+
+/*
+ * Wake up to nr_wake waiters on uaddr1 and move up to nr_requeue of the
+ * others over to uaddr2.
+ */
+static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
+			 int nr_wake, int nr_requeue)
+{
+	union futex_key key1, key2;
+	struct futex_hash_bucket *bh1, *bh2;
+	struct list_head *i, *next;
+	struct futex_q *this;
+	int ret, n, nr_woken = 0, nr_moved = 0;
+
+	ret = futex_get_key(uaddr1, &key1);
+	if (ret)
+		return ret;
+	ret = futex_get_key(uaddr2, &key2);
+	if (ret) {
+		drop_key_refs(&key1);
+		return ret;
+	}
+
+	bh1 = hash_futex(&key1);
+	bh2 = hash_futex(&key2);
+
+	/* Lock both buckets in address order */
+	if (bh1 < bh2) {
+		spin_lock(&bh1->lock);
+		spin_lock(&bh2->lock);
+	} else {
+		spin_lock(&bh2->lock);
+		if (bh1 != bh2)
+			spin_lock(&bh1->lock);
+	}
+
+	list_for_each_safe(i, next, &bh1->chain) {
+		this = list_entry(i, struct futex_q, list);
+		if (!match_futex(&this->key, &key1))
+			continue;
+		if (nr_woken < nr_wake) {
+			list_del_init(&this->list);
+			wake_up_all(&this->waiters);
+			nr_woken++;
+			continue;
+		}
+		if (nr_moved >= nr_requeue)
+			break;
+		/*
+		 * The waiter's reference moves from key1 to key2; the one
+		 * on key1 is dropped once the locks are released.
+		 */
+		list_del(&this->list);
+		list_add_tail(&this->list, &bh2->chain);
+		this->bh = bh2;
+		this->key = key2;
+		get_key_refs(&key2);
+		nr_moved++;
+	}
+
+	spin_unlock(&bh1->lock);
+	if (bh1 != bh2)
+		spin_unlock(&bh2->lock);
+
+	for (n = 0; n < nr_moved; n++)
+		drop_key_refs(&key1);
+	drop_key_refs(&key1);
+	drop_key_refs(&key2);
+	return nr_woken + nr_moved;
+}
+
+/*
+ * Sleep until woken through the futex at uaddr, provided it still
+ * holds val.  We queue ourselves before looking at the value, so a
+ * waker that changes it after our check is sure to find us.  Only a
+ * futex wakeup, the timeout or a signal ends the sleep; any other
+ * wakeup just puts us back to sleep.
+ */
+static int futex_wait(unsigned long uaddr, int val, long timeout)
+{
+	DECLARE_WAITQUEUE(wait, current);
+	struct futex_q q;
+	int ret, curval;
+
+	ret = futex_get_key(uaddr, &q.key);
+	if (ret)
+		return ret;
+	queue_me(&q);
+
+	if (get_user(curval, (int *) uaddr)) {
+		ret = -EFAULT;
+		goto out_unqueue;
+	}
+	if (curval != val) {
+		ret = -EWOULDBLOCK;
+		goto out_unqueue;
+	}
+
+	add_wait_queue(&q.waiters, &wait);
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (list_empty(&q.list) || !timeout || signal_pending(current))
+			break;
+		timeout = schedule_timeout(timeout);
+	}
+	set_current_state(TASK_RUNNING);
+	remove_wait_queue(&q.waiters, &wait);
+
+	/* Woken up by futex_wake() or futex_requeue()? */
+	if (!unqueue_me(&q))
+		return 0;
+	if (!timeout)
+		return -ETIMEDOUT;
+	return -EINTR;
+
+out_unqueue:
+	/* A wakeup that raced with us is handed on as a spurious one */
+	if (!unqueue_me(&q))
+		ret = 0;
+	return ret;
+}
+
+asmlinkage long sys_futex(u32 *uaddr, int op, int val,
+			  struct timespec *utime, u32 *uaddr2)
+{
+	unsigned long pos = (unsigned long) uaddr;
+	long timeout = MAX_SCHEDULE_TIMEOUT;
+	struct timespec t;
+
+	switch (op) {
+	case FUTEX_WAIT:
+		if (utime) {
+			if (copy_from_user(&t, utime, sizeof(t)))
+				return -EFAULT;
+			if (t.tv_sec < 0 || t.tv_nsec < 0 || t.tv_nsec >= 1000000000L)
+				return -EINVAL;
+			timeout = timespec_to_jiffies(&t) + 1;
+		}
+		return futex_wait(pos, val, timeout);
+	case FUTEX_WAKE:
+		return futex_wake(pos, val);
+	case FUTEX_REQUEUE:
+		/* the number of waiters to requeue comes in the utime slot */
+		return futex_requeue(pos, (unsigned long) uaddr2, val,
+				     (int) (long) utime);
+	}
+	return -ENOSYS;
+}
+
+static int __init init_futex(void)
+{
+	int i;
+
+	for (i = 0; i < (1 << FUTEX_HASHBITS); i++) {
+		INIT_LIST_HEAD(&futex_queues[i].chain);
+		spin_lock_init(&futex_queues[i].lock);
+	}
+	return 0;
+}
+
+__initcall(init_futex);
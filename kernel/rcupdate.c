@@ -0,0 +1,208 @@
+/*
+ * linux/kernel/rcupdate.c
+ *
+ * Read-Copy Update: grace period detection and callback batching.
+ *
+ * Callbacks queued by call_rcu() go on the CPU's nxtlist.  When the
+ * CPU starts a batch they move to curlist and get the next batch
+ * number; once every CPU has seen a quiescent state since that batch
+ * started, the callbacks run from the CPU's tasklet.  Quiescent states
+ * are counted per CPU by schedule() and by the timer tick, so the fast
+ * paths never touch a shared cache line.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+#include <linux/interrupt.h>
+#include <linux/completion.h>
+#include <linux/module.h>
+#include <linux/rcupdate.h>
+
+#include <asm/bitops.h>
+
+struct rcu_ctrlblk rcu_ctrlblk =
+	{ mutex: SPIN_LOCK_UNLOCKED, curbatch: 1, maxbatch: 1, rcu_cpu_mask: 0 };
+struct rcu_data rcu_data[NR_CPUS] __cacheline_aligned;
+static struct tasklet_struct rcu_tasklet[NR_CPUS];
+
+/**
+ * call_rcu - queue an RCU callback for invocation after a grace period
+ * @head: structure to be used for queueing the callback
+ * @func: actual callback function to be invoked after the grace period
+ * @arg: argument to be passed to the callback function
+ *
+ * @func runs in softirq context once every CPU has gone through a
+ * quiescent state, so any lockless reader that could have seen the
+ * object when it was unlinked has finished with it.
+ */
+void call_rcu(struct rcu_head *head, void (*func)(void *arg), void *arg)
+{
+	unsigned long flags;
+	int cpu;
+
+	head->func = func;
+	head->arg = arg;
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	list_add_tail(&head->list, &RCU_nxtlist(cpu));
+	local_irq_restore(flags);
+}
+
+/* Invoke the callbacks of a completed batch */
+static void rcu_do_batch(struct list_head *list)
+{
+	struct list_head *entry;
+	struct rcu_head *head;
+
+	while (!list_empty(list)) {
+		entry = list->next;
+		list_del(entry);
+		head = list_entry(entry, struct rcu_head, list);
+		head->func(head->arg);
+	}
+}
+
+/*
+ * Make sure batch "newbatch" gets waited for, and start the next grace
+ * period unless one is already running.  Called with rcu_ctrlblk.mutex.
+ */
+static void rcu_start_batch(long newbatch)
+{
+	unsigned long mask = 0;
+	int i;
+
+	if (rcu_batch_before(rcu_ctrlblk.maxbatch, newbatch))
+		rcu_ctrlblk.maxbatch = newbatch;
+	if (rcu_batch_before(rcu_ctrlblk.maxbatch, rcu_ctrlblk.curbatch) ||
+	    rcu_ctrlblk.rcu_cpu_mask != 0)
+		return;
+	/* CPU ids need not be contiguous: mark those that are online */
+	for (i = 0; i < smp_num_cpus; i++)
+		mask |= 1UL << cpu_logical_map(i);
+	rcu_ctrlblk.rcu_cpu_mask = mask;
+}
+
+/*
+ * Check whether this CPU went through a quiescent state since the
+ * current grace period started; the last CPU to do so ends the grace
+ * period and starts the next one.
+ */
+static void rcu_check_quiescent_state(void)
+{
+	int cpu = smp_processor_id();
+
+	if (!test_bit(cpu, &rcu_ctrlblk.rcu_cpu_mask))
+		return;
+
+	/*
+	 * Counters are only compared against their value at the start of
+	 * the grace period, so first snapshot it.
+	 */
+	if (RCU_last_qsctr(cpu) == RCU_QSCTR_INVALID) {
+		RCU_last_qsctr(cpu) = RCU_qsctr(cpu);
+		return;
+	}
+	if (RCU_qsctr(cpu) == RCU_last_qsctr(cpu))
+		return;
+
+	spin_lock(&rcu_ctrlblk.mutex);
+	if (!test_bit(cpu, &rcu_ctrlblk.rcu_cpu_mask))
+		goto out_unlock;
+
+	clear_bit(cpu, &rcu_ctrlblk.rcu_cpu_mask);
+	RCU_last_qsctr(cpu) = RCU_QSCTR_INVALID;
+	if (rcu_ctrlblk.rcu_cpu_mask != 0)
+		goto out_unlock;
+
+	rcu_ctrlblk.curbatch++;
+	rcu_start_batch(rcu_ctrlblk.maxbatch);
+
+out_unlock:
+	spin_unlock(&rcu_ctrlblk.mutex);
+}
+
+/*
+ * Per-CPU tasklet: run the callbacks whose grace period is over, and
+ * move newly queued ones into a batch of their own.
+ */
+static void rcu_process_callbacks(unsigned long unused)
+{
+	int cpu = smp_processor_id();
+	LIST_HEAD(list);
+
+	if (!list_empty(&RCU_curlist(cpu)) &&
+	    rcu_batch_after(rcu_ctrlblk.curbatch, RCU_batch(cpu))) {
+		list_splice(&RCU_curlist(cpu), &list);
+		INIT_LIST_HEAD(&RCU_curlist(cpu));
+	}
+
+	local_irq_disable();
+	if (!list_empty(&RCU_nxtlist(cpu)) && list_empty(&RCU_curlist(cpu))) {
+		list_splice(&RCU_nxtlist(cpu), &RCU_curlist(cpu));
+		INIT_LIST_HEAD(&RCU_nxtlist(cpu));
+		local_irq_enable();
+
+		/*
+		 * start the next batch of callbacks
+		 */
+		spin_lock(&rcu_ctrlblk.mutex);
+		RCU_batch(cpu) = rcu_ctrlblk.curbatch + 1;
+		rcu_start_batch(RCU_batch(cpu));
+		spin_unlock(&rcu_ctrlblk.mutex);
+	} else {
+		local_irq_enable();
+	}
+	rcu_check_quiescent_state();
+	if (!list_empty(&list))
+		rcu_do_batch(&list);
+}
+
+/*
+ * Called from the timer interrupt, with rcu_pending(cpu) true.  A tick
+ * that interrupted user mode, or the idle loop outside of any other
+ * interrupt or bottom half, is a quiescent state.
+ */
+void rcu_check_callbacks(int cpu, int user)
+{
+	if (user || (current->pid == 0 && !local_bh_count(cpu) &&
+		     local_irq_count(cpu) <= 1))
+		RCU_qsctr(cpu)++;
+	tasklet_schedule(&rcu_tasklet[cpu]);
+}
+
+void __init rcu_init(void)
+{
+	int i;
+
+	for (i = 0; i < NR_CPUS; i++) {
+		tasklet_init(&rcu_tasklet[i], rcu_process_callbacks, 0UL);
+		INIT_LIST_HEAD(&RCU_nxtlist(i));
+		INIT_LIST_HEAD(&RCU_curlist(i));
+	}
+}
+
+static void wakeme_after_rcu(void *arg)
+{
+	complete((struct completion *) arg);
+}
+
+/**
+ * synchronize_kernel - wait for a grace period
+ *
+ * Sleep until every CPU has gone through a quiescent state, i.e. until
+ * all lockless readers that started before the call are done.
+ */
+void synchronize_kernel(void)
+{
+	struct rcu_head rcu;
+	DECLARE_COMPLETION(completion);
+
+	call_rcu(&rcu, wakeme_after_rcu, &completion);
+	wait_for_completion(&completion);
+}
+
+EXPORT_SYMBOL(call_rcu);
+EXPORT_SYMBOL(synchronize_kernel);
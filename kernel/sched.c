@@ -29,6 +29,7 @@
 #include <linux/completion.h>
 #include <linux/prefetch.h>
 #include <linux/compiler.h>
+#include <linux/rcupdate.h>
 
 #include <asm/uaccess.h>
 #include <asm/mmu_context.h>
@@ -70,300 +71,404 @@ extern void mem_use(void);
 
 #define NICE_TO_TICKS(nice)	(TICK_SCALE(20-(nice))+1)
 
+/*
+ * Priorities: a task's p->prio goes from 0 to MAX_PRIO-1, lower
+ * values mean higher priority. Realtime tasks use 0..MAX_RT_PRIO-1,
+ * SCHED_OTHER tasks use MAX_RT_PRIO..MAX_PRIO-1, which is the nice
+ * value shifted into that range plus or minus a small interactivity
+ * bonus.
+ */
+#define NICE_TO_PRIO(nice)	(MAX_RT_PRIO + (nice) + 20)
+#define USER_PRIO(prio)		((prio) - MAX_RT_PRIO)
+#define MAX_USER_PRIO		(USER_PRIO(MAX_PRIO))
+
+/*
+ * Interactivity tuning. A task builds up sleep_avg (in ticks) while
+ * it sleeps and burns it while it runs. A task that sleeps a lot gets
+ * up to PRIO_BONUS_RATIO percent of the user priority range as a
+ * bonus, a CPU hog gets the same amount as a penalty.
+ *
+ * Interactive tasks are put back into the active array when their
+ * timeslice runs out, unless the expired array has been waiting for
+ * longer than STARVATION_LIMIT ticks per runnable task.
+ */
+#define MAX_SLEEP_AVG		(2*HZ)
+#define PRIO_BONUS_RATIO	25
+#define INTERACTIVE_DELTA	2
+#define CHILD_PENALTY		95
+#define STARVATION_LIMIT	(2*HZ)
+
+#define rt_task(p)		((p)->policy & (SCHED_FIFO | SCHED_RR))
+#define task_timeslice(p)	NICE_TO_TICKS((p)->nice)
+
+#define TASK_INTERACTIVE(p) \
+	((p)->prio <= NICE_TO_PRIO((p)->nice) - INTERACTIVE_DELTA)
+
+#define EXPIRED_STARVING(rq) \
+	((rq)->expired_timestamp && \
+	 (jiffies - (rq)->expired_timestamp >= \
+		STARVATION_LIMIT * ((rq)->nr_running) + 1))
+
+/*
+ * Load balancing. An idle CPU looks for work on every tick, a busy
+ * one only every BUSY_REBALANCE_TICK ticks. Tasks that ran during
+ * the last CACHE_DECAY_TICKS ticks are considered cache-hot and are
+ * only pulled over to an idle CPU.
+ */
+#define IDLE_REBALANCE_TICK	(HZ/1000 ?: 1)
+#define BUSY_REBALANCE_TICK	(HZ/5 ?: 1)
+#define CACHE_DECAY_TICKS	(HZ/50 ?: 1)
+
+/*
+ * The per-CPU runqueue. Each one holds two priority arrays: tasks
+ * that still have timeslice left sit in the active array, tasks that
+ * used it up wait in the expired array. Once the active array runs
+ * empty the two are switched, which replaces the old global counter
+ * recalculation loop.
+ *
+ * A bitmap with one bit per priority level, plus a delimiter bit at
+ * MAX_PRIO, makes finding the next task to run a fixed cost
+ * operation, however many tasks are runnable.
+ */
+#define BITMAP_SIZE ((((MAX_PRIO+1+7)/8)+sizeof(long)-1)/sizeof(long))
+
+struct prio_array {
+	int nr_active;
+	unsigned long bitmap[BITMAP_SIZE];
+	struct list_head queue[MAX_PRIO];
+};
+
+typedef struct runqueue {
+	spinlock_t lock;
+	unsigned long nr_running, nr_switches, expired_timestamp;
+	struct task_struct *curr, *idle;
+	prio_array_t *active, *expired, arrays[2];
+	int prev_nr_running[NR_CPUS];
+} ____cacheline_aligned runqueue_t;
+
+static runqueue_t runqueues[NR_CPUS] __cacheline_aligned;
+
+#define cpu_rq(cpu)		(runqueues + (cpu))
+#define this_rq()		cpu_rq(smp_processor_id())
+#define task_rq(p)		cpu_rq((p)->processor)
 
 /*
  *	Init task must be ok at boot for the ix86 as we will check its signals
  *	via the SMP irq return path.
  */
- 
+
 struct task_struct * init_tasks[NR_CPUS] = {&init_task, };
 
 /*
  * The tasklist_lock protects the linked list of processes.
  *
- * The runqueue_lock locks the parts that actually access
- * and change the run-queues, and have to be interrupt-safe.
+ * Each runqueue has its own lock, which protects the runqueue and
+ * the scheduling state (p->array, p->prio, p->counter) of the tasks
+ * queued on it, and has to be interrupt-safe. A task's runqueue is
+ * the one of p->processor; p->processor of a queued task only
+ * changes with both the old and the new runqueue locked.
  *
- * If both locks are to be concurrently held, the runqueue_lock
- * nests inside the tasklist_lock.
+ * If two runqueue locks are to be held at once, the one at the
+ * lower address is taken first. Runqueue locks nest inside the
+ * tasklist_lock.
  *
  * task->alloc_lock nests inside tasklist_lock.
  */
-spinlock_t runqueue_lock __cacheline_aligned = SPIN_LOCK_UNLOCKED;  /* inner */
 rwlock_t tasklist_lock __cacheline_aligned = RW_LOCK_UNLOCKED;	/* outer */
 
-static LIST_HEAD(runqueue_head);
+struct kernel_stat kstat;
+extern struct task_struct *child_reaper;
+
+void scheduling_functions_start_here(void) { }
 
 /*
- * We align per-CPU scheduling data on cacheline boundaries,
- * to prevent cacheline ping-pong.
+ * Find the highest priority queue with a task on it, starting
+ * at 'idx'. The delimiter bit at MAX_PRIO ends the search.
  */
-static union {
-	struct schedule_data {
-		struct task_struct * curr;
-		cycles_t last_schedule;
-	} schedule_data;
-	char __pad [SMP_CACHE_BYTES];
-} aligned_data [NR_CPUS] __cacheline_aligned = { {{&init_task,0}}};
-
-#define cpu_curr(cpu) aligned_data[(cpu)].schedule_data.curr
-#define last_schedule(cpu) aligned_data[(cpu)].schedule_data.last_schedule
-
-struct kernel_stat kstat;
-extern struct task_struct *child_reaper;
+static inline int sched_find_next_bit(unsigned long *bitmap, int idx)
+{
+	unsigned long word;
+	int i = idx / BITS_PER_LONG;
 
-#ifdef CONFIG_SMP
+	word = bitmap[i] & (~0UL << (idx % BITS_PER_LONG));
+	while (!word)
+		word = bitmap[++i];
+	return i * BITS_PER_LONG + ffz(~word);
+}
 
-#define idle_task(cpu) (init_tasks[cpu_number_map(cpu)])
-#define can_schedule(p,cpu) \
-	((p)->cpus_runnable & (p)->cpus_allowed & (1 << cpu))
+#define sched_find_first_bit(bitmap)	sched_find_next_bit((bitmap), 0)
 
-#else
+/*
+ * The bitmap is only touched with the runqueue locked, so it
+ * does not need the atomic bitops.
+ */
+#define prio_set_bit(nr, bitmap) \
+	((bitmap)[(nr) / BITS_PER_LONG] |= 1UL << ((nr) % BITS_PER_LONG))
+#define prio_clear_bit(nr, bitmap) \
+	((bitmap)[(nr) / BITS_PER_LONG] &= ~(1UL << ((nr) % BITS_PER_LONG)))
 
-#define idle_task(cpu) (&init_task)
-#define can_schedule(p,cpu) (1)
+/*
+ * Lock the runqueue a given task is on. The task can move to
+ * another runqueue while we spin, so re-check after getting
+ * the lock.
+ */
+static inline runqueue_t *task_rq_lock(struct task_struct *p, unsigned long *flags)
+{
+	runqueue_t *rq;
+
+repeat_lock_task:
+	local_irq_save(*flags);
+	rq = task_rq(p);
+	spin_lock(&rq->lock);
+	if (unlikely(rq != task_rq(p))) {
+		spin_unlock_irqrestore(&rq->lock, *flags);
+		goto repeat_lock_task;
+	}
+	return rq;
+}
 
-#endif
+static inline void task_rq_unlock(runqueue_t *rq, unsigned long *flags)
+{
+	spin_unlock_irqrestore(&rq->lock, *flags);
+}
 
-void scheduling_functions_start_here(void) { }
+/*
+ * Adding/removing a task to/from a priority array:
+ */
+static inline void dequeue_task(struct task_struct *p, prio_array_t *array)
+{
+	array->nr_active--;
+	list_del(&p->run_list);
+	if (list_empty(array->queue + p->prio))
+		prio_clear_bit(p->prio, array->bitmap);
+}
 
 /*
- * This is the function that decides how desirable a process is..
- * You can weigh different processes against each other depending
- * on what CPU they've run on lately etc to try to handle cache
- * and TLB miss penalties.
+ * Careful!
  *
- * Return values:
- *	 -1000: never select this
- *	     0: out of time, recalculate counters (but it might still be
- *		selected)
- *	   +ve: "goodness" value (the larger, the better)
- *	 +1000: realtime process, select this.
+ * This has to add the process to the _end_ of its priority
+ * queue, not the beginning. This is important to get SCHED_FIFO
+ * and SCHED_RR right, where a process that is either pre-empted
+ * or its time slice has expired, should be moved to the tail of
+ * the run queue for its priority - Bhavesh Davda
  */
+static inline void enqueue_task(struct task_struct *p, prio_array_t *array)
+{
+	list_add_tail(&p->run_list, array->queue + p->prio);
+	prio_set_bit(p->prio, array->bitmap);
+	array->nr_active++;
+	p->array = array;
+}
 
-static inline int goodness(struct task_struct * p, int this_cpu, struct mm_struct *this_mm)
+/*
+ * The priority a task is queued with: realtime tasks get theirs
+ * from rt_priority, everybody else from the nice value and the
+ * sleep average.
+ */
+static inline int effective_prio(struct task_struct *p)
 {
-	int weight;
+	int bonus, prio;
 
-	/*
-	 * select the current process after every other
-	 * runnable process, but before the idle thread.
-	 * Also, dont trigger a counter recalculation.
-	 */
-	weight = -1;
-	if (p->policy & SCHED_YIELD)
-		goto out;
+	if (rt_task(p))
+		return MAX_RT_PRIO-1 - p->rt_priority;
 
-	/*
-	 * Non-RT process - normal case first.
-	 */
-	if (p->policy == SCHED_OTHER) {
-		/*
-		 * Give the process a first-approximation goodness value
-		 * according to the number of clock-ticks it has left.
-		 *
-		 * Don't do any other calculations if the time slice is
-		 * over..
-		 */
-		weight = p->counter;
-		if (!weight)
-			goto out;
-			
-#ifdef CONFIG_SMP
-		/* Give a largish advantage to the same processor...   */
-		/* (this is equivalent to penalizing other processors) */
-		if (p->processor == this_cpu)
-			weight += PROC_CHANGE_PENALTY;
-#endif
+	bonus = MAX_USER_PRIO*PRIO_BONUS_RATIO*(int)p->sleep_avg/MAX_SLEEP_AVG/100 -
+			MAX_USER_PRIO*PRIO_BONUS_RATIO/100/2;
 
-		/* .. and a slight advantage to the current MM */
-		if (p->mm == this_mm || !p->mm)
-			weight += 1;
-		weight += 20 - p->nice;
-		goto out;
-	}
+	prio = NICE_TO_PRIO(p->nice) - bonus;
+	if (prio < MAX_RT_PRIO)
+		prio = MAX_RT_PRIO;
+	if (prio > MAX_PRIO-1)
+		prio = MAX_PRIO-1;
+	return prio;
+}
 
-	/*
-	 * Realtime process, select the first one on the
-	 * runqueue (taking priorities within processes
-	 * into account).
-	 */
-	weight = 1000 + p->rt_priority;
-out:
-	return weight;
+static inline void __activate_task(struct task_struct *p, runqueue_t *rq)
+{
+	enqueue_task(p, rq->active);
+	rq->nr_running++;
 }
 
 /*
- * the 'goodness value' of replacing a process on a given CPU.
- * positive value means 'replace', zero or negative means 'dont'.
+ * Put a task that has been sleeping back on the runqueue, crediting
+ * the time it slept to its sleep average.
  */
-static inline int preemption_goodness(struct task_struct * prev, struct task_struct * p, int cpu)
+static inline void activate_task(struct task_struct *p, runqueue_t *rq)
 {
-	return goodness(p, cpu, prev->active_mm) - goodness(prev, cpu, prev->active_mm);
+	unsigned long sleep_time = jiffies - p->sleep_time;
+
+	if (!rt_task(p) && sleep_time) {
+		p->sleep_avg += sleep_time;
+		if (p->sleep_avg > MAX_SLEEP_AVG)
+			p->sleep_avg = MAX_SLEEP_AVG;
+	}
+	p->prio = effective_prio(p);
+	__activate_task(p, rq);
+}
+
+static inline void deactivate_task(struct task_struct *p, runqueue_t *rq)
+{
+	rq->nr_running--;
+	dequeue_task(p, p->array);
+	p->array = NULL;
 }
 
 /*
- * This is ugly, but reschedule_idle() is very timing-critical.
- * We are called with the runqueue spinlock held and we must
- * not claim the tasklist_lock.
+ * Ask the task to reschedule. If it runs on another CPU that does
+ * not poll its need_resched flag, send an IPI.
  */
-static FASTCALL(void reschedule_idle(struct task_struct * p));
-
-static void reschedule_idle(struct task_struct * p)
+static inline void resched_task(struct task_struct *p)
 {
 #ifdef CONFIG_SMP
-	int this_cpu = smp_processor_id();
-	struct task_struct *tsk, *target_tsk;
-	int cpu, best_cpu, i, max_prio;
-	cycles_t oldest_idle;
+	int need_resched;
 
 	/*
-	 * shortcut if the woken up task's last CPU is
-	 * idle now.
+	 * If need_resched == -1 then we can skip sending
+	 * the IPI altogether, tsk->need_resched is
+	 * actively watched by the idle thread.
 	 */
-	best_cpu = p->processor;
-	if (can_schedule(p, best_cpu)) {
-		tsk = idle_task(best_cpu);
-		if (cpu_curr(best_cpu) == tsk) {
-			int need_resched;
-send_now_idle:
-			/*
-			 * If need_resched == -1 then we can skip sending
-			 * the IPI altogether, tsk->need_resched is
-			 * actively watched by the idle thread.
-			 */
-			need_resched = tsk->need_resched;
-			tsk->need_resched = 1;
-			if ((best_cpu != this_cpu) && !need_resched)
-				smp_send_reschedule(best_cpu);
-			return;
-		}
+	need_resched = p->need_resched;
+	p->need_resched = 1;
+	if (!need_resched && p->processor != smp_processor_id())
+		smp_send_reschedule(p->processor);
+#else
+	p->need_resched = 1;
+#endif
+}
+
+/*
+ * Take a task off the runqueue from outside the scheduler. The SMP
+ * boot code uses this on the freshly forked idle threads, which are
+ * never queued in the first place.
+ */
+void del_from_runqueue(struct task_struct * p)
+{
+	unsigned long flags;
+	runqueue_t *rq;
+
+	rq = task_rq_lock(p, &flags);
+	if (p->array) {
+		deactivate_task(p, rq);
+		p->sleep_time = jiffies;
 	}
+	task_rq_unlock(rq, &flags);
+}
 
-	/*
-	 * We know that the preferred CPU has a cache-affine current
-	 * process, lets try to find a new idle CPU for the woken-up
-	 * process. Select the least recently active idle CPU. (that
-	 * one will have the least active cache context.) Also find
-	 * the executing process which has the least priority.
-	 */
-	oldest_idle = (cycles_t) -1;
-	target_tsk = NULL;
-	max_prio = 0;
+#ifdef CONFIG_SMP
 
+/*
+ * Pick the CPU a task that is neither queued nor running should be
+ * put on: the one it last ran on if that is still allowed, otherwise
+ * the first one it is allowed to run on.
+ */
+static inline int task_allowed_cpu(struct task_struct *p)
+{
+	int i;
+
+	if (p->cpus_allowed & (1UL << p->processor))
+		return p->processor;
 	for (i = 0; i < smp_num_cpus; i++) {
-		cpu = cpu_logical_map(i);
-		if (!can_schedule(p, cpu))
-			continue;
-		tsk = cpu_curr(cpu);
-		/*
-		 * We use the first available idle CPU. This creates
-		 * a priority list between idle CPUs, but this is not
-		 * a problem.
-		 */
-		if (tsk == idle_task(cpu)) {
-#if defined(__i386__) && defined(CONFIG_SMP)
-                        /*
-			 * Check if two siblings are idle in the same
-			 * physical package. Use them if found.
-			 */
-			if (smp_num_siblings == 2) {
-				if (cpu_curr(cpu_sibling_map[cpu]) == 
-			            idle_task(cpu_sibling_map[cpu])) {
-					oldest_idle = last_schedule(cpu);
-					target_tsk = tsk;
-					break;
-				}
-				
-                        }
-#endif		
-			if (last_schedule(cpu) < oldest_idle) {
-				oldest_idle = last_schedule(cpu);
-				target_tsk = tsk;
-			}
-		} else {
-			if (oldest_idle == -1ULL) {
-				int prio = preemption_goodness(tsk, p, cpu);
+		int cpu = cpu_logical_map(i);
 
-				if (prio > max_prio) {
-					max_prio = prio;
-					target_tsk = tsk;
-				}
-			}
-		}
-	}
-	tsk = target_tsk;
-	if (tsk) {
-		if (oldest_idle != -1ULL) {
-			best_cpu = tsk->processor;
-			goto send_now_idle;
-		}
-		tsk->need_resched = 1;
-		if (tsk->processor != this_cpu)
-			smp_send_reschedule(tsk->processor);
+		if (p->cpus_allowed & (1UL << cpu))
+			return cpu;
 	}
-	return;
-		
-
-#else /* UP */
-	int this_cpu = smp_processor_id();
-	struct task_struct *tsk;
-
-	tsk = cpu_curr(this_cpu);
-	if (preemption_goodness(tsk, p, this_cpu) > 0)
-		tsk->need_resched = 1;
-#endif
+	return p->processor;
 }
 
 /*
- * Careful!
- *
- * This has to add the process to the _end_ of the 
- * run-queue, not the beginning. The goodness value will
- * determine whether this process will run next. This is
- * important to get SCHED_FIFO and SCHED_RR right, where
- * a process that is either pre-empted or its time slice
- * has expired, should be moved to the tail of the run 
- * queue for its priority - Bhavesh Davda
+ * Move a task that is neither queued nor running over to a runqueue
+ * of a CPU it is allowed to run on. Called with rq (the task's current
+ * runqueue) locked, returns with the task's new runqueue locked. The
+ * caller has to re-check p->array, as the locks might have been
+ * dropped meanwhile.
  */
-static inline void add_to_runqueue(struct task_struct * p)
+static runqueue_t *move_to_allowed_cpu(struct task_struct *p, runqueue_t *rq)
 {
-	list_add_tail(&p->run_list, &runqueue_head);
-	nr_running++;
+	int cpu = task_allowed_cpu(p);
+	runqueue_t *new_rq = cpu_rq(cpu);
+
+	if (new_rq == rq)
+		return rq;
+
+	if (new_rq < rq) {
+		spin_unlock(&rq->lock);
+		spin_lock(&new_rq->lock);
+		spin_lock(&rq->lock);
+		if (p->array || task_has_cpu(p) || task_rq(p) != rq) {
+			spin_unlock(&new_rq->lock);
+			return rq;
+		}
+	} else
+		spin_lock(&new_rq->lock);
+
+	p->processor = cpu;
+	spin_unlock(&rq->lock);
+	return new_rq;
 }
 
-static inline void move_last_runqueue(struct task_struct * p)
+/*
+ * A task that has to wait behind a busy CPU's current task might be
+ * better off elsewhere: poke one idle CPU it may run on, that CPU
+ * pulls it over from schedule(). Peeking at the other runqueues
+ * unlocked is fine, this is only a hint.
+ */
+static inline void kick_idle_cpu(struct task_struct *p)
 {
-	list_del(&p->run_list);
-	list_add_tail(&p->run_list, &runqueue_head);
+	int i;
+
+	for (i = 0; i < smp_num_cpus; i++) {
+		int cpu = cpu_logical_map(i);
+		runqueue_t *rq = cpu_rq(cpu);
+
+		if (!(p->cpus_allowed & (1UL << cpu)))
+			continue;
+		if (rq->idle && rq->curr == rq->idle && !rq->nr_running) {
+			resched_task(rq->idle);
+			break;
+		}
+	}
 }
 
+#else
+
+#define move_to_allowed_cpu(p, rq)	(rq)
+#define kick_idle_cpu(p)		do { } while (0)
+
+#endif
+
 /*
- * Wake up a process. Put it on the run-queue if it's not
+ * Wake up a process. Put it on its runqueue if it's not
  * already there.  The "current" process is always on the
  * run-queue (except when the actual re-schedule is in
  * progress), and as such you're allowed to do the simpler
  * "current->state = TASK_RUNNING" to mark yourself runnable
  * without the overhead of this.
  */
-static inline int try_to_wake_up(struct task_struct * p, int synchronous)
+static int try_to_wake_up(struct task_struct * p, int synchronous)
 {
 	unsigned long flags;
 	int success = 0;
+	runqueue_t *rq;
 
-	/*
-	 * We want the common case fall through straight, thus the goto.
-	 */
-	spin_lock_irqsave(&runqueue_lock, flags);
+	rq = task_rq_lock(p, &flags);
 	p->state = TASK_RUNNING;
-	if (task_on_runqueue(p))
+	if (p->array)
 		goto out;
-	add_to_runqueue(p);
-	if (!synchronous || !(p->cpus_allowed & (1 << smp_processor_id())))
-		reschedule_idle(p);
+	if (!task_has_cpu(p) && !(p->cpus_allowed & (1UL << p->processor))) {
+		rq = move_to_allowed_cpu(p, rq);
+		if (p->array)
+			goto out;
+	}
+	activate_task(p, rq);
+	if (p->prio < rq->curr->prio) {
+		if (!synchronous || rq != this_rq())
+			resched_task(rq->curr);
+	} else if (rq->curr != rq->idle)
+		kick_idle_cpu(p);
 	success = 1;
 out:
-	spin_unlock_irqrestore(&runqueue_lock, flags);
+	task_rq_unlock(rq, &flags);
 	return success;
 }
 
@@ -372,6 +477,30 @@ inline int wake_up_process(struct task_struct * p)
 	return try_to_wake_up(p, 0);
 }
 
+/*
+ * Put a freshly forked child on the parent's runqueue. The child
+ * inherits most of the parent's sleep average, so a fork storm
+ * started by an interactive task does not flood the active array.
+ */
+void wake_up_forked_process(struct task_struct * p)
+{
+	unsigned long flags;
+	runqueue_t *rq;
+
+	rq = task_rq_lock(p, &flags);
+	p->state = TASK_RUNNING;
+	if (!rt_task(p))
+		p->sleep_avg = p->sleep_avg * CHILD_PENALTY / 100;
+	p->sleep_time = jiffies;
+	p->prio = effective_prio(p);
+	__activate_task(p, rq);
+	if (p->prio < rq->curr->prio)
+		resched_task(rq->curr);
+	else if (rq->curr != rq->idle)
+		kick_idle_cpu(p);
+	task_rq_unlock(rq, &flags);
+}
+
 static void process_timeout(unsigned long __data)
 {
 	struct task_struct * p = (struct task_struct *) __data;
@@ -396,7 +525,7 @@ static void process_timeout(unsigned long __data)
  * delivered to the current task. In this case the remaining time
  * in jiffies will be returned, or 0 if the timer expired in time
  *
- * The current task state is guaranteed to be TASK_RUNNING when this 
+ * The current task state is guaranteed to be TASK_RUNNING when this
  * routine returns.
  *
  * Specifying a @timeout value of %MAX_SCHEDULE_TIMEOUT will schedule
@@ -458,29 +587,310 @@ signed long schedule_timeout(signed long timeout)
 }
 
 /*
- * schedule_tail() is getting called from the fork return path. This
- * cleans up all remaining scheduler things, without impacting the
- * common case.
+ * Number of runnable tasks in the system, summed over all runqueues.
+ * This is a snapshot, the runqueues are not locked.
  */
-static inline void __schedule_tail(struct task_struct *prev)
+unsigned long nr_running(void)
 {
+	unsigned long i, sum = 0;
+
+	for (i = 0; i < smp_num_cpus; i++)
+		sum += cpu_rq(cpu_logical_map(i))->nr_running;
+
+	return sum;
+}
+
 #ifdef CONFIG_SMP
-	int policy;
 
+/*
+ * Lock the busiest runqueue too, this_rq is locked already. If we
+ * have to drop this_rq's lock to keep the lock order, its length
+ * might have changed and is re-read.
+ */
+static inline unsigned int double_lock_balance(runqueue_t *this_rq,
+	runqueue_t *busiest, int this_cpu, int idle, unsigned int nr_running)
+{
+	if (unlikely(!spin_trylock(&busiest->lock))) {
+		if (busiest < this_rq) {
+			spin_unlock(&this_rq->lock);
+			spin_lock(&busiest->lock);
+			spin_lock(&this_rq->lock);
+			nr_running = this_rq->nr_running;
+			if (!idle && nr_running < this_rq->prev_nr_running[this_cpu])
+				nr_running = this_rq->prev_nr_running[this_cpu];
+		} else
+			spin_lock(&busiest->lock);
+	}
+	return nr_running;
+}
+
+/*
+ * Find the runqueue with the most runnable tasks. The other runqueues
+ * are looked at without their locks, the caller re-checks the result
+ * with the lock held.
+ *
+ * To filter out short-lived spikes, the length of each runqueue seen
+ * by the previous balancing run on this CPU is remembered and the
+ * smaller of the old and new value counts, while this CPU's own length
+ * counts with the larger one. A CPU that is about to go idle is not that
+ * picky and uses the current lengths.
+ */
+static runqueue_t *find_busiest_queue(runqueue_t *this_rq, int this_cpu,
+				      int idle, int *imbalance)
+{
+	int nr_running, load, max_load, i;
+	runqueue_t *busiest, *rq_src;
+
+	if (idle || this_rq->nr_running > this_rq->prev_nr_running[this_cpu])
+		nr_running = this_rq->nr_running;
+	else
+		nr_running = this_rq->prev_nr_running[this_cpu];
+
+	busiest = NULL;
+	max_load = 1;
+	for (i = 0; i < smp_num_cpus; i++) {
+		int cpu = cpu_logical_map(i);
+
+		rq_src = cpu_rq(cpu);
+		if (idle || rq_src->nr_running < this_rq->prev_nr_running[cpu])
+			load = rq_src->nr_running;
+		else
+			load = this_rq->prev_nr_running[cpu];
+		this_rq->prev_nr_running[cpu] = rq_src->nr_running;
+
+		if (load > max_load && rq_src != this_rq) {
+			busiest = rq_src;
+			max_load = load;
+		}
+	}
+
+	if (likely(!busiest))
+		goto out;
+
+	*imbalance = (max_load - nr_running) / 2;
+
+	/* It needs an at least ~25% imbalance to trigger balancing. */
+	if (!idle && (*imbalance < (max_load + 3)/4)) {
+		busiest = NULL;
+		goto out;
+	}
+
+	nr_running = double_lock_balance(this_rq, busiest, this_cpu, idle, nr_running);
 	/*
-	 * prev->policy can be written from here only before `prev'
-	 * can be scheduled (before setting prev->cpus_runnable to ~0UL).
-	 * Of course it must also be read before allowing prev
-	 * to be rescheduled, but since the write depends on the read
-	 * to complete, wmb() is enough. (the spin_lock() acquired
-	 * before setting cpus_runnable is not enough because the spin_lock()
-	 * common code semantics allows code outside the critical section
-	 * to enter inside the critical section)
+	 * Make sure nothing changed since we checked the
+	 * runqueue length.
 	 */
-	policy = prev->policy;
-	prev->policy = policy & ~SCHED_YIELD;
-	wmb();
+	if (busiest->nr_running <= nr_running + 1) {
+		spin_unlock(&busiest->lock);
+		busiest = NULL;
+	}
+out:
+	return busiest;
+}
 
+/*
+ * Move a task from a remote runqueue to the local runqueue.
+ * Both runqueues must be locked.
+ */
+static inline void pull_task(runqueue_t *src_rq, prio_array_t *src_array,
+			     struct task_struct *p, runqueue_t *this_rq, int this_cpu)
+{
+	dequeue_task(p, src_array);
+	src_rq->nr_running--;
+	p->processor = this_cpu;
+	this_rq->nr_running++;
+	enqueue_task(p, this_rq->active);
+	/*
+	 * Note that idle threads have a prio of MAX_PRIO, for this test
+	 * to be always true for them.
+	 */
+	if (p->prio < this_rq->curr->prio)
+		this_rq->curr->need_resched = 1;
+}
+
+/*
+ * A task can be pulled over if it is not running anywhere (the
+ * scheduler drops the runqueue lock before switch_to(), so a task
+ * can be queued and still running on its old CPU), if it is allowed
+ * on this CPU and, unless this CPU is idle, if it has not run for
+ * a while.
+ */
+#define can_migrate_task(p, this_cpu, idle)				\
+	(!task_has_cpu(p) && ((p)->cpus_allowed & (1UL << (this_cpu))) &&	\
+	 ((idle) || jiffies - (p)->sleep_time > CACHE_DECAY_TICKS))
+
+/*
+ * Pull tasks over from the busiest runqueue if the runqueues are out
+ * of balance. Expired tasks are preferred as they are likely to be
+ * cache-cold anyway, and within an array the highest priority ones.
+ *
+ * Called with this_rq locked and interrupts disabled.
+ */
+static void load_balance(runqueue_t *this_rq, int idle)
+{
+	int imbalance, idx, this_cpu = smp_processor_id();
+	runqueue_t *busiest;
+	prio_array_t *array;
+	struct list_head *head, *curr;
+	struct task_struct *tmp;
+
+	busiest = find_busiest_queue(this_rq, this_cpu, idle, &imbalance);
+	if (!busiest)
+		goto out;
+
+	if (busiest->expired->nr_active)
+		array = busiest->expired;
+	else
+		array = busiest->active;
+
+new_array:
+	/* Start searching at priority 0: */
+	idx = 0;
+skip_bitmap:
+	idx = sched_find_next_bit(array->bitmap, idx);
+	if (idx >= MAX_PRIO) {
+		if (array == busiest->expired) {
+			array = busiest->active;
+			goto new_array;
+		}
+		goto out_unlock;
+	}
+
+	head = array->queue + idx;
+	curr = head->prev;
+skip_queue:
+	tmp = list_entry(curr, struct task_struct, run_list);
+
+	/* Take the task that ran least recently first. */
+	curr = curr->prev;
+
+	if (!can_migrate_task(tmp, this_cpu, idle)) {
+		if (curr != head)
+			goto skip_queue;
+		idx++;
+		goto skip_bitmap;
+	}
+	pull_task(busiest, array, tmp, this_rq, this_cpu);
+	if (--imbalance > 0) {
+		if (curr != head)
+			goto skip_queue;
+		idx++;
+		goto skip_bitmap;
+	}
+out_unlock:
+	spin_unlock(&busiest->lock);
+out:
+	;
+}
+
+/*
+ * This CPU is about to go idle, see whether there is work to
+ * be taken over from the others.
+ */
+#define idle_balance(rq)	load_balance((rq), 1)
+
+#else
+
+#define idle_balance(rq)	do { } while (0)
+
+#endif /* CONFIG_SMP */
+
+/*
+ * Called from the timer interrupt on every CPU, to charge one tick
+ * to the current task's timeslice. A task that used up its timeslice
+ * moves over to the expired array; SCHED_RR tasks are requeued at the
+ * end of their priority level instead and SCHED_FIFO tasks have no
+ * timeslice at all.
+ */
+void scheduler_tick(void)
+{
+	struct task_struct *p = current;
+	runqueue_t *rq = this_rq();
+
+	if (p == rq->idle) {
+#ifdef CONFIG_SMP
+		if (!(jiffies % IDLE_REBALANCE_TICK)) {
+			spin_lock(&rq->lock);
+			load_balance(rq, 1);
+			spin_unlock(&rq->lock);
+		}
+#endif
+		return;
+	}
+
+	/* Task might have expired already, but not scheduled off yet */
+	if (p->array != rq->active) {
+		p->need_resched = 1;
+		return;
+	}
+
+	spin_lock(&rq->lock);
+	if (unlikely(rt_task(p))) {
+		/*
+		 * SCHED_FIFO is priority preemption, so this is
+		 * not the place to decide whether to reschedule a
+		 * SCHED_FIFO task or not - Bhavesh Davda
+		 */
+		if (p->policy == SCHED_RR && --p->counter <= 0) {
+			p->counter = task_timeslice(p);
+			p->need_resched = 1;
+			dequeue_task(p, rq->active);
+			enqueue_task(p, rq->active);
+		}
+		goto out;
+	}
+
+	if (p->sleep_avg)
+		p->sleep_avg--;
+	if (--p->counter <= 0) {
+		dequeue_task(p, rq->active);
+		p->need_resched = 1;
+		p->prio = effective_prio(p);
+		p->counter = task_timeslice(p);
+
+		if (!TASK_INTERACTIVE(p) || EXPIRED_STARVING(rq)) {
+			if (!rq->expired_timestamp)
+				rq->expired_timestamp = jiffies;
+			enqueue_task(p, rq->expired);
+		} else
+			enqueue_task(p, rq->active);
+	}
+out:
+#ifdef CONFIG_SMP
+	if (!(jiffies % BUSY_REBALANCE_TICK))
+		load_balance(rq, 0);
+#endif
+	spin_unlock(&rq->lock);
+}
+
+/*
+ * Requeue a task that wants to yield the CPU: SCHED_OTHER tasks go
+ * to the expired array, realtime tasks to the end of their priority
+ * level. Called with the runqueue locked.
+ */
+static inline void yield_task(struct task_struct *p, runqueue_t *rq)
+{
+	prio_array_t *array = p->array;
+
+	if (rt_task(p)) {
+		list_del(&p->run_list);
+		list_add_tail(&p->run_list, array->queue + p->prio);
+		return;
+	}
+	dequeue_task(p, array);
+	enqueue_task(p, rq->expired);
+	if (!rq->expired_timestamp)
+		rq->expired_timestamp = jiffies;
+}
+
+/*
+ * schedule_tail() is getting called from the fork return path. This
+ * cleans up all remaining scheduler things, without impacting the
+ * common case.
+ */
+static inline void __schedule_tail(struct task_struct *prev)
+{
+#ifdef CONFIG_SMP
 	/*
 	 * fast path falls through. We have to clear cpus_runnable before
 	 * checking prev->state to avoid a wakeup race. Protect against
@@ -489,43 +899,17 @@ static inline void __schedule_tail(struct task_struct *prev)
 	task_lock(prev);
 	task_release_cpu(prev);
 	mb();
-	if (prev->state == TASK_RUNNING)
-		goto needs_resched;
-
-out_unlock:
-	task_unlock(prev);	/* Synchronise here with release_task() if prev is TASK_ZOMBIE */
-	return;
 
 	/*
-	 * Slow path - we 'push' the previous process and
-	 * reschedule_idle() will attempt to find a new
-	 * processor for it. (but it might preempt the
-	 * current process as well.) We must take the runqueue
-	 * lock and re-check prev->state to be correct. It might
-	 * still happen that this process has a preemption
-	 * 'in progress' already - but this is not a problem and
-	 * might happen in other circumstances as well.
+	 * Slow path - schedule() took a runnable prev off this
+	 * runqueue because it is not allowed to run on this CPU
+	 * any more. Now that it is off the CPU, wake it up on
+	 * one it may run on.
 	 */
-needs_resched:
-	{
-		unsigned long flags;
+	if (unlikely(prev->state == TASK_RUNNING && !prev->array))
+		try_to_wake_up(prev, 0);
 
-		/*
-		 * Avoid taking the runqueue lock in cases where
-		 * no preemption-check is necessery:
-		 */
-		if ((prev == idle_task(smp_processor_id())) ||
-						(policy & SCHED_YIELD))
-			goto out_unlock;
-
-		spin_lock_irqsave(&runqueue_lock, flags);
-		if ((prev->state == TASK_RUNNING) && !task_has_cpu(prev))
-			reschedule_idle(prev);
-		spin_unlock_irqrestore(&runqueue_lock, flags);
-		goto out_unlock;
-	}
-#else
-	prev->policy &= ~SCHED_YIELD;
+	task_unlock(prev);	/* Synchronise here with release_task() if prev is TASK_ZOMBIE */
 #endif /* CONFIG_SMP */
 }
 
@@ -535,10 +919,9 @@ asmlinkage void schedule_tail(struct task_struct *prev)
 }
 
 /*
- *  'schedule()' is the scheduler function. It's a very simple and nice
- * scheduler: it's not perfect, but certainly works for most things.
- *
- * The goto is "interesting".
+ *  'schedule()' is the scheduler function. It picks the first task
+ * of the highest priority queue of this CPU's runqueue, so it costs
+ * the same no matter how many tasks are runnable.
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
@@ -546,13 +929,11 @@ asmlinkage void schedule_tail(struct task_struct *prev)
  */
 asmlinkage void schedule(void)
 {
-	struct schedule_data * sched_data;
-	struct task_struct *prev, *next, *p;
-	struct list_head *tmp;
-	int this_cpu, c;
-
-
-	spin_lock_prefetch(&runqueue_lock);
+	struct task_struct *prev, *next;
+	prio_array_t *array;
+	struct list_head *queue;
+	runqueue_t *rq;
+	int this_cpu, idx;
 
 	BUG_ON(!current->active_mm);
 need_resched_back:
@@ -565,21 +946,14 @@ need_resched_back:
 	}
 
 	release_kernel_lock(prev, this_cpu);
+	rcu_qsctr_inc(this_cpu);
 
 	/*
-	 * 'sched_data' is protected by the fact that we can run
-	 * only one process per CPU.
+	 * The runqueue is per-CPU, and 'rq->curr' only changes
+	 * under its lock here.
 	 */
-	sched_data = & aligned_data[this_cpu].schedule_data;
-
-	spin_lock_irq(&runqueue_lock);
-
-	/* move an exhausted RR process to be last.. */
-	if (unlikely(prev->policy == SCHED_RR))
-		if (!prev->counter) {
-			prev->counter = NICE_TO_TICKS(prev->nice);
-			move_last_runqueue(prev);
-		}
+	rq = this_rq();
+	spin_lock_irq(&rq->lock);
 
 	switch (prev->state) {
 		case TASK_INTERRUPTIBLE:
@@ -588,75 +962,68 @@ need_resched_back:
 				break;
 			}
 		default:
-			del_from_runqueue(prev);
+			/* the idle threads are never queued */
+			if (likely(prev->array != NULL))
+				deactivate_task(prev, rq);
 		case TASK_RUNNING:;
 	}
-	prev->need_resched = 0;
 
-	/*
-	 * this is the scheduler proper:
-	 */
+	if (unlikely(prev->policy & SCHED_YIELD)) {
+		prev->policy &= ~SCHED_YIELD;
+		if (prev->array)
+			yield_task(prev, rq);
+	}
 
-repeat_schedule:
+#ifdef CONFIG_SMP
 	/*
-	 * Default process to select..
+	 * Somebody changed prev->cpus_allowed so that it may not run
+	 * here any more: take it off this runqueue, __schedule_tail()
+	 * puts it on an allowed one once it is off the CPU.
 	 */
-	next = idle_task(this_cpu);
-	c = -1000;
-	list_for_each(tmp, &runqueue_head) {
-		p = list_entry(tmp, struct task_struct, run_list);
-		if (can_schedule(p, this_cpu)) {
-			int weight = goodness(p, this_cpu, prev->active_mm);
-			if (weight > c)
-				c = weight, next = p;
-		}
+	if (unlikely(prev->array && !(prev->cpus_allowed & (1UL << this_cpu))))
+		deactivate_task(prev, rq);
+#endif
+	prev->need_resched = 0;
+
+	if (unlikely(!rq->nr_running))
+		idle_balance(rq);
+	if (unlikely(!rq->nr_running)) {
+		next = rq->idle;
+		rq->expired_timestamp = 0;
+		goto switch_tasks;
 	}
 
-	/* Do we need to re-calculate counters? */
-	if (unlikely(!c)) {
-		struct task_struct *p;
-
-		spin_unlock_irq(&runqueue_lock);
-		read_lock(&tasklist_lock);
-		for_each_task(p)
-			p->counter = (p->counter >> 1) + NICE_TO_TICKS(p->nice);
-		read_unlock(&tasklist_lock);
-		spin_lock_irq(&runqueue_lock);
-		goto repeat_schedule;
+	array = rq->active;
+	if (unlikely(!array->nr_active)) {
+		/*
+		 * Switch the active and expired arrays.
+		 */
+		rq->active = rq->expired;
+		rq->expired = array;
+		array = rq->active;
+		rq->expired_timestamp = 0;
 	}
 
+	idx = sched_find_first_bit(array->bitmap);
+	queue = array->queue + idx;
+	next = list_entry(queue->next, struct task_struct, run_list);
+
+switch_tasks:
 	/*
 	 * from this point on nothing can prevent us from
 	 * switching to the next task, save this fact in
-	 * sched_data.
+	 * the runqueue.
 	 */
-	sched_data->curr = next;
+	rq->curr = next;
 	task_set_cpu(next, this_cpu);
-	spin_unlock_irq(&runqueue_lock);
-
-	if (unlikely(prev == next)) {
-		/* We won't go through the normal tail, so do this by hand */
-		prev->policy &= ~SCHED_YIELD;
-		goto same_process;
+	if (likely(prev != next)) {
+		rq->nr_switches++;
+		prev->sleep_time = jiffies;
 	}
+	spin_unlock_irq(&rq->lock);
 
-#ifdef CONFIG_SMP
- 	/*
- 	 * maintain the per-process 'last schedule' value.
- 	 * (this has to be recalculated even if we reschedule to
- 	 * the same process) Currently this is only used on SMP,
-	 * and it's approximate, so we do not have to maintain
-	 * it while holding the runqueue spinlock.
- 	 */
- 	sched_data->last_schedule = get_cycles();
-
-	/*
-	 * We drop the scheduler lock early (it's a global spinlock),
-	 * thus we have to lock the previous process from getting
-	 * rescheduled during switch_to().
-	 */
-
-#endif /* CONFIG_SMP */
+	if (unlikely(prev == next))
+		goto same_process;
 
 	kstat.context_swtch++;
 	/*
@@ -725,6 +1092,10 @@ static inline void __wake_up_common (wait_queue_head_t *q, unsigned int mode,
                 wait_queue_t *curr = list_entry(tmp, wait_queue_t, task_list);
 
 		CHECK_MAGIC(curr->__magic);
+		if (curr->func) {
+			curr->func(curr, mode, sync);
+			continue;
+		}
 		p = curr->task;
 		state = p->state;
 		if (state & mode) {
@@ -850,6 +1221,36 @@ long sleep_on_timeout(wait_queue_head_t *q, long timeout)
 
 void scheduling_functions_end_here(void) { }
 
+/*
+ * Change the nice value of a task. Its priority changes with it, so
+ * a queued task has to be requeued on its runqueue.
+ */
+void set_user_nice(struct task_struct *p, long nice)
+{
+	prio_array_t *array;
+	unsigned long flags;
+	runqueue_t *rq;
+	int old_prio;
+
+	rq = task_rq_lock(p, &flags);
+	array = p->array;
+	if (array)
+		dequeue_task(p, array);
+	old_prio = p->prio;
+	p->nice = nice;
+	p->prio = effective_prio(p);
+	if (array) {
+		enqueue_task(p, array);
+		/*
+		 * Reschedule if the task now beats the running one, or
+		 * is the running one and got worse.
+		 */
+		if (p == rq->curr ? p->prio > old_prio : p->prio < rq->curr->prio)
+			resched_task(rq->curr);
+	}
+	task_rq_unlock(rq, &flags);
+}
+
 #ifndef __alpha__
 
 /*
@@ -881,7 +1282,7 @@ asmlinkage long sys_nice(int increment)
 		newprio = -20;
 	if (newprio > 19)
 		newprio = 19;
-	current->nice = newprio;
+	set_user_nice(current, newprio);
 	return 0;
 }
 
@@ -901,6 +1302,9 @@ static int setscheduler(pid_t pid, int policy,
 {
 	struct sched_param lp;
 	struct task_struct *p;
+	prio_array_t *array;
+	unsigned long flags;
+	runqueue_t *rq;
 	int retval;
 
 	retval = -EINVAL;
@@ -915,14 +1319,19 @@ static int setscheduler(pid_t pid, int policy,
 	 * We play safe to avoid deadlocks.
 	 */
 	read_lock_irq(&tasklist_lock);
-	spin_lock(&runqueue_lock);
 
 	p = find_process_by_pid(pid);
 
 	retval = -ESRCH;
 	if (!p)
-		goto out_unlock;
-			
+		goto out_unlock_tasklist;
+
+	/*
+	 * The task's priority changes, so it has to be requeued
+	 * on its runqueue.
+	 */
+	rq = task_rq_lock(p, &flags);
+
 	if (policy < 0)
 		policy = p->policy;
 	else {
@@ -951,13 +1360,20 @@ static int setscheduler(pid_t pid, int policy,
 		goto out_unlock;
 
 	retval = 0;
+	array = p->array;
+	if (array)
+		deactivate_task(p, rq);
 	p->policy = policy;
 	p->rt_priority = lp.sched_priority;
+	p->prio = effective_prio(p);
+	if (array)
+		__activate_task(p, rq);
 
-	current->need_resched = 1;
+	resched_task(rq->curr);
 
 out_unlock:
-	spin_unlock(&runqueue_lock);
+	task_rq_unlock(rq, &flags);
+out_unlock_tasklist:
 	read_unlock_irq(&tasklist_lock);
 
 out_nounlock:
@@ -1029,40 +1445,19 @@ out_unlock:
 asmlinkage long sys_sched_yield(void)
 {
 	/*
-	 * Trick. sched_yield() first counts the number of truly 
-	 * 'pending' runnable processes, then returns if it's
-	 * only the current processes. (This test does not have
-	 * to be atomic.) In threaded applications this optimization
-	 * gets triggered quite often.
+	 * Trick. If we are the only runnable task on this CPU there
+	 * is nobody to yield to. (This test does not have to be
+	 * atomic.) In threaded applications this optimization gets
+	 * triggered quite often.
 	 */
-
-	int nr_pending = nr_running;
-
-#if CONFIG_SMP
-	int i;
-
-	// Subtract non-idle processes running on other CPUs.
-	for (i = 0; i < smp_num_cpus; i++) {
-		int cpu = cpu_logical_map(i);
-		if (aligned_data[cpu].schedule_data.curr != idle_task(cpu))
-			nr_pending--;
-	}
-#else
-	// on UP this process is on the runqueue as well
-	nr_pending--;
-#endif
-	if (nr_pending) {
+	if (this_rq()->nr_running > 1) {
 		/*
 		 * This process can only be rescheduled by us,
-		 * so this is safe without any locking.
+		 * so this is safe without any locking. schedule()
+		 * moves us behind the other runnable tasks.
 		 */
-		if (current->policy == SCHED_OTHER)
-			current->policy |= SCHED_YIELD;
+		current->policy |= SCHED_YIELD;
 		current->need_resched = 1;
-
-		spin_lock_irq(&runqueue_lock);
-		move_last_runqueue(current);
-		spin_unlock_irq(&runqueue_lock);
 	}
 	return 0;
 }
@@ -1247,6 +1642,7 @@ void show_state(void)
 void reparent_to_init(void)
 {
 	struct task_struct *this_task = current;
+	prio_array_t *array;
 
 	write_lock_irq(&tasklist_lock);
 
@@ -1259,13 +1655,20 @@ void reparent_to_init(void)
 	/* Set the exit signal to SIGCHLD so we signal init on exit */
 	this_task->exit_signal = SIGCHLD;
 
-	/* We also take the runqueue_lock while altering task fields
-	 * which affect scheduling decisions */
-	spin_lock(&runqueue_lock);
+	/* We also take the runqueue lock while altering task fields
+	 * which affect scheduling decisions, and requeue ourselves
+	 * as our priority changes with them */
+	spin_lock(&this_rq()->lock);
 
+	array = this_task->array;
+	if (array)
+		dequeue_task(this_task, array);
 	this_task->ptrace = 0;
 	this_task->nice = DEF_NICE;
 	this_task->policy = SCHED_OTHER;
+	this_task->prio = effective_prio(this_task);
+	if (array)
+		enqueue_task(this_task, array);
 	/* cpus_allowed? */
 	/* rt_priority? */
 	/* signals? */
@@ -1276,7 +1679,7 @@ void reparent_to_init(void)
 	memcpy(this_task->rlim, init_task.rlim, sizeof(*(this_task->rlim)));
 	this_task->user = INIT_USER;
 
-	spin_unlock(&runqueue_lock);
+	spin_unlock(&this_rq()->lock);
 	write_unlock_irq(&tasklist_lock);
 }
 
@@ -1316,16 +1719,18 @@ extern unsigned long wait_init_idle;
 
 void __init init_idle(void)
 {
-	struct schedule_data * sched_data;
-	sched_data = &aligned_data[smp_processor_id()].schedule_data;
+	runqueue_t *rq = this_rq();
+	unsigned long flags;
 
-	if (current != &init_task && task_on_runqueue(current)) {
+	if (task_on_runqueue(current)) {
 		printk("UGH! (%d:%d) was on the runqueue, removing.\n",
 			smp_processor_id(), current->pid);
 		del_from_runqueue(current);
 	}
-	sched_data->curr = current;
-	sched_data->last_schedule = get_cycles();
+	spin_lock_irqsave(&rq->lock, flags);
+	rq->curr = rq->idle = current;
+	current->prio = MAX_PRIO;
+	spin_unlock_irqrestore(&rq->lock, flags);
 	clear_bit(current->processor, &wait_init_idle);
 }
 
@@ -1338,12 +1743,40 @@ void __init sched_init(void)
 	 * process right in SMP mode.
 	 */
 	int cpu = smp_processor_id();
-	int nr;
+	runqueue_t *rq;
+	int i, j, k;
 
 	init_task.processor = cpu;
 
-	for(nr = 0; nr < PIDHASH_SZ; nr++)
-		pidhash[nr] = NULL;
+	for (i = 0; i < NR_CPUS; i++) {
+		prio_array_t *array;
+
+		rq = cpu_rq(i);
+		rq->active = rq->arrays;
+		rq->expired = rq->arrays + 1;
+		spin_lock_init(&rq->lock);
+
+		for (j = 0; j < 2; j++) {
+			array = rq->arrays + j;
+			for (k = 0; k < MAX_PRIO; k++) {
+				INIT_LIST_HEAD(array->queue + k);
+				prio_clear_bit(k, array->bitmap);
+			}
+			/* delimiter for bitsearch */
+			prio_set_bit(MAX_PRIO, array->bitmap);
+		}
+	}
+
+	/*
+	 * The boot thread becomes this CPU's idle thread once it
+	 * is done booting; it is never on a runqueue.
+	 */
+	rq = cpu_rq(cpu);
+	rq->curr = rq->idle = current;
+	current->prio = MAX_PRIO;
+
+	for(i = 0; i < PIDHASH_SZ; i++)
+		pidhash[i] = NULL;
 
 	init_timervecs();
 
@@ -223,7 +223,7 @@ asmlinkage long sys_setpriority(int which, int who, int niceval)
 		if (niceval < p->nice && !capable(CAP_SYS_NICE))
 			error = -EACCES;
 		else
-			p->nice = niceval;
+			set_user_nice(p, niceval);
 	}
 	read_unlock(&tasklist_lock);
 
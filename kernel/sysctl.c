@@ -30,6 +30,7 @@
 #include <linux/init.h>
 #include <linux/sysrq.h>
 #include <linux/highuid.h>
+#include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
 
@@ -55,6 +56,9 @@ extern int cad_pid;
 static int maxolduid = 65535;
 static int minolduid;
 
+/* a pipe holds at least one page */
+static int min_pipe_size = PAGE_SIZE;
+
 #ifdef CONFIG_KMOD
 extern char modprobe_path[];
 #endif
@@ -277,6 +281,10 @@ static ctl_table vm_table[] = {
 	&vm_max_readahead,sizeof(int), 0644, NULL, &proc_dointvec},
 	{VM_MAX_MAP_COUNT, "max_map_count",
 	 &max_map_count, sizeof(int), 0644, NULL, &proc_dointvec},
+#ifdef CONFIG_HUGETLB_PAGE
+	{VM_HUGETLB_PAGES, "nr_hugepages", &htlbpage_max, sizeof(int), 0644,
+	 NULL, &hugetlb_sysctl_handler},
+#endif
 	{0}
 };
 
@@ -309,6 +317,9 @@ static ctl_table fs_table[] = {
 	 sizeof(int), 0644, NULL, &proc_dointvec},
 	{FS_LEASE_TIME, "lease-break-time", &lease_break_time, sizeof(int),
 	 0644, NULL, &proc_dointvec},
+	{FS_PIPE_MAX_SIZE, "pipe-max-size", &pipe_max_size, sizeof(int),
+	 0644, NULL, &proc_dointvec_minmax, &sysctl_intvec, NULL,
+	 &min_pipe_size, NULL},
 	{0}
 };
 
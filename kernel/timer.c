@@ -22,6 +22,7 @@
 #include <linux/smp_lock.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/rcupdate.h>
 
 #include <asm/uaccess.h>
 
@@ -598,18 +599,8 @@ void update_process_times(int user_tick)
 	int cpu = smp_processor_id(), system = user_tick ^ 1;
 
 	update_one_process(p, user_tick, system, cpu);
+	scheduler_tick();
 	if (p->pid) {
-		if (--p->counter <= 0) {
-			p->counter = 0;
-			/*
-			 * SCHED_FIFO is priority preemption, so this is 
-			 * not the place to decide whether to reschedule a
-			 * SCHED_FIFO task or not - Bhavesh Davda
-			 */
-			if (p->policy != SCHED_FIFO) {
-				p->need_resched = 1;
-			}
-		}
 		if (p->nice > 0)
 			kstat.per_cpu_nice[cpu] += user_tick;
 		else
@@ -617,6 +608,8 @@ void update_process_times(int user_tick)
 		kstat.per_cpu_system[cpu] += system;
 	} else if (local_bh_count(cpu) || local_irq_count(cpu) > 1)
 		kstat.per_cpu_system[cpu] += system;
+	if (rcu_pending(cpu))
+		rcu_check_callbacks(cpu, user_tick);
 }
 
 /*
@@ -23,6 +23,7 @@
 #include <linux/init.h>
 #include <linux/mm.h>
 #include <linux/iobuf.h>
+#include <linux/hugetlb.h>
 
 #include <asm/pgalloc.h>
 #include <asm/uaccess.h>
@@ -709,7 +710,7 @@ static int page_cache_read(struct file * file, unsigned long offset)
 	if (page)
 		return 0;
 
-	page = page_cache_alloc(mapping);
+	page = page_cache_alloc_cold(mapping);
 	if (!page)
 		return -ENOMEM;
 
@@ -2154,6 +2155,10 @@ int filemap_sync(struct vm_area_struct * vma, unsigned long address,
 	unsigned long end = address + size;
 	int error = 0;
 
+	/* Huge pages are never written back */
+	if (is_vm_hugetlb_page(vma))
+		return 0;
+
 	/* Aquire the lock early; it may be possible to avoid dropping
 	 * and reaquiring it repeatedly.
 	 */
@@ -2536,6 +2541,9 @@ static long madvise_vma(struct vm_area_struct * vma, unsigned long start,
 {
 	long error = -EBADF;
 
+	if (is_vm_hugetlb_page(vma))
+		return -EINVAL;
+
 	switch (behavior) {
 	case MADV_NORMAL:
 	case MADV_SEQUENTIAL:
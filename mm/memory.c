@@ -45,6 +45,8 @@
 #include <linux/highmem.h>
 #include <linux/pagemap.h>
 #include <linux/module.h>
+#include <linux/rmap.h>
+#include <linux/hugetlb.h>
 
 #include <asm/pgalloc.h>
 #include <asm/uaccess.h>
@@ -103,6 +105,7 @@ static inline void free_one_pmd(pmd_t * dir)
 	}
 	pte = pte_offset(dir, 0);
 	pmd_clear(dir);
+	pgtable_remove_rmap(pte);
 	pte_free(pte);
 }
 
@@ -171,7 +174,8 @@ void clear_page_tables(struct mm_struct *mm, unsigned long first, int nr)
  *         variable count and make things faster. -jj
  *
  * dst->page_table_lock is held on entry and exit,
- * but may be dropped within pmd_alloc() and pte_alloc().
+ * but may be dropped within pmd_alloc() and pte_alloc(),
+ * and to refill the pte_chain reserve for page_add_rmap().
  */
 int copy_page_range(struct mm_struct *dst, struct mm_struct *src,
 			struct vm_area_struct *vma)
@@ -180,6 +184,11 @@ int copy_page_range(struct mm_struct *dst, struct mm_struct *src,
 	unsigned long address = vma->vm_start;
 	unsigned long end = vma->vm_end;
 	unsigned long cow = (vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) == VM_MAYWRITE;
+	struct pte_chain *pte_chain = NULL;
+	int error = 0;
+
+	if (is_vm_hugetlb_page(vma))
+		return copy_hugetlb_page_range(dst, src, vma);
 
 	src_pgd = pgd_offset(src, address)-1;
 	dst_pgd = pgd_offset(dst, address)-1;
@@ -230,11 +239,12 @@ skip_copy_pte_range:		address = (address + PMD_SIZE) & PMD_MASK;
 
 			spin_lock(&src->page_table_lock);			
 			do {
-				pte_t pte = *src_pte;
+				pte_t pte;
 				struct page *ptepage;
 				
 				/* copy_one_pte */
 
+again:				pte = *src_pte;
 				if (pte_none(pte))
 					goto cont_copy_pte_range_noset;
 				if (!pte_present(pte)) {
@@ -246,6 +256,22 @@ skip_copy_pte_range:		address = (address + PMD_SIZE) & PMD_MASK;
 				    PageReserved(ptepage))
 					goto cont_copy_pte_range;
 
+				/*
+				 * Top up the reserve for page_add_rmap().  If
+				 * that needs to sleep, drop the locks and look
+				 * at the pte again afterwards.
+				 */
+				if (pte_chain_reserve(&pte_chain, GFP_ATOMIC)) {
+					spin_unlock(&src->page_table_lock);
+					spin_unlock(&dst->page_table_lock);
+					error = pte_chain_reserve(&pte_chain, GFP_KERNEL);
+					spin_lock(&dst->page_table_lock);
+					spin_lock(&src->page_table_lock);
+					if (error)
+						goto out_unlock;
+					goto again;
+				}
+
 				/* If it's a COW mapping, write protect it both in the parent and the child */
 				if (cow && pte_write(pte)) {
 					ptep_set_wrprotect(src_pte);
@@ -258,6 +284,9 @@ skip_copy_pte_range:		address = (address + PMD_SIZE) & PMD_MASK;
 				pte = pte_mkold(pte);
 				get_page(ptepage);
 				dst->rss++;
+				set_pte(dst_pte, pte);
+				page_add_rmap(ptepage, dst_pte, &pte_chain);
+				goto cont_copy_pte_range_noset;
 
 cont_copy_pte_range:		set_pte(dst_pte, pte);
 cont_copy_pte_range_noset:	address += PAGE_SIZE;
@@ -275,8 +304,10 @@ cont_copy_pmd_range:	src_pmd++;
 out_unlock:
 	spin_unlock(&src->page_table_lock);
 out:
-	return 0;
+	pte_chain_release(pte_chain);
+	return error;
 nomem:
+	pte_chain_release(pte_chain);
 	return -ENOMEM;
 }
 
@@ -315,8 +346,10 @@ static inline int zap_pte_range(mmu_gather_t *tlb, pmd_t * pmd, unsigned long ad
 			continue;
 		if (pte_present(pte)) {
 			struct page *page = pte_page(pte);
-			if (VALID_PAGE(page) && !PageReserved(page))
+			if (VALID_PAGE(page) && !PageReserved(page)) {
 				freed ++;
+				page_remove_rmap(page, ptep);
+			}
 			/* This will eventually call __free_pte on the pte. */
 			tlb_remove_page(tlb, ptep, address + offset);
 		} else {
@@ -473,6 +506,14 @@ int get_user_pages(struct task_struct *tsk, struct mm_struct *mm, unsigned long
 		if ( !vma || (pages && vma->vm_flags & VM_IO) || !(flags & vma->vm_flags) )
 			return i ? : -EFAULT;
 
+		if (is_vm_hugetlb_page(vma)) {
+			i = follow_hugetlb_page(mm, vma, pages, vmas,
+						&start, &len, i);
+			if (i < 0)
+				return i;
+			continue;
+		}
+
 		spin_lock(&mm->page_table_lock);
 		do {
 			struct page *map;
@@ -949,6 +990,7 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	unsigned long address, pte_t *page_table, pte_t pte)
 {
 	struct page *old_page, *new_page;
+	struct pte_chain *pte_chain = NULL;
 
 	old_page = pte_page(pte);
 	if (!VALID_PAGE(old_page))
@@ -971,6 +1013,8 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	page_cache_get(old_page);
 	spin_unlock(&mm->page_table_lock);
 
+	if (pte_chain_reserve(&pte_chain, GFP_KERNEL))
+		goto no_mem;
 	new_page = alloc_page(GFP_HIGHUSER);
 	if (!new_page)
 		goto no_mem;
@@ -983,13 +1027,16 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	if (pte_same(*page_table, pte)) {
 		if (PageReserved(old_page))
 			++mm->rss;
+		page_remove_rmap(old_page, page_table);
 		break_cow(vma, new_page, address, page_table);
+		page_add_rmap(new_page, page_table, &pte_chain);
 		lru_cache_add(new_page);
 
 		/* Free the old page.. */
 		new_page = old_page;
 	}
 	spin_unlock(&mm->page_table_lock);
+	pte_chain_release(pte_chain);
 	page_cache_release(new_page);
 	page_cache_release(old_page);
 	return 1;	/* Minor fault */
@@ -999,6 +1046,7 @@ bad_wp_page:
 	printk("do_wp_page: bogus page at address %08lx (page 0x%lx)\n",address,(unsigned long)old_page);
 	return -1;
 no_mem:
+	pte_chain_release(pte_chain);
 	page_cache_release(old_page);
 	return -1;
 }
@@ -1121,9 +1169,14 @@ static int do_swap_page(struct mm_struct * mm,
 	struct page *page;
 	swp_entry_t entry = pte_to_swp_entry(orig_pte);
 	pte_t pte;
+	struct pte_chain *pte_chain = NULL;
 	int ret = 1;
 
 	spin_unlock(&mm->page_table_lock);
+	if (pte_chain_reserve(&pte_chain, GFP_KERNEL)) {
+		pte_chain_release(pte_chain);
+		return -1;
+	}
 	page = lookup_swap_cache(entry);
 	if (!page) {
 		swapin_readahead(entry);
@@ -1137,6 +1190,7 @@ static int do_swap_page(struct mm_struct * mm,
 			spin_lock(&mm->page_table_lock);
 			retval = pte_same(*page_table, orig_pte) ? -1 : 1;
 			spin_unlock(&mm->page_table_lock);
+			pte_chain_release(pte_chain);
 			return retval;
 		}
 
@@ -1157,6 +1211,7 @@ static int do_swap_page(struct mm_struct * mm,
 		spin_unlock(&mm->page_table_lock);
 		unlock_page(page);
 		page_cache_release(page);
+		pte_chain_release(pte_chain);
 		return 1;
 	}
 
@@ -1175,10 +1230,12 @@ static int do_swap_page(struct mm_struct * mm,
 	flush_page_to_ram(page);
 	flush_icache_page(vma, page);
 	set_pte(page_table, pte);
+	page_add_rmap(page, page_table, &pte_chain);
 
 	/* No need to invalidate - it was non-present before */
 	update_mmu_cache(vma, address, pte);
 	spin_unlock(&mm->page_table_lock);
+	pte_chain_release(pte_chain);
 	return ret;
 }
 
@@ -1189,18 +1246,20 @@ static int do_swap_page(struct mm_struct * mm,
  */
 static int do_anonymous_page(struct mm_struct * mm, struct vm_area_struct * vma, pte_t *page_table, int write_access, unsigned long addr)
 {
+	struct page *page = ZERO_PAGE(addr);
+	struct pte_chain *pte_chain = NULL;
 	pte_t entry;
 
 	/* Read-only mapping of ZERO_PAGE. */
-	entry = pte_wrprotect(mk_pte(ZERO_PAGE(addr), vma->vm_page_prot));
+	entry = pte_wrprotect(mk_pte(page, vma->vm_page_prot));
 
 	/* ..except if it's a write access */
 	if (write_access) {
-		struct page *page;
-
 		/* Allocate our own private page. */
 		spin_unlock(&mm->page_table_lock);
 
+		if (pte_chain_reserve(&pte_chain, GFP_KERNEL))
+			goto no_mem;
 		page = alloc_page(GFP_HIGHUSER);
 		if (!page)
 			goto no_mem;
@@ -1210,6 +1269,7 @@ static int do_anonymous_page(struct mm_struct * mm, struct vm_area_struct * vma,
 		if (!pte_none(*page_table)) {
 			page_cache_release(page);
 			spin_unlock(&mm->page_table_lock);
+			pte_chain_release(pte_chain);
 			return 1;
 		}
 		mm->rss++;
@@ -1219,14 +1279,18 @@ static int do_anonymous_page(struct mm_struct * mm, struct vm_area_struct * vma,
 		mark_page_accessed(page);
 	}
 
+	/* The ZERO_PAGE is reserved, page_add_rmap() leaves it alone */
 	set_pte(page_table, entry);
+	page_add_rmap(page, page_table, &pte_chain);
 
 	/* No need to invalidate - it was non-present before */
 	update_mmu_cache(vma, addr, entry);
 	spin_unlock(&mm->page_table_lock);
+	pte_chain_release(pte_chain);
 	return 1;	/* Minor fault */
 
 no_mem:
+	pte_chain_release(pte_chain);
 	return -1;
 }
 
@@ -1246,6 +1310,7 @@ static int do_no_page(struct mm_struct * mm, struct vm_area_struct * vma,
 	unsigned long address, int write_access, pte_t *page_table)
 {
 	struct page * new_page;
+	struct pte_chain *pte_chain = NULL;
 	pte_t entry;
 
 	if (!vma->vm_ops || !vma->vm_ops->nopage)
@@ -1258,16 +1323,16 @@ static int do_no_page(struct mm_struct * mm, struct vm_area_struct * vma,
 		return 0;
 	if (new_page == NOPAGE_OOM)
 		return -1;
+	if (pte_chain_reserve(&pte_chain, GFP_KERNEL))
+		goto oom;
 
 	/*
 	 * Should we do an early C-O-W break?
 	 */
 	if (write_access && !(vma->vm_flags & VM_SHARED)) {
 		struct page * page = alloc_page(GFP_HIGHUSER);
-		if (!page) {
-			page_cache_release(new_page);
-			return -1;
-		}
+		if (!page)
+			goto oom;
 		copy_user_highpage(page, new_page, address);
 		page_cache_release(new_page);
 		lru_cache_add(page);
@@ -1294,17 +1359,25 @@ static int do_no_page(struct mm_struct * mm, struct vm_area_struct * vma,
 		if (write_access)
 			entry = pte_mkwrite(pte_mkdirty(entry));
 		set_pte(page_table, entry);
+		page_add_rmap(new_page, page_table, &pte_chain);
 	} else {
 		/* One of our sibling threads was faster, back out. */
 		page_cache_release(new_page);
 		spin_unlock(&mm->page_table_lock);
+		pte_chain_release(pte_chain);
 		return 1;
 	}
 
 	/* no need to invalidate: a not-present page shouldn't be cached */
 	update_mmu_cache(vma, address, entry);
 	spin_unlock(&mm->page_table_lock);
+	pte_chain_release(pte_chain);
 	return 2;	/* Major fault */
+
+oom:
+	page_cache_release(new_page);
+	pte_chain_release(pte_chain);
+	return -1;
 }
 
 /*
@@ -1368,6 +1441,11 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct * vma,
 	pmd_t *pmd;
 
 	current->state = TASK_RUNNING;
+
+	/* Huge pages are all mapped up front: this one has been truncated */
+	if (is_vm_hugetlb_page(vma))
+		return 0;
+
 	pgd = pgd_offset(mm, address);
 
 	/*
@@ -1451,12 +1529,76 @@ pte_t *pte_alloc(struct mm_struct *mm, pmd_t *pmd, unsigned long address)
 				goto out;
 			}
 		}
+		pgtable_add_rmap(new, mm, address);
 		pmd_populate(mm, pmd, new);
 	}
 out:
 	return pte_offset(pmd, address);
 }
 
+/*
+ * Make "page" the private anonymous page at "address" in a vma,
+ * dropping whatever was mapped there.  This lets a receive path hand a
+ * page it has just filled to user space instead of copying it.  The
+ * caller holds mmap_sem, has checked that the vma is a private writable
+ * anonymous mapping and that nobody else knows about the page, and
+ * gives us a reference to it.
+ */
+int install_anon_page(struct vm_area_struct *vma, unsigned long address,
+		      struct page *page)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct pte_chain *pte_chain = NULL;
+	pgd_t *pgd;
+	pmd_t *pmd;
+	pte_t *ptep, pte;
+
+	if (pte_chain_reserve(&pte_chain, GFP_KERNEL)) {
+		pte_chain_release(pte_chain);
+		return -ENOMEM;
+	}
+	pgd = pgd_offset(mm, address);
+	spin_lock(&mm->page_table_lock);
+	pmd = pmd_alloc(mm, pgd, address);
+	if (!pmd)
+		goto nomem;
+	ptep = pte_alloc(mm, pmd, address);
+	if (!ptep)
+		goto nomem;
+
+	pte = ptep_get_and_clear(ptep);
+	if (pte_none(pte)) {
+		++mm->rss;
+	} else if (pte_present(pte)) {
+		struct page *old_page = pte_page(pte);
+
+		flush_tlb_page(vma, address);
+		if (VALID_PAGE(old_page) && !PageReserved(old_page)) {
+			page_remove_rmap(old_page, ptep);
+			free_page_and_swap_cache(old_page);
+		} else
+			++mm->rss;
+	} else {
+		free_swap_and_cache(pte_to_swp_entry(pte));
+		++mm->rss;
+	}
+
+	flush_page_to_ram(page);
+	pte = pte_mkwrite(pte_mkdirty(mk_pte(page, vma->vm_page_prot)));
+	set_pte(ptep, pte);
+	page_add_rmap(page, ptep, &pte_chain);
+	lru_cache_add(page);
+	update_mmu_cache(vma, address, pte);
+	spin_unlock(&mm->page_table_lock);
+	pte_chain_release(pte_chain);
+	return 0;
+
+nomem:
+	spin_unlock(&mm->page_table_lock);
+	pte_chain_release(pte_chain);
+	return -ENOMEM;
+}
+
 int make_pages_present(unsigned long addr, unsigned long end)
 {
 	int ret, len, write;
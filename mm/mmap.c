@@ -14,6 +14,7 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/personality.h>
+#include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgalloc.h>
@@ -940,6 +941,17 @@ int do_munmap(struct mm_struct *mm, unsigned long addr, size_t len)
 	if (mpnt->vm_start >= addr+len)
 		return 0;
 
+#ifdef CONFIG_HUGETLB_PAGE
+	/* Huge page mappings can only be split at huge page boundaries */
+	if ((addr | len) & ~HPAGE_MASK) {
+		struct vm_area_struct *vma;
+
+		for (vma = mpnt; vma && vma->vm_start < addr+len; vma = vma->vm_next)
+			if (is_vm_hugetlb_page(vma))
+				return -EINVAL;
+	}
+#endif
+
 	/* If we'll make "hole", check the vm areas limit */
 	if ((mpnt->vm_start < addr && mpnt->vm_end > addr+len)
 	    && mm->map_count >= max_map_count)
@@ -990,7 +1002,10 @@ int do_munmap(struct mm_struct *mm, unsigned long addr, size_t len)
 		remove_shared_vm_struct(mpnt);
 		mm->map_count--;
 
-		zap_page_range(mm, st, size);
+		if (is_vm_hugetlb_page(mpnt))
+			zap_hugepage_range(mpnt, st, size);
+		else
+			zap_page_range(mm, st, size);
 
 		/*
 		 * Fix the mapping, and free the old area if it wasn't reused.
@@ -1147,7 +1162,10 @@ void exit_mmap(struct mm_struct * mm)
 		}
 		mm->map_count--;
 		remove_shared_vm_struct(mpnt);
-		zap_page_range(mm, start, size);
+		if (is_vm_hugetlb_page(mpnt))
+			zap_hugepage_range(mpnt, start, size);
+		else
+			zap_page_range(mm, start, size);
 		if (mpnt->vm_file)
 			fput(mpnt->vm_file);
 		kmem_cache_free(vm_area_cachep, mpnt);
@@ -9,6 +9,8 @@
 #include <linux/shm.h>
 #include <linux/mman.h>
 #include <linux/swap.h>
+#include <linux/rmap.h>
+#include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgalloc.h>
@@ -70,6 +72,8 @@ static inline int copy_one_pte(struct mm_struct *mm, pte_t * src, pte_t * dst)
 			error++;
 		}
 		set_pte(dst, pte);
+		if (pte_present(pte))
+			page_move_rmap(pte_page(pte), src, dst);
 	}
 	return error;
 }
@@ -224,6 +228,11 @@ unsigned long do_mremap(unsigned long addr,
 	if (addr & ~PAGE_MASK)
 		goto out;
 
+	/* Huge page mappings can be neither moved nor resized */
+	vma = find_vma(current->mm, addr);
+	if (vma && vma->vm_start <= addr && is_vm_hugetlb_page(vma))
+		goto out;
+
 	old_len = PAGE_ALIGN(old_len);
 	new_len = PAGE_ALIGN(new_len);
 
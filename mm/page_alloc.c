@@ -21,6 +21,7 @@
 #include <linux/bootmem.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/seq_file.h>
 
 int nr_swap_pages;
 int nr_active_pages;
@@ -78,41 +79,16 @@ static int zone_balance_max[MAX_NR_ZONES] __initdata = { 255 , 255, 255, };
  * -- wli
  */
 
-static void FASTCALL(__free_pages_ok (struct page *page, unsigned int order));
-static void __free_pages_ok (struct page *page, unsigned int order)
+static void FASTCALL(__free_pages_ok (struct page *page, unsigned int order, int cold));
+
+/*
+ * Merge a freed block back into the buddy lists.  Caller holds zone->lock.
+ */
+static void __free_one_page (zone_t *zone, struct page *page, unsigned int order)
 {
-	unsigned long index, page_idx, mask, flags;
+	unsigned long index, page_idx, mask;
 	free_area_t *area;
 	struct page *base;
-	zone_t *zone;
-
-	/*
-	 * Yes, think what happens when other parts of the kernel take 
-	 * a reference to a page in order to pin it for io. -ben
-	 */
-	if (PageLRU(page)) {
-		if (unlikely(in_interrupt()))
-			BUG();
-		lru_cache_del(page);
-	}
-
-	if (page->buffers)
-		BUG();
-	if (page->mapping)
-		BUG();
-	if (!VALID_PAGE(page))
-		BUG();
-	if (PageLocked(page))
-		BUG();
-	if (PageActive(page))
-		BUG();
-	page->flags &= ~((1<<PG_referenced) | (1<<PG_dirty));
-
-	if (current->flags & PF_FREE_PAGES)
-		goto local_freelist;
- back_local_freelist:
-
-	zone = page_zone(page);
 
 	mask = (~0UL) << order;
 	base = zone->zone_mem_map;
@@ -123,8 +99,6 @@ static void __free_pages_ok (struct page *page, unsigned int order)
 
 	area = zone->free_area + order;
 
-	spin_lock_irqsave(&zone->lock, flags);
-
 	zone->free_pages -= mask;
 
 	while (mask + (1 << (MAX_ORDER-1))) {
@@ -156,7 +130,85 @@ static void __free_pages_ok (struct page *page, unsigned int order)
 		page_idx &= mask;
 	}
 	list_add(&(base + page_idx)->list, &area->free_list);
+}
+
+/*
+ * Hand up to count order-0 pages from the cold end of a per-CPU list
+ * back to the buddy allocator, under a single zone->lock round trip.
+ * Returns the number of pages freed.  Called with interrupts disabled.
+ */
+static int free_pages_bulk(zone_t *zone, int count, struct list_head *list)
+{
+	struct page *page;
+	int ret = 0;
+
+	spin_lock(&zone->lock);
+	while (!list_empty(list) && count--) {
+		page = list_entry(list->prev, struct page, list);
+		list_del(&page->list);
+		__free_one_page(zone, page, 0);
+		ret++;
+	}
+	spin_unlock(&zone->lock);
+	return ret;
+}
+
+static void free_hot_cold_page(zone_t *zone, struct page *page, int cold)
+{
+	struct per_cpu_pages *pcp;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pcp = &zone->pageset[smp_processor_id()].pcp[cold];
+	if (pcp->count >= pcp->high)
+		pcp->count -= free_pages_bulk(zone, pcp->batch, &pcp->list);
+	list_add(&page->list, &pcp->list);
+	pcp->count++;
+	local_irq_restore(flags);
+}
+
+static void __free_pages_ok (struct page *page, unsigned int order, int cold)
+{
+	unsigned long flags;
+	zone_t *zone;
+
+	/*
+	 * Yes, think what happens when other parts of the kernel take 
+	 * a reference to a page in order to pin it for io. -ben
+	 */
+	if (PageLRU(page)) {
+		if (unlikely(in_interrupt()))
+			BUG();
+		lru_cache_del(page);
+	}
+
+	if (page->buffers)
+		BUG();
+	if (page->mapping)
+		BUG();
+	if (page_mapped(page))
+		BUG();
+	if (!VALID_PAGE(page))
+		BUG();
+	if (PageLocked(page))
+		BUG();
+	if (PageActive(page))
+		BUG();
+	page->flags &= ~((1<<PG_referenced) | (1<<PG_dirty));
+
+	if (current->flags & PF_FREE_PAGES)
+		goto local_freelist;
+ back_local_freelist:
+
+	zone = page_zone(page);
 
+	if (order == 0) {
+		free_hot_cold_page(zone, page, cold);
+		return;
+	}
+
+	spin_lock_irqsave(&zone->lock, flags);
+	__free_one_page(zone, page, order);
 	spin_unlock_irqrestore(&zone->lock, flags);
 	return;
 
@@ -195,16 +247,17 @@ static inline struct page * expand (zone_t *zone, struct page *page,
 	return page;
 }
 
-static FASTCALL(struct page * rmqueue(zone_t *zone, unsigned int order));
-static struct page * rmqueue(zone_t *zone, unsigned int order)
+/*
+ * Take a block of the given order off the buddy lists.  Caller holds
+ * zone->lock.
+ */
+static struct page * __rmqueue(zone_t *zone, unsigned int order)
 {
 	free_area_t * area = zone->free_area + order;
 	unsigned int curr_order = order;
 	struct list_head *head, *curr;
-	unsigned long flags;
 	struct page *page;
 
-	spin_lock_irqsave(&zone->lock, flags);
 	do {
 		head = &area->free_list;
 		curr = head->next;
@@ -221,26 +274,116 @@ static struct page * rmqueue(zone_t *zone, unsigned int order)
 				MARK_USED(index, curr_order, area);
 			zone->free_pages -= 1UL << order;
 
-			page = expand(zone, page, index, order, curr_order, area);
-			spin_unlock_irqrestore(&zone->lock, flags);
-
-			set_page_count(page, 1);
-			if (BAD_RANGE(zone,page))
-				BUG();
-			if (PageLRU(page))
-				BUG();
-			if (PageActive(page))
-				BUG();
-			return page;	
+			return expand(zone, page, index, order, curr_order, area);
 		}
 		curr_order++;
 		area++;
 	} while (curr_order < MAX_ORDER);
-	spin_unlock_irqrestore(&zone->lock, flags);
 
 	return NULL;
 }
 
+/*
+ * Move up to count order-0 pages from the buddy lists onto a per-CPU
+ * list, under a single zone->lock round trip.  Returns the number of
+ * pages moved.  Called with interrupts disabled.
+ */
+static int rmqueue_bulk(zone_t *zone, int count, struct list_head *list)
+{
+	struct page *page;
+	int i;
+
+	spin_lock(&zone->lock);
+	for (i = 0; i < count; i++) {
+		page = __rmqueue(zone, 0);
+		if (page == NULL)
+			break;
+		list_add_tail(&page->list, list);
+	}
+	spin_unlock(&zone->lock);
+	return i;
+}
+
+static FASTCALL(struct page * rmqueue(zone_t *zone, unsigned int order, int cold));
+static struct page * rmqueue(zone_t *zone, unsigned int order, int cold)
+{
+	unsigned long flags;
+	struct page *page = NULL;
+
+	if (order == 0) {
+		struct per_cpu_pages *pcp;
+
+		local_irq_save(flags);
+		pcp = &zone->pageset[smp_processor_id()].pcp[cold];
+		if (pcp->count <= pcp->low)
+			pcp->count += rmqueue_bulk(zone, pcp->batch, &pcp->list);
+		if (pcp->count) {
+			page = list_entry(pcp->list.next, struct page, list);
+			list_del(&page->list);
+			pcp->count--;
+		}
+		local_irq_restore(flags);
+	}
+
+	if (page == NULL) {
+		spin_lock_irqsave(&zone->lock, flags);
+		page = __rmqueue(zone, order);
+		spin_unlock_irqrestore(&zone->lock, flags);
+		if (page == NULL)
+			return NULL;
+	}
+
+	set_page_count(page, 1);
+	if (BAD_RANGE(zone,page))
+		BUG();
+	if (PageLRU(page))
+		BUG();
+	if (PageActive(page))
+		BUG();
+	return page;
+}
+
+/*
+ * Give the pages on this CPU's lists back to the buddy allocator.
+ */
+static void drain_local_pages(void)
+{
+	struct per_cpu_pageset *pset;
+	unsigned long flags;
+	zone_t *zone;
+	int cold;
+
+	local_irq_save(flags);
+	for_each_zone(zone) {
+		pset = &zone->pageset[smp_processor_id()];
+		for (cold = 0; cold < 2; cold++)
+			if (pset->pcp[cold].count)
+				pset->pcp[cold].count -= free_pages_bulk(zone,
+					pset->pcp[cold].count, &pset->pcp[cold].list);
+	}
+	local_irq_restore(flags);
+}
+
+#ifdef CONFIG_SMP
+static void drain_pages_ipi(void *info)
+{
+	drain_local_pages();
+}
+#endif
+
+/*
+ * Drain the lists of every CPU if we may wait for the others, of this
+ * one only otherwise (interrupts may be disabled).
+ */
+static void drain_cpu_pages(unsigned int gfp_mask)
+{
+#ifdef CONFIG_SMP
+	if ((gfp_mask & __GFP_WAIT) && !in_interrupt())
+		smp_call_function(drain_pages_ipi, NULL, 0, 1);
+#endif
+	drain_local_pages();
+}
+
 #ifndef CONFIG_DISCONTIGMEM
 struct page *_alloc_pages(unsigned int gfp_mask, unsigned int order)
 {
@@ -310,7 +453,7 @@ static struct page * balance_classzone(zone_t * classzone, unsigned int gfp_mask
 		while ((entry = local_pages->prev) != local_pages) {
 			list_del(entry);
 			tmp = list_entry(entry, struct page, list);
-			__free_pages_ok(tmp, tmp->index);
+			__free_pages_ok(tmp, tmp->index, 1);
 			if (!nr_pages--)
 				BUG();
 		}
@@ -329,8 +472,9 @@ struct page * __alloc_pages(unsigned int gfp_mask, unsigned int order, zonelist_
 	unsigned long min;
 	zone_t **zone, * classzone;
 	struct page * page;
-	int freed;
+	int freed, cold, drained = 0;
 
+	cold = (gfp_mask & __GFP_COLD) != 0;
 	zone = zonelist->zones;
 	classzone = *zone;
 	if (classzone == NULL)
@@ -343,7 +487,7 @@ struct page * __alloc_pages(unsigned int gfp_mask, unsigned int order, zonelist_
 
 		min += z->pages_low;
 		if (z->free_pages > min) {
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -354,6 +498,7 @@ struct page * __alloc_pages(unsigned int gfp_mask, unsigned int order, zonelist_
 	if (waitqueue_active(&kswapd_wait))
 		wake_up_interruptible(&kswapd_wait);
 
+try_min:
 	zone = zonelist->zones;
 	min = 1UL << order;
 	for (;;) {
@@ -367,7 +512,7 @@ struct page * __alloc_pages(unsigned int gfp_mask, unsigned int order, zonelist_
 			local_min >>= 2;
 		min += local_min;
 		if (z->free_pages > min) {
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -375,6 +520,16 @@ struct page * __alloc_pages(unsigned int gfp_mask, unsigned int order, zonelist_
 
 	/* here we're in the low on memory slow path */
 
+	/*
+	 * The per-CPU lists may hold the pages we need, unseen by the
+	 * watermarks; give them back before reclaiming or failing.
+	 */
+	if (!drained) {
+		drain_cpu_pages(gfp_mask);
+		drained = 1;
+		goto try_min;
+	}
+
 rebalance:
 	if (current->flags & (PF_MEMALLOC | PF_MEMDIE)) {
 		zone = zonelist->zones;
@@ -383,7 +538,7 @@ rebalance:
 			if (!z)
 				break;
 
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -398,6 +553,9 @@ rebalance:
 	if (page)
 		return page;
 
+	/* Pages freed by reclaim went to this CPU's lists */
+	drain_local_pages();
+
 	zone = zonelist->zones;
 	min = 1UL << order;
 	for (;;) {
@@ -407,7 +565,7 @@ rebalance:
 
 		min += z->pages_min;
 		if (z->free_pages > min) {
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -451,7 +609,17 @@ unsigned long get_zeroed_page(unsigned int gfp_mask)
 void __free_pages(struct page *page, unsigned int order)
 {
 	if (!PageReserved(page) && put_page_testzero(page))
-		__free_pages_ok(page, order);
+		__free_pages_ok(page, order, 0);
+}
+
+/*
+ * Free a page whose contents are not expected to be in the CPU cache,
+ * so that it is handed out again after the hot ones.
+ */
+void free_cold_page(struct page *page)
+{
+	if (!PageReserved(page) && put_page_testzero(page))
+		__free_pages_ok(page, 0, 1);
 }
 
 void free_pages(unsigned long addr, unsigned int order)
@@ -727,7 +895,7 @@ void __init free_area_init_core(int nid, pg_data_t *pgdat, struct page **gmap,
 	offset = lmem_map - mem_map;	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
 		zone_t *zone = pgdat->node_zones + j;
-		unsigned long mask;
+		unsigned long mask, batch;
 		unsigned long size, realsize;
 
 		zone_table[nid * MAX_NR_ZONES + j] = zone;
@@ -742,6 +910,35 @@ void __init free_area_init_core(int nid, pg_data_t *pgdat, struct page **gmap,
 		zone->zone_pgdat = pgdat;
 		zone->free_pages = 0;
 		zone->need_balance = 0;
+
+		/*
+		 * Per-CPU batches of about a quarter of a permille of the
+		 * zone, capped at 256kB: big enough to amortise the lock,
+		 * small enough that pages stranded on idle CPUs don't matter.
+		 */
+		batch = realsize / 4096;
+		if (batch * PAGE_SIZE > 256*1024)
+			batch = (256*1024) / PAGE_SIZE;
+		if (batch < 1)
+			batch = 1;
+		for (i = 0; i < NR_CPUS; i++) {
+			struct per_cpu_pages *pcp;
+
+			pcp = &zone->pageset[i].pcp[0];	/* hot */
+			pcp->count = 0;
+			pcp->low = 2 * batch;
+			pcp->high = 6 * batch;
+			pcp->batch = batch;
+			INIT_LIST_HEAD(&pcp->list);
+
+			pcp = &zone->pageset[i].pcp[1];	/* cold */
+			pcp->count = 0;
+			pcp->low = 0;
+			pcp->high = 2 * batch;
+			pcp->batch = batch;
+			INIT_LIST_HEAD(&pcp->list);
+		}
+
 		if (!size)
 			continue;
 
@@ -852,3 +1049,68 @@ static int __init setup_mem_frac(char *str)
 }
 
 __setup("memfrac=", setup_mem_frac);
+
+#ifdef CONFIG_PROC_FS
+/*
+ * /proc/pagesetinfo: the per-CPU hot and cold page lists of every
+ * populated zone, one line per CPU.
+ */
+static void *pageset_start(struct seq_file *m, loff_t *pos)
+{
+	loff_t n = *pos;
+	zone_t *zone;
+
+	for_each_zone(zone) {
+		if (!zone->size)
+			continue;
+		if (!n--)
+			return zone;
+	}
+	return NULL;
+}
+
+static void *pageset_next(struct seq_file *m, void *p, loff_t *pos)
+{
+	zone_t *zone = p;
+
+	++*pos;
+	while ((zone = next_zone(zone)) != NULL)
+		if (zone->size)
+			return zone;
+	return NULL;
+}
+
+static void pageset_stop(struct seq_file *m, void *p)
+{
+}
+
+static int pageset_show(struct seq_file *m, void *p)
+{
+	zone_t *zone = p;
+	int i;
+
+	seq_printf(m, "Node %d, zone %8s\n",
+		   zone->zone_pgdat->node_id, zone->name);
+	seq_printf(m, "%4s %8s %6s %6s %6s %8s %6s %6s %6s\n", "cpu",
+		   "hot", "low", "high", "batch", "cold", "low", "high", "batch");
+	for (i = 0; i < smp_num_cpus; i++) {
+		struct per_cpu_pageset *pset;
+
+		pset = &zone->pageset[cpu_logical_map(i)];
+		seq_printf(m, "%4d %8d %6d %6d %6d %8d %6d %6d %6d\n",
+			   cpu_logical_map(i),
+			   pset->pcp[0].count, pset->pcp[0].low,
+			   pset->pcp[0].high, pset->pcp[0].batch,
+			   pset->pcp[1].count, pset->pcp[1].low,
+			   pset->pcp[1].high, pset->pcp[1].batch);
+	}
+	return 0;
+}
+
+struct seq_operations pagesetinfo_op = {
+	start:	pageset_start,
+	next:	pageset_next,
+	stop:	pageset_stop,
+	show:	pageset_show,
+};
+#endif /* CONFIG_PROC_FS */
@@ -0,0 +1,350 @@
+/*
+ *  linux/mm/rmap.c
+ *
+ *  Reverse mapping: for each page mapped into user page tables, keep
+ *  track of the ptes that map it.  This lets page reclaim unmap the
+ *  page it picked off the inactive list directly, instead of scanning
+ *  every process' page tables hoping to come across it.
+ *
+ *  A page mapped by a single pte (by far the common case) points to
+ *  that pte directly.  Once a second mapping is added the page gets a
+ *  chain of pte_chain entries instead.
+ *
+ *  Locking:
+ *	- page->pte is protected by the PG_chainlock bit;
+ *	- pte_chain_lock nests inside mm->page_table_lock, so the unmap
+ *	  side, which starts from the page, may only trylock the latter.
+ *
+ *  Recording a mapping must not fail, or reclaim would never find the
+ *  pte again.  So the pte_chains page_add_rmap() may need are set aside
+ *  by the caller with pte_chain_reserve() before it takes the
+ *  page_table_lock, while it can still sleep.
+ */
+
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/swap.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/rmap.h>
+
+#include <asm/pgalloc.h>
+
+struct pte_chain {
+	struct pte_chain *next;
+	pte_t *ptep;
+};
+
+static kmem_cache_t *pte_chain_cache;
+
+static inline void pte_chain_free(struct pte_chain *pc)
+{
+	kmem_cache_free(pte_chain_cache, pc);
+}
+
+/**
+ * pte_chain_reserve - set aside pte_chains for page_add_rmap()
+ * @res: the caller's reserve, NULL to begin with
+ * @gfp_mask: how to allocate
+ *
+ * Tops @res up to the two pte_chains a single page_add_rmap() can
+ * use.  Returns 0 or -ENOMEM; on failure whatever was already there
+ * stays in @res.  Hand it back with pte_chain_release() when done.
+ */
+int pte_chain_reserve(struct pte_chain **res, int gfp_mask)
+{
+	struct pte_chain *pc;
+
+	while (!*res || !(*res)->next) {
+		pc = kmem_cache_alloc(pte_chain_cache, gfp_mask);
+		if (!pc)
+			return -ENOMEM;
+		pc->next = *res;
+		*res = pc;
+	}
+	return 0;
+}
+
+/**
+ * pte_chain_release - free what is left of a reserve
+ * @res: the reserve
+ */
+void pte_chain_release(struct pte_chain *res)
+{
+	struct pte_chain *pc;
+
+	while ((pc = res) != NULL) {
+		res = pc->next;
+		pte_chain_free(pc);
+	}
+}
+
+/* Take a pte_chain from the reserve and fill it in */
+static inline struct pte_chain *pte_chain_take(struct pte_chain **res,
+					       pte_t *ptep,
+					       struct pte_chain *next)
+{
+	struct pte_chain *pc = *res;
+
+	if (!pc)
+		BUG();
+	*res = pc->next;
+	pc->ptep = ptep;
+	pc->next = next;
+	return pc;
+}
+
+/* Go back to a direct pointer once a chain is down to a single entry */
+static inline void pte_chain_collapse(struct page *page)
+{
+	struct pte_chain *pc = page->pte.chain;
+
+	if (pc && !pc->next) {
+		page->pte.direct = pc->ptep;
+		SetPageDirect(page);
+		pte_chain_free(pc);
+	}
+}
+
+/**
+ * page_referenced - test and clear the accessed bits of a page's ptes
+ * @page: the page to test
+ *
+ * Returns the number of ptes that had their accessed bit set.
+ */
+int page_referenced(struct page *page)
+{
+	struct pte_chain *pc;
+	int referenced = 0;
+
+	if (!page_mapped(page))
+		return 0;
+
+	pte_chain_lock(page);
+	if (PageDirect(page)) {
+		if (ptep_test_and_clear_young(page->pte.direct))
+			referenced++;
+	} else {
+		for (pc = page->pte.chain; pc; pc = pc->next)
+			if (ptep_test_and_clear_young(pc->ptep))
+				referenced++;
+	}
+	pte_chain_unlock(page);
+	return referenced;
+}
+
+/**
+ * page_add_rmap - record a new pte mapping a page
+ * @page: the page
+ * @ptep: the pte that now maps it
+ * @res: pte_chains set aside by pte_chain_reserve()
+ *
+ * Called with the page_table_lock of the mm the pte belongs to held.
+ * Takes what it needs from @res, so it cannot fail.
+ */
+void page_add_rmap(struct page *page, pte_t *ptep, struct pte_chain **res)
+{
+	if (!VALID_PAGE(page) || PageReserved(page))
+		return;
+
+	pte_chain_lock(page);
+	if (!page_mapped(page)) {
+		page->pte.direct = ptep;
+		SetPageDirect(page);
+		goto out;
+	}
+
+	if (PageDirect(page)) {
+		page->pte.chain = pte_chain_take(res, page->pte.direct, NULL);
+		ClearPageDirect(page);
+	}
+	page->pte.chain = pte_chain_take(res, ptep, page->pte.chain);
+out:
+	pte_chain_unlock(page);
+}
+
+/**
+ * page_remove_rmap - forget a pte that no longer maps a page
+ * @page: the page
+ * @ptep: the pte that used to map it
+ *
+ * Called with the page_table_lock of the mm the pte belongs to held.
+ */
+void page_remove_rmap(struct page *page, pte_t *ptep)
+{
+	struct pte_chain *pc, **pprev;
+
+	if (!VALID_PAGE(page) || PageReserved(page))
+		return;
+
+	pte_chain_lock(page);
+	if (PageDirect(page)) {
+		if (page->pte.direct == ptep) {
+			page->pte.direct = NULL;
+			ClearPageDirect(page);
+		}
+		goto out;
+	}
+
+	for (pprev = &page->pte.chain; (pc = *pprev) != NULL; pprev = &pc->next) {
+		if (pc->ptep == ptep) {
+			*pprev = pc->next;
+			pte_chain_free(pc);
+			break;
+		}
+	}
+	pte_chain_collapse(page);
+out:
+	pte_chain_unlock(page);
+}
+
+/**
+ * page_move_rmap - a page's mapping has moved to another pte
+ * @page: the page
+ * @old: the pte that used to map it
+ * @new: the pte that maps it now
+ *
+ * Used by mremap(), which moves ptes around under the page_table_lock.
+ * The entry is rewritten in place, so nothing needs allocating.
+ */
+void page_move_rmap(struct page *page, pte_t *old, pte_t *new)
+{
+	struct pte_chain *pc;
+
+	if (!VALID_PAGE(page) || PageReserved(page))
+		return;
+
+	pte_chain_lock(page);
+	if (PageDirect(page)) {
+		if (page->pte.direct == old)
+			page->pte.direct = new;
+		goto out;
+	}
+
+	for (pc = page->pte.chain; pc; pc = pc->next) {
+		if (pc->ptep == old) {
+			pc->ptep = new;
+			break;
+		}
+	}
+out:
+	pte_chain_unlock(page);
+}
+
+/*
+ * Unmap one pte of a page.  The page is locked and pinned by the
+ * caller, which also holds its pte_chain_lock.
+ */
+static int try_to_unmap_one(struct page *page, pte_t *ptep)
+{
+	struct mm_struct *mm = ptep_to_mm(ptep);
+	unsigned long address = ptep_to_address(ptep);
+	struct vm_area_struct *vma;
+	pte_t pte;
+	int ret = SWAP_FAIL;
+
+	if (!mm)
+		return SWAP_FAIL;
+	if (!spin_trylock(&mm->page_table_lock))
+		return SWAP_AGAIN;
+
+	/* The vma list is stable under the page_table_lock */
+	vma = find_vma(mm, address);
+	if (!vma || (vma->vm_flags & (VM_LOCKED | VM_RESERVED)))
+		goto out_unlock;
+
+	/*
+	 * An anonymous page must have been given a swap entry for the
+	 * pte to point at.  Truncate can also leave anonymous pages
+	 * behind with buffers but no mapping; those stay mapped.
+	 */
+	if (!page->mapping)
+		goto out_unlock;
+
+	/* Recently used through this mapping: leave it alone. */
+	if (ptep_test_and_clear_young(ptep))
+		goto out_unlock;
+
+	flush_cache_page(vma, address);
+	pte = ptep_get_and_clear(ptep);
+	flush_tlb_page(vma, address);
+
+	if (PageSwapCache(page)) {
+		swp_entry_t entry;
+
+		entry.val = page->index;
+		swap_duplicate(entry);
+		set_pte(ptep, swp_entry_to_pte(entry));
+	}
+
+	if (pte_dirty(pte))
+		set_page_dirty(page);
+
+	mm->rss--;
+	page_cache_release(page);
+	ret = SWAP_SUCCESS;
+
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/**
+ * try_to_unmap - remove all ptes that map a page
+ * @page: the page, locked and pinned by the caller
+ *
+ * Returns SWAP_SUCCESS if the page is no longer mapped, SWAP_AGAIN if
+ * some page table lock was busy, and SWAP_FAIL if a mapping cannot or
+ * should not be removed.
+ */
+int try_to_unmap(struct page *page)
+{
+	struct pte_chain *pc, **pprev;
+	int ret = SWAP_SUCCESS;
+
+	if (!PageLocked(page))
+		BUG();
+	if (!page_mapped(page))
+		return SWAP_SUCCESS;
+
+	pte_chain_lock(page);
+	if (PageDirect(page)) {
+		ret = try_to_unmap_one(page, page->pte.direct);
+		if (ret == SWAP_SUCCESS) {
+			page->pte.direct = NULL;
+			ClearPageDirect(page);
+		}
+		goto out;
+	}
+
+	pprev = &page->pte.chain;
+	while ((pc = *pprev) != NULL) {
+		switch (try_to_unmap_one(page, pc->ptep)) {
+		case SWAP_SUCCESS:
+			*pprev = pc->next;
+			pte_chain_free(pc);
+			continue;
+		case SWAP_AGAIN:
+			ret = SWAP_AGAIN;
+			break;
+		case SWAP_FAIL:
+			ret = SWAP_FAIL;
+			goto out_collapse;
+		}
+		pprev = &pc->next;
+	}
+out_collapse:
+	pte_chain_collapse(page);
+out:
+	pte_chain_unlock(page);
+	return ret;
+}
+
+void __init pte_chain_init(void)
+{
+	pte_chain_cache = kmem_cache_create("pte_chain",
+					    sizeof(struct pte_chain), 0,
+					    0, NULL, NULL);
+	if (!pte_chain_cache)
+		panic("pte_chain_init: cannot create pte_chain cache");
+}
@@ -14,6 +14,8 @@
 #include <linux/vmalloc.h>
 #include <linux/pagemap.h>
 #include <linux/shm.h>
+#include <linux/rmap.h>
+#include <linux/hugetlb.h>
 
 #include <asm/pgtable.h>
 
@@ -360,10 +362,15 @@ void free_swap_and_cache(swp_entry_t entry)
  * after one process has exited).  We don't know just how many PTEs will
  * share this swap entry, so be cautious and let do_wp_page work out
  * what to do if a write is requested later.
+ *
+ * We cannot sleep here to refill the pte_chain reserve.  If it runs
+ * out, the pte is left pointing at swap and try_to_unuse() finds the
+ * entry again on a later pass, after topping the reserve up.
  */
 /* mmlist_lock and vma->vm_mm->page_table_lock are held */
 static inline void unuse_pte(struct vm_area_struct * vma, unsigned long address,
-	pte_t *dir, swp_entry_t entry, struct page* page)
+	pte_t *dir, swp_entry_t entry, struct page* page,
+	struct pte_chain **pte_chain)
 {
 	pte_t pte = *dir;
 
@@ -371,8 +378,11 @@ static inline void unuse_pte(struct vm_area_struct * vma, unsigned long address,
 		return;
 	if (unlikely(pte_none(pte) || pte_present(pte)))
 		return;
+	if (pte_chain_reserve(pte_chain, GFP_ATOMIC))
+		return;
 	get_page(page);
 	set_pte(dir, pte_mkold(mk_pte(page, vma->vm_page_prot)));
+	page_add_rmap(page, dir, pte_chain);
 	swap_free(entry);
 	++vma->vm_mm->rss;
 }
@@ -380,7 +390,7 @@ static inline void unuse_pte(struct vm_area_struct * vma, unsigned long address,
 /* mmlist_lock and vma->vm_mm->page_table_lock are held */
 static inline void unuse_pmd(struct vm_area_struct * vma, pmd_t *dir,
 	unsigned long address, unsigned long size, unsigned long offset,
-	swp_entry_t entry, struct page* page)
+	swp_entry_t entry, struct page* page, struct pte_chain **pte_chain)
 {
 	pte_t * pte;
 	unsigned long end;
@@ -399,7 +409,8 @@ static inline void unuse_pmd(struct vm_area_struct * vma, pmd_t *dir,
 	if (end > PMD_SIZE)
 		end = PMD_SIZE;
 	do {
-		unuse_pte(vma, offset+address-vma->vm_start, pte, entry, page);
+		unuse_pte(vma, offset+address-vma->vm_start, pte, entry, page,
+			  pte_chain);
 		address += PAGE_SIZE;
 		pte++;
 	} while (address && (address < end));
@@ -408,7 +419,7 @@ static inline void unuse_pmd(struct vm_area_struct * vma, pmd_t *dir,
 /* mmlist_lock and vma->vm_mm->page_table_lock are held */
 static inline void unuse_pgd(struct vm_area_struct * vma, pgd_t *dir,
 	unsigned long address, unsigned long size,
-	swp_entry_t entry, struct page* page)
+	swp_entry_t entry, struct page* page, struct pte_chain **pte_chain)
 {
 	pmd_t * pmd;
 	unsigned long offset, end;
@@ -430,7 +441,7 @@ static inline void unuse_pgd(struct vm_area_struct * vma, pgd_t *dir,
 		BUG();
 	do {
 		unuse_pmd(vma, pmd, address, end - address, offset, entry,
-			  page);
+			  page, pte_chain);
 		address = (address + PMD_SIZE) & PMD_MASK;
 		pmd++;
 	} while (address && (address < end));
@@ -438,21 +449,24 @@ static inline void unuse_pgd(struct vm_area_struct * vma, pgd_t *dir,
 
 /* mmlist_lock and vma->vm_mm->page_table_lock are held */
 static void unuse_vma(struct vm_area_struct * vma, pgd_t *pgdir,
-			swp_entry_t entry, struct page* page)
+			swp_entry_t entry, struct page* page,
+			struct pte_chain **pte_chain)
 {
 	unsigned long start = vma->vm_start, end = vma->vm_end;
 
 	if (start >= end)
 		BUG();
 	do {
-		unuse_pgd(vma, pgdir, start, end - start, entry, page);
+		unuse_pgd(vma, pgdir, start, end - start, entry, page,
+			  pte_chain);
 		start = (start + PGDIR_SIZE) & PGDIR_MASK;
 		pgdir++;
 	} while (start && (start < end));
 }
 
 static void unuse_process(struct mm_struct * mm,
-			swp_entry_t entry, struct page* page)
+			swp_entry_t entry, struct page* page,
+			struct pte_chain **pte_chain)
 {
 	struct vm_area_struct* vma;
 
@@ -462,7 +476,10 @@ static void unuse_process(struct mm_struct * mm,
 	spin_lock(&mm->page_table_lock);
 	for (vma = mm->mmap; vma; vma = vma->vm_next) {
 		pgd_t * pgd = pgd_offset(mm, vma->vm_start);
-		unuse_vma(vma, pgd, entry, page);
+
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		unuse_vma(vma, pgd, entry, page, pte_chain);
 	}
 	spin_unlock(&mm->page_table_lock);
 	return;
@@ -518,6 +535,7 @@ static int try_to_unuse(unsigned int type)
 	unsigned short swcount;
 	struct page *page;
 	swp_entry_t entry;
+	struct pte_chain *pte_chain = NULL;
 	int i = 0;
 	int retval = 0;
 	int reset_overflow = 0;
@@ -553,6 +571,11 @@ static int try_to_unuse(unsigned int type)
 	 * to swapoff for a while, then reappear - but that is rare.
 	 */
 	while ((i = find_next_to_unuse(si, i))) {
+		if (pte_chain_reserve(&pte_chain, GFP_KERNEL)) {
+			retval = -ENOMEM;
+			break;
+		}
+
 		/* 
 		 * Get a page for the entry, using the existing swap
 		 * cache page if there is one.  Otherwise, get a clean
@@ -605,7 +628,7 @@ static int try_to_unuse(unsigned int type)
 			if (start_mm == &init_mm)
 				shmem_unuse(entry, page);
 			else
-				unuse_process(start_mm, entry, page);
+				unuse_process(start_mm, entry, page, &pte_chain);
 		}
 		if (*swap_map > 1) {
 			int set_start_mm = (*swap_map >= swcount);
@@ -622,7 +645,7 @@ static int try_to_unuse(unsigned int type)
 					set_start_mm = 1;
 					shmem_unuse(entry, page);
 				} else
-					unuse_process(mm, entry, page);
+					unuse_process(mm, entry, page, &pte_chain);
 				if (set_start_mm && *swap_map < swcount) {
 					new_start_mm = mm;
 					set_start_mm = 0;
@@ -697,6 +720,7 @@ static int try_to_unuse(unsigned int type)
 	}
 
 	mmput(start_mm);
+	pte_chain_release(pte_chain);
 	if (reset_overflow) {
 		printk(KERN_WARNING "swapoff: cleared swap entry overflow\n");
 		swap_overflow = 0;
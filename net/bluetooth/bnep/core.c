@@ -458,7 +458,7 @@ static int bnep_session(void *arg)
         sigfillset(&current->blocked);
 	flush_signals(current);
 
-	current->nice = -15;
+	set_user_nice(current, -15);
 
         set_fs(KERNEL_DS);
 
@@ -87,6 +87,7 @@
 #include <linux/skbuff.h>
 #include <linux/brlock.h>
 #include <net/sock.h>
+#include <net/tcp.h>
 #include <linux/rtnetlink.h>
 #include <linux/proc_fs.h>
 #include <linux/stat.h>
@@ -975,6 +976,25 @@ illegal_highdma(struct net_device *dev, struct sk_buff *skb)
 #define illegal_highdma(dev, skb)	(0)
 #endif
 
+#ifdef CONFIG_INET
+static int dev_tso_xmit(struct sk_buff *skb)
+{
+	struct sk_buff *segs, *next;
+
+	segs = tcp_tso_segment(skb);
+	kfree_skb(skb);
+	if (segs == NULL)
+		return -ENOMEM;
+
+	do {
+		next = segs->next;
+		segs->next = NULL;
+		dev_queue_xmit(segs);
+	} while ((segs = next) != NULL);
+	return 0;
+}
+#endif
+
 /**
  *	dev_queue_xmit - transmit a buffer
  *	@skb: buffer to transmit
@@ -993,6 +1013,14 @@ int dev_queue_xmit(struct sk_buff *skb)
 	struct net_device *dev = skb->dev;
 	struct Qdisc  *q;
 
+#ifdef CONFIG_INET
+	/* TCP may have built a frame for a TSO device and then had it
+	 * routed elsewhere; cut it up into MTU sized segments here.
+	 */
+	if (skb_shinfo(skb)->tso_size && !(dev->features&NETIF_F_TSO))
+		return dev_tso_xmit(skb);
+#endif
+
 	if (skb_shinfo(skb)->frag_list &&
 	    !(dev->features&NETIF_F_FRAGLIST) &&
 	    skb_linearize(skb, GFP_ATOMIC) != 0) {
@@ -1026,7 +1054,16 @@ int dev_queue_xmit(struct sk_buff *skb)
 	spin_lock_bh(&dev->queue_lock);
 	q = dev->qdisc;
 	if (q->enqueue) {
-		int ret = q->enqueue(skb, q);
+		int ret;
+
+		/* Nothing waiting: try the driver first */
+		if (qdisc_bypass(dev, skb)) {
+			spin_unlock_bh(&dev->queue_lock);
+			return NET_XMIT_SUCCESS;
+		}
+
+		q = dev->qdisc;
+		ret = q->enqueue(skb, q);
 
 		qdisc_run(dev);
 
@@ -1567,6 +1604,7 @@ static void net_rx_action(struct softirq_action *h)
 
 	while (!list_empty(&queue->poll_list)) {
 		struct net_device *dev;
+		int done;
 
 		if (budget <= 0 || jiffies - start_time > 1)
 			goto softnet_break;
@@ -1575,7 +1613,16 @@ static void net_rx_action(struct softirq_action *h)
 
 		dev = list_entry(queue->poll_list.next, struct net_device, poll_list);
 
-		if (dev->quota <= 0 || dev->poll(dev, &budget)) {
+		if (dev->quota > 0) {
+			int old_budget = budget;
+
+			done = dev->poll(dev, &budget) == 0;
+			dev->poll_count++;
+			dev->poll_pkts += old_budget - budget;
+		} else
+			done = 0;
+
+		if (!done) {
 			local_irq_disable();
 			list_del(&dev->poll_list);
 			list_add_tail(&dev->poll_list, &queue->poll_list);
@@ -1839,6 +1886,49 @@ static int dev_proc_stats(char *buffer, char **start, off_t offset,
 	return len;
 }
 
+/*
+ *	Per-device polling statistics, for the drivers that have a
+ *	dev->poll method: packets per poll is pkts/polls, and irqs
+ *	counts the receive interrupts that scheduled a poll.
+ */
+
+static int dev_poll_get_info(char *buffer, char **start, off_t offset, int length)
+{
+	int len = 0;
+	off_t begin = 0;
+	off_t pos = 0;
+	struct net_device *dev;
+
+	len = sprintf(buffer, "Iface   weight      irqs     polls      pkts\n");
+	pos = len;
+
+	read_lock(&dev_base_lock);
+	for (dev = dev_base; dev != NULL; dev = dev->next) {
+		if (dev->poll == NULL)
+			continue;
+		len += sprintf(buffer+len, "%-6s %7d %9lu %9lu %9lu\n",
+			       dev->name, dev->weight, dev->irq_count,
+			       dev->poll_count, dev->poll_pkts);
+		pos = begin + len;
+
+		if (pos < offset) {
+			len = 0;
+			begin = pos;
+		}
+		if (pos > offset + length)
+			break;
+	}
+	read_unlock(&dev_base_lock);
+
+	*start = buffer + (offset - begin);
+	len -= (offset - begin);
+	if (len > length)
+		len = length;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+
 #endif	/* CONFIG_PROC_FS */
 
 
@@ -2400,6 +2490,31 @@ static int dev_boot_phase = 1;
 
 int net_dev_init(void);
 
+/**
+ *	netdev_init_tx_rings - set up the transmit rings of a device
+ *	@dev: device, not yet registered
+ *	@ring: array of @rings rings, owned by the driver
+ *	@rings: number of hardware transmit rings
+ *
+ *	Makes the packet scheduler feed @dev through its
+ *	hard_start_xmit_ring() method, spreading transmitting CPUs over
+ *	the rings, each under its own lock.  All rings start out running.
+ */
+
+void netdev_init_tx_rings(struct net_device *dev, struct netdev_tx_ring *ring,
+			  int rings)
+{
+	int i;
+
+	for (i = 0; i < rings; i++) {
+		spin_lock_init(&ring[i].xmit_lock);
+		ring[i].xmit_lock_owner = -1;
+		ring[i].state = 0;
+	}
+	dev->tx_ring = ring;
+	dev->tx_rings = rings;
+}
+
 int register_netdevice(struct net_device *dev)
 {
 	struct net_device *d, **dp;
@@ -2777,6 +2892,7 @@ int __init net_dev_init(void)
 #ifdef CONFIG_PROC_FS
 	proc_net_create("dev", 0, dev_get_info);
 	create_proc_read_entry("net/softnet_stat", 0, 0, dev_proc_stats, NULL);
+	proc_net_create("dev_poll", 0, dev_poll_get_info);
 	proc_net_drivers = proc_mkdir("net/drivers", 0);
 #ifdef WIRELESS_EXT
 	/* Available in net/core/wireless.c */
@@ -207,6 +207,8 @@ struct sk_buff *alloc_skb(unsigned int size,int gfp_mask)
 	atomic_set(&skb->users, 1); 
 	atomic_set(&(skb_shinfo(skb)->dataref), 1);
 	skb_shinfo(skb)->nr_frags = 0;
+	skb_shinfo(skb)->tso_size = 0;
+	skb_shinfo(skb)->tso_segs = 0;
 	skb_shinfo(skb)->frag_list = NULL;
 	return skb;
 
@@ -441,6 +443,8 @@ static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 #ifdef CONFIG_NET_SCHED
 	new->tc_index = old->tc_index;
 #endif
+	skb_shinfo(new)->tso_size = skb_shinfo(old)->tso_size;
+	skb_shinfo(new)->tso_segs = skb_shinfo(old)->tso_segs;
 }
 
 /**
@@ -495,6 +499,8 @@ int skb_linearize(struct sk_buff *skb, int gfp_mask)
 	long offset;
 	int headerlen = skb->data - skb->head;
 	int expand = (skb->tail+skb->data_len) - skb->end;
+	unsigned short tso_size = skb_shinfo(skb)->tso_size;
+	unsigned short tso_segs = skb_shinfo(skb)->tso_segs;
 
 	if (skb_shared(skb))
 		BUG();
@@ -531,6 +537,8 @@ int skb_linearize(struct sk_buff *skb, int gfp_mask)
 	/* Set up shinfo */
 	atomic_set(&(skb_shinfo(skb)->dataref), 1);
 	skb_shinfo(skb)->nr_frags = 0;
+	skb_shinfo(skb)->tso_size = tso_size;
+	skb_shinfo(skb)->tso_segs = tso_segs;
 	skb_shinfo(skb)->frag_list = NULL;
 
 	/* We are no longer a clone, even if we were. */
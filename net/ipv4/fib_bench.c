@@ -0,0 +1,342 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		IPv4 FIB: lookup benchmark for fib_hash and fib_trie.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Loading the module builds one private table with each lookup engine,
+ * checks that both find the longest matching prefix for a set of nested
+ * routes, then fills both with the same synthetic routing table and
+ * times the same series of lookups on each.  The routes go through
+ * lo and never reach the tables which route traffic; the tables are
+ * private, so changing them sends no netlink messages either.  All is
+ * freed again before the results are logged; unload the module to run
+ * it again:
+ *
+ *	insmod fib_bench.o routes=120000 lookups=1000000 seed=1
+ *	rmmod fib_bench
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/init.h>
+
+#include <asm/div64.h>
+
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/ip_fib.h>
+
+static int routes = 120000;
+static int lookups = 1000000;
+static int seed = 1;
+
+MODULE_PARM(routes, "i");
+MODULE_PARM_DESC(routes, "number of synthetic routes (default 120000)");
+MODULE_PARM(lookups, "i");
+MODULE_PARM_DESC(lookups, "number of timed lookups per engine (default 1000000)");
+MODULE_PARM(seed, "i");
+MODULE_PARM_DESC(seed, "seed of the route and address generator");
+
+/* Private table id: nothing else ever sees it */
+#define BENCH_TABLE	250
+
+static int bench_oif;
+
+static u32 bench_random(u32 *state)
+{
+	u32 x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* A prefix with roughly the length mix of a BGP table */
+static u32 bench_prefix(u32 *state, int *plen)
+{
+	u32 r = bench_random(state) % 100;
+
+	if (r < 55)
+		*plen = 24;
+	else if (r < 85)
+		*plen = 16 + r % 8;
+	else if (r < 97)
+		*plen = 8 + r % 8;
+	else
+		*plen = 25 + r % 8;
+	return bench_random(state) & (*plen ? ~0U << (32 - *plen) : 0);
+}
+
+static int bench_change(struct fib_table *tb, int cmd, u32 prefix, int plen)
+{
+	struct rtmsg r;
+	struct kern_rta rta;
+	struct nlmsghdr nlh;
+	u32 dst = htonl(prefix);
+
+	memset(&r, 0, sizeof(r));
+	memset(&rta, 0, sizeof(rta));
+	memset(&nlh, 0, sizeof(nlh));
+
+	r.rtm_family = AF_INET;
+	r.rtm_dst_len = plen;
+	r.rtm_table = BENCH_TABLE;
+	r.rtm_protocol = RTPROT_STATIC;
+	r.rtm_scope = RT_SCOPE_LINK;
+	r.rtm_type = RTN_UNICAST;
+	rta.rta_dst = &dst;
+	rta.rta_oif = &bench_oif;
+	nlh.nlmsg_type = cmd;
+
+	if (cmd == RTM_DELROUTE)
+		return tb->tb_delete(tb, &r, &rta, &nlh, NULL);
+	nlh.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+	return tb->tb_insert(tb, &r, &rta, &nlh, NULL);
+}
+
+/* Length of the prefix addr matches, or -1 if none */
+static int bench_lookup(struct fib_table *tb, u32 addr)
+{
+	struct rt_key key;
+	struct fib_result res;
+	int plen;
+
+	memset(&key, 0, sizeof(key));
+	memset(&res, 0, sizeof(res));
+	key.dst = htonl(addr);
+	if (tb->tb_lookup(tb, &key, &res))
+		return -1;
+	plen = res.prefixlen;
+	fib_res_put(&res);
+	return plen;
+}
+
+#define BENCH_ADDR(a,b,c,d)	(((a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+/* Nested prefixes: every lookup must find the longest one */
+static const struct {
+	u32	prefix;
+	int	plen;
+} nested[] = {
+	{ BENCH_ADDR(0,0,0,0),	0 },
+	{ BENCH_ADDR(10,0,0,0),	8 },
+	{ BENCH_ADDR(10,1,0,0),	16 },
+	{ BENCH_ADDR(10,1,2,0),	24 },
+	{ BENCH_ADDR(10,1,2,3),	32 },
+	{ BENCH_ADDR(192,168,1,0),	24 },
+};
+
+static const struct {
+	u32	addr;
+	int	plen;		/* with the default route */
+	int	plen_nodflt;	/* and without */
+} probes[] = {
+	{ BENCH_ADDR(10,1,2,3),	32,	32 },
+	{ BENCH_ADDR(10,1,2,4),	24,	24 },
+	{ BENCH_ADDR(10,1,3,1),	16,	16 },
+	{ BENCH_ADDR(10,2,0,1),	8,	8 },
+	{ BENCH_ADDR(11,0,0,1),	0,	-1 },
+	{ BENCH_ADDR(192,168,1,5),	24,	24 },
+	{ BENCH_ADDR(192,168,2,5),	0,	-1 },
+	{ BENCH_ADDR(255,255,255,255), 0,	-1 },
+};
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+static int bench_probe(struct fib_table *tb, const char *name, int dflt)
+{
+	int i, plen, want, bad = 0;
+	u32 addr;
+
+	for (i = 0; i < ARRAY_LEN(probes); i++) {
+		want = dflt ? probes[i].plen : probes[i].plen_nodflt;
+		plen = bench_lookup(tb, probes[i].addr);
+		if (plen == want)
+			continue;
+		addr = htonl(probes[i].addr);
+		printk(KERN_ERR "fib_bench: %s: %u.%u.%u.%u matched /%d, "
+		       "not /%d (%s default route)\n", name, NIPQUAD(addr),
+		       plen, want, dflt ? "with" : "without");
+		bad++;
+	}
+	return bad;
+}
+
+static int bench_check(struct fib_table *tb, const char *name)
+{
+	int i, bad = 0;
+
+	rtnl_lock();
+	for (i = 0; i < ARRAY_LEN(nested); i++)
+		if (bench_change(tb, RTM_NEWROUTE, nested[i].prefix,
+				 nested[i].plen))
+			bad++;
+	rtnl_unlock();
+
+	if (bad)
+		printk(KERN_ERR "fib_bench: %s: cannot add test routes\n", name);
+	else {
+		bad += bench_probe(tb, name, 1);
+		rtnl_lock();
+		bench_change(tb, RTM_DELROUTE, nested[0].prefix,
+			     nested[0].plen);
+		rtnl_unlock();
+		bad += bench_probe(tb, name, 0);
+	}
+
+	rtnl_lock();
+	for (i = 0; i < ARRAY_LEN(nested); i++)
+		bench_change(tb, RTM_DELROUTE, nested[i].prefix,
+			     nested[i].plen);
+	rtnl_unlock();
+
+	if (bad)
+		return -EIO;
+	printk(KERN_INFO "fib_bench: %s: longest prefix match ok\n", name);
+	return 0;
+}
+
+static void bench_fill(struct fib_table *tb, int cmd)
+{
+	u32 state = seed ? seed : 1;
+	u32 prefix;
+	int i, plen;
+
+	rtnl_lock();
+	bench_change(tb, cmd, 0, 0);
+	for (i = 0; i < routes; i++) {
+		prefix = bench_prefix(&state, &plen);
+		/* Duplicates fail with -EEXIST / -ESRCH, which is fine */
+		bench_change(tb, cmd, prefix, plen);
+		if (current->need_resched) {
+			rtnl_unlock();
+			schedule();
+			rtnl_lock();
+		}
+	}
+	rtnl_unlock();
+}
+
+/*
+ * Times lookups of addresses inside the routes, in microseconds.
+ * found counts those which matched at least their route's prefix.
+ */
+static long bench_run(struct fib_table *tb, unsigned long *found)
+{
+	u32 state = seed ? seed : 1;
+	u32 lstate = ~state;
+	struct timeval start, end;
+	u32 prefix, addr;
+	int i, plen;
+
+	*found = 0;
+	do_gettimeofday(&start);
+	for (i = 0; i < lookups; i++) {
+		/* Reuse the route generator, restarting it as needed */
+		if (i % routes == 0)
+			state = seed ? seed : 1;
+		prefix = bench_prefix(&state, &plen);
+		addr = prefix | (bench_random(&lstate) &
+				 (plen ? ~(~0U << (32 - plen)) : ~0U));
+		if (bench_lookup(tb, addr) >= plen)
+			(*found)++;
+	}
+	do_gettimeofday(&end);
+	return (end.tv_sec - start.tv_sec) * 1000000L +
+		end.tv_usec - start.tv_usec;
+}
+
+static void bench_report(const char *name, long usecs, unsigned long found)
+{
+	u64 rate = (u64)lookups * 1000000;
+
+	if (usecs <= 0)
+		usecs = 1;
+	do_div(rate, usecs);
+	printk(KERN_INFO "fib_bench: %s: %d lookups in %ld us, %lu/s\n",
+	       name, lookups, usecs, (unsigned long)rate);
+	if (found != lookups)
+		printk(KERN_ERR "fib_bench: %s: %lu lookups missed the route "
+		       "they were made for\n", name, lookups - found);
+}
+
+static int __init fib_bench_init(void)
+{
+	struct fib_table *hash, *trie;
+	struct net_device *dev;
+	unsigned long hfound, tfound;
+	long husecs, tusecs;
+	int err;
+
+	if (routes < 1 || lookups < 1)
+		return -EINVAL;
+
+	dev = dev_get_by_name("lo");
+	if (dev == NULL)
+		return -ENODEV;
+	bench_oif = dev->ifindex;
+	dev_put(dev);
+
+	hash = fib_hash_init(BENCH_TABLE);
+	trie = fib_trie_init(BENCH_TABLE);
+	err = -ENOMEM;
+	if (hash == NULL || trie == NULL)
+		goto out;
+	hash->tb_private = 1;
+	trie->tb_private = 1;
+
+	err = bench_check(hash, "hash");
+	if (bench_check(trie, "trie"))
+		err = -EIO;
+	if (err)
+		goto out;
+
+	bench_fill(hash, RTM_NEWROUTE);
+	bench_fill(trie, RTM_NEWROUTE);
+	printk(KERN_INFO "fib_bench: %d synthetic routes, seed %d\n",
+	       routes, seed);
+
+	husecs = bench_run(hash, &hfound);
+	tusecs = bench_run(trie, &tfound);
+	bench_report("hash", husecs, hfound);
+	bench_report("trie", tusecs, tfound);
+
+	bench_fill(hash, RTM_DELROUTE);
+	bench_fill(trie, RTM_DELROUTE);
+	err = 0;
+out:
+	/* An empty trie is just the table; fib_hash keeps its zones */
+	rtnl_lock();
+	if (hash)
+		fib_hash_free(hash);
+	rtnl_unlock();
+	if (trie)
+		kfree(trie);
+	return err;
+}
+
+/* Everything went in fib_bench_init(); this only allows unloading */
+static void __exit fib_bench_exit(void)
+{
+}
+
+module_init(fib_bench_init);
+module_exit(fib_bench_exit);
+
+MODULE_DESCRIPTION("IPv4 FIB lookup benchmark: fib_hash vs. fib_trie");
+MODULE_LICENSE("GPL");
@@ -64,7 +64,7 @@ struct fib_table *__fib_new_table(int id)
 {
 	struct fib_table *tb;
 
-	tb = fib_hash_init(id);
+	tb = fib_new_engine_table(id);
 	if (!tb)
 		return NULL;
 	fib_tables[id] = tb;
@@ -648,8 +648,8 @@ void __init ip_fib_init(void)
 #endif		/* CONFIG_PROC_FS */
 
 #ifndef CONFIG_IP_MULTIPLE_TABLES
-	local_table = fib_hash_init(RT_TABLE_LOCAL);
-	main_table = fib_hash_init(RT_TABLE_MAIN);
+	local_table = fib_new_engine_table(RT_TABLE_LOCAL);
+	main_table = fib_new_engine_table(RT_TABLE_MAIN);
 #else
 	fib_rules_init();
 #endif
@@ -425,7 +425,7 @@ for ( ; ((f) = *(fp)) != NULL && fn_key_eq((f)->fn_key, (key)) && \
 #endif
 
 
-static void rtmsg_fib(int, struct fib_node*, int, int,
+static void rtmsg_fib(int, struct fib_node*, int, struct fib_table *,
 		      struct nlmsghdr *n,
 		      struct netlink_skb_parms *);
 
@@ -593,7 +593,7 @@ replace:
 		write_unlock_bh(&fib_hash_lock);
 
 		if (!(f->fn_state&FN_S_ZOMBIE))
-			rtmsg_fib(RTM_DELROUTE, f, z, tb->tb_id, n, req);
+			rtmsg_fib(RTM_DELROUTE, f, z, tb, n, req);
 		if (f->fn_state&FN_S_ACCESSED)
 			rt_cache_flush(-1);
 		fn_free_node(f);
@@ -601,7 +601,7 @@ replace:
 	} else {
 		rt_cache_flush(-1);
 	}
-	rtmsg_fib(RTM_NEWROUTE, new_f, z, tb->tb_id, n, req);
+	rtmsg_fib(RTM_NEWROUTE, new_f, z, tb, n, req);
 	return 0;
 
 out:
@@ -677,7 +677,7 @@ FTprint("tb(%d)_delete: %d %08x/%d %d\n", tb->tb_id, r->rtm_type, rta->rta_dst ?
 
 	if (del_fp) {
 		f = *del_fp;
-		rtmsg_fib(RTM_DELROUTE, f, z, tb->tb_id, n, req);
+		rtmsg_fib(RTM_DELROUTE, f, z, tb, n, req);
 
 		if (matched != 1) {
 			write_lock_bh(&fib_hash_lock);
@@ -862,18 +862,21 @@ static int fn_hash_dump(struct fib_table *tb, struct sk_buff *skb, struct netlin
 	return skb->len;
 }
 
-static void rtmsg_fib(int event, struct fib_node* f, int z, int tb_id,
+static void rtmsg_fib(int event, struct fib_node* f, int z, struct fib_table *tb,
 		      struct nlmsghdr *n, struct netlink_skb_parms *req)
 {
 	struct sk_buff *skb;
 	u32 pid = req ? req->pid : 0;
 	int size = NLMSG_SPACE(sizeof(struct rtmsg)+256);
 
+	if (tb->tb_private)
+		return;
+
 	skb = alloc_skb(size, GFP_KERNEL);
 	if (!skb)
 		return;
 
-	if (fib_dump_info(skb, pid, n->nlmsg_seq, event, tb_id,
+	if (fib_dump_info(skb, pid, n->nlmsg_seq, event, tb->tb_id,
 			  f->fn_type, f->fn_scope, &f->fn_key, z, f->fn_tos,
 			  FIB_INFO(f)) < 0) {
 		kfree_skb(skb);
@@ -887,7 +890,7 @@ static void rtmsg_fib(int event, struct fib_node* f, int z, int tb_id,
 		netlink_unicast(rtnl, skb, pid, MSG_DONTWAIT);
 }
 
-#ifdef CONFIG_IP_MULTIPLE_TABLES
+#if defined(CONFIG_IP_MULTIPLE_TABLES) || defined(CONFIG_IP_FIB_BENCH_MODULE)
 struct fib_table * fib_hash_init(int id)
 #else
 struct fib_table * __init fib_hash_init(int id)
@@ -906,6 +909,7 @@ struct fib_table * __init fib_hash_init(int id)
 		return NULL;
 
 	tb->tb_id = id;
+	tb->tb_private = 0;
 	tb->tb_lookup = fn_hash_lookup;
 	tb->tb_insert = fn_hash_insert;
 	tb->tb_delete = fn_hash_delete;
@@ -918,3 +922,30 @@ struct fib_table * __init fib_hash_init(int id)
 	memset(tb->tb_data, 0, sizeof(struct fn_hash));
 	return tb;
 }
+
+#ifdef CONFIG_IP_FIB_BENCH_MODULE
+/*
+ * Free a table which was never used for routing, with whatever
+ * routes are left in it and its zones.  Called under the RTNL.
+ */
+void fib_hash_free(struct fib_table *tb)
+{
+	struct fn_hash *table = (struct fn_hash*)tb->tb_data;
+	struct fn_zone *fz, *next;
+	struct fib_node *f;
+	int i;
+
+	for (fz = table->fn_zone_list; fz; fz = next) {
+		next = fz->fz_next;
+		for (i = 0; i < fz->fz_divisor; i++) {
+			while ((f = fz->fz_hash[i]) != NULL) {
+				fz->fz_hash[i] = f->fn_next;
+				fn_free_node(f);
+			}
+		}
+		kfree(fz->fz_hash);
+		kfree(fz);
+	}
+	kfree(tb);
+}
+#endif
@@ -0,0 +1,1302 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		IPv4 FIB: LC-trie lookup engine and maintenance routines.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A drop-in replacement for fib_hash.c, selected with CONFIG_IP_FIB_TRIE
+ * (fib_new_engine_table() then makes tries).
+ *
+ * Prefixes live in the leaves of a path- and level-compressed binary
+ * trie (S. Nilsson, G. Karlsson: "IP-address lookup using LC-tries")
+ * keyed by network address: 10.0.0.0/8 and 10.0.0.0/16 share the leaf
+ * for 10.0.0.0.  An internal node looks at `bits' bits of the key from
+ * bit `pos' on (bit 0 is the most significant) and has 2^bits children;
+ * nodes are doubled or halved as they fill up or empty, so that dense
+ * parts of the address space are crossed in a few steps.
+ *
+ * The longest match is found by walking down with the destination
+ * address; if nothing there matches, the next shorter candidate prefix
+ * is tried by clearing the lowest set bit of the last child index used,
+ * which only ever sends us back up the path we came down.
+ *
+ * Locking: changes are made under the RTNL semaphore.  Lookups take no
+ * shared lock: a new node or alias is completely set up before the
+ * pointer to it is stored, and anything unlinked is only freed after a
+ * write-side pass of the BR_FIB_LOCK big-reader lock, which readers
+ * hold (on their own CPU only) while they walk the table.
+ */
+
+#include <linux/config.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <asm/bitops.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/socket.h>
+#include <linux/sockios.h>
+#include <linux/errno.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/if_arp.h>
+#include <linux/proc_fs.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/init.h>
+#include <linux/brlock.h>
+
+#include <net/ip.h>
+#include <net/protocol.h>
+#include <net/route.h>
+#include <net/tcp.h>
+#include <net/sock.h>
+#include <net/ip_fib.h>
+
+static kmem_cache_t * fn_alias_kmem;
+static kmem_cache_t * fn_leaf_kmem;
+
+/* One route: the fib_hash fib_node without the key. */
+struct fib_alias
+{
+	struct fib_alias	*fa_next;
+	struct fib_info		*fa_info;
+	u8			fa_tos;
+	u8			fa_type;
+	u8			fa_scope;
+	u8			fa_state;
+	struct fib_alias	*fa_gc;
+};
+
+#define FA_S_ACCESSED	2
+
+/* The routes for one prefix of a leaf */
+struct leaf_info
+{
+	struct leaf_info	*li_next;
+	struct leaf_info	*li_gc;
+	int			li_plen;
+	u32			li_mask;	/* host order */
+	struct fib_alias	*li_alias;
+};
+
+#define T_TNODE	0
+#define T_LEAF	1
+
+/* Keys are kept in host order. */
+struct node
+{
+	u32		key;
+	unsigned char	type;
+	struct tnode	*parent;	/* only used by writers */
+	struct node	*gc_next;
+};
+
+struct leaf
+{
+	u32		key;
+	unsigned char	type;
+	struct tnode	*parent;
+	struct node	*gc_next;
+	struct leaf_info *list;		/* longest prefix first */
+};
+
+struct tnode
+{
+	u32		key;		/* bits below pos are zero */
+	unsigned char	type;
+	struct tnode	*parent;
+	struct node	*gc_next;
+	unsigned char	pos;
+	unsigned char	bits;
+	unsigned int	full_children;	/* tnodes indexing from pos+bits */
+	unsigned int	empty_children;
+	struct node	*child[0];
+};
+
+#define IS_LEAF(n)	((n)->type == T_LEAF)
+#define TNODE_SIZE(bits) \
+	(sizeof(struct tnode) + (sizeof(struct node *) << (bits)))
+
+/* Largest node: 2^16 children */
+#define TNODE_MAX_BITS	16
+
+/* Fill (in %) a node must reach when doubled to be doubled, and below
+   which it is halved.  The root is allowed to be sparser. */
+#define INFLATE_THRESHOLD	50
+#define HALVE_THRESHOLD		25
+#define INFLATE_THRESHOLD_ROOT	30
+#define HALVE_THRESHOLD_ROOT	15
+
+struct trie
+{
+	struct node		*root;
+	/* Unlinked, to be freed when no lookup can see them */
+	struct node		*gc_nodes;
+	struct leaf_info	*gc_info;
+	struct fib_alias	*gc_alias;
+};
+
+static __inline__ u32 trie_mask(int plen)
+{
+	return plen ? ~0U << (32 - plen) : 0;
+}
+
+static __inline__ unsigned int tkey_extract(u32 key, int pos, int bits)
+{
+	return (key << pos) >> (32 - bits);
+}
+
+/* Position of the first bit in which a and b differ, 32 if none */
+static __inline__ int tkey_mismatch(u32 a, u32 b)
+{
+	u32 diff = a ^ b;
+	int pos = 0;
+
+	if (!diff)
+		return 32;
+	while (!(diff & 0x80000000)) {
+		diff <<= 1;
+		pos++;
+	}
+	return pos;
+}
+
+static __inline__ int tnode_full(const struct tnode *tn, const struct node *n)
+{
+	return n && !IS_LEAF(n) &&
+		((struct tnode *)n)->pos == tn->pos + tn->bits;
+}
+
+static struct tnode *tnode_new(u32 key, int pos, int bits)
+{
+	unsigned int size = TNODE_SIZE(bits);
+	struct tnode *tn;
+
+	if (size <= PAGE_SIZE)
+		tn = kmalloc(size, GFP_KERNEL);
+	else
+		tn = (struct tnode *)__get_free_pages(GFP_KERNEL,
+						      get_order(size));
+	if (tn == NULL)
+		return NULL;
+
+	memset(tn, 0, size);
+	tn->key = key & trie_mask(pos);
+	tn->type = T_TNODE;
+	tn->pos = pos;
+	tn->bits = bits;
+	tn->empty_children = 1 << bits;
+	return tn;
+}
+
+static void tnode_free(struct tnode *tn)
+{
+	unsigned int size = TNODE_SIZE(tn->bits);
+
+	if (size <= PAGE_SIZE)
+		kfree(tn);
+	else
+		free_pages((unsigned long)tn, get_order(size));
+}
+
+static __inline__ void trie_gc_node(struct trie *t, struct node *n)
+{
+	n->gc_next = t->gc_nodes;
+	t->gc_nodes = n;
+}
+
+static __inline__ void trie_gc_alias(struct trie *t, struct fib_alias *fa)
+{
+	fa->fa_gc = t->gc_alias;
+	t->gc_alias = fa;
+}
+
+/* Frees everything unlinked by the current change, once all lookups
+   which might still be looking at it are gone. */
+static void trie_reclaim(struct trie *t)
+{
+	struct node *n;
+	struct leaf_info *li;
+	struct fib_alias *fa;
+
+	if (!t->gc_nodes && !t->gc_info && !t->gc_alias)
+		return;
+
+	br_write_lock_bh(BR_FIB_LOCK);
+	br_write_unlock_bh(BR_FIB_LOCK);
+
+	while ((n = t->gc_nodes) != NULL) {
+		t->gc_nodes = n->gc_next;
+		if (IS_LEAF(n))
+			kmem_cache_free(fn_leaf_kmem, n);
+		else
+			tnode_free((struct tnode *)n);
+	}
+	while ((li = t->gc_info) != NULL) {
+		t->gc_info = li->li_gc;
+		kfree(li);
+	}
+	while ((fa = t->gc_alias) != NULL) {
+		t->gc_alias = fa->fa_gc;
+		fib_release_info(fa->fa_info);
+		kmem_cache_free(fn_alias_kmem, fa);
+	}
+}
+
+static void put_child(struct tnode *tn, int i, struct node *n)
+{
+	struct node *chi = tn->child[i];
+	int wasfull, isfull;
+
+	if (n == NULL && chi != NULL)
+		tn->empty_children++;
+	else if (n != NULL && chi == NULL)
+		tn->empty_children--;
+
+	wasfull = tnode_full(tn, chi);
+	isfull = tnode_full(tn, n);
+	if (wasfull && !isfull)
+		tn->full_children--;
+	else if (!wasfull && isfull)
+		tn->full_children++;
+
+	if (n)
+		n->parent = tn;
+	/* Lookups must not find n before they can follow it. */
+	wmb();
+	tn->child[i] = n;
+}
+
+static struct node *resize(struct trie *t, struct tnode *tn, int root);
+
+/* Returns a copy of tn indexing one more bit, or NULL (and tn left as
+   it was) if out of memory. */
+static struct tnode *inflate(struct trie *t, struct tnode *tn)
+{
+	int olen = 1 << tn->bits;
+	struct tnode *tn2;
+	int i;
+
+	tn2 = tnode_new(tn->key, tn->pos, tn->bits + 1);
+	if (tn2 == NULL)
+		return NULL;
+
+	/* Full children get split in two: get the halves first. */
+	for (i = 0; i < olen; i++) {
+		struct tnode *inode = (struct tnode *)tn->child[i];
+		struct tnode *left, *right;
+
+		if (!tnode_full(tn, (struct node *)inode) || inode->bits == 1)
+			continue;
+
+		left = tnode_new(inode->key, inode->pos + 1, inode->bits - 1);
+		right = tnode_new(inode->key | (0x80000000 >> inode->pos),
+				  inode->pos + 1, inode->bits - 1);
+		tn2->child[2*i] = (struct node *)left;
+		tn2->child[2*i+1] = (struct node *)right;
+		if (!left || !right)
+			goto nomem;
+	}
+
+	for (i = 0; i < olen; i++) {
+		struct node *n = tn->child[i];
+		struct tnode *inode, *left, *right;
+		int size, j;
+
+		if (n == NULL)
+			continue;
+
+		if (!tnode_full(tn, n)) {
+			put_child(tn2, 2*i + tkey_extract(n->key,
+						tn->pos + tn->bits, 1), n);
+			continue;
+		}
+
+		inode = (struct tnode *)n;
+		if (inode->bits == 1) {
+			put_child(tn2, 2*i, inode->child[0]);
+			put_child(tn2, 2*i+1, inode->child[1]);
+			trie_gc_node(t, n);
+			continue;
+		}
+
+		left = (struct tnode *)tn2->child[2*i];
+		right = (struct tnode *)tn2->child[2*i+1];
+		tn2->child[2*i] = tn2->child[2*i+1] = NULL;
+
+		size = 1 << left->bits;
+		for (j = 0; j < size; j++) {
+			put_child(left, j, inode->child[j]);
+			put_child(right, j, inode->child[j + size]);
+		}
+		put_child(tn2, 2*i, resize(t, left, 0));
+		put_child(tn2, 2*i+1, resize(t, right, 0));
+		trie_gc_node(t, n);
+	}
+	return tn2;
+
+nomem:
+	for (i = 0; i < 2*olen; i++)
+		if (tn2->child[i])
+			tnode_free((struct tnode *)tn2->child[i]);
+	tnode_free(tn2);
+	return NULL;
+}
+
+/* Returns a copy of tn indexing one bit less, or NULL. */
+static struct tnode *halve(struct trie *t, struct tnode *tn)
+{
+	int olen = 1 << tn->bits;
+	struct tnode *tn2, *bin;
+	int i;
+
+	tn2 = tnode_new(tn->key, tn->pos, tn->bits - 1);
+	if (tn2 == NULL)
+		return NULL;
+
+	/* Pairs of children which are both there need a binary node. */
+	for (i = 0; i < olen; i += 2) {
+		if (!tn->child[i] || !tn->child[i+1])
+			continue;
+		bin = tnode_new(tn->child[i]->key, tn->pos + tn->bits - 1, 1);
+		if (bin == NULL)
+			goto nomem;
+		tn2->child[i/2] = (struct node *)bin;
+	}
+
+	for (i = 0; i < olen; i += 2) {
+		struct node *left = tn->child[i];
+		struct node *right = tn->child[i+1];
+
+		if (left == NULL) {
+			put_child(tn2, i/2, right);
+			continue;
+		}
+		if (right == NULL) {
+			put_child(tn2, i/2, left);
+			continue;
+		}
+		bin = (struct tnode *)tn2->child[i/2];
+		tn2->child[i/2] = NULL;
+		put_child(bin, 0, left);
+		put_child(bin, 1, right);
+		put_child(tn2, i/2, (struct node *)bin);
+	}
+	return tn2;
+
+nomem:
+	for (i = 0; i < olen/2; i++)
+		if (tn2->child[i])
+			tnode_free((struct tnode *)tn2->child[i]);
+	tnode_free(tn2);
+	return NULL;
+}
+
+/* Returns what should replace tn in its parent: tn itself, a doubled or
+   halved copy, its only child, or NULL if it has none left. */
+static struct node *resize(struct trie *t, struct tnode *tn, int root)
+{
+	int inflate_threshold = root ? INFLATE_THRESHOLD_ROOT : INFLATE_THRESHOLD;
+	int halve_threshold = root ? HALVE_THRESHOLD_ROOT : HALVE_THRESHOLD;
+	struct tnode *tn2;
+	int i;
+
+	if (tn->empty_children == 1 << tn->bits) {
+		trie_gc_node(t, (struct node *)tn);
+		return NULL;
+	}
+
+	/* Doubling turns a full child into two children, any other
+	   child stays one: double if that gives the wanted fill. */
+	while (tn->bits < TNODE_MAX_BITS &&
+	       50 * (tn->full_children + (1 << tn->bits) - tn->empty_children)
+	       >= inflate_threshold << tn->bits) {
+		tn2 = inflate(t, tn);
+		if (tn2 == NULL)
+			break;
+		trie_gc_node(t, (struct node *)tn);
+		tn = tn2;
+	}
+
+	while (tn->bits > 1 &&
+	       100 * ((1 << tn->bits) - tn->empty_children)
+	       < halve_threshold << tn->bits) {
+		tn2 = halve(t, tn);
+		if (tn2 == NULL)
+			break;
+		trie_gc_node(t, (struct node *)tn);
+		tn = tn2;
+	}
+
+	/* Path compression: a node with one child is not needed. */
+	if (tn->empty_children == (1 << tn->bits) - 1) {
+		for (i = 0; i < 1 << tn->bits; i++) {
+			struct node *n = tn->child[i];
+
+			if (n) {
+				trie_gc_node(t, (struct node *)tn);
+				return n;
+			}
+		}
+	}
+	return (struct node *)tn;
+}
+
+/* Resizes tn and every node above it. */
+static void trie_rebalance(struct trie *t, struct tnode *tn)
+{
+	struct tnode *tp;
+	struct node *n;
+
+	while ((tp = tn->parent) != NULL) {
+		put_child(tp, tkey_extract(tn->key, tp->pos, tp->bits),
+			  resize(t, tn, 0));
+		tn = tp;
+	}
+
+	n = resize(t, tn, 1);
+	if (n)
+		n->parent = NULL;
+	wmb();
+	t->root = n;
+}
+
+static struct leaf *trie_find_leaf(struct trie *t, u32 key)
+{
+	struct node *n = t->root;
+
+	while (n && !IS_LEAF(n)) {
+		struct tnode *tn = (struct tnode *)n;
+
+		n = tn->child[tkey_extract(key, tn->pos, tn->bits)];
+	}
+	if (n && n->key == key)
+		return (struct leaf *)n;
+	return NULL;
+}
+
+/* Returns the leaf for key, adding it if needed. */
+static struct leaf *trie_insert_leaf(struct trie *t, u32 key)
+{
+	struct node *n = t->root;
+	struct tnode *tp = NULL, *tn;
+	struct leaf *l;
+	int pos, bit;
+
+	while (n && !IS_LEAF(n)) {
+		tn = (struct tnode *)n;
+		if (tkey_mismatch(key, tn->key) < tn->pos)
+			break;
+		tp = tn;
+		n = tn->child[tkey_extract(key, tn->pos, tn->bits)];
+	}
+	if (n && IS_LEAF(n) && n->key == key)
+		return (struct leaf *)n;
+
+	l = kmem_cache_alloc(fn_leaf_kmem, SLAB_KERNEL);
+	if (l == NULL)
+		return NULL;
+	memset(l, 0, sizeof(struct leaf));
+	l->key = key;
+	l->type = T_LEAF;
+
+	if (n) {
+		/* n is a leaf or a subtree whose prefix key is not in:
+		   both go under a new binary node where they differ. */
+		pos = tkey_mismatch(key, n->key);
+		tn = tnode_new(key, pos, 1);
+		if (tn == NULL) {
+			kmem_cache_free(fn_leaf_kmem, l);
+			return NULL;
+		}
+		bit = tkey_extract(key, pos, 1);
+		put_child(tn, bit, (struct node *)l);
+		put_child(tn, !bit, n);
+		n = (struct node *)tn;
+	} else
+		n = (struct node *)l;
+
+	if (tp) {
+		put_child(tp, tkey_extract(key, tp->pos, tp->bits), n);
+		trie_rebalance(t, tp);
+	} else {
+		n->parent = NULL;
+		wmb();
+		t->root = n;
+	}
+	return l;
+}
+
+static void trie_remove_leaf(struct trie *t, struct leaf *l)
+{
+	struct tnode *tp = l->parent;
+
+	if (tp) {
+		put_child(tp, tkey_extract(l->key, tp->pos, tp->bits), NULL);
+		trie_rebalance(t, tp);
+	} else
+		t->root = NULL;
+	trie_gc_node(t, (struct node *)l);
+}
+
+static struct leaf_info *find_leaf_info(struct leaf *l, int plen)
+{
+	struct leaf_info *li;
+
+	for (li = l->list; li; li = li->li_next)
+		if (li->li_plen == plen)
+			return li;
+	return NULL;
+}
+
+static void insert_leaf_info(struct leaf *l, struct leaf_info *li)
+{
+	struct leaf_info **lip;
+
+	for (lip = &l->list; *lip; lip = &(*lip)->li_next)
+		if ((*lip)->li_plen < li->li_plen)
+			break;
+	li->li_next = *lip;
+	wmb();
+	*lip = li;
+}
+
+/* Unlinks a prefix which has no routes left, and its leaf if empty. */
+static void remove_leaf_info(struct trie *t, struct leaf *l,
+			     struct leaf_info *li)
+{
+	struct leaf_info **lip;
+
+	for (lip = &l->list; *lip; lip = &(*lip)->li_next)
+		if (*lip == li) {
+			*lip = li->li_next;
+			break;
+		}
+	li->li_gc = t->gc_info;
+	t->gc_info = li;
+
+	if (l->list == NULL)
+		trie_remove_leaf(t, l);
+}
+
+/* In-order walk over the leaves; readers must hold BR_FIB_LOCK. */
+struct trie_iter
+{
+	struct node	*next;		/* to be visited first */
+	struct tnode	*tn[32];
+	unsigned int	idx[32];	/* next child of tn[] to visit */
+	int		depth;
+};
+
+static struct leaf *trie_iter_next(struct trie_iter *it)
+{
+	struct node *n;
+
+	for (;;) {
+		if ((n = it->next) != NULL)
+			it->next = NULL;
+		else {
+			struct tnode *tn;
+			int d;
+
+			if (it->depth == 0)
+				return NULL;
+			d = it->depth - 1;
+			tn = it->tn[d];
+			if (it->idx[d] >= 1 << tn->bits) {
+				it->depth--;
+				continue;
+			}
+			n = tn->child[it->idx[d]++];
+			if (n == NULL)
+				continue;
+		}
+		if (IS_LEAF(n))
+			return (struct leaf *)n;
+		it->tn[it->depth] = (struct tnode *)n;
+		it->idx[it->depth] = 0;
+		it->depth++;
+	}
+}
+
+/* Sets the walk up to start at the first leaf with a key >= key. */
+static void trie_iter_seek(struct trie_iter *it, struct trie *t, u32 key)
+{
+	struct node *n = t->root;
+	int pos;
+
+	it->next = NULL;
+	it->depth = 0;
+	while (n && !IS_LEAF(n)) {
+		struct tnode *tn = (struct tnode *)n;
+		unsigned int i;
+
+		pos = tkey_mismatch(key, tn->key);
+		if (pos < tn->pos) {
+			/* All of the subtree is on one side of key */
+			if (!tkey_extract(key, pos, 1))
+				it->next = n;
+			return;
+		}
+		i = tkey_extract(key, tn->pos, tn->bits);
+		it->tn[it->depth] = tn;
+		it->idx[it->depth] = i + 1;
+		it->depth++;
+		n = tn->child[i];
+	}
+	if (n && n->key >= key)
+		it->next = n;
+}
+
+static __inline__ int
+check_leaf(struct leaf *l, u32 dst, int limit,
+	   const struct rt_key *key, struct fib_result *res)
+{
+	struct leaf_info *li;
+	struct fib_alias *fa;
+	int err;
+
+	for (li = l->list; li; li = li->li_next) {
+		if (li->li_plen > limit || ((l->key ^ dst) & li->li_mask))
+			continue;
+
+		for (fa = li->li_alias; fa; fa = fa->fa_next) {
+#ifdef CONFIG_IP_ROUTE_TOS
+			if (fa->fa_tos && fa->fa_tos != key->tos)
+				continue;
+#endif
+			fa->fa_state |= FA_S_ACCESSED;
+
+			if (fa->fa_scope < key->scope)
+				continue;
+
+			err = fib_semantic_match(fa->fa_type, fa->fa_info, key, res);
+			if (err == 0) {
+				res->type = fa->fa_type;
+				res->scope = fa->fa_scope;
+				res->prefixlen = li->li_plen;
+				return 0;
+			}
+			if (err < 0)
+				return err;
+		}
+	}
+	return 1;
+}
+
+static int
+fn_trie_lookup(struct fib_table *tb, const struct rt_key *key, struct fib_result *res)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct {
+		struct tnode	*tn;
+		unsigned int	slot;
+	} stack[32];
+	u32 dst = ntohl(key->dst);
+	int depth = 0, limit = 32;
+	struct tnode *tn;
+	struct node *n;
+	int err, j;
+
+	br_read_lock(BR_FIB_LOCK);
+	n = t->root;
+	for (;;) {
+		if (n && !IS_LEAF(n)) {
+			tn = (struct tnode *)n;
+
+			/* Prefixes under tn longer than the part of its
+			   skipped key bits which agrees with dst cannot
+			   match.  Longer ones further down still can. */
+			j = tkey_mismatch(dst, tn->key);
+			if (j < tn->pos && j < limit)
+				limit = j;
+
+			stack[depth].tn = tn;
+			stack[depth].slot = tkey_extract(dst & trie_mask(limit),
+							 tn->pos, tn->bits);
+			n = tn->child[stack[depth].slot];
+			depth++;
+			continue;
+		}
+
+		if (n) {
+			err = check_leaf((struct leaf *)n, dst, limit, key, res);
+			if (err <= 0)
+				goto out;
+		}
+
+		/* Nothing here: the next shorter prefix length which
+		   leads elsewhere clears the lowest set bit of an index. */
+		while (depth && !stack[depth-1].slot)
+			depth--;
+		if (!depth)
+			break;
+		tn = stack[depth-1].tn;
+		j = ffs(stack[depth-1].slot) - 1;
+		stack[depth-1].slot &= ~(1U << j);
+		limit = tn->pos + tn->bits - 1 - j;
+		n = tn->child[stack[depth-1].slot];
+	}
+	err = 1;
+out:
+	br_read_unlock(BR_FIB_LOCK);
+	return err;
+}
+
+static int fn_hash_last_dflt=-1;
+
+static int fib_detect_death(struct fib_info *fi, int order,
+			    struct fib_info **last_resort, int *last_idx)
+{
+	struct neighbour *n;
+	int state = NUD_NONE;
+
+	n = neigh_lookup(&arp_tbl, &fi->fib_nh[0].nh_gw, fi->fib_dev);
+	if (n) {
+		state = n->nud_state;
+		neigh_release(n);
+	}
+	if (state==NUD_REACHABLE)
+		return 0;
+	if ((state&NUD_VALID) && order != fn_hash_last_dflt)
+		return 0;
+	if ((state&NUD_VALID) ||
+	    (*last_idx<0 && order > fn_hash_last_dflt)) {
+		*last_resort = fi;
+		*last_idx = order;
+	}
+	return 1;
+}
+
+static void
+fn_trie_select_default(struct fib_table *tb, const struct rt_key *key, struct fib_result *res)
+{
+	int order, last_idx;
+	struct fib_alias *fa;
+	struct fib_info *fi = NULL;
+	struct fib_info *last_resort;
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct leaf_info *li = NULL;
+	struct leaf *l;
+
+	last_idx = -1;
+	last_resort = NULL;
+	order = -1;
+
+	br_read_lock(BR_FIB_LOCK);
+	l = trie_find_leaf(t, 0);
+	if (l)
+		li = find_leaf_info(l, 0);
+	if (li == NULL)
+		goto out;
+
+	for (fa = li->li_alias; fa; fa = fa->fa_next) {
+		struct fib_info *next_fi = fa->fa_info;
+
+		if (fa->fa_scope != res->scope ||
+		    fa->fa_type != RTN_UNICAST)
+			continue;
+
+		if (next_fi->fib_priority > res->fi->fib_priority)
+			break;
+		if (!next_fi->fib_nh[0].nh_gw || next_fi->fib_nh[0].nh_scope != RT_SCOPE_LINK)
+			continue;
+		fa->fa_state |= FA_S_ACCESSED;
+
+		if (fi == NULL) {
+			if (next_fi != res->fi)
+				break;
+		} else if (!fib_detect_death(fi, order, &last_resort, &last_idx)) {
+			if (res->fi)
+				fib_info_put(res->fi);
+			res->fi = fi;
+			atomic_inc(&fi->fib_clntref);
+			fn_hash_last_dflt = order;
+			goto out;
+		}
+		fi = next_fi;
+		order++;
+	}
+
+	if (order<=0 || fi==NULL) {
+		fn_hash_last_dflt = -1;
+		goto out;
+	}
+
+	if (!fib_detect_death(fi, order, &last_resort, &last_idx)) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = fi;
+		atomic_inc(&fi->fib_clntref);
+		fn_hash_last_dflt = order;
+		goto out;
+	}
+
+	if (last_idx >= 0) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = last_resort;
+		if (last_resort)
+			atomic_inc(&last_resort->fib_clntref);
+	}
+	fn_hash_last_dflt = last_idx;
+out:
+	br_read_unlock(BR_FIB_LOCK);
+}
+
+#define FA_SCAN(fa, fap) \
+for ( ; ((fa) = *(fap)) != NULL; (fap) = &(fa)->fa_next)
+
+#ifndef CONFIG_IP_ROUTE_TOS
+#define FA_SCAN_TOS(fa, fap, tos) FA_SCAN(fa, fap)
+#else
+#define FA_SCAN_TOS(fa, fap, tos) \
+for ( ; ((fa) = *(fap)) != NULL && (fa)->fa_tos == (tos) ; \
+     (fap) = &(fa)->fa_next)
+#endif
+
+static void rtmsg_fib(int, struct fib_alias*, u32, int, struct fib_table *,
+		      struct nlmsghdr *n,
+		      struct netlink_skb_parms *);
+
+static int
+fn_trie_insert(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct fib_alias *new_fa, *fa, **fap, **del_fap;
+	struct fib_alias *none = NULL;
+	struct leaf_info *li = NULL;
+	struct leaf *l;
+	struct fib_info *fi;
+
+	int plen = r->rtm_dst_len;
+	int type = r->rtm_type;
+#ifdef CONFIG_IP_ROUTE_TOS
+	u8 tos = r->rtm_tos;
+#endif
+	u32 key = 0;
+	int err;
+
+	if (plen > 32)
+		return -EINVAL;
+
+	if (rta->rta_dst) {
+		u32 dst;
+		memcpy(&dst, rta->rta_dst, 4);
+		key = ntohl(dst);
+		if (key & ~trie_mask(plen))
+			return -EINVAL;
+	}
+
+	if  ((fi = fib_create_info(r, rta, n, &err)) == NULL)
+		return err;
+
+	l = trie_find_leaf(t, key);
+	if (l)
+		li = find_leaf_info(l, plen);
+	fap = li ? &li->li_alias : &none;
+	fa = *fap;
+
+#ifdef CONFIG_IP_ROUTE_TOS
+	/*
+	 * Find routes with the same tos.
+	 */
+	FA_SCAN(fa, fap) {
+		if (fa->fa_tos <= tos)
+			break;
+	}
+#endif
+
+	del_fap = NULL;
+
+	FA_SCAN_TOS(fa, fap, tos) {
+		if (fi->fib_priority <= fa->fa_info->fib_priority)
+			break;
+	}
+
+	/* Now fa==*fap points to the first route with the same
+	   [tos,priority], if there is one, or to the route
+	   before which we will insert the new one.
+	 */
+
+	if (fa &&
+#ifdef CONFIG_IP_ROUTE_TOS
+	    fa->fa_tos == tos &&
+#endif
+	    fi->fib_priority == fa->fa_info->fib_priority) {
+		struct fib_alias **ins_fap;
+
+		err = -EEXIST;
+		if (n->nlmsg_flags&NLM_F_EXCL)
+			goto out;
+
+		if (n->nlmsg_flags&NLM_F_REPLACE) {
+			del_fap = fap;
+			fap = &fa->fa_next;
+			fa = *fap;
+			goto replace;
+		}
+
+		ins_fap = fap;
+		err = -EEXIST;
+
+		FA_SCAN_TOS(fa, fap, tos) {
+			if (fi->fib_priority != fa->fa_info->fib_priority)
+				break;
+			if (fa->fa_type == type && fa->fa_scope == r->rtm_scope
+			    && fa->fa_info == fi)
+				goto out;
+		}
+
+		if (!(n->nlmsg_flags&NLM_F_APPEND)) {
+			fap = ins_fap;
+			fa = *fap;
+		}
+	}
+
+	err = -ENOENT;
+	if (!(n->nlmsg_flags&NLM_F_CREATE))
+		goto out;
+
+replace:
+	err = -ENOBUFS;
+	new_fa = kmem_cache_alloc(fn_alias_kmem, SLAB_KERNEL);
+	if (new_fa == NULL)
+		goto out;
+
+	memset(new_fa, 0, sizeof(struct fib_alias));
+#ifdef CONFIG_IP_ROUTE_TOS
+	new_fa->fa_tos = tos;
+#endif
+	new_fa->fa_type = type;
+	new_fa->fa_scope = r->rtm_scope;
+	new_fa->fa_info = fi;
+
+	/*
+	 * Insert new entry to the list, adding the prefix (and its
+	 * leaf) if this is the first route for it.
+	 */
+
+	if (li == NULL) {
+		li = kmalloc(sizeof(struct leaf_info), GFP_KERNEL);
+		if (li == NULL)
+			goto out_free;
+		l = trie_insert_leaf(t, key);
+		if (l == NULL) {
+			kfree(li);
+			goto out_free;
+		}
+		memset(li, 0, sizeof(struct leaf_info));
+		li->li_plen = plen;
+		li->li_mask = trie_mask(plen);
+		li->li_alias = new_fa;
+		insert_leaf_info(l, li);
+	} else {
+		new_fa->fa_next = fa;
+		wmb();
+		*fap = new_fa;
+	}
+
+	if (del_fap) {
+		fa = *del_fap;
+		/* Unlink replaced route */
+		*del_fap = fa->fa_next;
+
+		rtmsg_fib(RTM_DELROUTE, fa, key, plen, tb, n, req);
+		if (fa->fa_state&FA_S_ACCESSED)
+			rt_cache_flush(-1);
+		trie_gc_alias(t, fa);
+	} else {
+		rt_cache_flush(-1);
+	}
+	rtmsg_fib(RTM_NEWROUTE, new_fa, key, plen, tb, n, req);
+	trie_reclaim(t);
+	return 0;
+
+out_free:
+	kmem_cache_free(fn_alias_kmem, new_fa);
+out:
+	trie_reclaim(t);
+	fib_release_info(fi);
+	return err;
+}
+
+
+static int
+fn_trie_delete(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct fib_alias **fap, **del_fap, *fa;
+	struct leaf_info *li;
+	struct leaf *l;
+	int plen = r->rtm_dst_len;
+	u32 key = 0;
+#ifdef CONFIG_IP_ROUTE_TOS
+	u8 tos = r->rtm_tos;
+#endif
+
+	if (plen > 32)
+		return -EINVAL;
+
+	if (rta->rta_dst) {
+		u32 dst;
+		memcpy(&dst, rta->rta_dst, 4);
+		key = ntohl(dst);
+		if (key & ~trie_mask(plen))
+			return -EINVAL;
+	}
+
+	l = trie_find_leaf(t, key);
+	if (l == NULL || (li = find_leaf_info(l, plen)) == NULL)
+		return -ESRCH;
+
+	fap = &li->li_alias;
+#ifdef CONFIG_IP_ROUTE_TOS
+	FA_SCAN(fa, fap) {
+		if (fa->fa_tos == tos)
+			break;
+	}
+#endif
+
+	del_fap = NULL;
+	FA_SCAN_TOS(fa, fap, tos) {
+		struct fib_info * fi = fa->fa_info;
+
+		if (del_fap == NULL &&
+		    (!r->rtm_type || fa->fa_type == r->rtm_type) &&
+		    (r->rtm_scope == RT_SCOPE_NOWHERE || fa->fa_scope == r->rtm_scope) &&
+		    (!r->rtm_protocol || fi->fib_protocol == r->rtm_protocol) &&
+		    fib_nh_match(r, n, rta, fi) == 0)
+			del_fap = fap;
+	}
+
+	if (del_fap == NULL)
+		return -ESRCH;
+
+	fa = *del_fap;
+	rtmsg_fib(RTM_DELROUTE, fa, key, plen, tb, n, req);
+
+	*del_fap = fa->fa_next;
+	if (fa->fa_state&FA_S_ACCESSED)
+		rt_cache_flush(-1);
+	trie_gc_alias(t, fa);
+
+	if (li->li_alias == NULL)
+		remove_leaf_info(t, l, li);
+	trie_reclaim(t);
+	return 0;
+}
+
+/* Drops the routes through dead next hops from one leaf. */
+static int fn_flush_leaf(struct trie *t, struct leaf *l)
+{
+	struct leaf_info *li, *next;
+	struct fib_alias *fa, **fap;
+	int found = 0;
+
+	for (li = l->list; li; li = next) {
+		next = li->li_next;
+
+		fap = &li->li_alias;
+		while ((fa = *fap) != NULL) {
+			struct fib_info *fi = fa->fa_info;
+
+			if (fi && (fi->fib_flags&RTNH_F_DEAD)) {
+				*fap = fa->fa_next;
+				trie_gc_alias(t, fa);
+				found++;
+				continue;
+			}
+			fap = &fa->fa_next;
+		}
+		if (li->li_alias == NULL)
+			remove_leaf_info(t, l, li);
+	}
+	return found;
+}
+
+static int fn_trie_flush(struct fib_table *tb)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct trie_iter it;
+	struct leaf *l;
+	int found = 0;
+
+	trie_iter_seek(&it, t, 0);
+	while ((l = trie_iter_next(&it)) != NULL) {
+		u32 key = l->key;
+
+		found += fn_flush_leaf(t, l);
+		if (l->list == NULL) {
+			/* The leaf went, and the trie may have been
+			   reshaped under the walk: start it again. */
+			if (key == ~0U)
+				break;
+			trie_iter_seek(&it, t, key + 1);
+		}
+	}
+	trie_reclaim(t);
+	return found;
+}
+
+
+#ifdef CONFIG_PROC_FS
+
+static int fn_trie_get_info(struct fib_table *tb, char *buffer, int first, int count)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct trie_iter it;
+	struct leaf_info *li;
+	struct fib_alias *fa;
+	struct leaf *l;
+	int pos = 0;
+	int n = 0;
+
+	br_read_lock(BR_FIB_LOCK);
+	trie_iter_seek(&it, t, 0);
+	while ((l = trie_iter_next(&it)) != NULL) {
+		for (li = l->list; li; li = li->li_next) {
+			for (fa = li->li_alias; fa; fa = fa->fa_next) {
+				if (++pos <= first)
+					continue;
+				fib_node_get_info(fa->fa_type, 0, fa->fa_info,
+						  htonl(l->key),
+						  htonl(li->li_mask), buffer);
+				buffer += 128;
+				if (++n >= count)
+					goto out;
+			}
+		}
+	}
+out:
+	br_read_unlock(BR_FIB_LOCK);
+	return n;
+}
+#endif
+
+
+static int fn_trie_dump(struct fib_table *tb, struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct trie_iter it;
+	struct leaf_info *li;
+	struct fib_alias *fa;
+	struct leaf *l;
+	int i, s_i, j, s_j;
+	u32 key;
+
+	/* args[1] counts prefixes, args[2] routes within a prefix */
+	s_i = cb->args[1];
+	s_j = cb->args[2];
+	i = 0;
+	br_read_lock(BR_FIB_LOCK);
+	trie_iter_seek(&it, t, 0);
+	while ((l = trie_iter_next(&it)) != NULL) {
+		key = htonl(l->key);
+		for (li = l->list; li; li = li->li_next, i++) {
+			if (i < s_i)
+				continue;
+			if (i > s_i)
+				s_j = 0;
+			for (fa = li->li_alias, j = 0; fa; fa = fa->fa_next, j++) {
+				if (j < s_j)
+					continue;
+				if (fib_dump_info(skb, NETLINK_CB(cb->skb).pid,
+						  cb->nlh->nlmsg_seq,
+						  RTM_NEWROUTE, tb->tb_id,
+						  fa->fa_type, fa->fa_scope,
+						  &key, li->li_plen, fa->fa_tos,
+						  fa->fa_info) < 0) {
+					cb->args[1] = i;
+					cb->args[2] = j;
+					br_read_unlock(BR_FIB_LOCK);
+					return -1;
+				}
+			}
+		}
+	}
+	br_read_unlock(BR_FIB_LOCK);
+	cb->args[1] = i;
+	cb->args[2] = 0;
+	return skb->len;
+}
+
+static void rtmsg_fib(int event, struct fib_alias* fa, u32 key, int z,
+		      struct fib_table *tb, struct nlmsghdr *n,
+		      struct netlink_skb_parms *req)
+{
+	struct sk_buff *skb;
+	u32 pid = req ? req->pid : 0;
+	int size = NLMSG_SPACE(sizeof(struct rtmsg)+256);
+	u32 dst = htonl(key);
+
+	if (tb->tb_private)
+		return;
+
+	skb = alloc_skb(size, GFP_KERNEL);
+	if (!skb)
+		return;
+
+	if (fib_dump_info(skb, pid, n->nlmsg_seq, event, tb->tb_id,
+			  fa->fa_type, fa->fa_scope, &dst, z, fa->fa_tos,
+			  fa->fa_info) < 0) {
+		kfree_skb(skb);
+		return;
+	}
+	NETLINK_CB(skb).dst_groups = RTMGRP_IPV4_ROUTE;
+	if (n->nlmsg_flags&NLM_F_ECHO)
+		atomic_inc(&skb->users);
+	netlink_broadcast(rtnl, skb, pid, RTMGRP_IPV4_ROUTE, GFP_KERNEL);
+	if (n->nlmsg_flags&NLM_F_ECHO)
+		netlink_unicast(rtnl, skb, pid, MSG_DONTWAIT);
+}
+
+#if defined(CONFIG_IP_MULTIPLE_TABLES) || defined(CONFIG_IP_FIB_BENCH_MODULE)
+struct fib_table * fib_trie_init(int id)
+#else
+struct fib_table * __init fib_trie_init(int id)
+#endif
+{
+	struct fib_table *tb;
+
+	if (fn_alias_kmem == NULL)
+		fn_alias_kmem = kmem_cache_create("ip_fib_alias",
+						  sizeof(struct fib_alias),
+						  0, SLAB_HWCACHE_ALIGN,
+						  NULL, NULL);
+	if (fn_leaf_kmem == NULL)
+		fn_leaf_kmem = kmem_cache_create("ip_fib_trie",
+						 sizeof(struct leaf),
+						 0, SLAB_HWCACHE_ALIGN,
+						 NULL, NULL);
+
+	tb = kmalloc(sizeof(struct fib_table) + sizeof(struct trie), GFP_KERNEL);
+	if (tb == NULL)
+		return NULL;
+
+	tb->tb_id = id;
+	tb->tb_private = 0;
+	tb->tb_lookup = fn_trie_lookup;
+	tb->tb_insert = fn_trie_insert;
+	tb->tb_delete = fn_trie_delete;
+	tb->tb_flush = fn_trie_flush;
+	tb->tb_select_default = fn_trie_select_default;
+	tb->tb_dump = fn_trie_dump;
+#ifdef CONFIG_PROC_FS
+	tb->tb_get_info = fn_trie_get_info;
+#endif
+	memset(tb->tb_data, 0, sizeof(struct trie));
+	return tb;
+}
@@ -305,11 +305,22 @@ static inline int ip_queue_xmit2(struct sk_buff *skb)
 		iph = skb->nh.iph;
 	}
 
+	/* A TSO frame is cut into pmtu sized segments by the device, or
+	 * by dev_queue_xmit() for one that cannot, and each segment will
+	 * need an IP ID of its own.
+	 */
+	if (skb_shinfo(skb)->tso_size) {
+		ip_select_ident_more(iph, &rt->u.dst, sk,
+				     skb_shinfo(skb)->tso_segs - 1);
+		goto send;
+	}
+
 	if (skb->len > rt->u.dst.pmtu)
 		goto fragment;
 
 	ip_select_ident(iph, &rt->u.dst, sk);
 
+send:
 	/* Add an IP checksum. */
 	ip_send_check(iph);
 
@@ -369,7 +380,7 @@ int ip_queue_xmit(struct sk_buff *skb)
 				    sk->bound_dev_if))
 			goto no_route;
 		__sk_dst_set(sk, &rt->u.dst);
-		sk->route_caps = rt->u.dst.dev->features;
+		tcp_v4_setup_caps(sk, &rt->u.dst);
 	}
 	skb->dst = dst_clone(&rt->u.dst);
 
@@ -574,7 +585,7 @@ static int ip_build_xmit_slow(struct sock *sk,
 					 * for packets without DF or having
 					 * been fragmented.
 					 */
-					__ip_select_ident(iph, &rt->u.dst);
+					__ip_select_ident(iph, &rt->u.dst, 0);
 					id = iph->id;
 				}
 
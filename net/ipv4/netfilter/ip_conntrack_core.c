@@ -31,11 +31,15 @@
 #include <linux/stddef.h>
 #include <linux/sysctl.h>
 #include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
 /* For ERR_PTR().  Yeah, I know... --RR */
 #include <linux/fs.h>
 
 /* This rwlock protects the main hash table, protocol/helper/expected
-   registrations, conntrack timers*/
+   registrations, conntrack timers.  The hash chains are also covered
+   by per-bucket locks (see below): they are changed only with both
+   held, so a lookup needs just one of them. */
 #define ASSERT_READ_LOCK(x) MUST_BE_READ_LOCKED(&ip_conntrack_lock)
 #define ASSERT_WRITE_LOCK(x) MUST_BE_WRITE_LOCKED(&ip_conntrack_lock)
 
@@ -66,6 +70,24 @@ static atomic_t ip_conntrack_count = ATOMIC_INIT(0);
 struct list_head *ip_conntrack_hash;
 static kmem_cache_t *ip_conntrack_cachep;
 
+/* Keys the hash, so that chains cannot be filled on purpose; a new
+   key is picked whenever the table is rebuilt. */
+static u_int32_t ip_conntrack_hash_rnd;
+
+/* Per-packet lookups take only the read lock of the bucket they hash
+   to, so they never touch ip_conntrack_lock.  Each lock covers every
+   IP_CT_BUCKET_LOCKS'th bucket.  Resizing holds all of them and bumps
+   ip_conntrack_hash_gen, which tells a lookup that the bucket it
+   computed belongs to a table that is gone. */
+#define IP_CT_BUCKET_LOCKS	64
+
+static struct {
+	rwlock_t lock;
+} ____cacheline_aligned ip_ct_bucket_lock[IP_CT_BUCKET_LOCKS];
+static unsigned int ip_conntrack_hash_gen;
+
+#define bucket_lock(hash)	(&ip_ct_bucket_lock[(hash) % IP_CT_BUCKET_LOCKS].lock)
+
 extern struct ip_conntrack_protocol ip_conntrack_generic_protocol;
 
 static inline int proto_cmpfn(const struct ip_conntrack_protocol *curr,
@@ -113,14 +135,48 @@ hash_conntrack(const struct ip_conntrack_tuple *tuple)
 #if 0
 	dump_tuple(tuple);
 #endif
-	/* ntohl because more differences in low bits. */
-	/* To ensure that halves of the same connection don't hash
-	   clash, we add the source per-proto again. */
-	return (ntohl(tuple->src.ip + tuple->dst.ip
-		     + tuple->src.u.all + tuple->dst.u.all
-		     + tuple->dst.protonum)
-		+ ntohs(tuple->src.u.all))
-		% ip_conntrack_htable_size;
+	return (jhash_3words(tuple->src.ip,
+			     tuple->dst.ip ^ tuple->dst.protonum,
+			     tuple->src.u.all | (tuple->dst.u.all << 16),
+			     ip_conntrack_hash_rnd)
+		% ip_conntrack_htable_size);
+}
+
+/* Read-lock the chain a tuple hashes to, and return its index. */
+static inline u_int32_t
+lock_chain(const struct ip_conntrack_tuple *tuple)
+{
+	unsigned int gen;
+	u_int32_t hash;
+
+	for (;;) {
+		gen = ip_conntrack_hash_gen;
+		hash = hash_conntrack(tuple);
+		read_lock_bh(bucket_lock(hash));
+		if (gen == ip_conntrack_hash_gen)
+			return hash;
+		/* Lost a race with ip_conntrack_resize() */
+		read_unlock_bh(bucket_lock(hash));
+	}
+}
+
+/* Write-lock the chains of both tuples of ct; ip_conntrack_lock is
+   held for writing, so there is no other writer to deadlock with. */
+static inline void
+write_lock_chains(u_int32_t hash, u_int32_t repl_hash)
+{
+	MUST_BE_WRITE_LOCKED(&ip_conntrack_lock);
+	write_lock(bucket_lock(hash));
+	if (bucket_lock(repl_hash) != bucket_lock(hash))
+		write_lock(bucket_lock(repl_hash));
+}
+
+static inline void
+write_unlock_chains(u_int32_t hash, u_int32_t repl_hash)
+{
+	if (bucket_lock(repl_hash) != bucket_lock(hash))
+		write_unlock(bucket_lock(repl_hash));
+	write_unlock(bucket_lock(hash));
 }
 
 inline int
@@ -290,17 +346,22 @@ static void remove_expectations(struct ip_conntrack *ct)
 static void
 clean_from_lists(struct ip_conntrack *ct)
 {
+	u_int32_t hash, repl_hash;
+
 	DEBUGP("clean_from_lists(%p)\n", ct);
 	MUST_BE_WRITE_LOCKED(&ip_conntrack_lock);
+	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+
 	/* Remove from both hash lists: must not NULL out next ptrs,
            otherwise we'll look unconfirmed.  Fortunately, LIST_DELETE
            doesn't do this. --RR */
-	LIST_DELETE(&ip_conntrack_hash
-		    [hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple)],
+	write_lock_chains(hash, repl_hash);
+	LIST_DELETE(&ip_conntrack_hash[hash],
 		    &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-	LIST_DELETE(&ip_conntrack_hash
-		    [hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple)],
+	LIST_DELETE(&ip_conntrack_hash[repl_hash],
 		    &ct->tuplehash[IP_CT_DIR_REPLY]);
+	write_unlock_chains(hash, repl_hash);
 
 	/* Destroy all un-established, pending expectations */
 	remove_expectations(ct);
@@ -359,23 +420,25 @@ conntrack_tuple_cmp(const struct ip_conntrack_tuple_hash *i,
 		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
 	return i->ctrack != ignored_conntrack
 		&& ip_ct_tuple_equal(tuple, &i->tuple);
 }
 
+/* Caller holds the bucket lock of the chain, or ip_conntrack_lock. */
 static struct ip_conntrack_tuple_hash *
-__ip_conntrack_find(const struct ip_conntrack_tuple *tuple,
+__ip_conntrack_find(u_int32_t hash,
+		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
+	struct list_head *chain = &ip_conntrack_hash[hash], *i;
 	struct ip_conntrack_tuple_hash *h;
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-	h = LIST_FIND(&ip_conntrack_hash[hash_conntrack(tuple)],
-		      conntrack_tuple_cmp,
-		      struct ip_conntrack_tuple_hash *,
-		      tuple, ignored_conntrack);
-	return h;
+	for (i = chain->next; i != chain; i = i->next) {
+		h = (struct ip_conntrack_tuple_hash *)i;
+		if (conntrack_tuple_cmp(h, tuple, ignored_conntrack))
+			return h;
+	}
+	return NULL;
 }
 
 /* Find a connection corresponding to a tuple. */
@@ -384,12 +447,13 @@ ip_conntrack_find_get(const struct ip_conntrack_tuple *tuple,
 		      const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+	u_int32_t hash;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
+	hash = lock_chain(tuple);
+	h = __ip_conntrack_find(hash, tuple, ignored_conntrack);
 	if (h)
 		atomic_inc(&h->ctrack->ct_general.use);
-	READ_UNLOCK(&ip_conntrack_lock);
+	read_unlock_bh(bucket_lock(hash));
 
 	return h;
 }
@@ -432,9 +496,6 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 	if (CTINFO2DIR(ctinfo) != IP_CT_DIR_ORIGINAL)
 		return NF_ACCEPT;
 
-	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-
 	/* We're not in hash table, and we refuse to set up related
 	   connections for unconfirmed conns.  But packet copies and
 	   REJECT will give spurious warnings here. */
@@ -446,6 +507,9 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 	DEBUGP("Confirming conntrack %p\n", ct);
 
 	WRITE_LOCK(&ip_conntrack_lock);
+	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+
 	/* See if there's one in the list already, including reverse:
            NAT could have grabbed it without realizing, since we're
            not in the hash.  If there is, we lost race. */
@@ -457,10 +521,12 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 			  conntrack_tuple_cmp,
 			  struct ip_conntrack_tuple_hash *,
 			  &ct->tuplehash[IP_CT_DIR_REPLY].tuple, NULL)) {
+		write_lock_chains(hash, repl_hash);
 		list_prepend(&ip_conntrack_hash[hash],
 			     &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
 		list_prepend(&ip_conntrack_hash[repl_hash],
 			     &ct->tuplehash[IP_CT_DIR_REPLY]);
+		write_unlock_chains(hash, repl_hash);
 		/* Timer relative to confirmation time, not original
 		   setting time, otherwise we'd get timer wrap in
 		   weird delay cases. */
@@ -482,10 +548,11 @@ ip_conntrack_tuple_taken(const struct ip_conntrack_tuple *tuple,
 			 const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+	u_int32_t hash;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	READ_UNLOCK(&ip_conntrack_lock);
+	hash = lock_chain(tuple);
+	h = __ip_conntrack_find(hash, tuple, ignored_conntrack);
+	read_unlock_bh(bucket_lock(hash));
 
 	return h != NULL;
 }
@@ -588,13 +655,22 @@ static inline int unreplied(const struct ip_conntrack_tuple_hash *i)
 	return !(i->ctrack->status & IPS_ASSURED);
 }
 
-static int early_drop(struct list_head *chain)
+/* Drop an unreplied conntrack from the chain of tuple, or from the
+   next one in turn if tuple is NULL. */
+static int early_drop(const struct ip_conntrack_tuple *tuple)
 {
 	/* Traverse backwards: gives us oldest, which is roughly LRU */
+	static unsigned int drop_next = 0;
 	struct ip_conntrack_tuple_hash *h;
+	struct list_head *chain;
 	int dropped = 0;
 
 	READ_LOCK(&ip_conntrack_lock);
+	if (tuple)
+		chain = &ip_conntrack_hash[hash_conntrack(tuple)];
+	else
+		chain = &ip_conntrack_hash[(drop_next++)
+					   % ip_conntrack_htable_size];
 	h = LIST_FIND(chain, unreplied, struct ip_conntrack_tuple_hash *);
 	if (h)
 		atomic_inc(&h->ctrack->ct_general.use);
@@ -633,22 +709,15 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 {
 	struct ip_conntrack *conntrack;
 	struct ip_conntrack_tuple repl_tuple;
-	size_t hash, repl_hash;
 	struct ip_conntrack_expect *expected;
 	int i;
-	static unsigned int drop_next = 0;
-
-	hash = hash_conntrack(tuple);
 
 	if (ip_conntrack_max &&
 	    atomic_read(&ip_conntrack_count) >= ip_conntrack_max) {
 		/* Try dropping from random chain, or else from the
                    chain about to put into (in case they're trying to
                    bomb one hash chain). */
-		unsigned int next = (drop_next++)%ip_conntrack_htable_size;
-
-		if (!early_drop(&ip_conntrack_hash[next])
-		    && !early_drop(&ip_conntrack_hash[hash])) {
+		if (!early_drop(NULL) && !early_drop(tuple)) {
 			if (net_ratelimit())
 				printk(KERN_WARNING
 				       "ip_conntrack: table full, dropping"
@@ -661,7 +730,6 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 		DEBUGP("Can't invert tuple.\n");
 		return NULL;
 	}
-	repl_hash = hash_conntrack(&repl_tuple);
 
 	conntrack = kmem_cache_alloc(ip_conntrack_cachep, GFP_ATOMIC);
 	if (!conntrack) {
@@ -1103,7 +1171,7 @@ int ip_conntrack_alter_reply(struct ip_conntrack *conntrack,
 			     const struct ip_conntrack_tuple *newreply)
 {
 	WRITE_LOCK(&ip_conntrack_lock);
-	if (__ip_conntrack_find(newreply, conntrack)) {
+	if (__ip_conntrack_find(hash_conntrack(newreply), newreply, conntrack)) {
 		WRITE_UNLOCK(&ip_conntrack_lock);
 		return 0;
 	}
@@ -1172,20 +1240,71 @@ void ip_ct_refresh(struct ip_conntrack *ct, unsigned long extra_jiffies)
 {
 	IP_NF_ASSERT(ct->timeout.data == (unsigned long)ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
-	/* If not in hash table, timer will not be active yet */
-	if (!is_confirmed(ct))
-		ct->timeout.expires = extra_jiffies;
-	else {
+	/* Once confirmed, only a successful del_timer lets us re-add
+	   the timer, so refreshes need no lock against each other or
+	   against death_by_timeout(). */
+	if (is_confirmed(ct)) {
 		/* Need del_timer for race avoidance (may already be dying). */
 		if (del_timer(&ct->timeout)) {
 			ct->timeout.expires = jiffies + extra_jiffies;
 			add_timer(&ct->timeout);
 		}
+		return;
+	}
+
+	WRITE_LOCK(&ip_conntrack_lock);
+	/* If not in hash table, timer will not be active yet */
+	if (!is_confirmed(ct))
+		ct->timeout.expires = extra_jiffies;
+	else if (del_timer(&ct->timeout)) {
+		ct->timeout.expires = jiffies + extra_jiffies;
+		add_timer(&ct->timeout);
 	}
 	WRITE_UNLOCK(&ip_conntrack_lock);
 }
 
+/* Move every conntrack into a new table of size buckets, under a new
+   hash key.  Nothing is dropped; packets wait while it happens. */
+int ip_conntrack_resize(unsigned int size)
+{
+	struct list_head *hash, *old;
+	struct ip_conntrack_tuple_hash *h;
+	unsigned int i, old_size;
+
+	hash = vmalloc(sizeof(struct list_head) * size);
+	if (!hash)
+		return -ENOMEM;
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(&hash[i]);
+
+	WRITE_LOCK(&ip_conntrack_lock);
+	for (i = 0; i < IP_CT_BUCKET_LOCKS; i++)
+		write_lock(&ip_ct_bucket_lock[i].lock);
+
+	old = ip_conntrack_hash;
+	old_size = ip_conntrack_htable_size;
+	ip_conntrack_hash = hash;
+	ip_conntrack_htable_size = size;
+	get_random_bytes(&ip_conntrack_hash_rnd, sizeof(ip_conntrack_hash_rnd));
+	ip_conntrack_hash_gen++;
+
+	for (i = 0; i < old_size; i++) {
+		while (!list_empty(&old[i])) {
+			h = (struct ip_conntrack_tuple_hash *)old[i].next;
+			list_del(&h->list);
+			list_add(&h->list, &hash[hash_conntrack(&h->tuple)]);
+		}
+	}
+
+	for (i = IP_CT_BUCKET_LOCKS; i-- > 0; )
+		write_unlock(&ip_ct_bucket_lock[i].lock);
+	WRITE_UNLOCK(&ip_conntrack_lock);
+
+	vfree(old);
+	printk(KERN_INFO "ip_conntrack: %u buckets, was %u\n", size, old_size);
+	return 0;
+}
+
 /* Returns new sk_buff, or NULL */
 struct sk_buff *
 ip_ct_gather_frags(struct sk_buff *skb)
@@ -1347,13 +1466,38 @@ static struct nf_sockopt_ops so_getorigdst
 
 #define NET_IP_CONNTRACK_MAX 2089
 #define NET_IP_CONNTRACK_MAX_NAME "ip_conntrack_max"
+#define NET_IP_CONNTRACK_BUCKETS 2090
+#define NET_IP_CONNTRACK_BUCKETS_NAME "ip_conntrack_buckets"
 
 #ifdef CONFIG_SYSCTL
 static struct ctl_table_header *ip_conntrack_sysctl_header;
 
+static int ip_conntrack_buckets;
+static int ip_conntrack_buckets_min = 16;
+static int ip_conntrack_buckets_max = 1 << 22;
+
+/* Writing ip_conntrack_buckets rebuilds the table at the new size. */
+static int
+ip_conntrack_buckets_sysctl(ctl_table *table, int write, struct file *filp,
+			    void *buffer, size_t *lenp)
+{
+	int ret;
+
+	ip_conntrack_buckets = ip_conntrack_htable_size;
+	ret = proc_dointvec_minmax(table, write, filp, buffer, lenp);
+	if (ret == 0 && write
+	    && ip_conntrack_buckets != ip_conntrack_htable_size)
+		ret = ip_conntrack_resize(ip_conntrack_buckets);
+	return ret;
+}
+
 static ctl_table ip_conntrack_table[] = {
 	{ NET_IP_CONNTRACK_MAX, NET_IP_CONNTRACK_MAX_NAME, &ip_conntrack_max,
 	  sizeof(ip_conntrack_max), 0644,  NULL, proc_dointvec },
+	{ NET_IP_CONNTRACK_BUCKETS, NET_IP_CONNTRACK_BUCKETS_NAME,
+	  &ip_conntrack_buckets, sizeof(ip_conntrack_buckets), 0644, NULL,
+	  ip_conntrack_buckets_sysctl, NULL, NULL,
+	  &ip_conntrack_buckets_min, &ip_conntrack_buckets_max },
  	{ 0 }
 };
 
@@ -1457,6 +1601,9 @@ int __init ip_conntrack_init(void)
 
 	for (i = 0; i < ip_conntrack_htable_size; i++)
 		INIT_LIST_HEAD(&ip_conntrack_hash[i]);
+	for (i = 0; i < IP_CT_BUCKET_LOCKS; i++)
+		ip_ct_bucket_lock[i].lock = RW_LOCK_UNLOCKED;
+	get_random_bytes(&ip_conntrack_hash_rnd, sizeof(ip_conntrack_hash_rnd));
 
 /* This is fucking braindead.  There is NO WAY of doing this without
    the CONFIG_SYSCTL unless you don't want to detect errors.
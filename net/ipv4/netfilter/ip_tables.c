@@ -18,6 +18,8 @@
 #include <linux/tcp.h>
 #include <linux/udp.h>
 #include <linux/icmp.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
 #include <net/ip.h>
 #include <asm/uaccess.h>
 #include <asm/semaphore.h>
@@ -83,6 +85,8 @@ static DECLARE_MUTEX(ipt_mutex);
 
    Hence the start of any table is given by get_table() below.  */
 
+struct ipt_compiled;
+
 /* The table itself */
 struct ipt_table_info
 {
@@ -97,6 +101,9 @@ struct ipt_table_info
 	unsigned int hook_entry[NF_IP_NUMHOOKS];
 	unsigned int underflow[NF_IP_NUMHOOKS];
 
+	/* Per-chain lookup structures, or NULL: shared by all CPUs */
+	struct ipt_compiled *compiled;
+
 	/* ipt_entry tables: one per CPU */
 	char entries[0] ____cacheline_aligned;
 };
@@ -251,6 +258,216 @@ get_entry(void *base, unsigned int offset)
 	return (struct ipt_entry *)(base + offset);
 }
 
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+/* Rule compiler.
+
+   When a table is loaded, each chain in it is looked at.  If enough of
+   its rules ask for one exact value of the same packet field (source
+   or destination address under a common mask, or protocol and
+   destination port), the offsets of those rules are hashed by that
+   value and the others go on a `wild' list.  A packet walking the
+   chain then only has to try the rules in its own bucket and on the
+   wild list: every other rule is known not to match it, so is stepped
+   over.  Matching, counters, jumps and targets are untouched.
+
+   Packets which cannot be classified (fragments, short headers: the
+   tcp and udp matches may want to drop those) walk the chain linearly,
+   as does every chain with too few keyed rules. */
+
+#define IPT_CKEY_NONE	0	/* linear */
+#define IPT_CKEY_SRC	1
+#define IPT_CKEY_DST	2
+#define IPT_CKEY_DPORT	3
+
+/* A chain needs this many keyed rules to be worth hashing. */
+#define IPT_COMPILE_MIN	8
+
+struct ipt_ckey
+{
+	struct ipt_ckey *next;
+	u_int32_t key;
+	unsigned int num;
+	/* Offsets of the rules with this key, ascending */
+	unsigned int *off;
+};
+
+struct ipt_cblock
+{
+	/* Entries covered: [start, end) */
+	unsigned int start, end;
+	char name[IPT_FUNCTION_MAXNAMELEN];
+	unsigned int rules;
+
+	unsigned int type;
+	u_int32_t mask;
+	unsigned int keyed;
+	/* nfcache bits of all rules, for those we step over */
+	unsigned int nfcache;
+
+	unsigned int hsize;
+	struct ipt_ckey **hash;
+	unsigned int nwild;
+	unsigned int *wild;
+};
+
+struct ipt_cstat
+{
+	unsigned long lookups;
+	unsigned long linear;
+};
+
+struct ipt_compiled
+{
+	unsigned int num;
+	/* Chains not walked linearly */
+	unsigned int hashed;
+	u_int32_t rnd;
+	void *arena;
+	/* One array of num counters per CPU, SMP_ALIGNed */
+	unsigned int stats_size;
+	struct ipt_cstat *stats;
+	/* Sorted by start */
+	struct ipt_cblock blocks[0];
+};
+
+/* Where a packet is on its walk through the table. */
+struct ipt_cwalk
+{
+	struct ipt_cblock *blk;
+	int indexed;
+	const struct ipt_ckey *k;
+};
+
+static inline struct ipt_cblock *
+cblock_find(struct ipt_compiled *c, unsigned int off)
+{
+	unsigned int lo = 0, hi = c->num;
+
+	while (hi - lo > 1) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (c->blocks[mid].start <= off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (off < c->blocks[lo].start || off >= c->blocks[lo].end)
+		return NULL;
+	return &c->blocks[lo];
+}
+
+/* Fills in the packet's value of the block's key field; returns 0 if
+   the packet has to walk the block linearly. */
+static inline int
+cblock_key(const struct ipt_cblock *b, const struct iphdr *ip,
+	   const void *protohdr, u_int16_t datalen, u_int16_t offset,
+	   u_int32_t *key)
+{
+	switch (b->type) {
+	case IPT_CKEY_SRC:
+		*key = ip->saddr & b->mask;
+		return 1;
+	case IPT_CKEY_DST:
+		*key = ip->daddr & b->mask;
+		return 1;
+	case IPT_CKEY_DPORT:
+		if (ip->protocol == IPPROTO_TCP) {
+			if (offset || datalen < sizeof(struct tcphdr))
+				return 0;
+			*key = (IPPROTO_TCP << 16)
+				| ntohs(((struct tcphdr *)protohdr)->dest);
+		} else if (ip->protocol == IPPROTO_UDP) {
+			if (offset || datalen < sizeof(struct udphdr))
+				return 0;
+			*key = (IPPROTO_UDP << 16)
+				| ntohs(((struct udphdr *)protohdr)->dest);
+		} else
+			/* Matches no keyed rule: they are all tcp or udp */
+			*key = ip->protocol << 16;
+		return 1;
+	}
+	return 0;
+}
+
+static inline const struct ipt_ckey *
+cblock_lookup(const struct ipt_compiled *c, const struct ipt_cblock *b,
+	      u_int32_t key)
+{
+	const struct ipt_ckey *k;
+
+	for (k = b->hash[jhash_1word(key, c->rnd) & (b->hsize - 1)];
+	     k; k = k->next)
+		if (k->key == key)
+			return k;
+	return NULL;
+}
+
+/* First of the ascending offsets not below off, or ~0U. */
+static inline unsigned int
+first_from(const unsigned int *a, unsigned int n, unsigned int off)
+{
+	unsigned int lo = 0, hi = n;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (a[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < n ? a[lo] : ~0U;
+}
+
+/* Steps over the rules from e on which cannot match this packet. */
+static inline struct ipt_entry *
+ipt_compiled_next(struct ipt_compiled *c, struct ipt_cwalk *w,
+		  void *table_base, struct ipt_entry *e,
+		  struct sk_buff *skb, const struct iphdr *ip,
+		  const void *protohdr, u_int16_t datalen, u_int16_t offset)
+{
+	unsigned int off = (void *)e - table_base;
+	struct ipt_cblock *b = w->blk;
+	unsigned int next, n;
+
+	if (!b || off < b->start || off >= b->end) {
+		struct ipt_cstat *st;
+		u_int32_t key;
+
+		b = w->blk = cblock_find(c, off);
+		if (!b || b->type == IPT_CKEY_NONE) {
+			w->indexed = 0;
+			return e;
+		}
+		st = (void *)c->stats
+			+ c->stats_size * cpu_number_map(smp_processor_id());
+		w->indexed = cblock_key(b, ip, protohdr, datalen, offset,
+					&key);
+		if (w->indexed) {
+			st[b - c->blocks].lookups++;
+			w->k = cblock_lookup(c, b, key);
+		} else
+			st[b - c->blocks].linear++;
+	}
+	if (!w->indexed)
+		return e;
+
+	next = first_from(b->wild, b->nwild, off);
+	if (w->k) {
+		n = first_from(w->k->off, w->k->num, off);
+		if (n < next)
+			next = n;
+	}
+	if (next == off)
+		return e;
+
+	skb->nfcache |= b->nfcache;
+	if (next > b->end)
+		next = b->end;
+	return get_entry(table_base, next);
+}
+#endif /* CONFIG_IP_NF_IPTABLES_COMPILE */
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff **pskb,
@@ -271,6 +488,10 @@ ipt_do_table(struct sk_buff **pskb,
 	const char *indev, *outdev;
 	void *table_base;
 	struct ipt_entry *e, *back;
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+	struct ipt_compiled *compiled;
+	struct ipt_cwalk walk = { NULL, 0, NULL };
+#endif
 
 	/* Initialization */
 	ip = (*pskb)->nh.iph;
@@ -292,6 +513,11 @@ ipt_do_table(struct sk_buff **pskb,
 		+ TABLE_OFFSET(table->private,
 			       cpu_number_map(smp_processor_id()));
 	e = get_entry(table_base, table->private->hook_entry[hook]);
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+	compiled = table->private->compiled;
+	if (compiled && !compiled->hashed)
+		compiled = NULL;
+#endif
 
 #ifdef CONFIG_NETFILTER_DEBUG
 	/* Check noone else using our table */
@@ -312,6 +538,12 @@ ipt_do_table(struct sk_buff **pskb,
 	do {
 		IP_NF_ASSERT(e);
 		IP_NF_ASSERT(back);
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+		if (compiled)
+			e = ipt_compiled_next(compiled, &walk, table_base, e,
+					      *pskb, ip, protohdr, datalen,
+					      offset);
+#endif
 		(*pskb)->nfcache |= e->nfcache;
 		if (ip_packet_match(ip, indev, outdev, &e->ip, offset)) {
 			struct ipt_entry_target *t;
@@ -382,6 +614,10 @@ ipt_do_table(struct sk_buff **pskb,
 				ip = (*pskb)->nh.iph;
 				protohdr = (u_int32_t *)ip + ip->ihl;
 				datalen = (*pskb)->len - ip->ihl * 4;
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+				/* ... so classify it again. */
+				walk.blk = NULL;
+#endif
 
 				if (verdict == IPT_CONTINUE)
 					e = (void *)e + e->next_offset;
@@ -793,6 +1029,305 @@ cleanup_entry(struct ipt_entry *e, unsigned int *i)
 	return 0;
 }
 
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+static const char *const ipt_hooknames[NF_IP_NUMHOOKS]
+= { "PREROUTING", "INPUT", "FORWARD", "OUTPUT", "POSTROUTING" };
+
+/* Arena pieces are kept long-aligned. */
+#define CARVE(x) (((x) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+
+/* Returns the chain name if a chain starts at this entry: the hook
+   entry points, and the ERROR entries heading user-defined chains. */
+static const char *
+chain_start(const struct ipt_table_info *info, struct ipt_entry *e,
+	    unsigned int off, int *head)
+{
+	struct ipt_entry_target *t = ipt_get_target(e);
+	unsigned int hook;
+
+	*head = 0;
+	if (strcmp(t->u.kernel.target->name, IPT_ERROR_TARGET) == 0) {
+		*head = 1;
+		return (const char *)t->data;
+	}
+	for (hook = 0; hook < NF_IP_NUMHOOKS; hook++)
+		if (info->hook_entry[hook] == off)
+			return ipt_hooknames[hook];
+	return off == 0 ? "" : NULL;
+}
+
+static inline int
+port_key(struct ipt_entry_match *m, const struct ipt_entry *e,
+	 u_int32_t *key)
+{
+	const char *name = m->u.kernel.match->name;
+
+	if (e->ip.invflags & IPT_INV_PROTO)
+		return 0;
+	if (e->ip.proto == IPPROTO_TCP && strcmp(name, "tcp") == 0) {
+		const struct ipt_tcp *tcpinfo = (void *)m->data;
+
+		if (tcpinfo->dpts[0] != tcpinfo->dpts[1]
+		    || (tcpinfo->invflags & IPT_TCP_INV_DSTPT))
+			return 0;
+		*key = (IPPROTO_TCP << 16) | tcpinfo->dpts[0];
+		return 1;
+	}
+	if (e->ip.proto == IPPROTO_UDP && strcmp(name, "udp") == 0) {
+		const struct ipt_udp *udpinfo = (void *)m->data;
+
+		if (udpinfo->dpts[0] != udpinfo->dpts[1]
+		    || (udpinfo->invflags & IPT_UDP_INV_DSTPT))
+			return 0;
+		*key = (IPPROTO_UDP << 16) | udpinfo->dpts[0];
+		return 1;
+	}
+	return 0;
+}
+
+/* Returns 1 if the rule can only match packets whose value of the
+   field (under mask) is key. */
+static int
+rule_key(struct ipt_entry *e, unsigned int type, u_int32_t mask,
+	 u_int32_t *key)
+{
+	switch (type) {
+	case IPT_CKEY_SRC:
+		if ((e->ip.invflags & IPT_INV_SRCIP)
+		    || e->ip.smsk.s_addr != mask)
+			return 0;
+		*key = e->ip.src.s_addr;
+		return 1;
+	case IPT_CKEY_DST:
+		if ((e->ip.invflags & IPT_INV_DSTIP)
+		    || e->ip.dmsk.s_addr != mask)
+			return 0;
+		*key = e->ip.dst.s_addr;
+		return 1;
+	case IPT_CKEY_DPORT:
+		return IPT_MATCH_ITERATE(e, port_key, e, key);
+	}
+	return 0;
+}
+
+/* Prefix length of a netmask, or -1 if it has holes. */
+static inline int
+mask_len(u_int32_t mask)
+{
+	u_int32_t m = ntohl(mask);
+	int len = 0;
+
+	while (m & 0x80000000) {
+		m <<= 1;
+		len++;
+	}
+	return m ? -1 : len;
+}
+
+/* Picks the field most rules of the chain are keyed by. */
+static void
+cblock_choose(struct ipt_cblock *b, void *base)
+{
+	unsigned int src[33], dst[33], dport = 0, entries = 0;
+	unsigned int off, i;
+	struct ipt_entry *e;
+	u_int32_t key;
+	int len;
+
+	memset(src, 0, sizeof(src));
+	memset(dst, 0, sizeof(dst));
+	for (off = b->start; off < b->end; off += e->next_offset) {
+		e = get_entry(base, off);
+		entries++;
+		b->nfcache |= e->nfcache;
+		if (!(e->ip.invflags & IPT_INV_SRCIP)
+		    && (len = mask_len(e->ip.smsk.s_addr)) > 0)
+			src[len]++;
+		if (!(e->ip.invflags & IPT_INV_DSTIP)
+		    && (len = mask_len(e->ip.dmsk.s_addr)) > 0)
+			dst[len]++;
+		if (rule_key(e, IPT_CKEY_DPORT, 0, &key))
+			dport++;
+	}
+
+	for (i = 1; i <= 32; i++) {
+		if (src[i] > b->keyed) {
+			b->type = IPT_CKEY_SRC;
+			b->mask = htonl(~0U << (32 - i));
+			b->keyed = src[i];
+		}
+		if (dst[i] > b->keyed) {
+			b->type = IPT_CKEY_DST;
+			b->mask = htonl(~0U << (32 - i));
+			b->keyed = dst[i];
+		}
+	}
+	if (dport > b->keyed) {
+		b->type = IPT_CKEY_DPORT;
+		b->mask = 0;
+		b->keyed = dport;
+	}
+
+	if (b->keyed < IPT_COMPILE_MIN) {
+		b->type = IPT_CKEY_NONE;
+		b->keyed = 0;
+		return;
+	}
+	for (b->hsize = 1; b->hsize < b->keyed; b->hsize <<= 1);
+	b->nwild = entries - b->keyed;
+}
+
+static inline unsigned int
+cblock_size(const struct ipt_cblock *b)
+{
+	return CARVE(b->hsize * sizeof(struct ipt_ckey *))
+		+ CARVE(b->keyed * sizeof(struct ipt_ckey))
+		+ CARVE((b->keyed + b->nwild) * sizeof(unsigned int));
+}
+
+/* Hashes the keyed rules of a chain, putting the rest on the wild
+   list.  Rules are visited in order, so every list is ascending. */
+static void
+cblock_build(struct ipt_compiled *c, struct ipt_cblock *b, void *base,
+	     char *arena)
+{
+	struct ipt_ckey *nodes, *k;
+	unsigned int *offs, nnodes = 0, off, i;
+	struct ipt_entry *e;
+	u_int32_t key;
+
+	b->hash = (void *)arena;
+	arena += CARVE(b->hsize * sizeof(struct ipt_ckey *));
+	nodes = (void *)arena;
+	arena += CARVE(b->keyed * sizeof(struct ipt_ckey));
+	offs = (void *)arena;
+	memset(b->hash, 0, b->hsize * sizeof(struct ipt_ckey *));
+
+	/* Count the rules under each key... */
+	for (off = b->start; off < b->end; off += e->next_offset) {
+		e = get_entry(base, off);
+		if (!rule_key(e, b->type, b->mask, &key))
+			continue;
+		k = (struct ipt_ckey *)cblock_lookup(c, b, key);
+		if (!k) {
+			unsigned int h = jhash_1word(key, c->rnd)
+				& (b->hsize - 1);
+
+			k = &nodes[nnodes++];
+			k->key = key;
+			k->num = 0;
+			k->next = b->hash[h];
+			b->hash[h] = k;
+		}
+		k->num++;
+	}
+
+	/* ...then hand out their slices of offs, and fill them in. */
+	for (i = 0; i < nnodes; i++) {
+		nodes[i].off = offs;
+		offs += nodes[i].num;
+		nodes[i].num = 0;
+	}
+	b->wild = offs;
+	b->nwild = 0;
+	for (off = b->start; off < b->end; off += e->next_offset) {
+		e = get_entry(base, off);
+		if (rule_key(e, b->type, b->mask, &key)) {
+			k = (struct ipt_ckey *)cblock_lookup(c, b, key);
+			k->off[k->num++] = off;
+		} else
+			b->wild[b->nwild++] = off;
+	}
+}
+
+/* Builds the lookup structures for a translated table.  Failure is
+   not an error: the table is then simply walked linearly. */
+static void
+ipt_compile_table(struct ipt_table_info *info)
+{
+	struct ipt_compiled *c;
+	struct ipt_cblock *b = NULL;
+	struct ipt_entry *e;
+	unsigned int num = 0, size, off, i;
+	const char *name;
+	int head;
+	char *arena;
+
+	for (off = 0; off < info->size; off += e->next_offset) {
+		e = get_entry(info->entries, off);
+		if (chain_start(info, e, off, &head))
+			num++;
+	}
+
+	c = vmalloc(sizeof(struct ipt_compiled)
+		    + num * sizeof(struct ipt_cblock));
+	if (!c)
+		return;
+	memset(c, 0, sizeof(struct ipt_compiled)
+	       + num * sizeof(struct ipt_cblock));
+
+	for (off = 0; off < info->size; off += e->next_offset) {
+		e = get_entry(info->entries, off);
+		name = chain_start(info, e, off, &head);
+		if (name) {
+			if (b)
+				b->end = off;
+			b = &c->blocks[c->num++];
+			b->start = off;
+			strncpy(b->name, name, sizeof(b->name) - 1);
+			if (head)
+				continue;
+		}
+		b->rules++;
+	}
+	b->end = info->size;
+
+	c->stats_size = SMP_ALIGN(num * sizeof(struct ipt_cstat));
+	size = c->stats_size * smp_num_cpus;
+	for (i = 0; i < c->num; i++) {
+		b = &c->blocks[i];
+		cblock_choose(b, info->entries);
+		if (b->type != IPT_CKEY_NONE) {
+			c->hashed++;
+			size += cblock_size(b);
+		}
+	}
+
+	c->arena = vmalloc(size);
+	if (!c->arena) {
+		vfree(c);
+		return;
+	}
+	c->stats = c->arena;
+	memset(c->stats, 0, c->stats_size * smp_num_cpus);
+	get_random_bytes(&c->rnd, sizeof(c->rnd));
+
+	arena = c->arena + c->stats_size * smp_num_cpus;
+	for (i = 0; i < c->num; i++) {
+		b = &c->blocks[i];
+		if (b->type == IPT_CKEY_NONE)
+			continue;
+		cblock_build(c, b, info->entries, arena);
+		arena += cblock_size(b);
+	}
+
+	info->compiled = c;
+}
+
+static void
+ipt_free_compiled(struct ipt_table_info *info)
+{
+	if (info->compiled) {
+		vfree(info->compiled->arena);
+		vfree(info->compiled);
+		info->compiled = NULL;
+	}
+}
+#else
+#define ipt_compile_table(info)		do { } while (0)
+#define ipt_free_compiled(info)		do { } while (0)
+#endif /* CONFIG_IP_NF_IPTABLES_COMPILE */
+
 /* Checks and translates the user-supplied table segment (held in
    newinfo) */
 static int
@@ -809,6 +1344,7 @@ translate_table(const char *name,
 
 	newinfo->size = size;
 	newinfo->number = number;
+	newinfo->compiled = NULL;
 
 	/* Init all hooks to impossible value. */
 	for (i = 0; i < NF_IP_NUMHOOKS; i++) {
@@ -872,6 +1408,7 @@ translate_table(const char *name,
 		       SMP_ALIGN(newinfo->size));
 	}
 
+	ipt_compile_table(newinfo);
 	return ret;
 }
 
@@ -1128,6 +1665,7 @@ do_replace(void *user, unsigned int len)
 	get_counters(oldinfo, counters);
 	/* Decrease module usage counts and free resource */
 	IPT_ENTRY_ITERATE(oldinfo->entries, oldinfo->size, cleanup_entry,NULL);
+	ipt_free_compiled(oldinfo);
 	vfree(oldinfo);
 	/* Silent error: too late now. */
 	copy_to_user(tmp.counters, counters,
@@ -1140,6 +1678,7 @@ do_replace(void *user, unsigned int len)
 	up(&ipt_mutex);
  free_newinfo_counters_untrans:
 	IPT_ENTRY_ITERATE(newinfo->entries, newinfo->size, cleanup_entry,NULL);
+	ipt_free_compiled(newinfo);
  free_newinfo_counters:
 	vfree(counters);
  free_newinfo:
@@ -1382,7 +1921,7 @@ int ipt_register_table(struct ipt_table *table)
 	int ret;
 	struct ipt_table_info *newinfo;
 	static struct ipt_table_info bootstrap
-		= { 0, 0, 0, { 0 }, { 0 }, { } };
+		= { 0, 0, 0, { 0 }, { 0 }, NULL, { } };
 
 	MOD_INC_USE_COUNT;
 	newinfo = vmalloc(sizeof(struct ipt_table_info)
@@ -1407,6 +1946,7 @@ int ipt_register_table(struct ipt_table *table)
 
 	ret = down_interruptible(&ipt_mutex);
 	if (ret != 0) {
+		ipt_free_compiled(newinfo);
 		vfree(newinfo);
 		MOD_DEC_USE_COUNT;
 		return ret;
@@ -1437,6 +1977,7 @@ int ipt_register_table(struct ipt_table *table)
 	return ret;
 
  free_unlock:
+	ipt_free_compiled(newinfo);
 	vfree(newinfo);
 	MOD_DEC_USE_COUNT;
 	goto unlock;
@@ -1451,6 +1992,7 @@ void ipt_unregister_table(struct ipt_table *table)
 	/* Decrease module usage counts and free resources */
 	IPT_ENTRY_ITERATE(table->private->entries, table->private->size,
 			  cleanup_entry, NULL);
+	ipt_free_compiled(table->private);
 	vfree(table->private);
 	MOD_DEC_USE_COUNT;
 }
@@ -1733,6 +2275,85 @@ static int ipt_get_tables(char *buffer, char **start, off_t offset, int length)
 	*start=(char *)((unsigned long)count-offset);
 	return pos;
 }
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+/* One line per chain: table, chain, rules, how packets find the
+   rules (linear, or the field hashed on), keyed rules, and how many
+   walks through the chain were hashed and linear. */
+static inline int print_chains(const struct ipt_table *t,
+			       off_t start_offset, char *buffer, int length,
+			       off_t *pos, unsigned int *count)
+{
+	const struct ipt_compiled *c = t->private->compiled;
+	unsigned int i, cpu;
+
+	if (!c)
+		return 0;
+
+	for (i = 0; i < c->num; i++) {
+		const struct ipt_cblock *b = &c->blocks[i];
+		unsigned long lookups = 0, linear = 0;
+		char line[128], path[8];
+		unsigned int len;
+
+		/* The ERROR entry closing the table */
+		if (!b->rules && b->end == t->private->size)
+			continue;
+		if ((*count)++ < start_offset)
+			continue;
+
+		for (cpu = 0; cpu < smp_num_cpus; cpu++) {
+			const struct ipt_cstat *st = (void *)c->stats
+				+ c->stats_size * cpu;
+
+			lookups += st[i].lookups;
+			linear += st[i].linear;
+		}
+		switch (b->type) {
+		case IPT_CKEY_SRC:
+			sprintf(path, "src/%d", mask_len(b->mask));
+			break;
+		case IPT_CKEY_DST:
+			sprintf(path, "dst/%d", mask_len(b->mask));
+			break;
+		case IPT_CKEY_DPORT:
+			strcpy(path, "dport");
+			break;
+		default:
+			strcpy(path, "linear");
+		}
+
+		len = sprintf(line, "%-15s %-30s %6u %-6s %6u %10lu %10lu\n",
+			      t->name, b->name, b->rules, path, b->keyed,
+			      lookups, linear);
+		if (*pos + len > length) {
+			/* Stop iterating */
+			return 1;
+		}
+		memcpy(buffer + *pos, line, len);
+		*pos += len;
+	}
+	return 0;
+}
+
+static int ipt_get_chains(char *buffer, char **start, off_t offset,
+			  int length)
+{
+	off_t pos = 0;
+	unsigned int count = 0;
+
+	if (down_interruptible(&ipt_mutex) != 0)
+		return 0;
+
+	LIST_FIND(&ipt_tables, print_chains, struct ipt_table *,
+		  offset, buffer, length, &pos, &count);
+
+	up(&ipt_mutex);
+
+	/* `start' hack - see fs/proc/generic.c line ~105 */
+	*start=(char *)((unsigned long)count-offset);
+	return pos;
+}
+#endif
 #endif /*CONFIG_PROC_FS*/
 
 static int __init init(void)
@@ -1765,6 +2386,15 @@ static int __init init(void)
 		return -ENOMEM;
 	}
 	proc->owner = THIS_MODULE;
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+	proc = proc_net_create("ip_tables_chains", 0, ipt_get_chains);
+	if (!proc) {
+		proc_net_remove("ip_tables_names");
+		nf_unregister_sockopt(&ipt_sockopts);
+		return -ENOMEM;
+	}
+	proc->owner = THIS_MODULE;
+#endif
 	}
 #endif
 
@@ -1777,6 +2407,9 @@ static void __exit fini(void)
 	nf_unregister_sockopt(&ipt_sockopts);
 #ifdef CONFIG_PROC_FS
 	proc_net_remove("ip_tables_names");
+#ifdef CONFIG_IP_NF_IPTABLES_COMPILE
+	proc_net_remove("ip_tables_chains");
+#endif
 #endif
 }
 
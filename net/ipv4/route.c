@@ -85,6 +85,8 @@
 #include <linux/mroute.h>
 #include <linux/netfilter_ipv4.h>
 #include <linux/random.h>
+#include <linux/jhash.h>
+#include <linux/brlock.h>
 #include <net/protocol.h>
 #include <net/ip.h>
 #include <net/route.h>
@@ -117,6 +119,7 @@ int ip_rt_gc_elasticity		= 8;
 int ip_rt_mtu_expires		= 10 * 60 * HZ;
 int ip_rt_min_pmtu		= 512 + 20 + 20;
 int ip_rt_min_advmss		= 256;
+int ip_rt_secret_interval	= 10 * 60 * HZ;
 
 static unsigned long rt_deadline;
 
@@ -124,6 +127,7 @@ static unsigned long rt_deadline;
 
 static struct timer_list rt_flush_timer;
 static struct timer_list rt_periodic_timer;
+static struct timer_list rt_secret_timer;
 
 /*
  *	Interface to generic destination cache.
@@ -184,6 +188,10 @@ __u8 ip_tos2prio[16] = {
  * 3) Only readers acquire references to rtable entries,
  *    they do so with atomic increments and with the
  *    lock held.
+ * 4) The table itself can be replaced (net.ipv4.route.buckets):
+ *    bucket locks are only taken with BR_RT_HASH_LOCK read-locked,
+ *    and the resize holds it for writing.  Hash codes do not depend
+ *    on the table size; they are masked once the lock is held.
  */
 
 struct rt_hash_bucket {
@@ -194,6 +202,11 @@ struct rt_hash_bucket {
 static struct rt_hash_bucket 	*rt_hash_table;
 static unsigned			rt_hash_mask;
 static int			rt_hash_log;
+static int			rt_hash_order;	/* of the table's pages */
+
+/* Keys the hash so that nobody can aim packets at one chain; a new
+   one is chosen every time the cache is flushed. */
+static u32			rt_hash_rnd;
 
 struct rt_cache_stat rt_cache_stat[NR_CPUS];
 
@@ -202,11 +215,47 @@ static int rt_intern_hash(unsigned hash, struct rtable *rth,
 
 static __inline__ unsigned rt_hash_code(u32 daddr, u32 saddr, u8 tos)
 {
-	unsigned hash = ((daddr & 0xF0F0F0F0) >> 4) |
-			((daddr & 0x0F0F0F0F) << 4);
-	hash ^= saddr ^ tos;
-	hash ^= (hash >> 16);
-	return (hash ^ (hash >> 8)) & rt_hash_mask;
+	return jhash_3words(daddr, saddr, tos, rt_hash_rnd);
+}
+
+/* The hash code an entry was filed under */
+static __inline__ unsigned rt_hash_entry(struct rtable *rt)
+{
+	return rt_hash_code(rt->key.dst,
+			    rt->key.src ^ ((rt->key.iif ^ rt->key.oif) << 5),
+			    rt->key.tos);
+}
+
+static __inline__ struct rt_hash_bucket *rt_read_lock_bucket(unsigned hash)
+{
+	struct rt_hash_bucket *b;
+
+	br_read_lock_bh(BR_RT_HASH_LOCK);
+	b = &rt_hash_table[hash & rt_hash_mask];
+	read_lock(&b->lock);
+	return b;
+}
+
+static __inline__ void rt_read_unlock_bucket(struct rt_hash_bucket *b)
+{
+	read_unlock(&b->lock);
+	br_read_unlock_bh(BR_RT_HASH_LOCK);
+}
+
+static __inline__ struct rt_hash_bucket *rt_write_lock_bucket(unsigned hash)
+{
+	struct rt_hash_bucket *b;
+
+	br_read_lock_bh(BR_RT_HASH_LOCK);
+	b = &rt_hash_table[hash & rt_hash_mask];
+	write_lock(&b->lock);
+	return b;
+}
+
+static __inline__ void rt_write_unlock_bucket(struct rt_hash_bucket *b)
+{
+	write_unlock(&b->lock);
+	br_read_unlock_bh(BR_RT_HASH_LOCK);
 }
 
 static int rt_cache_get_info(char *buffer, char **start, off_t offset,
@@ -215,6 +264,7 @@ static int rt_cache_get_info(char *buffer, char **start, off_t offset,
 	int len = 0;
 	off_t pos = 128;
 	char temp[256];
+	struct rt_hash_bucket *b;
 	struct rtable *r;
 	int i;
 
@@ -227,8 +277,8 @@ static int rt_cache_get_info(char *buffer, char **start, off_t offset,
   	}
 	
 	for (i = rt_hash_mask; i >= 0; i--) {
-		read_lock_bh(&rt_hash_table[i].lock);
-		for (r = rt_hash_table[i].chain; r; r = r->u.rt_next) {
+		b = rt_read_lock_bucket(i);
+		for (r = b->chain; r; r = r->u.rt_next) {
 			/*
 			 *	Spin through entries until we are ready
 			 */
@@ -263,11 +313,11 @@ static int rt_cache_get_info(char *buffer, char **start, off_t offset,
 			sprintf(buffer + len, "%-127s\n", temp);
 			len += 128;
 			if (pos >= offset+length) {
-				read_unlock_bh(&rt_hash_table[i].lock);
+				rt_read_unlock_bucket(b);
 				goto done;
 			}
 		}
-		read_unlock_bh(&rt_hash_table[i].lock);
+		rt_read_unlock_bucket(b);
         }
 
 done:
@@ -287,7 +337,7 @@ static int rt_cache_stat_get_info(char *buffer, char **start, off_t offset, int
         for (lcpu = 0; lcpu < smp_num_cpus; lcpu++) {
                 i = cpu_logical_map(lcpu);
 
-		len += sprintf(buffer+len, "%08x  %08x %08x %08x %08x %08x %08x %08x  %08x %08x %08x %08x %08x %08x %08x \n",
+		len += sprintf(buffer+len, "%08x  %08x %08x %08x %08x %08x %08x %08x  %08x %08x %08x %08x %08x %08x %08x  %08x %08x %08x %08x \n",
 			       dst_entries,		       
 			       rt_cache_stat[i].in_hit,
 			       rt_cache_stat[i].in_slow_tot,
@@ -304,8 +354,12 @@ static int rt_cache_stat_get_info(char *buffer, char **start, off_t offset, int
 			       rt_cache_stat[i].gc_total,
 			       rt_cache_stat[i].gc_ignored,
 			       rt_cache_stat[i].gc_goal_miss,
-			       rt_cache_stat[i].gc_dst_overflow
+			       rt_cache_stat[i].gc_dst_overflow,
 
+			       rt_cache_stat[i].hash_insert,
+			       rt_cache_stat[i].hash_search,
+			       rt_cache_stat[i].gc_evict,
+			       rt_cache_stat[i].gc_scanned
 			);
 	}
 	len -= offset;
@@ -318,6 +372,48 @@ static int rt_cache_stat_get_info(char *buffer, char **start, off_t offset, int
 	*start = buffer + offset;
   	return len;
 }
+
+#define RT_CHAIN_HIST	16
+
+/* Size of the table and how long its chains are */
+static int rt_hash_get_info(char *buffer, char **start, off_t offset, int length)
+{
+	unsigned int hist[RT_CHAIN_HIST];
+	unsigned int entries = 0, longest = 0, n;
+	struct rt_hash_bucket *b;
+	struct rtable *r;
+	int i, len;
+
+	memset(hist, 0, sizeof(hist));
+	for (i = rt_hash_mask; i >= 0; i--) {
+		n = 0;
+		b = rt_read_lock_bucket(i);
+		for (r = b->chain; r; r = r->u.rt_next)
+			n++;
+		rt_read_unlock_bucket(b);
+
+		entries += n;
+		if (n > longest)
+			longest = n;
+		hist[n < RT_CHAIN_HIST ? n : RT_CHAIN_HIST - 1]++;
+	}
+
+	len = sprintf(buffer, "buckets %u entries %u longest %u\n",
+		      rt_hash_mask + 1, entries, longest);
+	for (i = 0; i < RT_CHAIN_HIST; i++)
+		len += sprintf(buffer + len, "%s%2d %u\n",
+			       i == RT_CHAIN_HIST - 1 ? ">=" : "  ",
+			       i, hist[i]);
+
+	len -= offset;
+	if (len > length)
+		len = length;
+	if (len < 0)
+		len = 0;
+
+	*start = buffer + offset;
+	return len;
+}
   
 static __inline__ void rt_free(struct rtable *rt)
 {
@@ -365,11 +461,30 @@ static __inline__ int rt_may_expire(struct rtable *rth, int tmo1, int tmo2)
 out:	return ret;
 }
 
+/* Which entry of a full chain to give up: the one with the lowest
+   score, i.e. the least recently used among the least valuable. */
+static __inline__ u32 rt_score(struct rtable *rt)
+{
+	u32 score = jiffies - rt->u.dst.lastuse;
+
+	score = ~score & ~(3<<30);
+
+	if (rt_valuable(rt))
+		score |= (1<<31);
+
+	if (!rt->key.iif ||
+	    !(rt->rt_flags & (RTCF_BROADCAST|RTCF_MULTICAST|RTCF_LOCAL)))
+		score |= (1<<30);
+
+	return score;
+}
+
 /* This runs via a timer and thus is always in BH context. */
 static void SMP_TIMER_NAME(rt_check_expire)(unsigned long dummy)
 {
 	static int rover;
 	int i = rover, t;
+	struct rt_hash_bucket *b;
 	struct rtable *rth, **rthp;
 	unsigned long now = jiffies;
 
@@ -378,9 +493,9 @@ static void SMP_TIMER_NAME(rt_check_expire)(unsigned long dummy)
 		unsigned tmo = ip_rt_gc_timeout;
 
 		i = (i + 1) & rt_hash_mask;
-		rthp = &rt_hash_table[i].chain;
+		b = rt_write_lock_bucket(i);
+		rthp = &b->chain;
 
-		write_lock(&rt_hash_table[i].lock);
 		while ((rth = *rthp) != NULL) {
 			if (rth->u.dst.expires) {
 				/* Entry is expired even if it is in use */
@@ -399,7 +514,7 @@ static void SMP_TIMER_NAME(rt_check_expire)(unsigned long dummy)
 			*rthp = rth->u.rt_next;
 			rt_free(rth);
 		}
-		write_unlock(&rt_hash_table[i].lock);
+		rt_write_unlock_bucket(b);
 
 		/* Fallback loop breaker. */
 		if ((jiffies - now) > 0)
@@ -417,16 +532,21 @@ SMP_TIMER_DEFINE(rt_check_expire, rt_gc_task);
 static void SMP_TIMER_NAME(rt_run_flush)(unsigned long dummy)
 {
 	int i;
+	struct rt_hash_bucket *b;
 	struct rtable *rth, *next;
 
 	rt_deadline = 0;
 
+	/* Entries added under the old key while we go may end up in
+	   the wrong chain; they will not be found, and age away. */
+	get_random_bytes(&rt_hash_rnd, sizeof(rt_hash_rnd));
+
 	for (i = rt_hash_mask; i >= 0; i--) {
-		write_lock_bh(&rt_hash_table[i].lock);
-		rth = rt_hash_table[i].chain;
+		b = rt_write_lock_bucket(i);
+		rth = b->chain;
 		if (rth)
-			rt_hash_table[i].chain = NULL;
-		write_unlock_bh(&rt_hash_table[i].lock);
+			b->chain = NULL;
+		rt_write_unlock_bucket(b);
 
 		for (; rth; rth = next) {
 			next = rth->u.rt_next;
@@ -436,6 +556,18 @@ static void SMP_TIMER_NAME(rt_run_flush)(unsigned long dummy)
 }
 
 SMP_TIMER_DEFINE(rt_run_flush, rt_cache_flush_task);
+
+/* Rekey the hash now and then, so that a colliding set of addresses
+   found by probing does not stay useful for long.  An interval of 0
+   leaves it to the flushes that route changes cause anyway. */
+static void rt_secret_rebuild(unsigned long dummy)
+{
+	if (ip_rt_secret_interval > 0) {
+		rt_cache_flush(0);
+		mod_timer(&rt_secret_timer, jiffies + ip_rt_secret_interval);
+	} else
+		mod_timer(&rt_secret_timer, jiffies + ip_rt_gc_interval);
+}
   
 static spinlock_t rt_flush_lock = SPIN_LOCK_UNLOCKED;
 
@@ -479,6 +611,11 @@ void rt_cache_flush(int delay)
 	spin_unlock_bh(&rt_flush_lock);
 }
 
+/* Buckets rt_garbage_collect() may scan per call from softirq.  On
+   the packet path it does a bounded share of the work and leaves the
+   rest to later calls, instead of sweeping the whole table. */
+#define RT_GC_BUDGET	256
+
 /*
    Short description of GC goals.
 
@@ -498,9 +635,10 @@ static int rt_garbage_collect(void)
 	static unsigned long last_gc;
 	static int rover;
 	static int equilibrium;
+	struct rt_hash_bucket *b;
 	struct rtable *rth, **rthp;
 	unsigned long now = jiffies;
-	int goal;
+	int goal, budget;
 
 	/*
 	 * Garbage collection is pretty expensive,
@@ -542,15 +680,20 @@ static int rt_garbage_collect(void)
 		goto work_done;
 	}
 
+	budget = rt_hash_mask;
+	if (in_softirq() && budget >= RT_GC_BUDGET)
+		budget = RT_GC_BUDGET - 1;
+
 	do {
 		int i, k;
 
-		for (i = rt_hash_mask, k = rover; i >= 0; i--) {
+		for (i = budget, k = rover; i >= 0; i--) {
 			unsigned tmo = expire;
 
 			k = (k + 1) & rt_hash_mask;
-			rthp = &rt_hash_table[k].chain;
-			write_lock_bh(&rt_hash_table[k].lock);
+			b = rt_write_lock_bucket(k);
+			rthp = &b->chain;
+			rt_cache_stat[smp_processor_id()].gc_scanned++;
 			while ((rth = *rthp) != NULL) {
 				if (!rt_may_expire(rth, tmo, expire)) {
 					tmo >>= 1;
@@ -561,7 +704,7 @@ static int rt_garbage_collect(void)
 				rt_free(rth);
 				goal--;
 			}
-			write_unlock_bh(&rt_hash_table[k].lock);
+			rt_write_unlock_bucket(b);
 			if (goal <= 0)
 				break;
 		}
@@ -615,41 +758,80 @@ out:	return 0;
 
 static int rt_intern_hash(unsigned hash, struct rtable *rt, struct rtable **rp)
 {
+	struct rt_hash_bucket *b;
 	struct rtable	*rth, **rthp;
+	struct rtable	*cand, **candp;
+	u32		min_score;
+	int		chain_length;
 	unsigned long	now = jiffies;
 	int attempts = !in_softirq();
 
 restart:
-	rthp = &rt_hash_table[hash].chain;
+	cand = NULL;
+	candp = NULL;
+	min_score = ~(u32)0;
+	chain_length = 0;
 
-	write_lock_bh(&rt_hash_table[hash].lock);
+	b = rt_write_lock_bucket(hash);
+	rthp = &b->chain;
 	while ((rth = *rthp) != NULL) {
 		if (memcmp(&rth->key, &rt->key, sizeof(rt->key)) == 0) {
 			/* Put it first */
 			*rthp = rth->u.rt_next;
-			rth->u.rt_next = rt_hash_table[hash].chain;
-			rt_hash_table[hash].chain = rth;
+			rth->u.rt_next = b->chain;
+			b->chain = rth;
 
 			rth->u.dst.__use++;
 			dst_hold(&rth->u.dst);
 			rth->u.dst.lastuse = now;
-			write_unlock_bh(&rt_hash_table[hash].lock);
+			rt_write_unlock_bucket(b);
 
 			rt_drop(rt);
 			*rp = rth;
 			return 0;
 		}
 
+		/* Collect garbage on the way: each insertion pays for
+		   cleaning the one chain it goes into. */
+		if (rt_may_expire(rth, ip_rt_gc_timeout, ip_rt_gc_timeout)) {
+			*rthp = rth->u.rt_next;
+			rt_free(rth);
+			continue;
+		}
+
+		if (!atomic_read(&rth->u.dst.__refcnt)) {
+			u32 score = rt_score(rth);
+
+			if (score <= min_score) {
+				cand = rth;
+				candp = rthp;
+				min_score = score;
+			}
+		}
+
+		chain_length++;
 		rthp = &rth->u.rt_next;
 	}
 
+	rt_cache_stat[smp_processor_id()].hash_insert++;
+	rt_cache_stat[smp_processor_id()].hash_search += chain_length;
+
+	/* A chain longer than gc_elasticity gives up its least useful
+	   entry, so a flood of new flows into one chain costs that chain
+	   its cold entries rather than the whole cache a GC pass. */
+	if (cand && chain_length > ip_rt_gc_elasticity) {
+		*candp = cand->u.rt_next;
+		rt_free(cand);
+		rt_cache_stat[smp_processor_id()].gc_evict++;
+	}
+
 	/* Try to bind route to arp only if it is output
 	   route or unicast forwarding path.
 	 */
 	if (rt->rt_type == RTN_UNICAST || rt->key.iif == 0) {
 		int err = arp_bind_neighbour(&rt->u.dst);
 		if (err) {
-			write_unlock_bh(&rt_hash_table[hash].lock);
+			rt_write_unlock_bucket(b);
 
 			if (err != -ENOBUFS) {
 				rt_drop(rt);
@@ -678,19 +860,20 @@ restart:
 		}
 	}
 
-	rt->u.rt_next = rt_hash_table[hash].chain;
+	rt->u.rt_next = b->chain;
 #if RT_CACHE_DEBUG >= 2
 	if (rt->u.rt_next) {
 		struct rtable *trt;
-		printk(KERN_DEBUG "rt_cache @%02x: %u.%u.%u.%u", hash,
+		printk(KERN_DEBUG "rt_cache @%02x: %u.%u.%u.%u",
+		       hash & rt_hash_mask,
 		       NIPQUAD(rt->rt_dst));
 		for (trt = rt->u.rt_next; trt; trt = trt->u.rt_next)
 			printk(" . %u.%u.%u.%u", NIPQUAD(trt->rt_dst));
 		printk("\n");
 	}
 #endif
-	rt_hash_table[hash].chain = rt;
-	write_unlock_bh(&rt_hash_table[hash].lock);
+	b->chain = rt;
+	rt_write_unlock_bucket(b);
 	*rp = rt;
 	return 0;
 }
@@ -732,7 +915,7 @@ static void ip_select_fb_ident(struct iphdr *iph)
 	spin_unlock_bh(&ip_fb_id_lock);
 }
 
-void __ip_select_ident(struct iphdr *iph, struct dst_entry *dst)
+void __ip_select_ident(struct iphdr *iph, struct dst_entry *dst, int more)
 {
 	struct rtable *rt = (struct rtable *) dst;
 
@@ -744,7 +927,7 @@ void __ip_select_ident(struct iphdr *iph, struct dst_entry *dst)
 		   so that we need not to grab a lock to dereference it.
 		 */
 		if (rt->peer) {
-			iph->id = htons(inet_getid(rt->peer));
+			iph->id = htons(inet_getid(rt->peer, more));
 			return;
 		}
 	} else
@@ -755,18 +938,19 @@ void __ip_select_ident(struct iphdr *iph, struct dst_entry *dst)
 
 static void rt_del(unsigned hash, struct rtable *rt)
 {
+	struct rt_hash_bucket *b;
 	struct rtable **rthp;
 
-	write_lock_bh(&rt_hash_table[hash].lock);
+	b = rt_write_lock_bucket(hash);
 	ip_rt_put(rt);
-	for (rthp = &rt_hash_table[hash].chain; *rthp;
+	for (rthp = &b->chain; *rthp;
 	     rthp = &(*rthp)->u.rt_next)
 		if (*rthp == rt) {
 			*rthp = rt->u.rt_next;
 			rt_free(rt);
 			break;
 		}
-	write_unlock_bh(&rt_hash_table[hash].lock);
+	rt_write_unlock_bucket(b);
 }
 
 void ip_rt_redirect(u32 old_gw, u32 daddr, u32 new_gw,
@@ -774,6 +958,7 @@ void ip_rt_redirect(u32 old_gw, u32 daddr, u32 new_gw,
 {
 	int i, k;
 	struct in_device *in_dev = in_dev_get(dev);
+	struct rt_hash_bucket *b;
 	struct rtable *rth, **rthp;
 	u32  skeys[2] = { saddr, 0 };
 	int  ikeys[2] = { dev->ifindex, 0 };
@@ -803,9 +988,9 @@ void ip_rt_redirect(u32 old_gw, u32 daddr, u32 new_gw,
 						     skeys[i] ^ (ikeys[k] << 5),
 						     tos);
 
-			rthp=&rt_hash_table[hash].chain;
+			b = rt_read_lock_bucket(hash);
+			rthp = &b->chain;
 
-			read_lock(&rt_hash_table[hash].lock);
 			while ((rth = *rthp) != NULL) {
 				struct rtable *rt;
 
@@ -826,7 +1011,7 @@ void ip_rt_redirect(u32 old_gw, u32 daddr, u32 new_gw,
 					break;
 
 				dst_clone(&rth->u.dst);
-				read_unlock(&rt_hash_table[hash].lock);
+				rt_read_unlock_bucket(b);
 
 				rt = dst_alloc(&ipv4_dst_ops);
 				if (rt == NULL) {
@@ -872,7 +1057,7 @@ void ip_rt_redirect(u32 old_gw, u32 daddr, u32 new_gw,
 					ip_rt_put(rt);
 				goto do_next;
 			}
-			read_unlock(&rt_hash_table[hash].lock);
+			rt_read_unlock_bucket(b);
 		do_next:
 			;
 		}
@@ -1051,9 +1236,10 @@ unsigned short ip_rt_frag_needed(struct iphdr *iph, unsigned short new_mtu)
 
 	for (i = 0; i < 2; i++) {
 		unsigned hash = rt_hash_code(daddr, skeys[i], tos);
+		struct rt_hash_bucket *b;
 
-		read_lock(&rt_hash_table[hash].lock);
-		for (rth = rt_hash_table[hash].chain; rth;
+		b = rt_read_lock_bucket(hash);
+		for (rth = b->chain; rth;
 		     rth = rth->u.rt_next) {
 			if (rth->key.dst == daddr &&
 			    rth->key.src == skeys[i] &&
@@ -1090,7 +1276,7 @@ unsigned short ip_rt_frag_needed(struct iphdr *iph, unsigned short new_mtu)
 				}
 			}
 		}
-		read_unlock(&rt_hash_table[hash].lock);
+		rt_read_unlock_bucket(b);
 	}
 	return est_mtu ? : new_mtu;
 }
@@ -1637,6 +1823,7 @@ martian_source:
 int ip_route_input(struct sk_buff *skb, u32 daddr, u32 saddr,
 		   u8 tos, struct net_device *dev)
 {
+	struct rt_hash_bucket *b;
 	struct rtable * rth;
 	unsigned	hash;
 	int iif = dev->ifindex;
@@ -1644,8 +1831,8 @@ int ip_route_input(struct sk_buff *skb, u32 daddr, u32 saddr,
 	tos &= IPTOS_RT_MASK;
 	hash = rt_hash_code(daddr, saddr ^ (iif << 5), tos);
 
-	read_lock(&rt_hash_table[hash].lock);
-	for (rth = rt_hash_table[hash].chain; rth; rth = rth->u.rt_next) {
+	b = rt_read_lock_bucket(hash);
+	for (rth = b->chain; rth; rth = rth->u.rt_next) {
 		if (rth->key.dst == daddr &&
 		    rth->key.src == saddr &&
 		    rth->key.iif == iif &&
@@ -1658,12 +1845,12 @@ int ip_route_input(struct sk_buff *skb, u32 daddr, u32 saddr,
 			dst_hold(&rth->u.dst);
 			rth->u.dst.__use++;
 			rt_cache_stat[smp_processor_id()].in_hit++;
-			read_unlock(&rt_hash_table[hash].lock);
+			rt_read_unlock_bucket(b);
 			skb->dst = (struct dst_entry*)rth;
 			return 0;
 		}
 	}
-	read_unlock(&rt_hash_table[hash].lock);
+	rt_read_unlock_bucket(b);
 
 	/* Multicast recognition logic is moved from route cache to here.
 	   The problem was that too many Ethernet cards have broken/missing
@@ -1998,13 +2185,14 @@ e_nobufs:
 
 int ip_route_output_key(struct rtable **rp, const struct rt_key *key)
 {
+	struct rt_hash_bucket *b;
 	unsigned hash;
 	struct rtable *rth;
 
 	hash = rt_hash_code(key->dst, key->src ^ (key->oif << 5), key->tos);
 
-	read_lock_bh(&rt_hash_table[hash].lock);
-	for (rth = rt_hash_table[hash].chain; rth; rth = rth->u.rt_next) {
+	b = rt_read_lock_bucket(hash);
+	for (rth = b->chain; rth; rth = rth->u.rt_next) {
 		if (rth->key.dst == key->dst &&
 		    rth->key.src == key->src &&
 		    rth->key.iif == 0 &&
@@ -2018,12 +2206,12 @@ int ip_route_output_key(struct rtable **rp, const struct rt_key *key)
 			dst_hold(&rth->u.dst);
 			rth->u.dst.__use++;
 			rt_cache_stat[smp_processor_id()].out_hit++;
-			read_unlock_bh(&rt_hash_table[hash].lock);
+			rt_read_unlock_bucket(b);
 			*rp = rth;
 			return 0;
 		}
 	}
-	read_unlock_bh(&rt_hash_table[hash].lock);
+	rt_read_unlock_bucket(b);
 
 	return ip_route_output_slow(rp, key);
 }	
@@ -2199,6 +2387,7 @@ out:	return err;
 
 int ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb)
 {
+	struct rt_hash_bucket *b;
 	struct rtable *rt;
 	int h, s_h;
 	int idx, s_idx;
@@ -2209,8 +2398,8 @@ int ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb)
 		if (h < s_h) continue;
 		if (h > s_h)
 			s_idx = 0;
-		read_lock_bh(&rt_hash_table[h].lock);
-		for (rt = rt_hash_table[h].chain, idx = 0; rt;
+		b = rt_read_lock_bucket(h);
+		for (rt = b->chain, idx = 0; rt;
 		     rt = rt->u.rt_next, idx++) {
 			if (idx < s_idx)
 				continue;
@@ -2219,12 +2408,12 @@ int ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb)
 					 cb->nlh->nlmsg_seq,
 					 RTM_NEWROUTE, 1) <= 0) {
 				dst_release(xchg(&skb->dst, NULL));
-				read_unlock_bh(&rt_hash_table[h].lock);
+				rt_read_unlock_bucket(b);
 				goto done;
 			}
 			dst_release(xchg(&skb->dst, NULL));
 		}
-		read_unlock_bh(&rt_hash_table[h].lock);
+		rt_read_unlock_bucket(b);
 	}
 
 done:
@@ -2268,6 +2457,78 @@ static int ipv4_sysctl_rtcache_flush_strategy(ctl_table *table, int *name,
 	return 0;
 }
 
+/* Move every entry into a new table of size buckets.  Lookups and
+   updates wait on BR_RT_HASH_LOCK meanwhile; nothing is dropped. */
+static int rt_hash_resize(unsigned int size)
+{
+	struct rt_hash_bucket *table, *old, *b;
+	struct rtable *rth, *next;
+	unsigned int old_mask;
+	int order, old_order, log, i;
+
+	for (log = 0; (2U << log) <= size; log++)
+		/* NOTHING */;
+	size = 1U << log;
+
+	for (order = 0;
+	     (PAGE_SIZE << order) < size * sizeof(struct rt_hash_bucket);
+	     order++)
+		/* NOTHING */;
+	table = (struct rt_hash_bucket *)__get_free_pages(GFP_KERNEL, order);
+	if (table == NULL)
+		return -ENOMEM;
+	for (i = 0; i < size; i++) {
+		table[i].lock = RW_LOCK_UNLOCKED;
+		table[i].chain = NULL;
+	}
+
+	br_write_lock_bh(BR_RT_HASH_LOCK);
+	old = rt_hash_table;
+	old_mask = rt_hash_mask;
+	old_order = rt_hash_order;
+	rt_hash_table = table;
+	rt_hash_mask = size - 1;
+	rt_hash_log = log;
+	rt_hash_order = order;
+
+	for (i = 0; i <= old_mask; i++) {
+		for (rth = old[i].chain; rth; rth = next) {
+			next = rth->u.rt_next;
+			b = &table[rt_hash_entry(rth) & rt_hash_mask];
+			rth->u.rt_next = b->chain;
+			b->chain = rth;
+		}
+	}
+
+	ipv4_dst_ops.gc_thresh = size;
+	ip_rt_max_size = size * 16;
+	br_write_unlock_bh(BR_RT_HASH_LOCK);
+
+	free_pages((unsigned long)old, old_order);
+	printk(KERN_INFO "IP: routing cache hash table of %u buckets, was %u\n",
+	       size, old_mask + 1);
+	return 0;
+}
+
+static int rt_hash_buckets;
+static int rt_hash_buckets_min = 16;
+static int rt_hash_buckets_max = 1 << 20;
+
+/* Writing buckets rebuilds the table at that size (rounded down to a
+   power of two); gc_thresh and max_size are reset to suit it. */
+static int ipv4_sysctl_rt_buckets(ctl_table *ctl, int write,
+				  struct file *filp, void *buffer,
+				  size_t *lenp)
+{
+	int ret;
+
+	rt_hash_buckets = rt_hash_mask + 1;
+	ret = proc_dointvec_minmax(ctl, write, filp, buffer, lenp);
+	if (ret == 0 && write && rt_hash_buckets != rt_hash_mask + 1)
+		ret = rt_hash_resize(rt_hash_buckets);
+	return ret;
+}
+
 ctl_table ipv4_route_table[] = {
         {
 		ctl_name:	NET_IPV4_ROUTE_FLUSH,
@@ -2411,6 +2672,25 @@ ctl_table ipv4_route_table[] = {
 		maxlen:		sizeof(int),
 		mode:		0644,
 		proc_handler:	&proc_dointvec,
+	},
+	{
+		ctl_name:	NET_IPV4_ROUTE_SECRET_INTERVAL,
+		procname:	"secret_interval",
+		data:		&ip_rt_secret_interval,
+		maxlen:		sizeof(int),
+		mode:		0644,
+		proc_handler:	&proc_dointvec_jiffies,
+		strategy:	&sysctl_jiffies,
+	},
+	{
+		ctl_name:	NET_IPV4_ROUTE_BUCKETS,
+		procname:	"buckets",
+		data:		&rt_hash_buckets,
+		maxlen:		sizeof(int),
+		mode:		0644,
+		proc_handler:	&ipv4_sysctl_rt_buckets,
+		extra1:		&rt_hash_buckets_min,
+		extra2:		&rt_hash_buckets_max,
 	},
 	 { 0 }
 };
@@ -2491,6 +2771,7 @@ void __init ip_rt_init(void)
 		rt_hash_table = (struct rt_hash_bucket *)
 			__get_free_pages(GFP_ATOMIC, order);
 	} while (rt_hash_table == NULL && --order > 0);
+	rt_hash_order = order;
 
 	if (!rt_hash_table)
 		panic("Failed to allocate IP route cache hash table\n");
@@ -2503,6 +2784,7 @@ void __init ip_rt_init(void)
 		/* NOTHING */;
 
 	rt_hash_mask--;
+	get_random_bytes(&rt_hash_rnd, sizeof(rt_hash_rnd));
 	for (i = 0; i <= rt_hash_mask; i++) {
 		rt_hash_table[i].lock = RW_LOCK_UNLOCKED;
 		rt_hash_table[i].chain = NULL;
@@ -2524,8 +2806,14 @@ void __init ip_rt_init(void)
 					ip_rt_gc_interval;
 	add_timer(&rt_periodic_timer);
 
+	rt_secret_timer.function = rt_secret_rebuild;
+	rt_secret_timer.expires = jiffies + net_random() % ip_rt_secret_interval +
+					ip_rt_secret_interval;
+	add_timer(&rt_secret_timer);
+
 	proc_net_create ("rt_cache", 0, rt_cache_get_info);
 	proc_net_create ("rt_cache_stat", 0, rt_cache_stat_get_info);
+	proc_net_create ("rt_hash", 0, rt_hash_get_info);
 #ifdef CONFIG_NET_CLS_ROUTE
 	create_proc_read_entry("net/rt_acct", 0, 0, ip_rt_acct_read, NULL);
 #endif
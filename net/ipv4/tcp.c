@@ -252,6 +252,8 @@
 #include <linux/init.h>
 #include <linux/smp_lock.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
 
 #include <net/icmp.h>
 #include <net/tcp.h>
@@ -839,7 +841,7 @@ ssize_t do_tcp_sendpages(struct sock *sk, struct page **pages, int poffset, size
 
 	clear_bit(SOCK_ASYNC_NOSPACE, &sk->socket->flags);
 
-	mss_now = tcp_current_mss(sk);
+	mss_now = tcp_current_mss(sk, 1);
 	copied = 0;
 
 	err = -EPIPE;
@@ -915,7 +917,7 @@ wait_for_memory:
 		if ((err = wait_for_tcp_memory(sk, &timeo)) != 0)
 			goto do_error;
 
-		mss_now = tcp_current_mss(sk);
+		mss_now = tcp_current_mss(sk, 1);
 	}
 
 out:
@@ -1032,7 +1034,7 @@ int tcp_sendmsg(struct sock *sk, struct msghdr *msg, int size)
 	/* This should be in poll */
 	clear_bit(SOCK_ASYNC_NOSPACE, &sk->socket->flags);
 
-	mss_now = tcp_current_mss(sk);
+	mss_now = tcp_current_mss(sk, 1);
 
 	/* Ok commence sending. */
 	iovlen = msg->msg_iovlen;
@@ -1180,7 +1182,7 @@ wait_for_memory:
 			if ((err = wait_for_tcp_memory(sk, &timeo)) != 0)
 				goto do_error;
 
-			mss_now = tcp_current_mss(sk);
+			mss_now = tcp_current_mss(sk, 1);
 		}
 	}
 
@@ -1456,6 +1458,70 @@ int tcp_read_sock(struct sock *sk, read_descriptor_t *desc,
 	return copied;
 }
 
+/*
+ *	Receive page flipping (TCP_ZEROCOPY_RECV).  A fragment that fills a
+ *	whole page can be handed to a page-aligned spot of a private
+ *	anonymous mapping by mapping the page there instead of copying it.
+ *	Only pages nobody else can see qualify: the skb must not be cloned
+ *	and the page must be a plain one the driver allocated for it.
+ *	Returns how many bytes from offset on were flipped and advances
+ *	the iovec like memcpy_toiovec does; the caller copies the rest.
+ */
+static int tcp_flip_pages(struct sk_buff *skb, int offset,
+			  struct iovec *iov, int len)
+{
+	struct mm_struct *mm = current->mm;
+	int start = skb_headlen(skb);
+	int i, flipped = 0;
+
+	if (offset < start || skb_cloned(skb) || !mm)
+		return 0;
+
+	down_read(&mm->mmap_sem);
+	for (i = 0; i < skb_shinfo(skb)->nr_frags && len >= PAGE_SIZE; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		struct page *page = frag->page;
+		struct vm_area_struct *vma;
+		unsigned long addr;
+		int end = start + frag->size;
+
+		if (offset >= end) {
+			start = end;
+			continue;
+		}
+		if (offset != start || frag->page_offset || frag->size != PAGE_SIZE)
+			break;
+		if (page_count(page) != 1 || page->mapping ||
+		    PageReserved(page) || PageLRU(page))
+			break;
+
+		while (!iov->iov_len)
+			iov++;
+		addr = (unsigned long) iov->iov_base;
+		if ((addr & ~PAGE_MASK) || iov->iov_len < PAGE_SIZE)
+			break;
+		vma = find_vma(mm, addr);
+		if (!vma || vma->vm_start > addr || vma->vm_end < addr + PAGE_SIZE ||
+		    vma->vm_file ||
+		    (vma->vm_flags & (VM_WRITE|VM_SHARED|VM_IO|VM_RESERVED|VM_HUGETLB)) != VM_WRITE)
+			break;
+
+		page_cache_get(page);
+		if (install_anon_page(vma, addr, page)) {
+			put_page(page);
+			break;
+		}
+		iov->iov_base += PAGE_SIZE;
+		iov->iov_len -= PAGE_SIZE;
+		offset += PAGE_SIZE;
+		flipped += PAGE_SIZE;
+		len -= PAGE_SIZE;
+		start = end;
+	}
+	up_read(&mm->mmap_sem);
+	return flipped;
+}
+
 /*
  *	This routine copies from a sock struct into the user buffer. 
  *
@@ -1589,7 +1655,11 @@ int tcp_recvmsg(struct sock *sk, struct msghdr *msg,
 
 		if (tp->ucopy.task == user_recv) {
 			/* Install new reader */
-			if (user_recv == NULL && !(flags&(MSG_TRUNC|MSG_PEEK))) {
+			/* Prequeue copies behind our back, so it is
+			 * bypassed when pages could be flipped.
+			 */
+			if (user_recv == NULL && !(flags&(MSG_TRUNC|MSG_PEEK)) &&
+			    !tp->zc_recv) {
 				user_recv = current;
 				tp->ucopy.task = user_recv;
 				tp->ucopy.iov = msg->msg_iov;
@@ -1694,13 +1764,22 @@ do_prequeue:
 		}
 
 		if (!(flags&MSG_TRUNC)) {
-			err = skb_copy_datagram_iovec(skb, offset, msg->msg_iov, used);
+			int flipped = 0;
+
+			if (tp->zc_recv && !(flags&MSG_PEEK) && used >= PAGE_SIZE)
+				flipped = tcp_flip_pages(skb, offset, msg->msg_iov, used);
+			err = 0;
+			if (used > flipped)
+				err = skb_copy_datagram_iovec(skb, offset + flipped,
+							      msg->msg_iov, used - flipped);
 			if (err) {
 				/* Exception. Bailout! */
 				if (!copied)
 					copied = -EFAULT;
 				break;
 			}
+			tp->zc_flipped += flipped;
+			tp->zc_copied += used - flipped;
 		}
 
 		*seq += used;
@@ -2391,6 +2470,10 @@ int tcp_setsockopt(struct sock *sk, int level, int optname, char *optval,
 		}
 		break;
 
+	case TCP_ZEROCOPY_RECV:
+		tp->zc_recv = val ? 1 : 0;
+		break;
+
 	default:
 		err = -ENOPROTOOPT;
 		break;
@@ -2515,6 +2598,25 @@ int tcp_getsockopt(struct sock *sk, int level, int optname, char *optval,
 	case TCP_QUICKACK:
 		val = !tp->ack.pingpong;
 		break;
+	case TCP_ZEROCOPY_RECV:
+		val = tp->zc_recv;
+		break;
+	case TCP_ZEROCOPY_INFO:
+	{
+		struct tcp_zerocopy_info info;
+
+		if(get_user(len,optlen))
+			return -EFAULT;
+		info.tcpzi_flipped = tp->zc_flipped;
+		info.tcpzi_copied = tp->zc_copied;
+
+		len = min_t(unsigned int, len, sizeof(info));
+		if(put_user(len, optlen))
+			return -EFAULT;
+		if(copy_to_user(optval, &info,len))
+			return -EFAULT;
+		return 0;
+	}
 	default:
 		return -ENOPROTOOPT;
 	};
@@ -691,6 +691,7 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		newtp->snd_sml = req->snt_isn + 1;
 
 		tcp_prequeue_init(newtp);
+		newtp->zc_flipped = newtp->zc_copied = 0;
 
 		tcp_init_wl(newtp, req->snt_isn, req->rcv_isn);
 
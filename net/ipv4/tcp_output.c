@@ -51,8 +51,10 @@ void update_send_head(struct sock *sk, struct tcp_opt *tp, struct sk_buff *skb)
 	if (tp->send_head == (struct sk_buff *) &sk->write_queue)
 		tp->send_head = NULL;
 	tp->snd_nxt = TCP_SKB_CB(skb)->end_seq;
-	if (tp->packets_out++ == 0)
+	if (tp->packets_out == 0)
 		tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
+	tcp_set_skb_tso_factor(skb, tp->mss_cache);
+	tp->packets_out += tcp_skb_pcount(skb);
 }
 
 /* SND.NXT, if window was not shrunk.
@@ -223,6 +225,18 @@ int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb)
 			tcp_header_size += (TCPOLEN_SACK_BASE_ALIGNED +
 					    (tp->eff_sacks * TCPOLEN_SACK_PERBLOCK));
 		}
+		/* Segments longer than the mss only reach us on a TSO
+		 * route; tell the device where to cut them.
+		 */
+		if (skb->len > tp->mss_cache) {
+			skb_shinfo(skb)->tso_size = tp->mss_cache;
+			skb_shinfo(skb)->tso_segs =
+				(skb->len + tp->mss_cache - 1) / tp->mss_cache;
+		} else {
+			skb_shinfo(skb)->tso_size = 0;
+			skb_shinfo(skb)->tso_segs = 0;
+		}
+
 		th = (struct tcphdr *) skb_push(skb, tcp_header_size);
 		skb->h.th = th;
 		skb_set_owner_w(skb, sk);
@@ -316,9 +330,11 @@ void tcp_send_skb(struct sock *sk, struct sk_buff *skb, int force_queue, unsigne
 		TCP_SKB_CB(skb)->when = tcp_time_stamp;
 		if (tcp_transmit_skb(sk, skb_clone(skb, sk->allocation)) == 0) {
 			tp->snd_nxt = TCP_SKB_CB(skb)->end_seq;
-			tcp_minshall_update(tp, cur_mss, skb);
-			if (tp->packets_out++ == 0)
+			tcp_minshall_update(tp, min_t(unsigned int, cur_mss, tp->mss_cache), skb);
+			if (tp->packets_out == 0)
 				tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
+			tcp_set_skb_tso_factor(skb, tp->mss_cache);
+			tp->packets_out += tcp_skb_pcount(skb);
 			return;
 		}
 	}
@@ -336,13 +352,14 @@ void tcp_push_one(struct sock *sk, unsigned cur_mss)
 	struct sk_buff *skb = tp->send_head;
 
 	if (tcp_snd_test(tp, skb, cur_mss, 1)) {
+		/* The mss may have shrunk since the skb was built. */
+		if (skb->len > cur_mss && tcp_fragment(sk, skb, cur_mss))
+			return;
+
 		/* Send it out now. */
 		TCP_SKB_CB(skb)->when = tcp_time_stamp;
 		if (tcp_transmit_skb(sk, skb_clone(skb, sk->allocation)) == 0) {
-			tp->send_head = NULL;
-			tp->snd_nxt = TCP_SKB_CB(skb)->end_seq;
-			if (tp->packets_out++ == 0)
-				tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
+			update_send_head(sk, tp, skb);
 			return;
 		}
 	}
@@ -417,11 +434,12 @@ static void skb_split(struct sk_buff *skb, struct sk_buff *skb1, u32 len)
  * packet to the list.  This won't be called frequently, I hope. 
  * Remember, these are still headerless SKBs at this point.
  */
-static int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
+int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
 {
 	struct tcp_opt *tp = &sk->tp_pinfo.af_tcp;
 	struct sk_buff *buff;
 	int nsize = skb->len - len;
+	int old_factor = 0;
 	u16 flags;
 
 	if (skb_cloned(skb) &&
@@ -435,6 +453,10 @@ static int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
 		return -ENOMEM; /* We'll just try again later. */
 	tcp_charge_skb(sk, buff);
 
+	/* The segments of a frame already sent are counted in flight. */
+	if (before(TCP_SKB_CB(skb)->seq, tp->snd_nxt))
+		old_factor = tcp_skb_pcount(skb);
+
 	/* Correct the sequence numbers. */
 	TCP_SKB_CB(buff)->seq = TCP_SKB_CB(skb)->seq + len;
 	TCP_SKB_CB(buff)->end_seq = TCP_SKB_CB(skb)->end_seq;
@@ -445,10 +467,6 @@ static int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
 	TCP_SKB_CB(skb)->flags = flags & ~(TCPCB_FLAG_FIN|TCPCB_FLAG_PSH);
 	TCP_SKB_CB(buff)->flags = flags;
 	TCP_SKB_CB(buff)->sacked = TCP_SKB_CB(skb)->sacked&(TCPCB_LOST|TCPCB_EVER_RETRANS|TCPCB_AT_TAIL);
-	if (TCP_SKB_CB(buff)->sacked&TCPCB_LOST) {
-		tp->lost_out++;
-		tp->left_out++;
-	}
 	TCP_SKB_CB(skb)->sacked &= ~TCPCB_AT_TAIL;
 
 	if (!skb_shinfo(skb)->nr_frags && skb->ip_summed != CHECKSUM_HW) {
@@ -471,6 +489,19 @@ static int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
 	 */
 	TCP_SKB_CB(buff)->when = TCP_SKB_CB(skb)->when;
 
+	/* Rounding up each half can make one segment more of them. */
+	tcp_set_skb_tso_factor(skb, tp->mss_cache);
+	tcp_set_skb_tso_factor(buff, tp->mss_cache);
+	if (old_factor) {
+		int diff = old_factor - tcp_skb_pcount(skb) - tcp_skb_pcount(buff);
+
+		tp->packets_out -= diff;
+		if (TCP_SKB_CB(skb)->sacked&TCPCB_LOST) {
+			tp->lost_out -= diff;
+			tp->left_out -= diff;
+		}
+	}
+
 	/* Link BUFF into the send queue. */
 	__skb_append(skb, buff);
 
@@ -493,6 +524,13 @@ static int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
    taking into account current pmtu, but never exceeds
    tp->mss_clamp.
 
+   tp->mss_cache_tso is the size of the super-segments handed to
+   a TSO capable device: a multiple of mss_cache, bounded by the
+   64K an IP datagram can carry, by half of the send window and
+   by a share of the congestion window.  It equals mss_cache when
+   the route cannot do TSO.  Because the windows move all the
+   time, tcp_current_mss() redoes it with tcp_sync_tso_mss().
+
    NOTE1. rfc1122 clearly states that advertised MSS
    DOES NOT include either tcp or ip options.
 
@@ -532,9 +570,41 @@ int tcp_sync_mss(struct sock *sk, u32 pmtu)
 	/* And store cached results */
 	tp->pmtu_cookie = pmtu;
 	tp->mss_cache = mss_now;
+	tp->mss_cache_tso = mss_now;
+
+	if (sk->route_caps & NETIF_F_TSO)
+		tcp_sync_tso_mss(sk);
 	return mss_now;
 }
 
+/* tcp_snd_test() charges a TSO frame against the congestion window
+ * by all of its segments.  A frame bigger than a fraction of cwnd
+ * would wait until nearly everything in flight is acked, and one
+ * bigger than half the send window could not leave at all, so size
+ * them to the windows as they are now.
+ */
+unsigned int tcp_sync_tso_mss(struct sock *sk)
+{
+	struct tcp_opt *tp = &sk->tp_pinfo.af_tcp;
+	unsigned int mss_now = tp->mss_cache;
+	unsigned int large_mss, segs;
+	u32 wnd = tp->snd_wnd ? tp->snd_wnd : tp->max_window;
+
+	large_mss = 65535 - tp->af_specific->net_header_len -
+		    tp->ext_header_len - tp->tcp_header_len;
+	if (wnd && large_mss > (wnd>>1))
+		large_mss = wnd>>1;
+	segs = tp->snd_cwnd / TCP_TSO_WIN_DIVISOR;
+	if (segs < large_mss / mss_now)
+		large_mss = segs * mss_now;
+	large_mss -= large_mss % mss_now;
+	if (large_mss < mss_now)
+		large_mss = mss_now;
+
+	tp->mss_cache_tso = large_mss;
+	return large_mss;
+}
+
 
 /* This routine writes packets to the network.  It advances the
  * send_head.  This happens as incoming acks open up the remote
@@ -561,7 +631,7 @@ int tcp_write_xmit(struct sock *sk, int nonagle)
 		 * We also handle things correctly when the user adds some
 		 * IP options mid-stream.  Silly to do, but cover it.
 		 */
-		mss_now = tcp_current_mss(sk); 
+		mss_now = tcp_current_mss(sk, 1); 
 
 		while((skb = tp->send_head) &&
 		      tcp_snd_test(tp, skb, mss_now, tcp_skb_is_last(sk, skb) ? nonagle : 1)) {
@@ -575,7 +645,7 @@ int tcp_write_xmit(struct sock *sk, int nonagle)
 				break;
 			/* Advance the send_head.  This one is sent out. */
 			update_send_head(sk, tp, skb);
-			tcp_minshall_update(tp, mss_now, skb);
+			tcp_minshall_update(tp, min_t(unsigned int, mss_now, tp->mss_cache), skb);
 			sent_pkts = 1;
 		}
 
@@ -738,10 +808,10 @@ static void tcp_retrans_try_collapse(struct sock *sk, struct sk_buff *skb, int m
 		 */
 		TCP_SKB_CB(skb)->sacked |= TCP_SKB_CB(next_skb)->sacked&(TCPCB_EVER_RETRANS|TCPCB_AT_TAIL);
 		if (TCP_SKB_CB(next_skb)->sacked&TCPCB_SACKED_RETRANS)
-			tp->retrans_out--;
+			tp->retrans_out -= tcp_skb_pcount(next_skb);
 		if (TCP_SKB_CB(next_skb)->sacked&TCPCB_LOST) {
-			tp->lost_out--;
-			tp->left_out--;
+			tp->lost_out -= tcp_skb_pcount(next_skb);
+			tp->left_out -= tcp_skb_pcount(next_skb);
 		}
 		/* Reno case is special. Sigh... */
 		if (!tp->sack_ok && tp->sacked_out) {
@@ -754,8 +824,8 @@ static void tcp_retrans_try_collapse(struct sock *sk, struct sk_buff *skb, int m
 		 */
 		if (tp->fackets_out)
 			tp->fackets_out--;
+		tp->packets_out -= tcp_skb_pcount(next_skb);
 		tcp_free_skb(sk, next_skb);
-		tp->packets_out--;
 	}
 }
 
@@ -767,7 +837,7 @@ void tcp_simple_retransmit(struct sock *sk)
 {
 	struct tcp_opt *tp = &(sk->tp_pinfo.af_tcp);
 	struct sk_buff *skb;
-	unsigned int mss = tcp_current_mss(sk);
+	unsigned int mss = tcp_current_mss(sk, 0);
 	int lost = 0;
 
 	for_retrans_queue(skb, sk, tp) {
@@ -775,11 +845,11 @@ void tcp_simple_retransmit(struct sock *sk)
 		    !(TCP_SKB_CB(skb)->sacked&TCPCB_SACKED_ACKED)) {
 			if (TCP_SKB_CB(skb)->sacked&TCPCB_SACKED_RETRANS) {
 				TCP_SKB_CB(skb)->sacked &= ~TCPCB_SACKED_RETRANS;
-				tp->retrans_out--;
+				tp->retrans_out -= tcp_skb_pcount(skb);
 			}
 			if (!(TCP_SKB_CB(skb)->sacked&TCPCB_LOST)) {
 				TCP_SKB_CB(skb)->sacked |= TCPCB_LOST;
-				tp->lost_out++;
+				tp->lost_out += tcp_skb_pcount(skb);
 				lost = 1;
 			}
 		}
@@ -812,7 +882,7 @@ void tcp_simple_retransmit(struct sock *sk)
 int tcp_retransmit_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_opt *tp = &(sk->tp_pinfo.af_tcp);
-	unsigned int cur_mss = tcp_current_mss(sk);
+	unsigned int cur_mss = tcp_current_mss(sk, 0);
 	int err;
 
 	/* Do not sent more than we queued. 1/4 is reserved for possible
@@ -830,12 +900,10 @@ int tcp_retransmit_skb(struct sock *sk, struct sk_buff *skb)
 	    && TCP_SKB_CB(skb)->seq != tp->snd_una)
 		return -EAGAIN;
 
+	/* tcp_fragment() accounts for the new SKB. */
 	if(skb->len > cur_mss) {
 		if(tcp_fragment(sk, skb, cur_mss))
 			return -ENOMEM; /* We'll try again later. */
-
-		/* New SKB created, account for it. */
-		tp->packets_out++;
 	}
 
 	/* Collapse two adjacent packets if worthwhile and we can. */
@@ -884,7 +952,7 @@ int tcp_retransmit_skb(struct sock *sk, struct sk_buff *skb)
 		}
 #endif
 		TCP_SKB_CB(skb)->sacked |= TCPCB_RETRANS;
-		tp->retrans_out++;
+		tp->retrans_out += tcp_skb_pcount(skb);
 
 		/* Save stamp of the first retransmit. */
 		if (!tp->retrans_stamp)
@@ -935,7 +1003,8 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 						tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
 				}
 
-				if (--packet_cnt <= 0)
+				packet_cnt -= tcp_skb_pcount(skb);
+				if (packet_cnt <= 0)
 					break;
 			}
 		}
@@ -964,7 +1033,8 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 	packet_cnt = 0;
 
 	for_retrans_queue(skb, sk, tp) {
-		if(++packet_cnt > tp->fackets_out)
+		packet_cnt += tcp_skb_pcount(skb);
+		if(packet_cnt > tp->fackets_out)
 			break;
 
 		if (tcp_packets_in_flight(tp) >= tp->snd_cwnd)
@@ -998,7 +1068,7 @@ void tcp_send_fin(struct sock *sk)
 	 * unsent frames.  But be careful about outgoing SACKS
 	 * and IP options.
 	 */
-	mss_now = tcp_current_mss(sk); 
+	mss_now = tcp_current_mss(sk, 1); 
 
 	if(tp->send_head != NULL) {
 		TCP_SKB_CB(skb)->flags |= TCPCB_FLAG_FIN;
@@ -1237,7 +1307,8 @@ int tcp_connect(struct sock *sk)
 	tp->retrans_stamp = TCP_SKB_CB(buff)->when;
 	__skb_queue_tail(&sk->write_queue, buff);
 	tcp_charge_skb(sk, buff);
-	tp->packets_out++;
+	tcp_set_skb_tso_factor(buff, tp->mss_cache);
+	tp->packets_out += tcp_skb_pcount(buff);
 	tcp_transmit_skb(sk, skb_clone(buff, GFP_KERNEL));
 	TCP_INC_STATS(TcpActiveOpens);
 
@@ -1379,7 +1450,7 @@ int tcp_write_wakeup(struct sock *sk)
 		if ((skb = tp->send_head) != NULL &&
 		    before(TCP_SKB_CB(skb)->seq, tp->snd_una+tp->snd_wnd)) {
 			int err;
-			int mss = tcp_current_mss(sk);
+			int mss = tcp_current_mss(sk, 0);
 			int seg_size = tp->snd_una+tp->snd_wnd-TCP_SKB_CB(skb)->seq;
 
 			if (before(tp->pushed_seq, TCP_SKB_CB(skb)->end_seq))
@@ -1448,3 +1519,84 @@ void tcp_send_probe0(struct sock *sk)
 				      min(tp->rto << tp->backoff, TCP_RESOURCE_PROBE_INTERVAL));
 	}
 }
+
+/* Cut a TSO frame into tso_size segments for a device that cannot do
+ * it itself.  Called from dev_queue_xmit() with skb->data at the link
+ * layer header.  Every segment gets its own copy of the headers, with
+ * the IP length, ID and checksum, and the TCP sequence number, flags
+ * and checksum fixed up; the payload is checksummed while it is copied.
+ *
+ * Returns the segments chained through ->next, or NULL if we ran out
+ * of memory.  The original skb is left to the caller.
+ */
+struct sk_buff *tcp_tso_segment(struct sk_buff *skb)
+{
+	struct tcphdr *th = skb->h.th;
+	unsigned int mss = skb_shinfo(skb)->tso_size;
+	unsigned int thlen = th->doff << 2;
+	unsigned int hlen = (skb->h.raw - skb->data) + thlen;
+	unsigned int offset = hlen;
+	u32 seq = ntohl(th->seq);
+	u16 id = ntohs(skb->nh.iph->id);
+	struct sk_buff *segs = NULL, **tail = &segs;
+
+	while (offset < skb->len) {
+		unsigned int len = min(mss, skb->len - offset);
+		struct sk_buff *nskb;
+		struct iphdr *iph;
+		unsigned int csum;
+
+		nskb = alloc_skb(skb_headroom(skb) + hlen + len, GFP_ATOMIC);
+		if (nskb == NULL)
+			goto nomem;
+		skb_reserve(nskb, skb_headroom(skb));
+		skb_put(nskb, hlen + len);
+
+		nskb->dev = skb->dev;
+		nskb->priority = skb->priority;
+		nskb->protocol = skb->protocol;
+		nskb->dst = dst_clone(skb->dst);
+		nskb->mac.raw = nskb->data;
+		nskb->nh.raw = nskb->data + (skb->nh.raw - skb->data);
+		nskb->h.raw = nskb->data + (skb->h.raw - skb->data);
+#ifdef CONFIG_NETFILTER
+		nskb->nfmark = skb->nfmark;
+#endif
+
+		if (skb_copy_bits(skb, 0, nskb->data, hlen))
+			BUG();
+		csum = skb_copy_and_csum_bits(skb, offset, nskb->data + hlen,
+					      len, 0);
+
+		iph = nskb->nh.iph;
+		iph->tot_len = htons(nskb->len - (nskb->nh.raw - nskb->data));
+		iph->id = htons(id++);
+		ip_send_check(iph);
+
+		th = nskb->h.th;
+		th->seq = htonl(seq);
+		if (offset != hlen)
+			th->cwr = 0;
+		if (offset + len < skb->len)
+			th->fin = th->psh = 0;
+		th->check = 0;
+		th->check = tcp_v4_check(th, thlen + len, iph->saddr, iph->daddr,
+					 csum_partial((char *)th, thlen, csum));
+		nskb->ip_summed = CHECKSUM_NONE;
+
+		*tail = nskb;
+		tail = &nskb->next;
+		seq += len;
+		offset += len;
+	}
+	return segs;
+
+nomem:
+	while (segs != NULL) {
+		struct sk_buff *next = segs->next;
+
+		kfree_skb(segs);
+		segs = next;
+	}
+	return NULL;
+}
@@ -458,6 +458,15 @@ EXPORT_SYMBOL(arp_rcv);
 EXPORT_SYMBOL(arp_tbl);
 EXPORT_SYMBOL(arp_find);
 
+#ifdef CONFIG_IP_FIB_BENCH_MODULE
+#include <net/ip_fib.h>
+/* For the FIB lookup benchmark */
+EXPORT_SYMBOL(fib_hash_init);
+EXPORT_SYMBOL(fib_trie_init);
+EXPORT_SYMBOL(fib_hash_free);
+EXPORT_SYMBOL(free_fib_info);
+#endif
+
 #endif  /* CONFIG_INET */
 
 #ifdef CONFIG_TR
@@ -505,6 +514,7 @@ EXPORT_SYMBOL(dev_load);
 #endif
 EXPORT_SYMBOL(dev_ioctl);
 EXPORT_SYMBOL(dev_queue_xmit);
+EXPORT_SYMBOL(netdev_init_tx_rings);
 #ifdef CONFIG_NET_HW_FLOWCONTROL
 EXPORT_SYMBOL(netdev_dropping);
 EXPORT_SYMBOL(netdev_register_fc);
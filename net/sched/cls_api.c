@@ -457,6 +457,9 @@ int __init tc_filter_init(void)
 #ifdef CONFIG_NET_CLS_FW
 	INIT_TC_FILTER(fw);
 #endif
+#ifdef CONFIG_NET_CLS_IPHASH
+	INIT_TC_FILTER(iphash);
+#endif
 #ifdef CONFIG_NET_CLS_RSVP
 	INIT_TC_FILTER(rsvp);
 #endif
@@ -0,0 +1,438 @@
+/*
+ * net/sched/cls_iphash.c	Classifier mapping an IPv4 address to a class.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ *	Meant for per-subscriber shaping, where every address gets its own
+ *	class: a u32 hash tree needs one node per address and a walk per
+ *	packet, here it is one hash lookup.  The filter handle is the
+ *	address itself (host byte order), the key is the destination
+ *	address unless TCA_IPHASH_KEY says source.  The table doubles as
+ *	filters are added, keeping chains short for tens of thousands of
+ *	addresses.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <asm/bitops.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/socket.h>
+#include <linux/sockios.h>
+#include <linux/in.h>
+#include <linux/errno.h>
+#include <linux/interrupt.h>
+#include <linux/if_ether.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/notifier.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <linux/skbuff.h>
+#include <net/sock.h>
+#include <net/pkt_sched.h>
+
+#define IPHASH_MIN	256
+#define IPHASH_MAX	16384
+
+struct iphash_head
+{
+	struct iphash_filter	**ht;
+	u32			mask;
+	int			count;
+	int			key;	/* TCA_IPHASH_KEY_* */
+};
+
+struct iphash_filter
+{
+	struct iphash_filter	*next;
+	u32			addr;
+	struct tcf_result	res;
+#ifdef CONFIG_NET_CLS_POLICE
+	struct tcf_police	*police;
+#endif
+};
+
+/* Subscriber addresses are mostly consecutive, so the low bits are
+   the interesting ones; fold the high half in for sparse ranges. */
+static __inline__ u32 iphash_hash(struct iphash_head *head, u32 addr)
+{
+	return (addr ^ (addr >> 16)) & head->mask;
+}
+
+static int iphash_classify(struct sk_buff *skb, struct tcf_proto *tp,
+			   struct tcf_result *res)
+{
+	struct iphash_head *head = (struct iphash_head*)tp->root;
+	struct iphash_filter *f;
+	u32 addr;
+
+	if (head == NULL || skb->protocol != htons(ETH_P_IP))
+		return -1;
+
+	if (head->key == TCA_IPHASH_KEY_SRC)
+		addr = ntohl(skb->nh.iph->saddr);
+	else
+		addr = ntohl(skb->nh.iph->daddr);
+
+	for (f=head->ht[iphash_hash(head, addr)]; f; f=f->next) {
+		if (f->addr == addr) {
+			*res = f->res;
+#ifdef CONFIG_NET_CLS_POLICE
+			if (f->police)
+				return tcf_police(skb, f->police);
+#endif
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static unsigned long iphash_get(struct tcf_proto *tp, u32 handle)
+{
+	struct iphash_head *head = (struct iphash_head*)tp->root;
+	struct iphash_filter *f;
+
+	if (head == NULL)
+		return 0;
+
+	for (f=head->ht[iphash_hash(head, handle)]; f; f=f->next) {
+		if (f->addr == handle)
+			return (unsigned long)f;
+	}
+	return 0;
+}
+
+static void iphash_put(struct tcf_proto *tp, unsigned long f)
+{
+}
+
+static int iphash_init(struct tcf_proto *tp)
+{
+	MOD_INC_USE_COUNT;
+	return 0;
+}
+
+static void iphash_destroy(struct tcf_proto *tp)
+{
+	struct iphash_head *head = (struct iphash_head*)xchg(&tp->root, NULL);
+	struct iphash_filter *f;
+	u32 h;
+
+	if (head == NULL) {
+		MOD_DEC_USE_COUNT;
+		return;
+	}
+
+	for (h=0; h<=head->mask; h++) {
+		while ((f=head->ht[h]) != NULL) {
+			unsigned long cl;
+			head->ht[h] = f->next;
+
+			if ((cl = __cls_set_class(&f->res.class, 0)) != 0)
+				tp->q->ops->cl_ops->unbind_tcf(tp->q, cl);
+#ifdef CONFIG_NET_CLS_POLICE
+			tcf_police_release(f->police);
+#endif
+			kfree(f);
+		}
+	}
+	kfree(head->ht);
+	kfree(head);
+	MOD_DEC_USE_COUNT;
+}
+
+static int iphash_delete(struct tcf_proto *tp, unsigned long arg)
+{
+	struct iphash_head *head = (struct iphash_head*)tp->root;
+	struct iphash_filter *f = (struct iphash_filter*)arg;
+	struct iphash_filter **fp;
+
+	if (head == NULL || f == NULL)
+		return -EINVAL;
+
+	for (fp=&head->ht[iphash_hash(head, f->addr)]; *fp; fp = &(*fp)->next) {
+		if (*fp == f) {
+			unsigned long cl;
+
+			tcf_tree_lock(tp);
+			*fp = f->next;
+			head->count--;
+			tcf_tree_unlock(tp);
+
+			if ((cl = cls_set_class(tp, &f->res.class, 0)) != 0)
+				tp->q->ops->cl_ops->unbind_tcf(tp->q, cl);
+#ifdef CONFIG_NET_CLS_POLICE
+			tcf_police_release(f->police);
+#endif
+			kfree(f);
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+static struct iphash_filter **iphash_alloc_table(u32 size)
+{
+	struct iphash_filter **ht;
+
+	ht = kmalloc(size*sizeof(*ht), GFP_KERNEL);
+	if (ht)
+		memset(ht, 0, size*sizeof(*ht));
+	return ht;
+}
+
+/* Double the table once there are two filters per bucket.  Failing to
+   grow is harmless, the chains just get longer. */
+static void iphash_grow(struct tcf_proto *tp, struct iphash_head *head)
+{
+	struct iphash_filter **ht, **old, *f;
+	u32 h, size = head->mask + 1;
+
+	if (head->count < 2*size || size >= IPHASH_MAX)
+		return;
+	if ((ht = iphash_alloc_table(2*size)) == NULL)
+		return;
+
+	tcf_tree_lock(tp);
+	old = head->ht;
+	head->ht = ht;
+	head->mask = 2*size - 1;
+	for (h=0; h<size; h++) {
+		while ((f=old[h]) != NULL) {
+			old[h] = f->next;
+			f->next = ht[iphash_hash(head, f->addr)];
+			ht[iphash_hash(head, f->addr)] = f;
+		}
+	}
+	tcf_tree_unlock(tp);
+	kfree(old);
+}
+
+static int iphash_change(struct tcf_proto *tp, unsigned long base,
+			 u32 handle,
+			 struct rtattr **tca,
+			 unsigned long *arg)
+{
+	struct iphash_head *head = (struct iphash_head*)tp->root;
+	struct iphash_filter *f;
+	struct rtattr *opt = tca[TCA_OPTIONS-1];
+	struct rtattr *tb[TCA_IPHASH_MAX];
+	int key = TCA_IPHASH_KEY_DST;
+	int err;
+
+	if (!opt)
+		return handle ? -EINVAL : 0;
+
+	if (rtattr_parse(tb, TCA_IPHASH_MAX, RTA_DATA(opt), RTA_PAYLOAD(opt)) < 0)
+		return -EINVAL;
+
+	if (tb[TCA_IPHASH_KEY-1]) {
+		if (RTA_PAYLOAD(tb[TCA_IPHASH_KEY-1]) != 4)
+			return -EINVAL;
+		key = *(u32*)RTA_DATA(tb[TCA_IPHASH_KEY-1]);
+		if (key != TCA_IPHASH_KEY_DST && key != TCA_IPHASH_KEY_SRC)
+			return -EINVAL;
+		/* all filters of one instance hash the same field */
+		if (head && head->count && head->key != key)
+			return -EINVAL;
+	}
+
+	if ((f = (struct iphash_filter*)*arg) != NULL) {
+		/* Node exists: adjust only classid */
+
+		if (f->addr != handle && handle)
+			return -EINVAL;
+		if (tb[TCA_IPHASH_CLASSID-1]) {
+			unsigned long cl;
+
+			f->res.classid = *(u32*)RTA_DATA(tb[TCA_IPHASH_CLASSID-1]);
+			cl = tp->q->ops->cl_ops->bind_tcf(tp->q, base, f->res.classid);
+			cl = cls_set_class(tp, &f->res.class, cl);
+			if (cl)
+				tp->q->ops->cl_ops->unbind_tcf(tp->q, cl);
+		}
+#ifdef CONFIG_NET_CLS_POLICE
+		if (tb[TCA_IPHASH_POLICE-1]) {
+			struct tcf_police *police = tcf_police_locate(tb[TCA_IPHASH_POLICE-1], tca[TCA_RATE-1]);
+
+			tcf_tree_lock(tp);
+			police = xchg(&f->police, police);
+			tcf_tree_unlock(tp);
+
+			tcf_police_release(police);
+		}
+#endif
+		return 0;
+	}
+
+	if (!handle)
+		return -EINVAL;
+
+	if (head == NULL) {
+		head = kmalloc(sizeof(struct iphash_head), GFP_KERNEL);
+		if (head == NULL)
+			return -ENOBUFS;
+		memset(head, 0, sizeof(*head));
+		if ((head->ht = iphash_alloc_table(IPHASH_MIN)) == NULL) {
+			kfree(head);
+			return -ENOBUFS;
+		}
+		head->mask = IPHASH_MIN - 1;
+		head->key = key;
+
+		tcf_tree_lock(tp);
+		tp->root = head;
+		tcf_tree_unlock(tp);
+	} else if (!head->count)
+		head->key = key;
+
+	f = kmalloc(sizeof(struct iphash_filter), GFP_KERNEL);
+	if (f == NULL)
+		return -ENOBUFS;
+	memset(f, 0, sizeof(*f));
+
+	f->addr = handle;
+
+	if (tb[TCA_IPHASH_CLASSID-1]) {
+		err = -EINVAL;
+		if (RTA_PAYLOAD(tb[TCA_IPHASH_CLASSID-1]) != 4)
+			goto errout;
+		f->res.classid = *(u32*)RTA_DATA(tb[TCA_IPHASH_CLASSID-1]);
+		cls_set_class(tp, &f->res.class, tp->q->ops->cl_ops->bind_tcf(tp->q, base, f->res.classid));
+	}
+
+#ifdef CONFIG_NET_CLS_POLICE
+	if (tb[TCA_IPHASH_POLICE-1])
+		f->police = tcf_police_locate(tb[TCA_IPHASH_POLICE-1], tca[TCA_RATE-1]);
+#endif
+
+	iphash_grow(tp, head);
+
+	f->next = head->ht[iphash_hash(head, handle)];
+	tcf_tree_lock(tp);
+	head->ht[iphash_hash(head, handle)] = f;
+	head->count++;
+	tcf_tree_unlock(tp);
+
+	*arg = (unsigned long)f;
+	return 0;
+
+errout:
+	if (f)
+		kfree(f);
+	return err;
+}
+
+static void iphash_walk(struct tcf_proto *tp, struct tcf_walker *arg)
+{
+	struct iphash_head *head = (struct iphash_head*)tp->root;
+	u32 h;
+
+	if (head == NULL)
+		arg->stop = 1;
+
+	if (arg->stop)
+		return;
+
+	for (h = 0; h <= head->mask; h++) {
+		struct iphash_filter *f;
+
+		for (f = head->ht[h]; f; f = f->next) {
+			if (arg->count < arg->skip) {
+				arg->count++;
+				continue;
+			}
+			if (arg->fn(tp, (unsigned long)f, arg) < 0) {
+				arg->stop = 1;
+				return;
+			}
+			arg->count++;
+		}
+	}
+}
+
+static int iphash_dump(struct tcf_proto *tp, unsigned long fh,
+		       struct sk_buff *skb, struct tcmsg *t)
+{
+	struct iphash_head *head = (struct iphash_head*)tp->root;
+	struct iphash_filter *f = (struct iphash_filter*)fh;
+	unsigned char	 *b = skb->tail;
+	struct rtattr *rta;
+	u32 key;
+
+	if (f == NULL)
+		return skb->len;
+
+	t->tcm_handle = f->addr;
+
+	rta = (struct rtattr*)b;
+	RTA_PUT(skb, TCA_OPTIONS, 0, NULL);
+
+	key = head->key;
+	RTA_PUT(skb, TCA_IPHASH_KEY, 4, &key);
+	if (f->res.classid)
+		RTA_PUT(skb, TCA_IPHASH_CLASSID, 4, &f->res.classid);
+#ifdef CONFIG_NET_CLS_POLICE
+	if (f->police) {
+		struct rtattr * p_rta = (struct rtattr*)skb->tail;
+
+		RTA_PUT(skb, TCA_IPHASH_POLICE, 0, NULL);
+
+		if (tcf_police_dump(skb, f->police) < 0)
+			goto rtattr_failure;
+
+		p_rta->rta_len = skb->tail - (u8*)p_rta;
+	}
+#endif
+
+	rta->rta_len = skb->tail - b;
+#ifdef CONFIG_NET_CLS_POLICE
+	if (f->police) {
+		if (qdisc_copy_stats(skb, &f->police->stats))
+			goto rtattr_failure;
+	}
+#endif
+	return skb->len;
+
+rtattr_failure:
+	skb_trim(skb, b - skb->data);
+	return -1;
+}
+
+struct tcf_proto_ops cls_iphash_ops = {
+	NULL,
+	"iphash",
+	iphash_classify,
+	iphash_init,
+	iphash_destroy,
+
+	iphash_get,
+	iphash_put,
+	iphash_change,
+	iphash_delete,
+	iphash_walk,
+	iphash_dump
+};
+
+#ifdef MODULE
+int init_module(void)
+{
+	return register_tcf_proto_ops(&cls_iphash_ops);
+}
+
+void cleanup_module(void)
+{
+	unregister_tcf_proto_ops(&cls_iphash_ops);
+}
+#endif
+MODULE_LICENSE("GPL");
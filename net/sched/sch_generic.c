@@ -63,6 +63,74 @@ rwlock_t qdisc_tree_lock = RW_LOCK_UNLOCKED;
  */
 
 
+/* Results of qdisc_xmit() */
+#define XMIT_OK		0	/* the driver took it */
+#define XMIT_BUSY	1	/* driver locked by someone else */
+#define XMIT_REFUSED	2	/* the driver (or stopped queue) said no */
+#define XMIT_RING_FULL	3	/* its ring is stopped */
+#define XMIT_DEADLOOP	(-1)	/* hard_start_xmit() recursed */
+
+/* Hand one packet to the driver, under dev->xmit_lock or that of the
+   ring picked for it.  Unless the driver took it, the packet is still
+   ours.
+
+   NOTE: Called under dev->queue_lock with locally disabled BH; the
+   lock is dropped while the driver runs, and held again on return.
+ */
+
+static int qdisc_xmit(struct net_device *dev, struct sk_buff *skb)
+{
+	spinlock_t *lock = &dev->xmit_lock;
+	int *owner = &dev->xmit_lock_owner;
+	int ring = 0, ret = XMIT_REFUSED;
+
+	if (dev->tx_rings) {
+		ring = netif_select_tx_ring(dev, skb);
+		lock = &dev->tx_ring[ring].xmit_lock;
+		owner = &dev->tx_ring[ring].xmit_lock_owner;
+	}
+
+	if (!spin_trylock(lock)) {
+		/* So, someone grabbed the driver. */
+
+		/* It may be transient configuration error,
+		   when hard_start_xmit() recurses. We detect
+		   it by checking xmit owner and drop the
+		   packet when deadloop is detected.
+		 */
+		if (*owner == smp_processor_id())
+			return XMIT_DEADLOOP;
+		netdev_rx_stat[smp_processor_id()].cpu_collision++;
+		return XMIT_BUSY;
+	}
+
+	/* Remember that the driver is grabbed by us. */
+	*owner = smp_processor_id();
+
+	/* And release queue */
+	spin_unlock(&dev->queue_lock);
+
+	if (!netif_queue_stopped(dev)) {
+		if (dev->tx_rings && netif_tx_ring_stopped(dev, ring))
+			ret = XMIT_RING_FULL;
+		else {
+			if (netdev_nit)
+				dev_queue_xmit_nit(skb, dev);
+
+			if ((dev->tx_rings ?
+			     dev->hard_start_xmit_ring(skb, dev, ring) :
+			     dev->hard_start_xmit(skb, dev)) == 0)
+				ret = XMIT_OK;
+		}
+	}
+
+	/* Release the driver */
+	*owner = -1;
+	spin_unlock(lock);
+	spin_lock(&dev->queue_lock);
+	return ret;
+}
+
 /* Kick device.
    Note, that this procedure can be called by a watchdog timer, so that
    we do not check dev->tbusy flag here.
@@ -81,46 +149,25 @@ int qdisc_restart(struct net_device *dev)
 
 	/* Dequeue packet */
 	if ((skb = q->dequeue(q)) != NULL) {
-		if (spin_trylock(&dev->xmit_lock)) {
-			/* Remember that the driver is grabbed by us. */
-			dev->xmit_lock_owner = smp_processor_id();
-
-			/* And release queue */
-			spin_unlock(&dev->queue_lock);
-
-			if (!netif_queue_stopped(dev)) {
-				if (netdev_nit)
-					dev_queue_xmit_nit(skb, dev);
-
-				if (dev->hard_start_xmit(skb, dev) == 0) {
-					dev->xmit_lock_owner = -1;
-					spin_unlock(&dev->xmit_lock);
-
-					spin_lock(&dev->queue_lock);
-					return -1;
-				}
-			}
+		switch (qdisc_xmit(dev, skb)) {
+		case XMIT_OK:
+			return -1;
+
+		case XMIT_DEADLOOP:
+			kfree_skb(skb);
+			if (net_ratelimit())
+				printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
+			return -1;
+
+		case XMIT_RING_FULL:
+			/* netif_wake_tx_ring() reschedules us */
+			q = dev->qdisc;
+			q->ops->requeue(skb, q);
+			return 1;
 
-			/* Release the driver */
-			dev->xmit_lock_owner = -1;
-			spin_unlock(&dev->xmit_lock);
-			spin_lock(&dev->queue_lock);
+		case XMIT_REFUSED:
 			q = dev->qdisc;
-		} else {
-			/* So, someone grabbed the driver. */
-
-			/* It may be transient configuration error,
-			   when hard_start_xmit() recurses. We detect
-			   it by checking xmit owner and drop the
-			   packet when deadloop is detected.
-			 */
-			if (dev->xmit_lock_owner == smp_processor_id()) {
-				kfree_skb(skb);
-				if (net_ratelimit())
-					printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
-				return -1;
-			}
-			netdev_rx_stat[smp_processor_id()].cpu_collision++;
+			break;
 		}
 
 		/* Device kicked us out :(
@@ -140,16 +187,80 @@ int qdisc_restart(struct net_device *dev)
 	return q->q.qlen;
 }
 
+/* Send skb past an empty queue, straight to the driver: saves the
+   enqueue and dequeue, and the extra trip through dev->queue_lock
+   that qdisc_run() makes for every packet.  Returns 0, and leaves skb
+   alone, if it has to be queued the usual way after all.
+
+   NOTE: Called under dev->queue_lock with locally disabled BH.
+ */
+
+int qdisc_bypass(struct net_device *dev, struct sk_buff *skb)
+{
+	struct Qdisc *q = dev->qdisc;
+	int ret;
+
+	if (!(q->flags & TCQ_F_CAN_BYPASS) || q->q.qlen ||
+	    netif_queue_stopped(dev))
+		return 0;
+
+	ret = qdisc_xmit(dev, skb);
+	if (ret == XMIT_OK)
+		return 1;
+	if (ret == XMIT_BUSY || ret == XMIT_DEADLOOP)
+		return 0;
+
+	/* The queue lock was dropped meanwhile: put the packet ahead
+	   of anything queued since, which came after it. */
+	q = dev->qdisc;
+	q->ops->requeue(skb, q);
+	if (ret != XMIT_RING_FULL)
+		netif_schedule(dev);
+	return 1;
+}
+
+/* Lock out all transmitters of dev; BH must be disabled. */
+static void dev_xmit_lock_all(struct net_device *dev)
+{
+	int i;
+
+	spin_lock(&dev->xmit_lock);
+	for (i = 0; i < dev->tx_rings; i++)
+		spin_lock(&dev->tx_ring[i].xmit_lock);
+}
+
+static void dev_xmit_unlock_all(struct net_device *dev)
+{
+	int i;
+
+	for (i = dev->tx_rings; i-- > 0; )
+		spin_unlock(&dev->tx_ring[i].xmit_lock);
+	spin_unlock(&dev->xmit_lock);
+}
+
+/* Has any transmit ring (or the whole queue) been stopped? */
+static int dev_xmit_stopped(struct net_device *dev)
+{
+	int i;
+
+	if (netif_queue_stopped(dev))
+		return 1;
+	for (i = 0; i < dev->tx_rings; i++)
+		if (netif_tx_ring_stopped(dev, i))
+			return 1;
+	return 0;
+}
+
 static void dev_watchdog(unsigned long arg)
 {
 	struct net_device *dev = (struct net_device *)arg;
 
-	spin_lock(&dev->xmit_lock);
+	dev_xmit_lock_all(dev);
 	if (dev->qdisc != &noop_qdisc) {
 		if (netif_device_present(dev) &&
 		    netif_running(dev) &&
 		    netif_carrier_ok(dev)) {
-			if (netif_queue_stopped(dev) &&
+			if (dev_xmit_stopped(dev) &&
 			    (jiffies - dev->trans_start) > dev->watchdog_timeo) {
 				printk(KERN_INFO "NETDEV WATCHDOG: %s: transmit timed out\n", dev->name);
 				dev->tx_timeout(dev);
@@ -158,7 +269,7 @@ static void dev_watchdog(unsigned long arg)
 				dev_hold(dev);
 		}
 	}
-	spin_unlock(&dev->xmit_lock);
+	dev_xmit_unlock_all(dev);
 
 	dev_put(dev);
 }
@@ -341,6 +452,8 @@ static int pfifo_fast_init(struct Qdisc *qdisc, struct rtattr *opt)
 	for (i=0; i<3; i++)
 		skb_queue_head_init(list+i);
 
+	/* Nothing to reorder when all bands are empty */
+	qdisc->flags |= TCQ_F_CAN_BYPASS;
 	return 0;
 }
 
@@ -464,6 +577,7 @@ void dev_activate(struct net_device *dev)
 void dev_deactivate(struct net_device *dev)
 {
 	struct Qdisc *qdisc;
+	int i;
 
 	spin_lock_bh(&dev->queue_lock);
 	qdisc = dev->qdisc;
@@ -479,6 +593,8 @@ void dev_deactivate(struct net_device *dev)
 		yield();
 
 	spin_unlock_wait(&dev->xmit_lock);
+	for (i = 0; i < dev->tx_rings; i++)
+		spin_unlock_wait(&dev->tx_ring[i].xmit_lock);
 }
 
 void dev_init_scheduler(struct net_device *dev)
@@ -64,7 +64,9 @@
     one less than their parent.
 */
 
-#define HTB_HSIZE 16	/* classid hash size */
+#define HTB_HSIZE 16	/* rate computer hash size */
+#define HTB_CLHASH_MIN 16	/* initial classid lookup hash size */
+#define HTB_CLHASH_MAX 8192	/* classid lookup hash won't grow past it */
 #define HTB_EWMAC 2	/* rate average over HTB_EWMAC*HTB_HSIZE sec */
 #define HTB_DEBUG 1	/* compile debugging support (activated by tc tool) */
 #define HTB_RATECM 1    /* whether to use rate computer */
@@ -150,7 +152,8 @@ struct htb_class
     /* topology */
     int level;			/* our level (see above) */
     struct htb_class *parent;	/* parent class */
-    struct list_head hlist;	/* classid hash list item */
+    struct list_head hlist;	/* rate computer hash list item */
+    struct list_head clist;	/* classid lookup hash list item */
     struct list_head sibling;	/* sibling list item */
     struct list_head children;	/* children list */
 
@@ -206,6 +209,9 @@ struct htb_sched
 {
     struct list_head root;			/* root classes list */
     struct list_head hash[HTB_HSIZE];		/* hashed by classid */
+    struct list_head *clhash;			/* classid lookup hash */
+    unsigned clhash_mask;			/* its size - 1 */
+    int nclasses;				/* classes in clhash */
     struct list_head drops[TC_HTB_NUMPRIO];	/* active leaves (for drops) */
     
     /* self list - roots of self generating tree */
@@ -255,6 +261,19 @@ static __inline__ int htb_hash(u32 h)
     return h & 0xf;
 }
 
+/* The fixed HTB_HSIZE hash above only drives the rate computer, which
+   wants to visit 1/HTB_HSIZE of classes per second. Lookups by classid
+   use clhash instead; it doubles whenever it holds more than two classes
+   per bucket, so htb_find stays O(1) with tens of thousands of classes.
+   All classes share the major number so only the minor one is hashed;
+   tc users tend to number minors sequentially, which the mask spreads
+   nicely. */
+static __inline__ unsigned htb_clhash(struct htb_sched *q,u32 h)
+{
+    h = TC_H_MIN(h);
+    return (h ^ (h >> 13)) & q->clhash_mask;
+}
+
 /* find class in global hash table using given handle */
 static __inline__ struct htb_class *htb_find(u32 handle, struct Qdisc *sch)
 {
@@ -263,14 +282,45 @@ static __inline__ struct htb_class *htb_find(u32 handle, struct Qdisc *sch)
 	if (TC_H_MAJ(handle) != sch->handle) 
 		return NULL;
 	
-	list_for_each (p,q->hash+htb_hash(handle)) {
-		struct htb_class *cl = list_entry(p,struct htb_class,hlist);
+	list_for_each (p,q->clhash+htb_clhash(q,handle)) {
+		struct htb_class *cl = list_entry(p,struct htb_class,clist);
 		if (cl->classid == handle)
 			return cl;
 	}
 	return NULL;
 }
 
+/* double clhash; called from process context without locks, tables are
+   swapped under the tree lock. Failure to grow is not fatal, chains just
+   get longer. */
+static void htb_clhash_grow(struct Qdisc *sch)
+{
+	struct htb_sched *q = (struct htb_sched *)sch->data;
+	struct list_head *nhash,*ohash;
+	unsigned i,osize = q->clhash_mask + 1;
+
+	if (osize >= HTB_CLHASH_MAX)
+		return;
+	if ((nhash = kmalloc(2*osize*sizeof(*nhash), GFP_KERNEL)) == NULL)
+		return;
+	for (i = 0; i < 2*osize; i++)
+		INIT_LIST_HEAD(nhash+i);
+
+	sch_tree_lock(sch);
+	ohash = q->clhash;
+	q->clhash = nhash;
+	q->clhash_mask = 2*osize - 1;
+	for (i = 0; i < osize; i++) 
+		while (!list_empty(ohash+i)) {
+			struct htb_class *cl = list_entry(ohash[i].next,
+					struct htb_class,clist);
+			list_del(&cl->clist);
+			list_add_tail(&cl->clist,nhash+htb_clhash(q,cl->classid));
+		}
+	sch_tree_unlock(sch);
+	kfree(ohash);
+}
+
 /**
  * htb_classify - classify a packet into class
  *
@@ -897,9 +947,10 @@ static long htb_do_events(struct htb_sched *q,int level)
 		if (cl->cmode != HTB_CAN_SEND)
 			htb_add_to_wait_tree (q,cl,diff,2);
 	}
-	if (net_ratelimit())
-		printk(KERN_WARNING "htb: too many events !\n");
-	return HZ/10;
+	/* with many classes a burst of events is normal; bound the work
+	   done here but come back at the next tick instead of stalling
+	   the level for HZ/10 */
+	return 1;
 }
 
 /**
@@ -1166,6 +1217,13 @@ static int htb_init(struct Qdisc *sch, struct rtattr *opt)
 	q->debug = gopt->debug;
 	HTB_DBG(0,1,"htb_init sch=%p handle=%X r2q=%d\n",sch,sch->handle,gopt->rate2quantum);
 
+	q->clhash = kmalloc(HTB_CLHASH_MIN*sizeof(*q->clhash), GFP_KERNEL);
+	if (!q->clhash)
+		return -ENOBUFS;
+	q->clhash_mask = HTB_CLHASH_MIN - 1;
+	for (i = 0; i < HTB_CLHASH_MIN; i++)
+		INIT_LIST_HEAD(q->clhash+i);
+
 	INIT_LIST_HEAD(&q->root);
 	for (i = 0; i < HTB_HSIZE; i++)
 		INIT_LIST_HEAD(q->hash+i);
@@ -1350,6 +1408,7 @@ static void htb_destroy_class(struct Qdisc* sch,struct htb_class *cl)
 
 	/* note: this delete may happen twice (see htb_delete) */
 	list_del(&cl->hlist);
+	list_del(&cl->clist);
 	list_del(&cl->sibling);
 	
 	if (cl->prio_activity)
@@ -1377,6 +1436,7 @@ static void htb_destroy(struct Qdisc* sch)
 
 	htb_destroy_filters(&q->filter_list);
 	__skb_queue_purge(&q->direct_queue);
+	kfree(q->clhash);
 	MOD_DEC_USE_COUNT;
 }
 
@@ -1396,6 +1456,8 @@ static int htb_delete(struct Qdisc *sch, unsigned long arg)
 	
 	/* delete from hash and active; remainder in destroy_class */
 	list_del_init(&cl->hlist);
+	list_del_init(&cl->clist);
+	q->nclasses--;
 	if (cl->prio_activity)
 		htb_deactivate (q,cl);
 
@@ -1456,11 +1518,14 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 		err = -ENOBUFS;
 		if ((cl = kmalloc(sizeof(*cl), GFP_KERNEL)) == NULL)
 			goto failure;
+		if (q->nclasses >= 2*(q->clhash_mask+1))
+			htb_clhash_grow(sch);
 		
 		memset(cl, 0, sizeof(*cl));
 		cl->refcnt = 1;
 		INIT_LIST_HEAD(&cl->sibling);
 		INIT_LIST_HEAD(&cl->hlist);
+		INIT_LIST_HEAD(&cl->clist);
 		INIT_LIST_HEAD(&cl->children);
 		INIT_LIST_HEAD(&cl->un.leaf.drop_list);
 #ifdef HTB_DEBUG
@@ -1499,6 +1564,8 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 
 		/* attach to the hash list and parent's family */
 		list_add_tail(&cl->hlist, q->hash+htb_hash(classid));
+		list_add_tail(&cl->clist, q->clhash+htb_clhash(q,classid));
+		q->nclasses++;
 		list_add_tail(&cl->sibling, parent ? &parent->children : &q->root);
 #ifdef HTB_DEBUG
 		{ 